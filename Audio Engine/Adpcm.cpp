@@ -0,0 +1,124 @@
+#include "Adpcm.h"
+#include "MixKernels.h"
+#include "Sample.h"
+#include "ConsoleColor.h"
+#include <iostream>
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+const int32_t kAdpcmSteps[kAdpcmStepCount] =
+{
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+	19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+	130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+	337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+	876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+	2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+	5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+// Picks the code that gets the predictor closest to 'target' from where it is, and moves the state on
+static unsigned EncodeAdpcmCode(int& predictor, int& index, int target)
+{
+	int step = kAdpcmSteps[index];
+	int difference = target - predictor;
+	unsigned code = 0;
+	if (difference < 0)
+	{
+		code = 8;
+		difference = -difference;
+	}
+	if (difference >= step)
+	{
+		code |= 4;
+		difference -= step;
+	}
+	if (difference >= step >> 1)
+	{
+		code |= 2;
+		difference -= step >> 1;
+	}
+	if (difference >= step >> 2)
+	{
+		code |= 1;
+	}
+	DecodeAdpcmCode(predictor, index, code);
+	return code;
+}
+
+static int ToPcm(float value)
+{
+	float scaled = floorf(value * 32768.0f + 0.5f);
+	return scaled > 32767.0f ? 32767 : (scaled < -32768.0f ? -32768 : (int)scaled);
+}
+
+bool CompressSample(Sample& sample)
+{
+	if (sample.format != SampleFormat::Float32 || sample.storage.empty() || sample.channels == 0)
+	{
+		std::cout << red << "ERROR: Can only compress samples loaded as float" << white << std::endl;
+		return false;
+	}
+
+	const unsigned channels = sample.channels;
+	const unsigned blocks = (sample.frameCount + kAdpcmUnitFrames - 1) / kAdpcmUnitFrames;
+	std::vector<uint8_t> units(GetAdpcmSize(sample.frameCount, channels), 0);
+	const float* frames = sample.storage.data();
+
+	for (unsigned channel = 0; channel < channels; channel++)
+	{
+		// Carried on from one unit to the next, so the headers only say where the encoder already was
+		int predictor = ToPcm(frames[channel]);
+		int index = 0;
+		int target = predictor;
+		for (unsigned block = 0; block < blocks; block++)
+		{
+			uint8_t* unit = units.data() + ((size_t)block * channels + channel) * kAdpcmUnitBytes;
+			unit[0] = (uint8_t)(predictor & 0xFF);
+			unit[1] = (uint8_t)((predictor >> 8) & 0xFF);
+			unit[2] = (uint8_t)index;
+
+			for (unsigned k = 0; k < kAdpcmUnitFrames; k++)
+			{
+				// The last unit's padded out by holding the last frame, which never gets played anyway
+				unsigned frame = block * kAdpcmUnitFrames + k;
+				if (frame < sample.frameCount)
+				{
+					target = ToPcm(frames[(size_t)frame * channels + channel]);
+				}
+				unsigned code = EncodeAdpcmCode(predictor, index, target);
+				unit[4 + k / 2] |= (uint8_t)(code << ((k & 1) * 4));
+			}
+		}
+	}
+
+	std::vector<float>().swap(sample.storage);
+	sample.compressed.swap(units);
+	sample.frames = sample.compressed.data();
+	sample.format = SampleFormat::ImaAdpcm;
+	return true;
+}
+
+void DecodeAdpcmFrames(const MixKernels& kernels, const Sample& sample, unsigned firstFrame, unsigned frameCount,
+	float* out, float* scratch)
+{
+	if (frameCount == 0)
+	{
+		return;
+	}
+
+	// A region of a bigger sample can start part way into a unit
+	firstFrame += sample.frameOffset;
+	const unsigned channels = sample.channels;
+	const unsigned firstBlock = firstFrame / kAdpcmUnitFrames;
+	const unsigned lastBlock = (firstFrame + frameCount - 1) / kAdpcmUnitFrames;
+	const uint8_t* units = (const uint8_t*)sample.frames + (size_t)firstBlock * channels * kAdpcmUnitBytes;
+	kernels.decodeAdpcm(scratch, units, (lastBlock - firstBlock + 1) * channels, channels);
+
+	// Only the frames that were asked for, from part way into the first unit
+	const float* first = scratch + (size_t)(firstFrame - firstBlock * kAdpcmUnitFrames) * channels;
+	memcpy(out, first, (size_t)frameCount * channels * sizeof(float));
+}
@@ -0,0 +1,62 @@
+// Adpcm.h
+// IMA ADPCM: 4 bits a sample instead of 16 (or 32 as float), so a lot more sounds fit in memory at once.
+// Each sample is stored as a step up or down from the one before, in units of a step size that grows while
+// the signal's moving fast and shrinks when it isn't, so quiet detail survives as well as loud.
+//
+// The layout is our own rather than a .wav's. Every channel is cut into units of kAdpcmUnitFrames frames, and
+// each unit starts with the decoder's state, so it can be decoded without the ones before it. That's what lets
+// the mixer decode just the frames a voice needs each block, straight from wherever it is (looping, pitched,
+// scheduled, whatever), with nothing kept per voice. Units go 64 frames at a time, one per channel:
+// [frames 0-63 left][frames 0-63 right][frames 64-127 left]...
+//
+// A unit is 36 bytes: the predictor (int16, little-endian) and step index (one byte) the decoder starts from,
+// a spare byte, then 64 4-bit codes two to a byte, low half first. That's 0.5625 bytes a sample, a little
+// over a quarter of 16-bit and a seventh of float.
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+struct Sample;
+struct MixKernels;
+
+static const unsigned kAdpcmUnitFrames = 64;
+static const unsigned kAdpcmUnitBytes = 4 + kAdpcmUnitFrames / 2;
+static const unsigned kAdpcmStepCount = 89;
+
+// The step sizes the index moves along, each about 10% bigger than the last
+extern const int32_t kAdpcmSteps[kAdpcmStepCount];
+
+// Decodes one 4-bit code, moving the predictor and step index on. The encoder runs exactly this too,
+// so it always knows what the decoder is going to come out with
+inline int DecodeAdpcmCode(int& predictor, int& index, unsigned code)
+{
+	// Masks rather than ifs: the codes are as good as random, so branches on them mostly guess wrong
+	const int step = kAdpcmSteps[index];
+	int difference = (step >> 3) + (step & -(int)((code >> 2) & 1)) + ((step >> 1) & -(int)((code >> 1) & 1)) +
+		((step >> 2) & -(int)(code & 1));
+	const int negative = -(int)((code >> 3) & 1);
+	predictor += (difference ^ negative) - negative;
+	predictor = predictor > 32767 ? 32767 : (predictor < -32768 ? -32768 : predictor);
+
+	// Big codes mean it's moving faster than the step, small ones that it's moving slower
+	static const int kIndexChanges[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+	index += kIndexChanges[code & 7];
+	index = index > (int)kAdpcmStepCount - 1 ? (int)kAdpcmStepCount - 1 : (index < 0 ? 0 : index);
+	return predictor;
+}
+
+// How many bytes frameCount frames of audio take up compressed
+inline size_t GetAdpcmSize(unsigned frameCount, unsigned channels)
+{
+	return (size_t)(frameCount + kAdpcmUnitFrames - 1) / kAdpcmUnitFrames * channels * kAdpcmUnitBytes;
+}
+
+// Compresses a sample that owns float frames, once, in place. Lossy, but only just: about 4 bits' worth of
+// noise that follows the signal's level around, which is hard to hear under anything but very pure tones
+bool CompressSample(Sample& sample);
+
+// Decodes frameCount frames from firstFrame on into 'out' as interleaved float. Works in whole units, so
+// 'scratch' needs room for frameCount + 2 * kAdpcmUnitFrames frames
+void DecodeAdpcmFrames(const MixKernels& kernels, const Sample& sample, unsigned firstFrame, unsigned frameCount,
+	float* out, float* scratch);
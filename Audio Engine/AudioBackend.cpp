@@ -0,0 +1,70 @@
+#include "AudioBackend.h"
+#include "Mixer.h"
+#include <chrono>
+
+ThreadedBackend::ThreadedBackend(bool paced) : realTimePaced(paced), mixer(nullptr), running(false), framesConsumed(0)
+{
+}
+
+ThreadedBackend::~ThreadedBackend()
+{
+	// Derived classes should have stopped already (their Consume() is gone by now), but just in case
+	Stop();
+}
+
+bool ThreadedBackend::Start(Mixer* mixerToPull)
+{
+	Stop();
+
+	mixer = mixerToPull;
+	block.resize((size_t)mixer->GetBlockFrames() * Mixer::kChannels);
+
+	if (!OnStart(mixer->GetSampleRate(), Mixer::kChannels))
+	{
+		return false;
+	}
+
+	running = true;
+	thread = std::thread(&ThreadedBackend::ThreadMain, this);
+	return true;
+}
+
+void ThreadedBackend::Stop()
+{
+	if (thread.joinable())
+	{
+		running = false;
+		thread.join();
+		OnStop();
+	}
+}
+
+unsigned ThreadedBackend::GetLatencyFrames() const
+{
+	// We only ever hold one block
+	return mixer ? mixer->GetBlockFrames() : 0;
+}
+
+void ThreadedBackend::ThreadMain()
+{
+	const unsigned frames = mixer->GetBlockFrames();
+	const auto blockDuration = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<double>((double)frames / mixer->GetSampleRate()));
+
+	auto deadline = std::chrono::steady_clock::now();
+
+	while (running.load(std::memory_order_relaxed))
+	{
+		mixer->Render(block.data(), frames);
+		Consume(block.data(), frames);
+		framesConsumed.fetch_add(frames, std::memory_order_relaxed);
+
+		if (realTimePaced)
+		{
+			// Sleep until this block would have finished playing. Using absolute deadlines
+			// means small oversleeps don't add up into drift
+			deadline += blockDuration;
+			std::this_thread::sleep_until(deadline);
+		}
+	}
+}
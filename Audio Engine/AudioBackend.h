@@ -0,0 +1,62 @@
+// AudioBackend.h
+// A backend is whatever consumes the mixer's output: a sound card, a file, or nothing at all.
+// Backends own the timing - they decide when to call Mixer::Render() and what to do with the result -
+// so the mixer itself never has to know which platform it's running on.
+
+#pragma once
+#include <atomic>
+#include <thread>
+#include <vector>
+
+class Mixer;
+
+class AudioBackend
+{
+public:
+	virtual ~AudioBackend() {}
+
+	// Start pulling audio from the mixer. The mixer has to outlive the backend (or at least Stop())
+	virtual bool Start(Mixer* mixer) = 0;
+	virtual void Stop() = 0;
+
+	// For log messages
+	virtual const char* GetName() const = 0;
+
+	// Roughly how many frames ahead of the listener the mixer is running
+	virtual unsigned GetLatencyFrames() const = 0;
+};
+
+// Shared plumbing for backends that run their own thread and push one block at a time somewhere.
+// If realTimePaced is set the thread sleeps so blocks come out at the speed they'd play at,
+// otherwise it renders as fast as the CPU allows (handy for benchmarks and offline renders).
+class ThreadedBackend : public AudioBackend
+{
+public:
+	ThreadedBackend(bool realTimePaced);
+	virtual ~ThreadedBackend();
+
+	virtual bool Start(Mixer* mixer) override;
+	virtual void Stop() override;
+	virtual unsigned GetLatencyFrames() const override;
+
+	// How many frames have gone through so far
+	unsigned long long GetFramesConsumed() const { return framesConsumed.load(std::memory_order_relaxed); }
+
+protected:
+	// Called on the backend thread before the first block and after the last one
+	virtual bool OnStart(unsigned /*sampleRate*/, unsigned /*channels*/) { return true; }
+	virtual void OnStop() {}
+
+	// Called on the backend thread with each freshly rendered block
+	virtual void Consume(const float* frames, unsigned frameCount) = 0;
+
+private:
+	void ThreadMain();
+
+	bool realTimePaced;
+	Mixer* mixer;
+	std::thread thread;
+	std::atomic<bool> running;
+	std::atomic<unsigned long long> framesConsumed;
+	std::vector<float> block;
+};
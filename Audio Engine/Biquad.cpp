@@ -0,0 +1,181 @@
+#include "Biquad.h"
+#include <algorithm>
+#include <math.h>
+
+static const double kPi = 3.14159265358979323846;
+
+BiquadCoefficients DesignBiquad(BiquadType type, float frequency, float q, float gainDb, unsigned sampleRate)
+{
+	BiquadCoefficients result;
+	if (type == BiquadType::Off || sampleRate == 0)
+	{
+		return result;
+	}
+
+	// Worked out in double, the float rounding matters for low frequencies at high sample rates
+	double f = std::max(10.0, std::min((double)frequency, sampleRate * 0.49));
+	double w0 = 2.0 * kPi * f / sampleRate;
+	double cosW0 = cos(w0);
+	double alpha = sin(w0) / (2.0 * std::max(0.05, (double)q));
+	double A = pow(10.0, gainDb / 40.0);
+
+	double b0, b1, b2, a0, a1, a2;
+	switch (type)
+	{
+	case BiquadType::Peaking:
+		b0 = 1.0 + alpha * A;
+		b1 = -2.0 * cosW0;
+		b2 = 1.0 - alpha * A;
+		a0 = 1.0 + alpha / A;
+		a1 = -2.0 * cosW0;
+		a2 = 1.0 - alpha / A;
+		break;
+
+	case BiquadType::LowPass:
+		b0 = (1.0 - cosW0) / 2.0;
+		b1 = 1.0 - cosW0;
+		b2 = (1.0 - cosW0) / 2.0;
+		a0 = 1.0 + alpha;
+		a1 = -2.0 * cosW0;
+		a2 = 1.0 - alpha;
+		break;
+
+	case BiquadType::HighPass:
+		b0 = (1.0 + cosW0) / 2.0;
+		b1 = -(1.0 + cosW0);
+		b2 = (1.0 + cosW0) / 2.0;
+		a0 = 1.0 + alpha;
+		a1 = -2.0 * cosW0;
+		a2 = 1.0 - alpha;
+		break;
+
+	case BiquadType::LowShelf:
+	{
+		double shelf = 2.0 * sqrt(A) * alpha;
+		b0 = A * ((A + 1.0) - (A - 1.0) * cosW0 + shelf);
+		b1 = 2.0 * A * ((A - 1.0) - (A + 1.0) * cosW0);
+		b2 = A * ((A + 1.0) - (A - 1.0) * cosW0 - shelf);
+		a0 = (A + 1.0) + (A - 1.0) * cosW0 + shelf;
+		a1 = -2.0 * ((A - 1.0) + (A + 1.0) * cosW0);
+		a2 = (A + 1.0) + (A - 1.0) * cosW0 - shelf;
+		break;
+	}
+
+	case BiquadType::HighShelf:
+	{
+		double shelf = 2.0 * sqrt(A) * alpha;
+		b0 = A * ((A + 1.0) + (A - 1.0) * cosW0 + shelf);
+		b1 = -2.0 * A * ((A - 1.0) + (A + 1.0) * cosW0);
+		b2 = A * ((A + 1.0) + (A - 1.0) * cosW0 - shelf);
+		a0 = (A + 1.0) - (A - 1.0) * cosW0 + shelf;
+		a1 = 2.0 * ((A - 1.0) - (A + 1.0) * cosW0);
+		a2 = (A + 1.0) - (A - 1.0) * cosW0 - shelf;
+		break;
+	}
+
+	case BiquadType::BandPass:
+		// 0dB at the centre
+		b0 = alpha;
+		b1 = 0.0;
+		b2 = -alpha;
+		a0 = 1.0 + alpha;
+		a1 = -2.0 * cosW0;
+		a2 = 1.0 - alpha;
+		break;
+
+	case BiquadType::Notch:
+		b0 = 1.0;
+		b1 = -2.0 * cosW0;
+		b2 = 1.0;
+		a0 = 1.0 + alpha;
+		a1 = -2.0 * cosW0;
+		a2 = 1.0 - alpha;
+		break;
+
+	default:
+		return result;
+	}
+
+	result.b0 = (float)(b0 / a0);
+	result.b1 = (float)(b1 / a0);
+	result.b2 = (float)(b2 / a0);
+	result.a1 = (float)(a1 / a0);
+	result.a2 = (float)(a2 / a0);
+	return result;
+}
+
+float SemitonesToQ(float semitones)
+{
+	double octaves = std::max(0.01, (double)semitones / 12.0);
+	double ratio = pow(2.0, octaves);
+	return (float)(sqrt(ratio) / (ratio - 1.0));
+}
+
+BiquadStage::BiquadStage()
+{
+	for (unsigned band = 0; band < kBands; band++)
+	{
+		SetBand(band, BiquadCoefficients());
+	}
+	Reset();
+}
+
+void BiquadStage::SetBand(unsigned band, const BiquadCoefficients& coefficients)
+{
+	for (unsigned lane = band * 2; lane < band * 2 + 2; lane++)
+	{
+		b0[lane] = coefficients.b0;
+		b1[lane] = coefficients.b1;
+		b2[lane] = coefficients.b2;
+		a1[lane] = coefficients.a1;
+		a2[lane] = coefficients.a2;
+	}
+}
+
+bool BiquadStage::IsPassThrough() const
+{
+	for (unsigned lane = 0; lane < kLanes; lane++)
+	{
+		if (b0[lane] != 1.0f || b1[lane] != 0.0f || b2[lane] != 0.0f || a1[lane] != 0.0f || a2[lane] != 0.0f)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void BiquadStage::Reset()
+{
+	for (unsigned lane = 0; lane < kLanes; lane++)
+	{
+		z1[lane] = 0.0f;
+		z2[lane] = 0.0f;
+	}
+}
+
+void BiquadStage::Step(float* frames, unsigned frameCount, unsigned step, float* outputs)
+{
+	// Last band first, so each band still sees what the band before it output last step
+	for (int band = kBands - 1; band >= 0; band--)
+	{
+		int frame = (int)step - band;
+		if (frame < 0 || frame >= (int)frameCount)
+		{
+			continue;
+		}
+
+		for (unsigned channel = 0; channel < 2; channel++)
+		{
+			unsigned lane = band * 2 + channel;
+			float x = band == 0 ? frames[frame * 2 + channel] : outputs[lane - 2];
+			float y = b0[lane] * x + z1[lane];
+			z1[lane] = b1[lane] * x - a1[lane] * y + z2[lane];
+			z2[lane] = b2[lane] * x - a2[lane] * y;
+			outputs[lane] = y;
+			if (band == kBands - 1)
+			{
+				frames[frame * 2 + channel] = y;
+			}
+		}
+	}
+}
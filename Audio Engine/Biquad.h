@@ -0,0 +1,70 @@
+// Biquad.h
+// Biquad filters, the building block for EQ: each one is a two-pole two-zero filter, and bands of an EQ
+// are just biquads one after another. The coefficients come from the RBJ "Audio EQ Cookbook".
+//
+// They're run four bands at a time on interleaved stereo by a BiquadStage, laid out so one frame of all
+// four bands (8 lanes: band 0 left, band 0 right, band 1 left...) fits in one AVX register. Each band needs
+// the one before it's output, so the SIMD versions skew them: while band 0 works on frame t, band 1 is on
+// frame t-1 and so on down the line, which keeps every lane busy. See MixKernels.h for the versions.
+
+#pragma once
+
+enum class BiquadType
+{
+	// Passes everything straight through
+	Off,
+	Peaking,
+	LowPass,
+	HighPass,
+	LowShelf,
+	HighShelf,
+	BandPass,
+	Notch,
+	Count
+};
+
+struct BiquadCoefficients
+{
+	// y = b0*x + b1*x1 + b2*x2 - a1*y1 - a2*y2, already divided through by a0
+	float b0 = 1.0f;
+	float b1 = 0.0f;
+	float b2 = 0.0f;
+	float a1 = 0.0f;
+	float a2 = 0.0f;
+};
+
+// frequency in Hz, q for the width (0.707 is a flat-topped low/high pass), gainDb only for peaking and shelves
+BiquadCoefficients DesignBiquad(BiquadType type, float frequency, float q, float gainDb, unsigned sampleRate);
+
+// DirectSound gives EQ widths in semitones, the cookbook wants Q
+float SemitonesToQ(float semitones);
+
+// Four bands of stereo biquads in a row, stored a lane at a time so SIMD can run them side by side
+struct alignas(32) BiquadStage
+{
+	static const unsigned kBands = 4;
+	static const unsigned kLanes = kBands * 2;
+
+	float b0[kLanes];
+	float b1[kLanes];
+	float b2[kLanes];
+	float a1[kLanes];
+	float a2[kLanes];
+
+	// Filter memory (transposed direct form II)
+	float z1[kLanes];
+	float z2[kLanes];
+
+	BiquadStage();
+
+	// Both channels of a band share coefficients
+	void SetBand(unsigned band, const BiquadCoefficients& coefficients);
+	// True if every band is Off, so the stage can be skipped
+	bool IsPassThrough() const;
+	void Reset();
+
+	// One step of the skewed pipeline the SIMD versions use, done a lane at a time. They use it for the
+	// first and last few steps of a block, where some bands have nothing to work on yet (or any more).
+	// 'outputs' holds each lane's output from the step before and gets this step's
+	void Step(float* frames, unsigned frameCount, unsigned step, float* outputs);
+};
@@ -0,0 +1,104 @@
+#include "ChorusEffect.h"
+#include <algorithm>
+#include <math.h>
+
+// Nothing should ring on for longer than this, however much feedback there is
+static const float kMaxTailSeconds = 10.0f;
+
+ModulatedDelayEffect::ModulatedDelayEffect(float maxDelay) :
+	Effect(ParameterCount),
+	maxDelayMs(maxDelay),
+	wet(0.0f),
+	dry(1.0f),
+	feedback(0.0f),
+	centreDelay(1.0f),
+	delaySwing(0.0f),
+	tailFrames(0)
+{
+}
+
+void ModulatedDelayEffect::OnPrepare()
+{
+	// Depth can swing it up to twice Delay
+	line.Allocate((unsigned)ceilf(2.0f * maxDelayMs * sampleRate / 1000.0f) + 1);
+}
+
+void ModulatedDelayEffect::Update()
+{
+	float mix = std::max(0.0f, std::min(100.0f, Get(WetDryMix))) / 100.0f;
+	wet = mix;
+	dry = 1.0f - mix;
+	feedback = std::max(-99.0f, std::min(99.0f, Get(Feedback))) / 100.0f;
+
+	float delayMs = std::max(0.0f, std::min(maxDelayMs, Get(Delay)));
+	float depth = std::max(0.0f, std::min(100.0f, Get(Depth))) / 100.0f;
+	centreDelay = delayMs * sampleRate / 1000.0f;
+	delaySwing = centreDelay * depth;
+
+	LfoShape shape = Get(Waveform) >= 0.5f ? LfoShape::Sine : LfoShape::Triangle;
+	float frequency = std::max(0.0f, std::min(10.0f, Get(Frequency)));
+	for (Lfo& channelLfo : lfo)
+	{
+		channelLfo.SetShape(shape);
+		channelLfo.SetFrequency(frequency, sampleRate);
+	}
+
+	// PHASE_ZERO is 2, each step either side a quarter of a cycle
+	float phaseOffset = (std::max(0.0f, std::min(4.0f, floorf(Get(Phase) + 0.5f))) - 2.0f) * 0.25f;
+	lfo[1].SetPhase(lfo[0].GetPhase() + phaseOffset);
+
+	tailFrames = GetFeedbackTailFrames(feedback, centreDelay + delaySwing + 1.0f, (unsigned)(kMaxTailSeconds * sampleRate));
+}
+
+void ModulatedDelayEffect::Process(float* frames, unsigned frameCount)
+{
+	const float maxDelay = (float)line.GetMaxDelay();
+	for (unsigned i = 0; i < frameCount; i++)
+	{
+		float delayed[2];
+		for (unsigned channel = 0; channel < 2; channel++)
+		{
+			float delay = centreDelay + delaySwing * lfo[channel].Next();
+			// Never closer than a frame, since this frame isn't in the line yet
+			delay = std::max(1.0f, std::min(maxDelay, delay));
+			delayed[channel] = line.Read(channel, delay);
+		}
+
+		float left = frames[i * 2];
+		float right = frames[i * 2 + 1];
+		line.Write(left + delayed[0] * feedback, right + delayed[1] * feedback);
+		frames[i * 2] = left * dry + delayed[0] * wet;
+		frames[i * 2 + 1] = right * dry + delayed[1] * wet;
+	}
+}
+
+void ModulatedDelayEffect::Reset()
+{
+	line.Clear();
+	float phaseOffset = lfo[1].GetPhase() - lfo[0].GetPhase();
+	lfo[0].SetPhase(0.0f);
+	lfo[1].SetPhase(phaseOffset);
+}
+
+ChorusEffect::ChorusEffect() : ModulatedDelayEffect(20.0f)
+{
+	// DirectSound's defaults
+	SetParameter(WetDryMix, 50.0f);
+	SetParameter(Depth, 10.0f);
+	SetParameter(Feedback, 25.0f);
+	SetParameter(Frequency, 1.1f);
+	SetParameter(Waveform, 1.0f);
+	SetParameter(Delay, 16.0f);
+	SetParameter(Phase, 3.0f);
+}
+
+FlangerEffect::FlangerEffect() : ModulatedDelayEffect(4.0f)
+{
+	SetParameter(WetDryMix, 50.0f);
+	SetParameter(Depth, 100.0f);
+	SetParameter(Feedback, -50.0f);
+	SetParameter(Frequency, 0.25f);
+	SetParameter(Waveform, 1.0f);
+	SetParameter(Delay, 2.0f);
+	SetParameter(Phase, 2.0f);
+}
@@ -0,0 +1,72 @@
+// ChorusEffect.h
+// Native versions of DirectSound's chorus and flanger, taking the same parameters as DSFXChorus and DSFXFlanger.
+//
+// They're the same effect at different sizes: the sound is mixed with a copy of itself delayed by an
+// amount an LFO sweeps up and down. A chorus uses a longer delay (up to 20ms), so the copy sounds like a
+// second, slightly out of tune voice; a flanger a much shorter one (up to 4ms) with a lot of feedback,
+// which sweeps a comb filter through the sound. Each channel has its own LFO, 'Phase' apart.
+
+#pragma once
+#include "EffectChain.h"
+#include "DelayLine.h"
+
+class ModulatedDelayEffect : public Effect
+{
+public:
+	enum Parameter
+	{
+		// How much of the output is the delayed copy, 0 to 100 percent
+		WetDryMix,
+		// How far the LFO moves the delay, 0 to 100 percent of Delay
+		Depth,
+		// How much of the delayed copy goes back into the delay, -99 to 99 percent
+		Feedback,
+		// LFO speed, 0 to 10 Hz
+		Frequency,
+		// DSFXCHORUS_WAVE_TRIANGLE (0) or DSFXCHORUS_WAVE_SIN (1)
+		Waveform,
+		// Milliseconds, 0 to 20 for a chorus and 0 to 4 for a flanger
+		Delay,
+		// The right LFO against the left: DSFXCHORUS_PHASE_NEG_180 (0) up to DSFXCHORUS_PHASE_180 (4), in 90 degree steps
+		Phase,
+		ParameterCount
+	};
+
+	virtual void Reset() override;
+	virtual unsigned GetTailFrames() const override { return tailFrames; }
+
+protected:
+	// maxDelayMs is the top of the Delay parameter's range
+	ModulatedDelayEffect(float maxDelayMs);
+
+	virtual void OnPrepare() override;
+	virtual void Process(float* frames, unsigned frameCount) override;
+	virtual void Update() override;
+
+private:
+	float maxDelayMs;
+	DelayLine line;
+	Lfo lfo[2];
+
+	// Worked out from the parameters, delays in frames
+	float wet;
+	float dry;
+	float feedback;
+	float centreDelay;
+	float delaySwing;
+	unsigned tailFrames;
+};
+
+class ChorusEffect : public ModulatedDelayEffect
+{
+public:
+	ChorusEffect();
+	virtual const char* GetName() const override { return "Chorus"; }
+};
+
+class FlangerEffect : public ModulatedDelayEffect
+{
+public:
+	FlangerEffect();
+	virtual const char* GetName() const override { return "Flanger"; }
+};
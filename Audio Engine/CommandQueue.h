@@ -0,0 +1,110 @@
+// CommandQueue.h
+// A fixed-size queue that any number of threads can push into and one thread (the audio thread)
+// pops from, with no locks anywhere.
+//
+// Every slot has a sequence number that says whose turn it is. A pusher claims the next free slot
+// by bumping the write position with a compare-exchange (only ever retried if another pusher got
+// there first), fills it in, then publishes it by moving the slot's sequence on. The popper just
+// checks the sequence of the next slot, so popping never waits or retries at all.
+// If the queue is full, Push() fails straight away rather than waiting for room.
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+
+template <typename T>
+class CommandQueue
+{
+public:
+	// capacity is rounded up to a power of two
+	CommandQueue(size_t minimumCapacity)
+	{
+		capacity = 2;
+		while (capacity < minimumCapacity)
+		{
+			capacity *= 2;
+		}
+		mask = capacity - 1;
+
+		slots.reset(new Slot[capacity]);
+		for (size_t i = 0; i < capacity; i++)
+		{
+			slots[i].sequence.store(i, std::memory_order_relaxed);
+		}
+		writePosition.store(0, std::memory_order_relaxed);
+		readPosition = 0;
+	}
+
+	CommandQueue(const CommandQueue&) = delete;
+	CommandQueue& operator=(const CommandQueue&) = delete;
+
+	// Any thread. Returns false if the queue is full
+	bool Push(const T& item)
+	{
+		uint64_t position = writePosition.load(std::memory_order_relaxed);
+		Slot* slot;
+		while (true)
+		{
+			slot = &slots[position & mask];
+			uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+			int64_t difference = (int64_t)(sequence - position);
+			if (difference == 0)
+			{
+				// The slot's free for this lap, try to claim it
+				if (writePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (difference < 0)
+			{
+				// Still holding last lap's item, the popper hasn't caught up
+				return false;
+			}
+			else
+			{
+				// Someone else claimed it first, go again from wherever they got to
+				position = writePosition.load(std::memory_order_relaxed);
+			}
+		}
+
+		slot->item = item;
+		slot->sequence.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	// The one consumer thread only. Returns false if there's nothing (finished) to pop
+	bool Pop(T& item)
+	{
+		Slot& slot = slots[readPosition & mask];
+		if (slot.sequence.load(std::memory_order_acquire) != readPosition + 1)
+		{
+			return false;
+		}
+
+		item = slot.item;
+		// Hand the slot back for the next lap round
+		slot.sequence.store(readPosition + capacity, std::memory_order_release);
+		readPosition++;
+		return true;
+	}
+
+	size_t GetCapacity() const { return capacity; }
+
+private:
+	struct Slot
+	{
+		std::atomic<uint64_t> sequence;
+		T item;
+	};
+
+	std::unique_ptr<Slot[]> slots;
+	size_t capacity;
+	size_t mask;
+
+	// Pushers and the popper each get their own cache line so they don't slow each other down
+	alignas(64) std::atomic<uint64_t> writePosition;
+	alignas(64) uint64_t readPosition;
+};
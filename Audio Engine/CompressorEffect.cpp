@@ -0,0 +1,115 @@
+#include "CompressorEffect.h"
+#include "Decibels.h"
+#include "MixKernels.h"
+#include <algorithm>
+#include <math.h>
+
+const float CompressorEffect::kMaxLookaheadMs = 4.0f;
+
+CompressorEffect::CompressorEffect() :
+	Effect(ParameterCount),
+	kernels(&GetMixKernels()),
+	delayMask(0),
+	delayPosition(0),
+	makeupDb(0.0f),
+	thresholdDb(0.0f),
+	slope(0.0f),
+	attackCoefficient(1.0f),
+	releaseCoefficient(1.0f),
+	lookaheadFrames(0),
+	rms(false),
+	envelopeDb(0.0f),
+	currentGain(1.0f),
+	gainReduction(0.0f)
+{
+	// DirectSound's defaults
+	SetParameter(Gain, 0.0f);
+	SetParameter(Attack, 10.0f);
+	SetParameter(Release, 200.0f);
+	SetParameter(Threshold, -20.0f);
+	SetParameter(Ratio, 3.0f);
+	SetParameter(Predelay, 4.0f);
+	SetParameter(Detector, 0.0f);
+}
+
+void CompressorEffect::OnPrepare()
+{
+	unsigned maxFrames = (unsigned)ceilf(kMaxLookaheadMs * sampleRate / 1000.0f) + 1;
+	unsigned length = 1;
+	while (length < maxFrames)
+	{
+		length <<= 1;
+	}
+	delay.assign((size_t)length * 2, 0.0f);
+	delayMask = length - 1;
+	delayPosition = 0;
+}
+
+// How far a one-pole smoother gets towards where it's going in one chunk, for a time constant in ms
+static float ChunkCoefficient(float ms, unsigned sampleRate)
+{
+	float frames = ms * sampleRate / 1000.0f;
+	return 1.0f - expf(-(float)CompressorEffect::kDetectFrames / std::max(1.0f, frames));
+}
+
+void CompressorEffect::Update()
+{
+	makeupDb = std::max(-60.0f, std::min(60.0f, Get(Gain)));
+	thresholdDb = std::max(-60.0f, std::min(0.0f, Get(Threshold)));
+	// Every dB over the threshold comes out as 1/ratio dB, so the rest is turned down
+	slope = 1.0f - 1.0f / std::max(1.0f, std::min(100.0f, Get(Ratio)));
+	attackCoefficient = ChunkCoefficient(std::max(0.01f, std::min(500.0f, Get(Attack))), sampleRate);
+	releaseCoefficient = ChunkCoefficient(std::max(50.0f, std::min(3000.0f, Get(Release))), sampleRate);
+	float lookaheadMs = std::max(0.0f, std::min(kMaxLookaheadMs, Get(Predelay)));
+	lookaheadFrames = std::min(delayMask, (unsigned)(lookaheadMs * sampleRate / 1000.0f + 0.5f));
+	rms = Get(Detector) >= 0.5f;
+}
+
+void CompressorEffect::Process(float* frames, unsigned frameCount)
+{
+	float* ring = delay.data();
+	for (unsigned start = 0; start < frameCount; start += kDetectFrames)
+	{
+		const unsigned count = std::min(kDetectFrames, frameCount - start);
+		float* chunk = frames + start * 2;
+
+		// How loud this chunk is going in. For RMS, half the dB of the mean square is the dB of its square root
+		float peak;
+		float sumOfSquares;
+		kernels->measureLevel(chunk, count * 2, &peak, &sumOfSquares);
+		float levelDb = rms ? 0.5f * FastGainToDb(sumOfSquares / (count * 2)) : FastGainToDb(peak);
+
+		// How far it ought to be turned down, and the envelope heading there
+		float overDb = levelDb - thresholdDb;
+		float targetDb = overDb > 0.0f ? overDb * slope : 0.0f;
+		envelopeDb += (targetDb - envelopeDb) * (targetDb > envelopeDb ? attackCoefficient : releaseCoefficient);
+		float gain = FastDbToGain(makeupDb - envelopeDb);
+
+		// Ramps from the last chunk's gain to this one's, on the audio from lookaheadFrames ago
+		float gainStep = (gain - currentGain) / count;
+		for (unsigned i = 0; i < count; i++)
+		{
+			unsigned write = delayPosition;
+			unsigned read = (delayPosition - lookaheadFrames) & delayMask;
+			ring[write * 2] = chunk[i * 2];
+			ring[write * 2 + 1] = chunk[i * 2 + 1];
+			delayPosition = (delayPosition + 1) & delayMask;
+
+			float frameGain = currentGain + gainStep * (i + 1);
+			chunk[i * 2] = ring[read * 2] * frameGain;
+			chunk[i * 2 + 1] = ring[read * 2 + 1] * frameGain;
+		}
+		currentGain = gain;
+	}
+
+	gainReduction.store(envelopeDb, std::memory_order_relaxed);
+}
+
+void CompressorEffect::Reset()
+{
+	std::fill(delay.begin(), delay.end(), 0.0f);
+	delayPosition = 0;
+	envelopeDb = 0.0f;
+	currentGain = FastDbToGain(makeupDb);
+	gainReduction.store(0.0f, std::memory_order_relaxed);
+}
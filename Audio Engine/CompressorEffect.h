@@ -0,0 +1,83 @@
+// CompressorEffect.h
+// Native compressor/limiter, replacing DirectSound's compressor and taking the same parameters as DSFXCompressor
+// (plus a choice of detector). Turn the ratio right up and it's a limiter: SoundEngine keeps one of those on the
+// master output so a loud scene with every voice going at once doesn't clip.
+//
+// The level isn't followed sample by sample. Each block is cut into short chunks, the SIMD kernels measure each
+// chunk's peak (or RMS) in one go, and the gain is worked out once per chunk, in dB, going through lookup
+// tables (Decibels.h) rather than log and exp. The gain then ramps smoothly across the chunk. So the cost is
+// a fixed handful of operations per chunk plus a multiply per sample, however loud things get.
+//
+// The audio comes out Predelay milliseconds late (lookahead), which lets the gain come down before a peak
+// gets to the output instead of just after.
+
+#pragma once
+#include <atomic>
+#include <vector>
+#include "EffectChain.h"
+
+struct MixKernels;
+
+class CompressorEffect : public Effect
+{
+public:
+	enum Parameter
+	{
+		// Make-up gain afterwards, -60 to 60 dB, default 0
+		Gain,
+		// How quickly it turns down once the level goes over, 0.01 to 500 ms, default 10
+		Attack,
+		// How quickly it comes back up, 50 to 3000 ms, default 200
+		Release,
+		// Where it starts turning down, -60 to 0 dB, default -20
+		Threshold,
+		// How much: 1 is not at all, 100 near enough a limiter. Default 3
+		Ratio,
+		// Lookahead, 0 to 4 ms, default 4
+		Predelay,
+		// 0 for peak (catches everything, what a limiter wants), 1 for RMS (follows loudness, smoother). Default 0
+		Detector,
+		ParameterCount
+	};
+
+	// How many frames the level's measured over at a time
+	static constexpr unsigned kDetectFrames = 32;
+	static const float kMaxLookaheadMs;
+
+	CompressorEffect();
+
+	virtual const char* GetName() const override { return "Compressor"; }
+	virtual void Reset() override;
+	// The lookahead still has to come out
+	virtual unsigned GetTailFrames() const override { return lookaheadFrames; }
+
+	// How far it's turning down right now, in dB (0 or more). Safe to read from any thread, for meters
+	float GetGainReduction() const { return gainReduction.load(std::memory_order_relaxed); }
+
+protected:
+	virtual void OnPrepare() override;
+	virtual void Process(float* frames, unsigned frameCount) override;
+	virtual void Update() override;
+
+private:
+	const MixKernels* kernels;
+
+	// The lookahead, a power of two frames long
+	std::vector<float> delay;
+	unsigned delayMask;
+	unsigned delayPosition;
+
+	// Worked out from the parameters. The coefficients are how far the envelope moves per chunk
+	float makeupDb;
+	float thresholdDb;
+	float slope;
+	float attackCoefficient;
+	float releaseCoefficient;
+	unsigned lookaheadFrames;
+	bool rms;
+
+	// How far it's turning down (dB), and the linear gain the last chunk ended on
+	float envelopeDb;
+	float currentGain;
+	std::atomic<float> gainReduction;
+};
@@ -2,6 +2,8 @@
 
 #pragma once
 #include <iostream>
+
+#ifdef _WIN32
 #include <windows.h>
 
 inline std::ostream& blue(std::ostream& s)
@@ -58,3 +60,34 @@ operator<<(std::basic_ostream<_Elem, _Traits>& i, color& c)
     return i;
 }
 #pragma once
+
+#else
+
+// No console API outside Windows, so fall back to ANSI escape codes
+
+inline std::ostream& blue(std::ostream& s)
+{
+    return s << "\033[96m";
+}
+
+inline std::ostream& red(std::ostream& s)
+{
+    return s << "\033[91m";
+}
+
+inline std::ostream& green(std::ostream& s)
+{
+    return s << "\033[92m";
+}
+
+inline std::ostream& yellow(std::ostream& s)
+{
+    return s << "\033[93m";
+}
+
+inline std::ostream& white(std::ostream& s)
+{
+    return s << "\033[0m";
+}
+
+#endif
@@ -0,0 +1,360 @@
+#include "ConvolutionEffect.h"
+#include "ConvolutionWorkers.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+// ********************** Tail ******************************* //
+
+ConvolutionTail::ConvolutionTail() :
+	ir(nullptr),
+	blockFrames(0),
+	binCount(0),
+	partitionCount(0),
+	start(0),
+	deadlineMicros(0.0),
+	time(0),
+	base(0),
+	playing(-1),
+	ready(false),
+	posted(-1),
+	done(-1),
+	clearRequested(false),
+	lateBlocks(0),
+	busy(false),
+	claimed(-1),
+	lastRun(-1),
+	newest(0)
+{
+	outputBlock[0] = -1;
+	outputBlock[1] = -1;
+}
+
+void ConvolutionTail::Prepare(const ImpulseResponse& impulseResponse, unsigned sampleRate)
+{
+	ir = &impulseResponse;
+	blockFrames = ir->GetTailBlockFrames();
+	partitionCount = ir->HasTail() ? ir->GetTail(0).count : 0;
+	start = ir->GetTailStart();
+	// A block goes over once it's all come in, and is due a block after that
+	deadlineMicros = blockFrames * 1000000.0 / sampleRate;
+
+	fft.SetSize(blockFrames * 2);
+	binCount = fft.GetBinCount();
+	for (unsigned channel = 0; channel < 2; channel++)
+	{
+		collecting[channel].assign(blockFrames, 0.0f);
+		for (unsigned slot = 0; slot < 2; slot++)
+		{
+			inputs[slot][channel].assign(blockFrames, 0.0f);
+			outputs[slot][channel].assign(blockFrames, 0.0f);
+		}
+		historyReal[channel].assign((size_t)partitionCount * binCount, 0.0f);
+		historyImag[channel].assign((size_t)partitionCount * binCount, 0.0f);
+		previousInput[channel].assign(blockFrames, 0.0f);
+	}
+	frame.assign(blockFrames * 2, 0.0f);
+	sumReal.assign(binCount, 0.0f);
+	sumImag.assign(binCount, 0.0f);
+}
+
+void ConvolutionTail::Reset()
+{
+	// Skip a few block numbers so a worker finishing a block from before can't be mistaken for a new one
+	base += (long long)(time / std::max(1u, blockFrames)) + 4;
+	time = 0;
+	playing = -1;
+	ready = false;
+	clearRequested.store(true, std::memory_order_relaxed);
+}
+
+void ConvolutionTail::Process(const float* frames, float* const wet[2], unsigned frameCount)
+{
+	if (time >= start)
+	{
+		unsigned offset = (unsigned)((time - start) % blockFrames);
+		if (offset == 0)
+		{
+			// A new block's due. Either the worker's finished it or it hasn't, no waiting
+			playing = base + (long long)((time - start) / blockFrames);
+			ready = outputBlock[playing & 1].load(std::memory_order_acquire) == playing;
+			if (!ready)
+			{
+				lateBlocks.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+
+		if (ready)
+		{
+			for (unsigned channel = 0; channel < 2; channel++)
+			{
+				const float* output = outputs[playing & 1][channel].data() + offset;
+				for (unsigned i = 0; i < frameCount; i++)
+				{
+					wet[channel][i] += output[i];
+				}
+			}
+		}
+	}
+
+	unsigned position = (unsigned)(time % blockFrames);
+	for (unsigned channel = 0; channel < 2; channel++)
+	{
+		float* input = collecting[channel].data() + position;
+		for (unsigned i = 0; i < frameCount; i++)
+		{
+			input[i] = frames[i * 2 + channel];
+		}
+	}
+	time += frameCount;
+
+	if (time % blockFrames == 0)
+	{
+		// A whole block's in. Hand it over, as long as the worker isn't still on the last one
+		long long block = base + (long long)(time / blockFrames) - 1;
+		if (done.load(std::memory_order_acquire) == posted.load(std::memory_order_relaxed))
+		{
+			for (unsigned channel = 0; channel < 2; channel++)
+			{
+				memcpy(inputs[block & 1][channel].data(), collecting[channel].data(), sizeof(float) * blockFrames);
+			}
+			posted.store(block, std::memory_order_release);
+		}
+		else
+		{
+			lateBlocks.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+}
+
+bool ConvolutionTail::HasWork(long long& block)
+{
+	long long latest = posted.load(std::memory_order_acquire);
+	if (latest <= claimed)
+	{
+		return false;
+	}
+	claimed = latest;
+	block = latest;
+	return true;
+}
+
+void ConvolutionTail::Run(long long block)
+{
+	if (clearRequested.exchange(false, std::memory_order_acquire))
+	{
+		for (unsigned channel = 0; channel < 2; channel++)
+		{
+			std::fill(historyReal[channel].begin(), historyReal[channel].end(), 0.0f);
+			std::fill(historyImag[channel].begin(), historyImag[channel].end(), 0.0f);
+			std::fill(previousInput[channel].begin(), previousInput[channel].end(), 0.0f);
+		}
+		lastRun = block - 1;
+	}
+
+	// Blocks that got skipped (the worker was still busy when they came in) count as silence,
+	// so everything after them still lines up with the right partitions
+	long long skipped = std::min(block - lastRun - 1, (long long)partitionCount);
+	for (long long i = 0; i < skipped; i++)
+	{
+		newest = (newest + 1) % partitionCount;
+		for (unsigned channel = 0; channel < 2; channel++)
+		{
+			std::fill_n(historyReal[channel].begin() + (size_t)newest * binCount, binCount, 0.0f);
+			std::fill_n(historyImag[channel].begin() + (size_t)newest * binCount, binCount, 0.0f);
+			std::fill(previousInput[channel].begin(), previousInput[channel].end(), 0.0f);
+		}
+	}
+	newest = (newest + 1) % partitionCount;
+
+	for (unsigned channel = 0; channel < 2; channel++)
+	{
+		const ConvolutionPartitions& partitions = ir->GetTail(channel);
+		const std::vector<float>& input = inputs[block & 1][channel];
+
+		// Overlap-save: the FFT covers the last block and this one, and the second half of what comes back is the answer
+		std::copy(previousInput[channel].begin(), previousInput[channel].end(), frame.begin());
+		std::copy(input.begin(), input.end(), frame.begin() + blockFrames);
+		std::copy(input.begin(), input.end(), previousInput[channel].begin());
+
+		float* newestReal = historyReal[channel].data() + (size_t)newest * binCount;
+		float* newestImag = historyImag[channel].data() + (size_t)newest * binCount;
+		fft.Forward(frame.data(), newestReal, newestImag);
+
+		std::fill(sumReal.begin(), sumReal.end(), 0.0f);
+		std::fill(sumImag.begin(), sumImag.end(), 0.0f);
+		for (unsigned partition = 0; partition < partitionCount; partition++)
+		{
+			size_t slot = (size_t)((newest + partitionCount - partition) % partitionCount) * binCount;
+			ComplexMultiplyAdd(historyReal[channel].data() + slot, historyImag[channel].data() + slot,
+				partitions.GetReal(partition), partitions.GetImag(partition), sumReal.data(), sumImag.data(), binCount);
+		}
+
+		fft.Inverse(sumReal.data(), sumImag.data(), frame.data());
+		std::copy(frame.begin() + blockFrames, frame.end(), outputs[block & 1][channel].begin());
+	}
+
+	lastRun = block;
+	outputBlock[block & 1].store(block, std::memory_order_release);
+	done.store(block, std::memory_order_release);
+}
+
+// ********************** Effect ******************************* //
+
+static float DecibelsToGain(float decibels)
+{
+	return decibels <= -96.0f ? 0.0f : powf(10.0f, std::min(0.0f, decibels) / 20.0f);
+}
+
+ConvolutionEffect::ConvolutionEffect(std::shared_ptr<const ImpulseResponse> impulseResponse, ConvolutionWorkers* convolutionWorkers) :
+	Effect(ParameterCount),
+	ir(impulseResponse),
+	workers(convolutionWorkers),
+	wetGain(1.0f),
+	dryGain(0.0f),
+	blockFrames(0),
+	binCount(0),
+	partitionCount(0),
+	filled(0),
+	newest(0)
+{
+	SetParameter(Wet, 0.0f);
+	SetParameter(Dry, -96.0f);
+}
+
+ConvolutionEffect::~ConvolutionEffect()
+{
+	if (tail.IsUsed() && workers)
+	{
+		workers->Remove(&tail);
+	}
+}
+
+void ConvolutionEffect::OnPrepare()
+{
+	blockFrames = ir->GetHeadBlockFrames();
+	partitionCount = ir->GetHead(0).count;
+	fft.SetSize(blockFrames * 2);
+	binCount = fft.GetBinCount();
+
+	for (unsigned channel = 0; channel < 2; channel++)
+	{
+		frame[channel].assign(blockFrames * 2, 0.0f);
+		historyReal[channel].assign((size_t)partitionCount * binCount, 0.0f);
+		historyImag[channel].assign((size_t)partitionCount * binCount, 0.0f);
+		olderReal[channel].assign(binCount, 0.0f);
+		olderImag[channel].assign(binCount, 0.0f);
+		wet[channel].assign(blockFrames, 0.0f);
+	}
+	sumReal.assign(binCount, 0.0f);
+	sumImag.assign(binCount, 0.0f);
+	timeDomain.assign(blockFrames * 2, 0.0f);
+	filled = 0;
+	newest = 0;
+
+	if (ir->HasTail())
+	{
+		tail.Prepare(*ir, sampleRate);
+		if (workers)
+		{
+			workers->Add(&tail);
+		}
+	}
+}
+
+void ConvolutionEffect::Reset()
+{
+	for (unsigned channel = 0; channel < 2; channel++)
+	{
+		std::fill(frame[channel].begin(), frame[channel].end(), 0.0f);
+		std::fill(historyReal[channel].begin(), historyReal[channel].end(), 0.0f);
+		std::fill(historyImag[channel].begin(), historyImag[channel].end(), 0.0f);
+	}
+	filled = 0;
+	newest = 0;
+	if (tail.IsUsed())
+	{
+		tail.Reset();
+	}
+}
+
+void ConvolutionEffect::Update()
+{
+	wetGain = DecibelsToGain(Get(Wet));
+	dryGain = DecibelsToGain(Get(Dry));
+}
+
+void ConvolutionEffect::Process(float* frames, unsigned frameCount)
+{
+	while (frameCount > 0)
+	{
+		unsigned count = std::min(frameCount, blockFrames - filled);
+		ProcessPart(frames, count);
+		frames += count * 2;
+		frameCount -= count;
+	}
+}
+
+void ConvolutionEffect::ProcessPart(float* frames, unsigned frameCount)
+{
+	for (unsigned channel = 0; channel < 2; channel++)
+	{
+		const ConvolutionPartitions& partitions = ir->GetHead(channel);
+
+		if (filled == 0)
+		{
+			// The older blocks' part of the answer is the same for every frame of this block, so do it once
+			std::fill(olderReal[channel].begin(), olderReal[channel].end(), 0.0f);
+			std::fill(olderImag[channel].begin(), olderImag[channel].end(), 0.0f);
+			for (unsigned partition = 1; partition < partitionCount; partition++)
+			{
+				size_t slot = (size_t)((newest + partitionCount - partition) % partitionCount) * binCount;
+				ComplexMultiplyAdd(historyReal[channel].data() + slot, historyImag[channel].data() + slot,
+					partitions.GetReal(partition), partitions.GetImag(partition), olderReal[channel].data(), olderImag[channel].data(), binCount);
+			}
+		}
+
+		// The new frames go in after what's already come in this block, the rest of it stays zero
+		float* input = frame[channel].data() + blockFrames + filled;
+		for (unsigned i = 0; i < frameCount; i++)
+		{
+			input[i] = frames[i * 2 + channel];
+		}
+
+		float* newestReal = historyReal[channel].data() + (size_t)newest * binCount;
+		float* newestImag = historyImag[channel].data() + (size_t)newest * binCount;
+		fft.Forward(frame[channel].data(), newestReal, newestImag);
+
+		std::copy(olderReal[channel].begin(), olderReal[channel].end(), sumReal.begin());
+		std::copy(olderImag[channel].begin(), olderImag[channel].end(), sumImag.begin());
+		ComplexMultiplyAdd(newestReal, newestImag, partitions.GetReal(0), partitions.GetImag(0), sumReal.data(), sumImag.data(), binCount);
+		fft.Inverse(sumReal.data(), sumImag.data(), timeDomain.data());
+
+		std::copy(timeDomain.begin() + blockFrames + filled, timeDomain.begin() + blockFrames + filled + frameCount, wet[channel].begin());
+	}
+
+	if (tail.IsUsed())
+	{
+		float* const wetChannels[2] = { wet[0].data(), wet[1].data() };
+		tail.Process(frames, wetChannels, frameCount);
+	}
+
+	for (unsigned i = 0; i < frameCount; i++)
+	{
+		frames[i * 2] = frames[i * 2] * dryGain + wet[0][i] * wetGain;
+		frames[i * 2 + 1] = frames[i * 2 + 1] * dryGain + wet[1][i] * wetGain;
+	}
+
+	filled += frameCount;
+	if (filled == blockFrames)
+	{
+		// This block becomes the previous one, and its spectrum stays in the ring
+		for (unsigned channel = 0; channel < 2; channel++)
+		{
+			std::copy(frame[channel].begin() + blockFrames, frame[channel].end(), frame[channel].begin());
+			std::fill(frame[channel].begin() + blockFrames, frame[channel].end(), 0.0f);
+		}
+		newest = (newest + 1) % partitionCount;
+		filled = 0;
+	}
+}
@@ -0,0 +1,158 @@
+// ConvolutionEffect.h
+// Convolution reverb: plays everything through a recorded impulse response (see ImpulseResponse.h), so it
+// sounds like it was played in whatever space the IR was recorded in. Seconds-long IRs are fine.
+//
+// It's done with partitioned FFT convolution, in two parts:
+//  - The head, the first two tail blocks of the IR, runs on the audio thread in block-sized partitions.
+//    Part blocks are handled as they come, so nothing is added to the latency.
+//  - The tail, everything after that, runs in big partitions on the ConvolutionWorkers threads. A tail
+//    block of input is handed over as soon as it's complete and its output isn't due until a whole
+//    tail block later. If a worker misses that, the audio thread doesn't wait: that bit of the tail
+//    comes out silent and gets counted (see ConvolutionStats).
+//
+// Like ReverbEffect it's meant for an aux bus, so by default it's all reverb and no dry signal.
+
+#pragma once
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "EffectChain.h"
+#include "Fft.h"
+#include "ImpulseResponse.h"
+
+class ConvolutionWorkers;
+
+// The part of the convolution that runs on a worker. The audio thread collects each tail block of
+// input, leaves it in a slot for a worker, and picks the result up from another slot. There's only
+// ever one block in flight, so each side always knows which slots are its own
+class ConvolutionTail
+{
+public:
+	ConvolutionTail();
+
+	// Before it's handed to the workers
+	void Prepare(const ImpulseResponse& ir, unsigned sampleRate);
+	bool IsUsed() const { return partitionCount > 0; }
+
+	// Audio thread. Adds the tail's output for these frames to wet[channel], and takes them as input.
+	// frameCount never goes over a tail block boundary (the head's blocks divide into the tail's)
+	void Process(const float* frames, float* const wet[2], unsigned frameCount);
+	void Reset();
+
+	double GetDeadlineMicros() const { return deadlineMicros; }
+	unsigned long long GetLateBlocks() const { return lateBlocks.load(std::memory_order_relaxed); }
+
+private:
+	// Worker side. ConvolutionWorkers calls these with its lock held (HasWork) or the tail claimed (Run)
+	friend class ConvolutionWorkers;
+	bool HasWork(long long& block);
+	void Run(long long block);
+
+	const ImpulseResponse* ir;
+	unsigned blockFrames;
+	unsigned binCount;
+	unsigned partitionCount;
+	// When the tail starts, in frames
+	unsigned start;
+	double deadlineMicros;
+
+	// ---- Audio thread only
+	// Frames since Reset()
+	unsigned long long time;
+	// Blocks are numbered from here since the last Reset(), so nothing left over from before can be mistaken for new
+	long long base;
+	// The block being played, and whether it was ready in time
+	long long playing;
+	bool ready;
+	// This block's input, as it comes in
+	std::vector<float> collecting[2];
+
+	// ---- Handed between the two. Slot (block & 1)
+	std::vector<float> inputs[2][2];
+	std::vector<float> outputs[2][2];
+	// The last block handed over, and the last one finished
+	std::atomic<long long> posted;
+	std::atomic<long long> done;
+	// Which block each output slot holds
+	std::atomic<long long> outputBlock[2];
+	// Reset() asks, the worker clears its history before its next block
+	std::atomic<bool> clearRequested;
+	std::atomic<unsigned long long> lateBlocks;
+
+	// ---- Workers only
+	bool busy;
+	long long claimed;
+	long long lastRun;
+	RealFft fft;
+	// Input spectra of the blocks so far, a ring with one slot per partition
+	std::vector<float> historyReal[2];
+	std::vector<float> historyImag[2];
+	unsigned newest;
+	std::vector<float> previousInput[2];
+	std::vector<float> frame;
+	std::vector<float> sumReal;
+	std::vector<float> sumImag;
+};
+
+class ConvolutionEffect : public Effect
+{
+public:
+	enum Parameter
+	{
+		// How much reverb comes out, -96 to 0 dB, default 0
+		Wet,
+		// How much of what went in comes out too, -96 (none) to 0 dB, default -96
+		Dry,
+		ParameterCount
+	};
+
+	// The IR is shared and has to have been made for this mixer's block size.
+	// Tails go to 'workers', which has to outlive the effect
+	ConvolutionEffect(std::shared_ptr<const ImpulseResponse> impulseResponse, ConvolutionWorkers* workers);
+	virtual ~ConvolutionEffect();
+
+	virtual const char* GetName() const override { return "Convolution"; }
+	virtual void Reset() override;
+	virtual unsigned GetTailFrames() const override { return ir->GetFrameCount(); }
+
+	unsigned long long GetLateBlocks() const { return tail.GetLateBlocks(); }
+
+protected:
+	virtual void OnPrepare() override;
+	virtual void Process(float* frames, unsigned frameCount) override;
+	virtual void Update() override;
+
+private:
+	// Never more than what's left of the current head block
+	void ProcessPart(float* frames, unsigned frameCount);
+
+	std::shared_ptr<const ImpulseResponse> ir;
+	ConvolutionWorkers* workers;
+
+	float wetGain;
+	float dryGain;
+
+	// The head, one set per channel
+	RealFft fft;
+	unsigned blockFrames;
+	unsigned binCount;
+	unsigned partitionCount;
+	// How much of the current block has come in
+	unsigned filled;
+	// The ring slot the current block's spectrum goes in
+	unsigned newest;
+	// The previous block then the current one (zeros where it hasn't come in yet)
+	std::vector<float> frame[2];
+	// Input spectra of the last partitionCount blocks
+	std::vector<float> historyReal[2];
+	std::vector<float> historyImag[2];
+	// Everything from the older blocks, which only changes once a block
+	std::vector<float> olderReal[2];
+	std::vector<float> olderImag[2];
+	std::vector<float> sumReal;
+	std::vector<float> sumImag;
+	std::vector<float> timeDomain;
+	std::vector<float> wet[2];
+
+	ConvolutionTail tail;
+};
@@ -0,0 +1,125 @@
+#include "ConvolutionWorkers.h"
+#include "ConvolutionEffect.h"
+#include <algorithm>
+#include <chrono>
+
+ConvolutionWorkers::ConvolutionWorkers() : threadCount(0), running(false), jobsRun(0), peakJobMicros(0.0), deadlineMicros(0.0)
+{
+}
+
+ConvolutionWorkers::~ConvolutionWorkers()
+{
+	Stop();
+}
+
+void ConvolutionWorkers::Start()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (running)
+	{
+		return;
+	}
+
+	unsigned count = threadCount;
+	if (count == 0)
+	{
+		count = std::max(1u, std::min(4u, std::thread::hardware_concurrency() / 2));
+	}
+	running = true;
+	for (unsigned i = 0; i < count; i++)
+	{
+		threads.emplace_back(&ConvolutionWorkers::ThreadMain, this);
+	}
+}
+
+void ConvolutionWorkers::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+	}
+	wakeUp.notify_all();
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+	threads.clear();
+}
+
+void ConvolutionWorkers::Add(ConvolutionTail* tail)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (std::find(tails.begin(), tails.end(), tail) == tails.end())
+		{
+			tails.push_back(tail);
+		}
+		deadlineMicros = tail->GetDeadlineMicros();
+	}
+	Start();
+}
+
+void ConvolutionWorkers::Remove(ConvolutionTail* tail)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	jobFinished.wait(lock, [tail] { return !tail->busy; });
+	tails.erase(std::remove(tails.begin(), tails.end(), tail), tails.end());
+}
+
+unsigned ConvolutionWorkers::GetTailCount()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return (unsigned)tails.size();
+}
+
+ConvolutionStats ConvolutionWorkers::GetStats()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	ConvolutionStats stats;
+	stats.jobsRun = jobsRun;
+	stats.peakJobMicros = peakJobMicros;
+	stats.deadlineMicros = deadlineMicros;
+	for (ConvolutionTail* tail : tails)
+	{
+		stats.lateBlocks += tail->GetLateBlocks();
+	}
+	return stats;
+}
+
+void ConvolutionWorkers::ThreadMain()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (running)
+	{
+		// Claim a tail with a block waiting. Claiming it under the lock means no two threads get the same one
+		ConvolutionTail* claimed = nullptr;
+		long long block = 0;
+		for (ConvolutionTail* tail : tails)
+		{
+			if (!tail->busy && tail->HasWork(block))
+			{
+				claimed = tail;
+				claimed->busy = true;
+				break;
+			}
+		}
+
+		if (!claimed)
+		{
+			wakeUp.wait_for(lock, std::chrono::microseconds((unsigned)kPollMicroseconds));
+			continue;
+		}
+
+		lock.unlock();
+		auto startTime = std::chrono::steady_clock::now();
+		claimed->Run(block);
+		double micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - startTime).count();
+		lock.lock();
+
+		claimed->busy = false;
+		jobsRun++;
+		peakJobMicros = std::max(peakJobMicros, micros);
+		jobFinished.notify_all();
+	}
+}
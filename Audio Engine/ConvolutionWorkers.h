@@ -0,0 +1,71 @@
+// ConvolutionWorkers.h
+// The threads that work out the tails of convolution reverbs (see ConvolutionEffect.h), shared by
+// every convolution in the engine, so several long IRs on several buses get spread across cores.
+//
+// Like StreamReader, the audio thread never pokes these threads (that would mean taking a lock).
+// It leaves a block of input for a tail to pick up, and the threads check for work every millisecond.
+// A tail block isn't due until a whole tail block's time later, so that's plenty of slack.
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ConvolutionTail;
+
+// How the tails are keeping up. Safe to read from any thread
+struct ConvolutionStats
+{
+	unsigned long long jobsRun = 0;
+	// Tail blocks that weren't ready when the audio thread needed them, so that bit of the tail was silent
+	unsigned long long lateBlocks = 0;
+	// The slowest job so far, and how long a job's got before it's due (the same for every tail)
+	double peakJobMicros = 0.0;
+	double deadlineMicros = 0.0;
+};
+
+class ConvolutionWorkers
+{
+public:
+	static const unsigned kPollMicroseconds = 1000;
+
+	ConvolutionWorkers();
+	~ConvolutionWorkers();
+
+	ConvolutionWorkers(const ConvolutionWorkers&) = delete;
+	ConvolutionWorkers& operator=(const ConvolutionWorkers&) = delete;
+
+	// 0 threads means half the cores (at least one, at most four). The threads start with the first Add()
+	void SetThreadCount(unsigned count) { threadCount = count; }
+
+	// Tails have to be removed before they're destroyed. Remove() waits for a job on the tail to finish
+	void Add(ConvolutionTail* tail);
+	void Remove(ConvolutionTail* tail);
+
+	// Stops the threads. Tails stay registered, and Start() picks up where it left off
+	void Start();
+	void Stop();
+	// How many tails are registered, e.g. to know whether it's worth Start()ing again after a Stop()
+	unsigned GetTailCount();
+
+	ConvolutionStats GetStats();
+
+private:
+	void ThreadMain();
+
+	unsigned threadCount;
+	std::vector<std::thread> threads;
+
+	// Guards everything below. Never taken by the audio thread
+	std::mutex mutex;
+	std::condition_variable wakeUp;
+	std::condition_variable jobFinished;
+	bool running;
+	std::vector<ConvolutionTail*> tails;
+
+	unsigned long long jobsRun;
+	double peakJobMicros;
+	double deadlineMicros;
+};
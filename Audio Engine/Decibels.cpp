@@ -0,0 +1,79 @@
+#include "Decibels.h"
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+
+// 20 * log10(2): the dB in one power of two
+static const float kDbPerOctave = 6.0205999f;
+static const unsigned kTableBits = 8;
+static const unsigned kTableSize = 1 << kTableBits;
+
+// log2 of 1 to 2 and 2 to the 0 to 1, kTableSize steps each (plus the end, so interpolating never wraps)
+struct DecibelTables
+{
+	float log2Mantissa[kTableSize + 1];
+	float exp2Fraction[kTableSize + 1];
+
+	DecibelTables()
+	{
+		for (unsigned i = 0; i <= kTableSize; i++)
+		{
+			double x = (double)i / kTableSize;
+			log2Mantissa[i] = (float)log2(1.0 + x);
+			exp2Fraction[i] = (float)exp2(x);
+		}
+	}
+};
+
+static const DecibelTables& GetTables()
+{
+	static const DecibelTables tables;
+	return tables;
+}
+
+float FastGainToDb(float gain)
+{
+	// Denormals and below count as silence, and so does anything negative
+	if (!(gain >= 1.0e-30f))
+	{
+		return kSilenceDb;
+	}
+
+	uint32_t bits;
+	memcpy(&bits, &gain, sizeof(bits));
+	int exponent = (int)((bits >> 23) & 0xff) - 127;
+	uint32_t mantissa = bits & 0x7fffff;
+	unsigned index = mantissa >> (23 - kTableBits);
+	float fraction = (mantissa & ((1 << (23 - kTableBits)) - 1)) * (1.0f / (1 << (23 - kTableBits)));
+
+	const float* table = GetTables().log2Mantissa;
+	float log2Gain = (float)exponent + table[index] + (table[index + 1] - table[index]) * fraction;
+	float db = log2Gain * kDbPerOctave;
+	return db > kSilenceDb ? db : kSilenceDb;
+}
+
+float FastDbToGain(float db)
+{
+	if (db <= kSilenceDb)
+	{
+		return 0.0f;
+	}
+
+	// Kept well inside what a float's exponent can hold
+	float octaves = db / kDbPerOctave;
+	octaves = octaves < 120.0f ? octaves : 120.0f;
+	float whole = floorf(octaves);
+	float position = (octaves - whole) * kTableSize;
+	unsigned index = (unsigned)position;
+	index = index < kTableSize ? index : kTableSize - 1;
+	float fraction = position - (float)index;
+
+	const float* table = GetTables().exp2Fraction;
+	float value = table[index] + (table[index + 1] - table[index]) * fraction;
+
+	// Times 2^whole, made straight from the exponent bits
+	uint32_t bits = (uint32_t)((int)whole + 127) << 23;
+	float scale;
+	memcpy(&scale, &bits, sizeof(scale));
+	return value * scale;
+}
@@ -0,0 +1,13 @@
+// Decibels.h
+// Converting between decibels and linear gain without log10() or pow(), for code that has to do it every
+// few samples (compressors, meters). Both go by way of powers of two: a float already keeps its power of
+// two in its exponent bits, so only the part in between needs a table, and a small one interpolated
+// linearly is good to well under a thousandth of a dB.
+
+#pragma once
+
+// What FastGainToDb() gives for silence (or anything quieter)
+static const float kSilenceDb = -150.0f;
+
+float FastGainToDb(float gain);
+float FastDbToGain(float db);
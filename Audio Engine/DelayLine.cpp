@@ -0,0 +1,154 @@
+#include "DelayLine.h"
+#include <algorithm>
+#include <math.h>
+
+static const double kPi = 3.14159265358979323846;
+
+DelayBufferPool& DelayBufferPool::GetShared()
+{
+	static DelayBufferPool pool;
+	return pool;
+}
+
+unsigned DelayBufferPool::GetSizeClass(unsigned frames)
+{
+	unsigned sizeClass = kMinSizeClass;
+	while (sizeClass < kSizeClasses - 1 && (1u << sizeClass) < frames)
+	{
+		sizeClass++;
+	}
+	return sizeClass;
+}
+
+float* DelayBufferPool::Allocate(unsigned sizeClass)
+{
+	size_t count = ((size_t)1 << sizeClass) * 2;
+	storage.emplace_back(new float[count]);
+	allocatedBytes += count * sizeof(float);
+	return storage.back().get();
+}
+
+void DelayBufferPool::Reserve(unsigned frames, unsigned count)
+{
+	unsigned sizeClass = GetSizeClass(frames);
+	std::lock_guard<std::mutex> lock(mutex);
+	while (spare[sizeClass].size() < count)
+	{
+		spare[sizeClass].push_back(Allocate(sizeClass));
+	}
+}
+
+DelayBuffer DelayBufferPool::Acquire(unsigned frames)
+{
+	unsigned sizeClass = GetSizeClass(frames);
+	DelayBuffer buffer;
+	buffer.length = 1u << sizeClass;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (spare[sizeClass].empty())
+		{
+			buffer.frames = Allocate(sizeClass);
+		}
+		else
+		{
+			buffer.frames = spare[sizeClass].back();
+			spare[sizeClass].pop_back();
+		}
+	}
+
+	// Whoever had it last left their echoes in it
+	std::fill(buffer.frames, buffer.frames + (size_t)buffer.length * 2, 0.0f);
+	return buffer;
+}
+
+void DelayBufferPool::Release(DelayBuffer& buffer)
+{
+	if (!buffer.frames)
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		spare[GetSizeClass(buffer.length)].push_back(buffer.frames);
+	}
+	buffer = DelayBuffer();
+}
+
+size_t DelayBufferPool::GetAllocatedBytes()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return allocatedBytes;
+}
+
+void DelayLine::Allocate(unsigned maxDelayFrames)
+{
+	// Already big enough (prepared again at the same rate, say)
+	if (buffer.frames && GetMaxDelay() >= maxDelayFrames)
+	{
+		Clear();
+		return;
+	}
+
+	Free();
+	// One frame more for the interpolation to read, one more so the newest frame isn't overwritten
+	buffer = DelayBufferPool::GetShared().Acquire(maxDelayFrames + 2);
+	mask = buffer.length - 1;
+	position = 0;
+}
+
+void DelayLine::Free()
+{
+	DelayBufferPool::GetShared().Release(buffer);
+	mask = 0;
+	position = 0;
+}
+
+void DelayLine::Clear()
+{
+	if (buffer.frames)
+	{
+		std::fill(buffer.frames, buffer.frames + (size_t)buffer.length * 2, 0.0f);
+	}
+	position = 0;
+}
+
+unsigned GetFeedbackTailFrames(float feedback, float delayFrames, unsigned maxFrames)
+{
+	// One repeat, then however many more it takes each one gain 'feedback' quieter to get to -60dB
+	double repeats = 1.0;
+	double gain = fabs(feedback);
+	if (gain >= 1.0)
+	{
+		return maxFrames;
+	}
+	if (gain > 0.0)
+	{
+		repeats += log(0.001) / log(gain);
+	}
+	return (unsigned)std::min((double)maxFrames, ceil(repeats * delayFrames));
+}
+
+// Both worked out the first time anyone asks, then shared by every LFO
+struct LfoTables
+{
+	float tables[(int)LfoShape::Count][Lfo::kTableSize + 1];
+
+	LfoTables()
+	{
+		for (unsigned i = 0; i <= Lfo::kTableSize; i++)
+		{
+			double phase = (double)(i % Lfo::kTableSize) / Lfo::kTableSize;
+			// Starts at 0 and heads up, the same as the sine
+			double triangle = phase < 0.25 ? phase * 4.0 : (phase < 0.75 ? 2.0 - phase * 4.0 : phase * 4.0 - 4.0);
+			tables[(int)LfoShape::Triangle][i] = (float)triangle;
+			tables[(int)LfoShape::Sine][i] = (float)sin(2.0 * kPi * phase);
+		}
+	}
+};
+
+const float* Lfo::GetTable(LfoShape shape)
+{
+	static const LfoTables lfoTables;
+	return lfoTables.tables[std::min((int)shape, (int)LfoShape::Count - 1)];
+}
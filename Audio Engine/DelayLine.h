@@ -0,0 +1,164 @@
+// DelayLine.h
+// The pieces the delay effects (chorus, flanger, echo) are built from.
+//
+// DelayLine is a stereo delay that can be read back any distance into the past, fractions of a frame
+// included, which is what a chorus or flanger needs as its LFO sweeps the delay time smoothly about.
+//
+// Its memory comes from a DelayBufferPool rather than being allocated per effect. Buffers go back in the
+// pool when the effect goes away, and the next effect that wants one that size takes it over, so building
+// and tearing down chains (a level's worth at a time, say) stops hitting the heap once the pool has warmed up.
+// Reserve() warms it up front.
+//
+// The LFOs read their waveforms out of tables worked out once for the whole program.
+
+#pragma once
+#include <math.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Stereo interleaved and a power of two frames long, so wrapping round is a mask
+struct DelayBuffer
+{
+	float* frames = nullptr;
+	unsigned length = 0;
+};
+
+class DelayBufferPool
+{
+public:
+	// The one every effect uses
+	static DelayBufferPool& GetShared();
+
+	// Makes sure 'count' buffers that can hold 'frames' frames are sitting spare
+	void Reserve(unsigned frames, unsigned count);
+
+	// A silent buffer at least 'frames' long. Never call it from the audio thread, it can allocate
+	DelayBuffer Acquire(unsigned frames);
+	// Hands it back for someone else to use, and empties 'buffer'
+	void Release(DelayBuffer& buffer);
+
+	// Everything the pool has ever allocated, in use or not, in bytes
+	size_t GetAllocatedBytes();
+
+private:
+	// Buffers are 2^kMinSizeClass frames at the smallest, and sorted into lists by their power of two
+	static const unsigned kMinSizeClass = 8;
+	static const unsigned kSizeClasses = 32;
+
+	static unsigned GetSizeClass(unsigned frames);
+	float* Allocate(unsigned sizeClass);
+
+	std::mutex mutex;
+	// Never freed until the program ends, buffers only ever move between here and the effects
+	std::vector<std::unique_ptr<float[]>> storage;
+	size_t allocatedBytes = 0;
+	std::vector<float*> spare[kSizeClasses];
+};
+
+class DelayLine
+{
+public:
+	DelayLine() : mask(0), position(0) {}
+	~DelayLine() { Free(); }
+
+	DelayLine(const DelayLine&) = delete;
+	DelayLine& operator=(const DelayLine&) = delete;
+
+	// Gets enough memory from the shared pool to delay by up to maxDelayFrames (plus one for interpolating).
+	// From OnPrepare, not while processing
+	void Allocate(unsigned maxDelayFrames);
+	void Free();
+	void Clear();
+
+	// Frames of delay this line can manage
+	unsigned GetMaxDelay() const { return buffer.length ? buffer.length - 2 : 0; }
+
+	// Reads one channel from 'delay' frames ago, linearly interpolated between the frames either side.
+	// delay has to be at least 1 if the frame is written after it's read (as it is with feedback)
+	inline float Read(unsigned channel, float delay) const
+	{
+		unsigned whole = (unsigned)delay;
+		float fraction = delay - (float)whole;
+		float newer = buffer.frames[((position - whole) & mask) * 2 + channel];
+		float older = buffer.frames[((position - whole - 1) & mask) * 2 + channel];
+		return newer + (older - newer) * fraction;
+	}
+
+	// Whole frames only, for fixed delays like an echo's
+	inline float Read(unsigned channel, unsigned delay) const
+	{
+		return buffer.frames[((position - delay) & mask) * 2 + channel];
+	}
+
+	// Adds a frame and moves on, so what was just written is 1 frame ago
+	inline void Write(float left, float right)
+	{
+		buffer.frames[position * 2] = left;
+		buffer.frames[position * 2 + 1] = right;
+		position = (position + 1) & mask;
+	}
+
+private:
+	DelayBuffer buffer;
+	unsigned mask;
+	// Where the next frame goes
+	unsigned position;
+};
+
+// How long something fed back through a delay takes to die away by 60dB (capped at maxFrames,
+// since at full feedback it never does)
+unsigned GetFeedbackTailFrames(float feedback, float delayFrames, unsigned maxFrames);
+
+enum class LfoShape
+{
+	Triangle,
+	Sine,
+	Count
+};
+
+// One cycle of a waveform, -1 to 1, read with a phase from 0 to 1
+class Lfo
+{
+public:
+	static const unsigned kTableSize = 1024;
+
+	Lfo() : table(GetTable(LfoShape::Sine)), phase(0.0f), phaseStep(0.0f) {}
+
+	void SetShape(LfoShape shape) { table = GetTable(shape); }
+	void SetFrequency(float hz, unsigned sampleRate) { phaseStep = sampleRate ? hz / sampleRate : 0.0f; }
+	// Wraps round into 0 to 1, so -0.25 is a quarter of a cycle behind
+	void SetPhase(float newPhase)
+	{
+		phase = newPhase - floorf(newPhase);
+		if (phase >= 1.0f)
+		{
+			phase = 0.0f;
+		}
+	}
+	float GetPhase() const { return phase; }
+
+	// The value now, then on to the next frame
+	inline float Next()
+	{
+		float position = phase * kTableSize;
+		unsigned index = (unsigned)position;
+		float fraction = position - (float)index;
+		float value = table[index] + (table[index + 1] - table[index]) * fraction;
+
+		phase += phaseStep;
+		if (phase >= 1.0f)
+		{
+			phase -= 1.0f;
+		}
+		return value;
+	}
+
+	// The shared table for a shape (kTableSize + 1 entries, the last one wraps round to the first)
+	static const float* GetTable(LfoShape shape);
+
+private:
+	const float* table;
+	float phase;
+	float phaseStep;
+};
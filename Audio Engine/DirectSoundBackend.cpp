@@ -0,0 +1,279 @@
+#ifdef _WIN32
+
+#pragma comment(lib, "dsound.lib")
+#pragma comment(lib, "dxguid.lib")
+
+#include "DirectSoundBackend.h"
+#include "Mixer.h"
+#include "ConsoleColor.h"
+#include <iostream>
+
+DirectSoundBackend::DirectSoundBackend(HWND window) :
+	hwnd(window),
+	mixer(nullptr),
+	directSound(nullptr),
+	primaryBuffer(nullptr),
+	streamBuffer(nullptr),
+	bufferBytes(0),
+	blockBytes(0),
+	writeOffset(0),
+	running(false),
+	underruns(0)
+{
+	// Bring the device up straight away so GetDevice() works before Start()
+	InitializeDirectSound();
+}
+
+DirectSoundBackend::~DirectSoundBackend()
+{
+	Stop();
+	ShutdownDirectSound();
+}
+
+// Gets an interface pointer to DirectSound and the default primary sound buffer.
+bool DirectSoundBackend::InitializeDirectSound()
+{
+	// An HRESULT is an opaque result handle defined to be zero or positive for a successful return from a function, and negative for a failure.
+	HRESULT result;
+
+	// The DSBUFFERDESC structure describes the characteristics of a new buffer object
+	DSBUFFERDESC bufferDesc;
+
+	// WAVEFORMATEX structure defines the format of waveform-audio data
+	WAVEFORMATEX waveFormat;
+
+	// Initialize the direct sound interface pointer for the default sound device.
+	result = DirectSoundCreate8(NULL, &directSound, NULL);
+	if (FAILED(result))
+	{
+		std::cout << red << "ERROR: Failed to initialize direct sound interface pointer for default sound device." << white << std::endl;
+		directSound = nullptr;
+		return false;
+	}
+
+	// Set the cooperative level to priority so the format of the primary sound buffer can be modified.
+	result = directSound->SetCooperativeLevel(hwnd, DSSCL_PRIORITY);
+	if (FAILED(result))
+	{
+		std::cout << red << "ERROR: Failed to set cooperative level to priority." << white << std::endl;
+		return false;
+	}
+
+	// Setup the primary buffer description.
+	bufferDesc.dwSize = sizeof(DSBUFFERDESC); // The size of the structure
+	bufferDesc.dwFlags = DSBCAPS_PRIMARYBUFFER | DSBCAPS_CTRLVOLUME;
+	bufferDesc.dwBufferBytes = 0; // Size of this buffer, in bytes. Must be 0 for primary buffers
+	bufferDesc.dwReserved = 0; // Reserved. Must be 0.
+	bufferDesc.lpwfxFormat = NULL; // This value must be NULL for primary buffers.
+	bufferDesc.guid3DAlgorithm = GUID_NULL;
+
+	// Get control of the primary sound buffer on the default sound device.
+	result = directSound->CreateSoundBuffer(&bufferDesc, &primaryBuffer, NULL);
+	if (FAILED(result))
+	{
+		std::cout << red << "ERROR: Failed to get control of primary sound buffer." << white << std::endl;
+		primaryBuffer = nullptr;
+		return false;
+	}
+
+	// Setup the format of the primary sound bufffer: 44.1kHz, 16-bit, stereo
+	waveFormat.wFormatTag = WAVE_FORMAT_PCM;
+	waveFormat.nSamplesPerSec = Mixer::kDefaultSampleRate;
+	waveFormat.wBitsPerSample = 16;
+	waveFormat.nChannels = 2;
+	waveFormat.nBlockAlign = (waveFormat.wBitsPerSample / 8) * waveFormat.nChannels;
+	waveFormat.nAvgBytesPerSec = waveFormat.nSamplesPerSec * waveFormat.nBlockAlign;
+	waveFormat.cbSize = 0;
+
+	result = primaryBuffer->SetFormat(&waveFormat);
+	if (FAILED(result))
+	{
+		std::cout << red << "ERROR: Failed to set format of primary buffer." << white << std::endl;
+		return false;
+	}
+
+	std::cout << green << "DirectSound successfully initialized!" << white << std::endl;
+	return true;
+}
+
+void DirectSoundBackend::ShutdownDirectSound()
+{
+	if (primaryBuffer)
+	{
+		primaryBuffer->Release();
+		primaryBuffer = nullptr;
+	}
+
+	if (directSound)
+	{
+		directSound->Release();
+		directSound = nullptr;
+	}
+}
+
+bool DirectSoundBackend::Start(Mixer* mixerToPull)
+{
+	Stop();
+
+	if (!directSound)
+	{
+		return false;
+	}
+
+	mixer = mixerToPull;
+	block.resize((size_t)mixer->GetBlockFrames() * Mixer::kChannels);
+
+	// The streaming buffer matches the mixer's rate, always 16-bit stereo
+	WAVEFORMATEX waveFormat;
+	waveFormat.wFormatTag = WAVE_FORMAT_PCM;
+	waveFormat.nSamplesPerSec = mixer->GetSampleRate();
+	waveFormat.wBitsPerSample = 16;
+	waveFormat.nChannels = Mixer::kChannels;
+	waveFormat.nBlockAlign = (waveFormat.wBitsPerSample / 8) * waveFormat.nChannels;
+	waveFormat.nAvgBytesPerSec = waveFormat.nSamplesPerSec * waveFormat.nBlockAlign;
+	waveFormat.cbSize = 0;
+
+	blockBytes = mixer->GetBlockFrames() * waveFormat.nBlockAlign;
+	bufferBytes = blockBytes * kBufferBlocks;
+
+	// GETCURRENTPOSITION2 gives us an accurate play cursor, GLOBALFOCUS keeps playing when the window loses focus
+	DSBUFFERDESC bufferDesc;
+	bufferDesc.dwSize = sizeof(DSBUFFERDESC);
+	bufferDesc.dwFlags = DSBCAPS_GETCURRENTPOSITION2 | DSBCAPS_GLOBALFOCUS;
+	bufferDesc.dwBufferBytes = bufferBytes;
+	bufferDesc.dwReserved = 0;
+	bufferDesc.lpwfxFormat = &waveFormat;
+	bufferDesc.guid3DAlgorithm = GUID_NULL;
+
+	IDirectSoundBuffer* tempBuffer;
+	HRESULT result = directSound->CreateSoundBuffer(&bufferDesc, &tempBuffer, NULL);
+	if (FAILED(result))
+	{
+		std::cout << red << "ERROR: Couldn't create streaming buffer!" << white << std::endl;
+		return false;
+	}
+
+	result = tempBuffer->QueryInterface(IID_IDirectSoundBuffer8, (void**)&streamBuffer);
+	tempBuffer->Release();
+	if (FAILED(result))
+	{
+		std::cout << red << "ERROR: Streaming buffer did not have correct interface implementation!" << white << std::endl;
+		streamBuffer = nullptr;
+		return false;
+	}
+
+	// Fill everything but the last block before we start, so there's something queued from the off
+	writeOffset = 0;
+	for (unsigned i = 0; i < kBufferBlocks - 1; i++)
+	{
+		FillBlock(writeOffset);
+		writeOffset = (writeOffset + blockBytes) % bufferBytes;
+	}
+
+	result = streamBuffer->Play(0, 0, DSBPLAY_LOOPING);
+	if (FAILED(result))
+	{
+		std::cout << red << "ERROR: Couldn't start streaming buffer!" << white << std::endl;
+		streamBuffer->Release();
+		streamBuffer = nullptr;
+		return false;
+	}
+
+	running = true;
+	thread = std::thread(&DirectSoundBackend::ThreadMain, this);
+	return true;
+}
+
+void DirectSoundBackend::Stop()
+{
+	if (thread.joinable())
+	{
+		running = false;
+		thread.join();
+	}
+
+	if (streamBuffer)
+	{
+		streamBuffer->Stop();
+		streamBuffer->Release();
+		streamBuffer = nullptr;
+	}
+}
+
+unsigned DirectSoundBackend::GetLatencyFrames() const
+{
+	return mixer ? mixer->GetBlockFrames() * (kBufferBlocks - 1) : 0;
+}
+
+void DirectSoundBackend::ThreadMain()
+{
+	// Never write more than this far ahead of the play cursor
+	const DWORD writeAhead = bufferBytes - blockBytes;
+
+	// Check back a few times per block so we're never late by much
+	DWORD sleepMillis = (DWORD)(mixer->GetBlockFrames() * 1000 / mixer->GetSampleRate() / 4);
+	if (sleepMillis < 1)
+	{
+		sleepMillis = 1;
+	}
+
+	while (running.load(std::memory_order_relaxed))
+	{
+		DWORD playCursor;
+		DWORD writeCursor;
+		if (FAILED(streamBuffer->GetCurrentPosition(&playCursor, &writeCursor)))
+		{
+			Sleep(sleepMillis);
+			continue;
+		}
+
+		// How far ahead of the play cursor our data goes
+		DWORD queued = (writeOffset + bufferBytes - playCursor) % bufferBytes;
+		if (queued > writeAhead)
+		{
+			// The play cursor overtook us, so start again just after the hardware's write cursor
+			underruns.fetch_add(1, std::memory_order_relaxed);
+			writeOffset = ((writeCursor + blockBytes - 1) / blockBytes * blockBytes) % bufferBytes;
+			queued = (writeOffset + bufferBytes - playCursor) % bufferBytes;
+		}
+
+		while (queued + blockBytes <= writeAhead)
+		{
+			FillBlock(writeOffset);
+			writeOffset = (writeOffset + blockBytes) % bufferBytes;
+			queued += blockBytes;
+		}
+
+		Sleep(sleepMillis);
+	}
+}
+
+// Mixes one block and copies it into the streaming buffer at 'offset'
+void DirectSoundBackend::FillBlock(DWORD offset)
+{
+	const unsigned frames = mixer->GetBlockFrames();
+	mixer->Render(block.data(), frames);
+
+	void* regionA;
+	void* regionB;
+	DWORD bytesA;
+	DWORD bytesB;
+	if (FAILED(streamBuffer->Lock(offset, blockBytes, &regionA, &bytesA, &regionB, &bytesB, 0)))
+	{
+		return;
+	}
+
+	// A lock can wrap around the end of the buffer, in which case we get two regions
+	const float* source = block.data();
+	short* destinations[2] = { (short*)regionA, (short*)regionB };
+	DWORD counts[2] = { bytesA / sizeof(short), bytesB / sizeof(short) };
+	for (int region = 0; region < 2; region++)
+	{
+		mixer->GetKernels().floatToInt16(destinations[region], source, counts[region]);
+		source += counts[region];
+	}
+
+	streamBuffer->Unlock(regionA, bytesA, regionB, bytesB);
+}
+
+#endif
@@ -0,0 +1,63 @@
+// DirectSoundBackend.h
+// Plays the mixer's output through DirectSound. Instead of one secondary buffer per sound (the old way),
+// there's a single looping "streaming" buffer, and a thread keeps topping it up with freshly mixed blocks
+// just ahead of the play cursor. As far as DirectSound knows we're playing one long sound.
+
+#pragma once
+#ifdef _WIN32
+
+#include "DirectSoundCompat.h"
+#include "AudioBackend.h"
+
+class DirectSoundBackend : public AudioBackend
+{
+public:
+	// How many mixer blocks the streaming buffer holds. One is being played while the rest are queued,
+	// so latency is (kBufferBlocks - 1) blocks
+	static const unsigned kBufferBlocks = 4;
+
+	// HWND is a 'Window Handle', and it will tell DirectSound which window to play the sound from
+	DirectSoundBackend(HWND hwnd);
+	virtual ~DirectSoundBackend();
+
+	virtual bool Start(Mixer* mixer) override;
+	virtual void Stop() override;
+	virtual const char* GetName() const override { return "DirectSound"; }
+	virtual unsigned GetLatencyFrames() const override;
+
+	// How many times the play cursor caught up with us and played stale audio
+	unsigned long long GetUnderrunCount() const { return underruns.load(std::memory_order_relaxed); }
+
+	// The device, for anything that still wants to make its own DirectSound buffers
+	IDirectSound8* GetDevice() const { return directSound; }
+
+private:
+	bool InitializeDirectSound();
+	void ShutdownDirectSound();
+	void ThreadMain();
+	void FillBlock(DWORD offset);
+
+	HWND hwnd;
+	Mixer* mixer;
+
+	// For creating buffer objects, managing devices, and setting up the environment in DirectSound
+	IDirectSound8* directSound;
+
+	// Primary buffer, we only touch it to set the output format
+	IDirectSoundBuffer* primaryBuffer;
+
+	// The one secondary buffer everything is mixed into
+	IDirectSoundBuffer8* streamBuffer;
+
+	DWORD bufferBytes;
+	DWORD blockBytes;
+	// Where the next block gets written to
+	DWORD writeOffset;
+
+	std::vector<float> block;
+	std::thread thread;
+	std::atomic<bool> running;
+	std::atomic<unsigned long long> underruns;
+};
+
+#endif
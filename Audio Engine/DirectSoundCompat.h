@@ -0,0 +1,130 @@
+// DirectSoundCompat.h
+// The public engine API still speaks DirectSound (DWORD flags, DSBVOLUME_MAX, DSFXChorus and friends)
+// so existing callers keep working. On Windows we just pull in the real headers; everywhere else we
+// declare stand-ins with the same names and values so the portable engine code compiles on Linux.
+
+#pragma once
+
+#ifdef _WIN32
+
+#include <windows.h>
+#include <dsound.h>
+
+#else
+
+#include <stdint.h>
+
+typedef uint32_t DWORD;
+typedef void* HWND;
+
+// Volume is in hundredths of a decibel, 0 is full volume and -10000 is silence
+#define DSBVOLUME_MIN				-10000
+#define DSBVOLUME_MAX				0
+
+// Pan is in hundredths of a decibel of attenuation on the opposite channel
+#define DSBPAN_LEFT					-10000
+#define DSBPAN_CENTER				0
+#define DSBPAN_RIGHT				10000
+
+// Frequency is in Hz, 0 means "whatever the file was recorded at"
+#define DSBFREQUENCY_ORIGINAL		0
+#define DSBFREQUENCY_MIN			100
+#define DSBFREQUENCY_MAX			200000
+
+#define DSBPLAY_LOOPING				0x00000001
+
+#define DSFXCHORUS_WAVE_TRIANGLE	0
+#define DSFXCHORUS_WAVE_SIN			1
+#define DSFXCHORUS_PHASE_NEG_180	0
+#define DSFXCHORUS_PHASE_NEG_90		1
+#define DSFXCHORUS_PHASE_ZERO		2
+#define DSFXCHORUS_PHASE_90			3
+#define DSFXCHORUS_PHASE_180		4
+
+#define DSFXFLANGER_WAVE_TRIANGLE	0
+#define DSFXFLANGER_WAVE_SIN		1
+#define DSFXFLANGER_PHASE_NEG_180	0
+#define DSFXFLANGER_PHASE_NEG_90	1
+#define DSFXFLANGER_PHASE_ZERO		2
+#define DSFXFLANGER_PHASE_90		3
+#define DSFXFLANGER_PHASE_180		4
+
+#define DSFXGARGLE_WAVE_TRIANGLE	0
+#define DSFXGARGLE_WAVE_SQUARE		1
+
+#define DSFXECHO_PANDELAY_MIN		0
+#define DSFXECHO_PANDELAY_MAX		1
+
+// Effect parameter blocks, laid out exactly like the ones in dsound.h
+struct DSFXChorus
+{
+	float	fWetDryMix;
+	float	fDepth;
+	float	fFeedback;
+	float	fFrequency;
+	long	lWaveform;
+	float	fDelay;
+	long	lPhase;
+};
+
+struct DSFXCompressor
+{
+	float	fGain;
+	float	fAttack;
+	float	fRelease;
+	float	fThreshold;
+	float	fRatio;
+	float	fPredelay;
+};
+
+struct DSFXDistortion
+{
+	float	fGain;
+	float	fEdge;
+	float	fPostEQCenterFrequency;
+	float	fPostEQBandwidth;
+	float	fPreLowpassCutoff;
+};
+
+struct DSFXEcho
+{
+	float	fWetDryMix;
+	float	fFeedback;
+	float	fLeftDelay;
+	float	fRightDelay;
+	long	lPanDelay;
+};
+
+struct DSFXFlanger
+{
+	float	fWetDryMix;
+	float	fDepth;
+	float	fFeedback;
+	float	fFrequency;
+	long	lWaveform;
+	float	fDelay;
+	long	lPhase;
+};
+
+struct DSFXGargle
+{
+	DWORD	dwRateHz;
+	DWORD	dwWaveShape;
+};
+
+struct DSFXParamEq
+{
+	float	fCenter;
+	float	fBandwidth;
+	float	fGain;
+};
+
+struct DSFXWavesReverb
+{
+	float	fInGain;
+	float	fReverbMix;
+	float	fReverbTime;
+	float	fHighFreqRTRatio;
+};
+
+#endif
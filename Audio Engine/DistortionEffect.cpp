@@ -0,0 +1,77 @@
+#include "DistortionEffect.h"
+#include <algorithm>
+#include <math.h>
+
+static const float kPi = 3.14159265f;
+
+DistortionEffect::DistortionEffect() : Effect(ParameterCount)
+{
+	// DirectSound's defaults
+	SetParameter(Gain, -18.0f);
+	SetParameter(Edge, 15.0f);
+	SetParameter(PostEQCenterFrequency, 2400.0f);
+	SetParameter(PostEQBandwidth, 2400.0f);
+	SetParameter(PreLowpassCutoff, 8000.0f);
+	Reset();
+}
+
+void DistortionEffect::Reset()
+{
+	for (int channel = 0; channel < 2; channel++)
+	{
+		lowpassState[channel] = 0.0f;
+		eqState[channel][0] = 0.0f;
+		eqState[channel][1] = 0.0f;
+	}
+}
+
+void DistortionEffect::Update()
+{
+	const float nyquistish = sampleRate * 0.45f;
+
+	outputGain = powf(10.0f, std::max(-60.0f, std::min(0.0f, Get(Gain))) / 20.0f);
+
+	// Edge 0 leaves it alone, and it gets closer and closer to a hard clip on the way to 100
+	float edge = std::max(0.0f, std::min(99.0f, Get(Edge))) / 100.0f;
+	drive = 2.0f * edge / (1.0f - edge);
+
+	// One pole lowpass
+	float cutoff = std::max(20.0f, std::min(nyquistish, Get(PreLowpassCutoff)));
+	lowpass = 1.0f - expf(-2.0f * kPi * cutoff / sampleRate);
+
+	// Band-pass biquad (the RBJ cookbook one, 0dB at the centre)
+	float centre = std::max(20.0f, std::min(nyquistish, Get(PostEQCenterFrequency)));
+	float q = centre / std::max(1.0f, Get(PostEQBandwidth));
+	float w0 = 2.0f * kPi * centre / sampleRate;
+	float alpha = sinf(w0) / (2.0f * q);
+	float a0 = 1.0f + alpha;
+	b0 = alpha / a0;
+	b1 = 0.0f;
+	b2 = -alpha / a0;
+	a1 = -2.0f * cosf(w0) / a0;
+	a2 = (1.0f - alpha) / a0;
+}
+
+void DistortionEffect::Process(float* frames, unsigned frameCount)
+{
+	for (unsigned i = 0; i < frameCount; i++)
+	{
+		for (int channel = 0; channel < 2; channel++)
+		{
+			float x = frames[i * 2 + channel];
+
+			lowpassState[channel] += lowpass * (x - lowpassState[channel]);
+			x = lowpassState[channel];
+
+			// Soft clip that gets harder the more drive there is
+			x = x * (1.0f + drive) / (1.0f + drive * fabsf(x));
+
+			float* z = eqState[channel];
+			float y = b0 * x + z[0];
+			z[0] = b1 * x - a1 * y + z[1];
+			z[1] = b2 * x - a2 * y;
+
+			frames[i * 2 + channel] = y * outputGain;
+		}
+	}
+}
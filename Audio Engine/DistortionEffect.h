@@ -0,0 +1,44 @@
+// DistortionEffect.h
+// Native version of DirectSound's distortion, taking the same parameters in the same units:
+// a lowpass to tame the input, a waveshaper to bend it, then a band-pass "post EQ" and an output gain.
+
+#pragma once
+#include "EffectChain.h"
+
+class DistortionEffect : public Effect
+{
+public:
+	enum Parameter
+	{
+		// -60 to 0 dB, default -18
+		Gain,
+		// How hard it's driven, 0 to 100 percent, default 15
+		Edge,
+		// The band that's kept afterwards, 100 to 8000 Hz, defaults 2400 and 2400
+		PostEQCenterFrequency,
+		PostEQBandwidth,
+		// 100 to 8000 Hz, default 8000
+		PreLowpassCutoff,
+		ParameterCount
+	};
+
+	DistortionEffect();
+
+	virtual const char* GetName() const override { return "Distortion"; }
+	virtual void Reset() override;
+
+protected:
+	virtual void Process(float* frames, unsigned frameCount) override;
+	virtual void Update() override;
+
+private:
+	// Worked out from the parameters
+	float outputGain;
+	float drive;
+	float lowpass;
+	float b0, b1, b2, a1, a2;
+
+	// Filter memory, per channel
+	float lowpassState[2];
+	float eqState[2][2];
+};
@@ -0,0 +1,63 @@
+#include "EchoEffect.h"
+#include <algorithm>
+#include <math.h>
+
+static const float kMaxDelayMs = 2000.0f;
+// Even at full feedback, stop running it after this long
+static const float kMaxTailSeconds = 30.0f;
+
+EchoEffect::EchoEffect() : Effect(ParameterCount), wet(0.0f), dry(1.0f), feedback(0.0f), swap(false), tailFrames(0)
+{
+	delay[0] = delay[1] = 1;
+	SetParameter(WetDryMix, 50.0f);
+	SetParameter(Feedback, 50.0f);
+	SetParameter(LeftDelay, 500.0f);
+	SetParameter(RightDelay, 500.0f);
+	SetParameter(PanDelay, 0.0f);
+}
+
+void EchoEffect::OnPrepare()
+{
+	line.Allocate((unsigned)ceilf(kMaxDelayMs * sampleRate / 1000.0f));
+}
+
+void EchoEffect::Update()
+{
+	float mix = std::max(0.0f, std::min(100.0f, Get(WetDryMix))) / 100.0f;
+	wet = mix;
+	dry = 1.0f - mix;
+	feedback = std::max(0.0f, std::min(100.0f, Get(Feedback))) / 100.0f;
+	swap = Get(PanDelay) >= 0.5f;
+
+	for (unsigned channel = 0; channel < 2; channel++)
+	{
+		float ms = std::max(1.0f, std::min(kMaxDelayMs, Get(channel == 0 ? LeftDelay : RightDelay)));
+		delay[channel] = std::max(1u, std::min(line.GetMaxDelay(), (unsigned)(ms * sampleRate / 1000.0f + 0.5f)));
+	}
+
+	// Swapping, a repeat goes round both delays before it's back on the same side
+	float longest = (float)std::max(delay[0], delay[1]);
+	tailFrames = GetFeedbackTailFrames(feedback, swap ? longest * 2.0f : longest, (unsigned)(kMaxTailSeconds * sampleRate));
+}
+
+void EchoEffect::Process(float* frames, unsigned frameCount)
+{
+	for (unsigned i = 0; i < frameCount; i++)
+	{
+		float echoLeft = line.Read(0, delay[0]);
+		float echoRight = line.Read(1, delay[1]);
+
+		float left = frames[i * 2];
+		float right = frames[i * 2 + 1];
+		if (swap)
+		{
+			line.Write(left + echoRight * feedback, right + echoLeft * feedback);
+		}
+		else
+		{
+			line.Write(left + echoLeft * feedback, right + echoRight * feedback);
+		}
+		frames[i * 2] = left * dry + echoLeft * wet;
+		frames[i * 2 + 1] = right * dry + echoRight * wet;
+	}
+}
@@ -0,0 +1,48 @@
+// EchoEffect.h
+// Native version of DirectSound's echo, taking the same parameters as DSFXEcho: each channel repeats
+// after its own delay, quieter each time by the feedback. With PanDelay on the repeats bounce from
+// one side to the other (ping-pong) instead.
+
+#pragma once
+#include "EffectChain.h"
+#include "DelayLine.h"
+
+class EchoEffect : public Effect
+{
+public:
+	enum Parameter
+	{
+		// How much of the output is echo, 0 to 100 percent, default 50
+		WetDryMix,
+		// How much of each echo comes round again, 0 to 100 percent, default 50
+		Feedback,
+		// 1 to 2000 ms, default 500
+		LeftDelay,
+		RightDelay,
+		// DSFXECHO_PANDELAY_MIN (0) for separate channels, DSFXECHO_PANDELAY_MAX (1) to swap them every repeat
+		PanDelay,
+		ParameterCount
+	};
+
+	EchoEffect();
+
+	virtual const char* GetName() const override { return "Echo"; }
+	virtual void Reset() override { line.Clear(); }
+	virtual unsigned GetTailFrames() const override { return tailFrames; }
+
+protected:
+	virtual void OnPrepare() override;
+	virtual void Process(float* frames, unsigned frameCount) override;
+	virtual void Update() override;
+
+private:
+	DelayLine line;
+
+	// Worked out from the parameters, delays in frames
+	float wet;
+	float dry;
+	float feedback;
+	unsigned delay[2];
+	bool swap;
+	unsigned tailFrames;
+};
@@ -0,0 +1,84 @@
+#include "EffectChain.h"
+#include <algorithm>
+
+Effect::Effect(unsigned count) : sampleRate(0), maxBlockFrames(0), parameterCount(std::min(count, (unsigned)kMaxParameters)), changed(true)
+{
+	for (float& parameter : parameters)
+	{
+		parameter = 0.0f;
+	}
+}
+
+void Effect::Prepare(unsigned rate, unsigned blockFrames)
+{
+	sampleRate = rate;
+	maxBlockFrames = blockFrames;
+	OnPrepare();
+	// Coefficients depend on the rate, so work them out again
+	changed = true;
+}
+
+void Effect::Run(float* frames, unsigned frameCount)
+{
+	if (changed)
+	{
+		Update();
+		changed = false;
+	}
+	Process(frames, frameCount);
+}
+
+void Effect::SetParameter(unsigned index, float value)
+{
+	if (index < parameterCount)
+	{
+		parameters[index] = value;
+		changed = true;
+	}
+}
+
+EffectChain::EffectChain(unsigned rate, unsigned blockFrames) :
+	sampleRate(rate),
+	maxBlockFrames(blockFrames),
+	used(false),
+	active(false),
+	outputBus(0),
+	tailRemaining(0)
+{
+	input.resize((size_t)maxBlockFrames * 2);
+}
+
+Effect* EffectChain::Add(std::unique_ptr<Effect> effect)
+{
+	effect->Prepare(sampleRate, maxBlockFrames);
+	effects.push_back(std::move(effect));
+	return effects.back().get();
+}
+
+unsigned EffectChain::GetTailFrames() const
+{
+	// Effects in a row ring on one after the other, so the tails add up
+	unsigned tailFrames = 0;
+	for (const std::unique_ptr<Effect>& effect : effects)
+	{
+		tailFrames += effect->GetTailFrames();
+	}
+	return tailFrames;
+}
+
+void EffectChain::Process(float* frames, unsigned frameCount)
+{
+	for (const std::unique_ptr<Effect>& effect : effects)
+	{
+		effect->Run(frames, frameCount);
+	}
+}
+
+void EffectChain::Reset()
+{
+	for (const std::unique_ptr<Effect>& effect : effects)
+	{
+		effect->Reset();
+	}
+	tailRemaining = 0;
+}
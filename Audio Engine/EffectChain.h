@@ -0,0 +1,117 @@
+// EffectChain.h
+// Effects that run inside the mixer, and chains of them.
+//
+// An EffectChain is an ordered list of effects that gets built once (when the game starts, or the level
+// loads) and then attached to voices or buses as often as you like. Every effect allocates what it needs
+// when it's added to the chain, so playing a sound through a chain, or ten of them, costs the DSP and
+// nothing else: no effect objects get made or torn down per play the way DirectSound's SetFX did.
+//
+// On a bus, the chain processes everything summed into that bus.
+// On a voice, the chain gets its own little mix: every voice playing through the same chain is summed
+// into it, the chain runs once on that, and the result goes into the bus of the voices feeding it.
+// Either way it keeps running after its input goes quiet for as long as its tail (echoes, reverb) lasts.
+//
+// Once a chain is attached, only the audio thread may touch it: change parameters through
+// Mixer::SetEffectParameter(). And it has to stay alive for as long as the mixer might be using it
+// (SoundEngine keeps hold of the chains it makes until it goes away).
+
+#pragma once
+#include <memory>
+#include <vector>
+
+class Effect
+{
+public:
+	static const unsigned kMaxParameters = 32;
+
+	Effect(unsigned parameterCount);
+	virtual ~Effect() {}
+
+	virtual const char* GetName() const = 0;
+
+	// Gets everything ready to run at this rate, in blocks of up to maxBlockFrames (the chain does this)
+	void Prepare(unsigned rate, unsigned blockFrames);
+
+	// Back to silence, as if nothing had ever gone through it
+	virtual void Reset() {}
+
+	// How long it keeps making sound after its input stops, in frames
+	virtual unsigned GetTailFrames() const { return 0; }
+
+	// Interleaved stereo, in place. Picks up any parameter changes first
+	void Run(float* frames, unsigned frameCount);
+
+	// Parameters are plain floats, numbered by each effect's own Parameter enum.
+	// The new values get used from the next block the effect runs
+	void SetParameter(unsigned index, float value);
+	float GetParameter(unsigned index) const { return index < parameterCount ? parameters[index] : 0.0f; }
+	unsigned GetParameterCount() const { return parameterCount; }
+
+protected:
+	// Anything the effect needs to allocate (delay lines, say) gets allocated here, never while processing.
+	// sampleRate and maxBlockFrames are set by the time it's called
+	virtual void OnPrepare() {}
+
+	virtual void Process(float* frames, unsigned frameCount) = 0;
+
+	// Works out whatever the effect runs on (filter coefficients and the like) from the parameters
+	virtual void Update() {}
+
+	float Get(unsigned index) const { return parameters[index]; }
+
+	unsigned sampleRate;
+	unsigned maxBlockFrames;
+
+private:
+	float parameters[kMaxParameters];
+	unsigned parameterCount;
+	bool changed;
+};
+
+class EffectChain
+{
+public:
+	EffectChain(unsigned sampleRate, unsigned maxBlockFrames);
+
+	EffectChain(const EffectChain&) = delete;
+	EffectChain& operator=(const EffectChain&) = delete;
+
+	// Adds an effect to the end of the chain and gets it ready to run. Only while building the chain,
+	// before it's attached to anything. Returns the effect so its parameters can be set
+	template <typename T>
+	T* Add()
+	{
+		T* effect = new T();
+		Add(std::unique_ptr<Effect>(effect));
+		return effect;
+	}
+	Effect* Add(std::unique_ptr<Effect> effect);
+
+	// Runs every effect in order, in place on interleaved stereo
+	void Process(float* frames, unsigned frameCount);
+	void Reset();
+
+	// How long the chain rings on for: each effect's tail, one after the other
+	unsigned GetTailFrames() const;
+
+	size_t GetEffectCount() const { return effects.size(); }
+	Effect* GetEffect(size_t index) const { return effects[index].get(); }
+
+private:
+	unsigned sampleRate;
+	unsigned maxBlockFrames;
+	std::vector<std::unique_ptr<Effect>> effects;
+
+	// The mixer's bookkeeping for running the chain. Audio thread only
+	friend class Mixer;
+	// Where the voices playing through the chain get summed
+	std::vector<float> input;
+	// Whether a voice was mixed into 'input' this block
+	bool used;
+	// Whether it's in the mixer's list of chains to run
+	bool active;
+	// The bus the output goes to
+	unsigned outputBus;
+	// How much longer to keep running it after the last voice went quiet
+	unsigned tailRemaining;
+};
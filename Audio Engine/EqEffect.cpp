@@ -0,0 +1,63 @@
+#include "EqEffect.h"
+#include "MixKernels.h"
+
+EqEffect::EqEffect() : Effect(ParameterCount), kernels(&GetMixKernels())
+{
+	for (unsigned band = 0; band < kBands; band++)
+	{
+		SetParameter(BandParameter(band, Type), (float)BiquadType::Off);
+		SetParameter(BandParameter(band, Frequency), 1000.0f);
+		SetParameter(BandParameter(band, Q), 0.707f);
+		SetParameter(BandParameter(band, Gain), 0.0f);
+	}
+	for (bool& active : stageActive)
+	{
+		active = false;
+	}
+}
+
+void EqEffect::Reset()
+{
+	for (BiquadStage& stage : stages)
+	{
+		stage.Reset();
+	}
+}
+
+void EqEffect::Update()
+{
+	for (unsigned band = 0; band < kBands; band++)
+	{
+		int type = (int)Get(BandParameter(band, Type));
+		if (type < 0 || type >= (int)BiquadType::Count)
+		{
+			type = (int)BiquadType::Off;
+		}
+
+		BiquadCoefficients coefficients = DesignBiquad((BiquadType)type, Get(BandParameter(band, Frequency)),
+			Get(BandParameter(band, Q)), Get(BandParameter(band, Gain)), sampleRate);
+		stages[band / BiquadStage::kBands].SetBand(band % BiquadStage::kBands, coefficients);
+	}
+
+	for (unsigned i = 0; i < kStages; i++)
+	{
+		bool active = !stages[i].IsPassThrough();
+		// Don't want whatever was left in there when it was switched off ringing out when it's switched back on
+		if (!active && stageActive[i])
+		{
+			stages[i].Reset();
+		}
+		stageActive[i] = active;
+	}
+}
+
+void EqEffect::Process(float* frames, unsigned frameCount)
+{
+	for (unsigned i = 0; i < kStages; i++)
+	{
+		if (stageActive[i])
+		{
+			kernels->biquadStage(stages[i], frames, frameCount);
+		}
+	}
+}
@@ -0,0 +1,50 @@
+// EqEffect.h
+// Native multi-band parametric EQ, replacing DirectSound's ParamEQ (which only had the one band, and only
+// peaking). Up to eight bands of biquads, each a peak, shelf, low/high pass, band-pass or notch.
+// Bands are run four at a time by the SIMD biquad kernels, and a group of four that's all Off is skipped.
+
+#pragma once
+#include "EffectChain.h"
+#include "Biquad.h"
+
+struct MixKernels;
+
+class EqEffect : public Effect
+{
+public:
+	static const unsigned kBands = 8;
+
+	// Every band has the same four parameters: use BandParameter() to get the index for a band's
+	enum Parameter
+	{
+		// A BiquadType, as a float. Default Off
+		Type,
+		// Centre (or corner) in Hz, default 1000
+		Frequency,
+		// Width, default 0.707
+		Q,
+		// Boost or cut in dB for peaks and shelves, default 0
+		Gain,
+		ParametersPerBand,
+		ParameterCount = ParametersPerBand * kBands
+	};
+
+	static unsigned BandParameter(unsigned band, Parameter parameter) { return band * ParametersPerBand + parameter; }
+
+	EqEffect();
+
+	virtual const char* GetName() const override { return "EQ"; }
+	virtual void Reset() override;
+
+protected:
+	virtual void Process(float* frames, unsigned frameCount) override;
+	virtual void Update() override;
+
+private:
+	static const unsigned kStages = kBands / BiquadStage::kBands;
+
+	const MixKernels* kernels;
+	BiquadStage stages[kStages];
+	// False if every band in the stage is Off
+	bool stageActive[kStages];
+};
@@ -0,0 +1,186 @@
+#include "Fft.h"
+#include <math.h>
+
+static const double kPi = 3.14159265358979323846;
+
+RealFft::RealFft() : size(0), half(0)
+{
+}
+
+RealFft::RealFft(unsigned fftSize) : size(0), half(0)
+{
+	SetSize(fftSize);
+}
+
+void RealFft::SetSize(unsigned fftSize)
+{
+	size = RoundUpToPowerOfTwo(fftSize < 2 ? 2 : fftSize);
+	half = size / 2;
+
+	unsigned bits = 0;
+	while ((1u << bits) < half)
+	{
+		bits++;
+	}
+	bitReverse.resize(half);
+	for (unsigned i = 0; i < half; i++)
+	{
+		unsigned reversed = 0;
+		for (unsigned bit = 0; bit < bits; bit++)
+		{
+			reversed |= ((i >> bit) & 1) << (bits - 1 - bit);
+		}
+		bitReverse[i] = reversed;
+	}
+
+	// Worked out in double so the big sizes aren't off by a rounding error per bin
+	cosTable.resize(half / 2 + 1);
+	sinTable.resize(half / 2 + 1);
+	for (unsigned k = 0; k < cosTable.size(); k++)
+	{
+		cosTable[k] = (float)cos(2.0 * kPi * k / half);
+		sinTable[k] = (float)sin(2.0 * kPi * k / half);
+	}
+	splitCos.resize(half + 1);
+	splitSin.resize(half + 1);
+	for (unsigned k = 0; k <= half; k++)
+	{
+		splitCos[k] = (float)cos(2.0 * kPi * k / size);
+		splitSin[k] = (float)sin(2.0 * kPi * k / size);
+	}
+
+	workReal.assign(half, 0.0f);
+	workImag.assign(half, 0.0f);
+}
+
+void RealFft::Transform(float* real, float* imag, bool inverse)
+{
+	for (unsigned i = 0; i < half; i++)
+	{
+		unsigned j = bitReverse[i];
+		if (i < j)
+		{
+			float t = real[i];
+			real[i] = real[j];
+			real[j] = t;
+			t = imag[i];
+			imag[i] = imag[j];
+			imag[j] = t;
+		}
+	}
+
+	// Forward goes round the circle one way (e^-i), inverse the other
+	const float direction = inverse ? 1.0f : -1.0f;
+	for (unsigned length = 2; length <= half; length *= 2)
+	{
+		const unsigned span = length / 2;
+		const unsigned stride = half / length;
+		for (unsigned start = 0; start < half; start += length)
+		{
+			for (unsigned k = 0; k < span; k++)
+			{
+				float wReal = cosTable[k * stride];
+				float wImag = direction * sinTable[k * stride];
+				unsigned a = start + k;
+				unsigned b = a + span;
+				float tReal = real[b] * wReal - imag[b] * wImag;
+				float tImag = real[b] * wImag + imag[b] * wReal;
+				real[b] = real[a] - tReal;
+				imag[b] = imag[a] - tImag;
+				real[a] += tReal;
+				imag[a] += tImag;
+			}
+		}
+	}
+}
+
+void RealFft::Forward(const float* input, float* real, float* imag)
+{
+	float* zReal = workReal.data();
+	float* zImag = workImag.data();
+	for (unsigned n = 0; n < half; n++)
+	{
+		zReal[n] = input[n * 2];
+		zImag[n] = input[n * 2 + 1];
+	}
+	Transform(zReal, zImag, false);
+
+	// Pull the spectra of the even and odd samples back apart, then put them together as one
+	real[0] = zReal[0] + zImag[0];
+	imag[0] = 0.0f;
+	real[half] = zReal[0] - zImag[0];
+	imag[half] = 0.0f;
+	for (unsigned k = 1; k < half; k++)
+	{
+		float aReal = zReal[k];
+		float aImag = zImag[k];
+		float bReal = zReal[half - k];
+		float bImag = zImag[half - k];
+
+		float evenReal = (aReal + bReal) * 0.5f;
+		float evenImag = (aImag - bImag) * 0.5f;
+		float oddReal = (aImag + bImag) * 0.5f;
+		float oddImag = (bReal - aReal) * 0.5f;
+
+		// Odd samples are half a step later, so they get turned by e^(-2*pi*i*k/size)
+		float c = splitCos[k];
+		float s = splitSin[k];
+		real[k] = evenReal + c * oddReal + s * oddImag;
+		imag[k] = evenImag + c * oddImag - s * oddReal;
+	}
+}
+
+void RealFft::Inverse(const float* real, const float* imag, float* output)
+{
+	float* zReal = workReal.data();
+	float* zImag = workImag.data();
+	for (unsigned k = 0; k < half; k++)
+	{
+		float aReal = real[k];
+		float aImag = imag[k];
+		float bReal = real[half - k];
+		float bImag = -imag[half - k];
+
+		float evenReal = (aReal + bReal) * 0.5f;
+		float evenImag = (aImag + bImag) * 0.5f;
+		float differenceReal = aReal - bReal;
+		float differenceImag = aImag - bImag;
+
+		// Undo the turn from Forward()
+		float c = splitCos[k];
+		float s = splitSin[k];
+		float oddReal = (differenceReal * c - differenceImag * s) * 0.5f;
+		float oddImag = (differenceReal * s + differenceImag * c) * 0.5f;
+
+		zReal[k] = evenReal - oddImag;
+		zImag[k] = evenImag + oddReal;
+	}
+	Transform(zReal, zImag, true);
+
+	const float scale = 1.0f / half;
+	for (unsigned n = 0; n < half; n++)
+	{
+		output[n * 2] = zReal[n] * scale;
+		output[n * 2 + 1] = zImag[n] * scale;
+	}
+}
+
+void ComplexMultiplyAdd(const float* aReal, const float* aImag, const float* bReal, const float* bImag,
+	float* yReal, float* yImag, unsigned n)
+{
+	for (unsigned i = 0; i < n; i++)
+	{
+		yReal[i] += aReal[i] * bReal[i] - aImag[i] * bImag[i];
+		yImag[i] += aReal[i] * bImag[i] + aImag[i] * bReal[i];
+	}
+}
+
+unsigned RoundUpToPowerOfTwo(unsigned value)
+{
+	unsigned result = 1;
+	while (result < value)
+	{
+		result *= 2;
+	}
+	return result;
+}
@@ -0,0 +1,50 @@
+// Fft.h
+// Fast Fourier transforms for convolution. Real signals only, power of two sizes only.
+// Spectra are kept as separate real and imaginary arrays (GetBinCount() of each, DC up to Nyquist),
+// which is the layout the long runs of complex multiply-adds in convolution want.
+//
+// Everything is allocated when the size is set, so transforms can run on the audio thread.
+// One RealFft has its own scratch space, so each thread needs its own.
+
+#pragma once
+#include <vector>
+
+class RealFft
+{
+public:
+	RealFft();
+	explicit RealFft(unsigned size);
+
+	void SetSize(unsigned size);
+	unsigned GetSize() const { return size; }
+	unsigned GetBinCount() const { return size / 2 + 1; }
+
+	// size samples in, GetBinCount() bins out
+	void Forward(const float* input, float* real, float* imag);
+	// Back again. A round trip gives back what went in (it's scaled, not size times bigger)
+	void Inverse(const float* real, const float* imag, float* output);
+
+private:
+	// Complex FFT of half the size, in place. A real FFT of size N is a complex one of N/2 with
+	// the even samples as the real parts and the odd ones as the imaginary parts, plus a bit of untangling
+	void Transform(float* real, float* imag, bool inverse);
+
+	unsigned size;
+	unsigned half;
+	std::vector<unsigned> bitReverse;
+	// cos and sin of 2*pi*k/half, for the butterflies
+	std::vector<float> cosTable;
+	std::vector<float> sinTable;
+	// cos and sin of 2*pi*k/size, for the untangling
+	std::vector<float> splitCos;
+	std::vector<float> splitSin;
+	std::vector<float> workReal;
+	std::vector<float> workImag;
+};
+
+// y += a * b, for n complex numbers in split arrays. The inner loop of every convolution
+void ComplexMultiplyAdd(const float* aReal, const float* aImag, const float* bReal, const float* bImag,
+	float* yReal, float* yImag, unsigned n);
+
+// Smallest power of two that's at least 'value'
+unsigned RoundUpToPowerOfTwo(unsigned value);
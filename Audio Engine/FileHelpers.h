@@ -1,10 +1,27 @@
 #pragma once
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <stdio.h>
 
 
-bool fileExists(string filename)
+inline bool fileExists(std::string filename)
 {
     std::ifstream ifile(filename);
     return !ifile.fail();
-}
\ No newline at end of file
+}
+
+// fopen that keeps MSVC's SDL checks happy (it wants fopen_s) but still works everywhere else
+inline FILE* openFile(const char* filename, const char* mode)
+{
+#ifdef _WIN32
+    FILE* filePtr = nullptr;
+    if (fopen_s(&filePtr, filename, mode) != 0)
+    {
+        return nullptr;
+    }
+    return filePtr;
+#else
+    return fopen(filename, mode);
+#endif
+}
@@ -0,0 +1,33 @@
+#include "GargleEffect.h"
+#include <algorithm>
+#include <math.h>
+
+GargleEffect::GargleEffect() : Effect(ParameterCount), phase(0.0f)
+{
+	SetParameter(RateHz, 20.0f);
+	SetParameter(WaveShape, 0.0f);
+}
+
+void GargleEffect::Update()
+{
+	float rate = std::max(1.0f, std::min(1000.0f, Get(RateHz)));
+	phaseStep = rate / sampleRate;
+	square = Get(WaveShape) >= 0.5f;
+}
+
+void GargleEffect::Process(float* frames, unsigned frameCount)
+{
+	for (unsigned i = 0; i < frameCount; i++)
+	{
+		// Up from silence to full and back down again, once per cycle
+		float level = square ? (phase < 0.5f ? 1.0f : 0.0f) : 1.0f - fabsf(2.0f * phase - 1.0f);
+		frames[i * 2] *= level;
+		frames[i * 2 + 1] *= level;
+
+		phase += phaseStep;
+		if (phase >= 1.0f)
+		{
+			phase -= 1.0f;
+		}
+	}
+}
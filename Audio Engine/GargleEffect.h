@@ -0,0 +1,34 @@
+// GargleEffect.h
+// Native version of DirectSound's gargle: the volume gets wobbled up and down (amplitude modulation)
+// by a triangle or square wave. Takes the same parameters as DSFXGargle.
+
+#pragma once
+#include "EffectChain.h"
+
+class GargleEffect : public Effect
+{
+public:
+	enum Parameter
+	{
+		// 1 to 1000 Hz, default 20
+		RateHz,
+		// DSFXGARGLE_WAVE_TRIANGLE (0) or DSFXGARGLE_WAVE_SQUARE (1)
+		WaveShape,
+		ParameterCount
+	};
+
+	GargleEffect();
+
+	virtual const char* GetName() const override { return "Gargle"; }
+	virtual void Reset() override { phase = 0.0f; }
+
+protected:
+	virtual void Process(float* frames, unsigned frameCount) override;
+	virtual void Update() override;
+
+private:
+	// 0 to 1 through one cycle of the wave, and how far it moves per frame
+	float phase;
+	float phaseStep;
+	bool square;
+};
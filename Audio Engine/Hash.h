@@ -0,0 +1,146 @@
+// Hash.h
+// FNV-1a, a tiny string hash that's good enough for looking names up in tables.
+// It's constexpr, so names written in the code can be hashed by the compiler instead of at runtime.
+//
+// ContentHasher is for big blocks of data (what's in a sample) rather than names: FNV goes a byte at a time,
+// this goes 32 bytes at a time in four independent lanes, using xxHash64's rounds and final mix.
+// Neither is cryptographic, they're just quick and well spread.
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+static const uint64_t kFnvOffsetBasis = 14695981039346656037ull;
+static const uint64_t kFnvPrime = 1099511628211ull;
+
+constexpr uint64_t HashName(const char* name)
+{
+	uint64_t hash = kFnvOffsetBasis;
+	while (*name)
+	{
+		hash ^= (unsigned char)*name++;
+		hash *= kFnvPrime;
+	}
+	return hash;
+}
+
+constexpr uint64_t HashName(const char* name, size_t length)
+{
+	uint64_t hash = kFnvOffsetBasis;
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= (unsigned char)name[i];
+		hash *= kFnvPrime;
+	}
+	return hash;
+}
+
+// Hashes data fed in a piece at a time, any size pieces, coming out the same as if it had all been fed at once
+class ContentHasher
+{
+public:
+	explicit ContentHasher(uint64_t seed = 0) : tailSize(0), totalSize(0)
+	{
+		lanes[0] = seed + kPrime1 + kPrime2;
+		lanes[1] = seed + kPrime2;
+		lanes[2] = seed;
+		lanes[3] = seed - kPrime1;
+	}
+
+	void Add(const void* data, size_t size)
+	{
+		const unsigned char* bytes = (const unsigned char*)data;
+		totalSize += size;
+
+		// Finish off a stripe left over from last time first
+		if (tailSize > 0)
+		{
+			size_t take = size < kStripe - tailSize ? size : kStripe - tailSize;
+			memcpy(tail + tailSize, bytes, take);
+			tailSize += take;
+			bytes += take;
+			size -= take;
+			if (tailSize < kStripe)
+			{
+				return;
+			}
+			AddStripe(tail);
+			tailSize = 0;
+		}
+
+		for (; size >= kStripe; bytes += kStripe, size -= kStripe)
+		{
+			AddStripe(bytes);
+		}
+
+		memcpy(tail, bytes, size);
+		tailSize = size;
+	}
+
+	uint64_t Get() const
+	{
+		uint64_t hash;
+		if (totalSize >= kStripe)
+		{
+			hash = Rotate(lanes[0], 1) + Rotate(lanes[1], 7) + Rotate(lanes[2], 12) + Rotate(lanes[3], 18);
+			for (uint64_t lane : lanes)
+			{
+				hash = (hash ^ Round(0, lane)) * kPrime1 + kPrime4;
+			}
+		}
+		else
+		{
+			hash = lanes[2] + kPrime5;
+		}
+		hash += totalSize;
+
+		// Whatever's left that didn't make a whole stripe
+		size_t i = 0;
+		for (; i + 8 <= tailSize; i += 8)
+		{
+			hash = Rotate(hash ^ Round(0, Read64(tail + i)), 27) * kPrime1 + kPrime4;
+		}
+		for (; i < tailSize; i++)
+		{
+			hash = Rotate(hash ^ (tail[i] * kPrime5), 11) * kPrime1;
+		}
+
+		hash ^= hash >> 33;
+		hash *= kPrime2;
+		hash ^= hash >> 29;
+		hash *= kPrime3;
+		hash ^= hash >> 32;
+		return hash;
+	}
+
+private:
+	static const size_t kStripe = 32;
+	static const uint64_t kPrime1 = 11400714785074694791ull;
+	static const uint64_t kPrime2 = 14029467366897019727ull;
+	static const uint64_t kPrime3 = 1609587929392839161ull;
+	static const uint64_t kPrime4 = 9650029242287828579ull;
+	static const uint64_t kPrime5 = 2870177450012600261ull;
+
+	static uint64_t Rotate(uint64_t x, unsigned bits) { return (x << bits) | (x >> (64 - bits)); }
+	static uint64_t Round(uint64_t lane, uint64_t input) { return Rotate(lane + input * kPrime2, 31) * kPrime1; }
+	static uint64_t Read64(const unsigned char* bytes)
+	{
+		uint64_t value;
+		memcpy(&value, bytes, sizeof(value));
+		return value;
+	}
+
+	void AddStripe(const unsigned char* stripe)
+	{
+		for (unsigned lane = 0; lane < 4; lane++)
+		{
+			lanes[lane] = Round(lanes[lane], Read64(stripe + lane * 8));
+		}
+	}
+
+	uint64_t lanes[4];
+	unsigned char tail[kStripe];
+	size_t tailSize;
+	uint64_t totalSize;
+};
@@ -0,0 +1,65 @@
+#include "ImpulseResponse.h"
+#include "Fft.h"
+#include "Sample.h"
+#include <algorithm>
+
+// One channel of frames [start, end) of the IR, in pieces of blockFrames
+static void Partition(const std::vector<float>& ir, unsigned start, unsigned end, unsigned blockFrames, ConvolutionPartitions& partitions)
+{
+	RealFft fft(blockFrames * 2);
+	partitions.blockFrames = blockFrames;
+	partitions.binCount = fft.GetBinCount();
+	partitions.count = end > start ? (end - start + blockFrames - 1) / blockFrames : 0;
+	partitions.real.assign((size_t)partitions.count * partitions.binCount, 0.0f);
+	partitions.imag.assign((size_t)partitions.count * partitions.binCount, 0.0f);
+
+	// Each piece goes in the first half of its FFT, the second half is the zero padding that stops it wrapping round
+	std::vector<float> padded(blockFrames * 2);
+	for (unsigned i = 0; i < partitions.count; i++)
+	{
+		std::fill(padded.begin(), padded.end(), 0.0f);
+		unsigned from = start + i * blockFrames;
+		unsigned count = std::min(blockFrames, end - from);
+		std::copy(ir.begin() + from, ir.begin() + from + count, padded.begin());
+		fft.Forward(padded.data(), partitions.real.data() + (size_t)i * partitions.binCount, partitions.imag.data() + (size_t)i * partitions.binCount);
+	}
+}
+
+std::shared_ptr<const ImpulseResponse> ImpulseResponse::Create(const Sample& sample, unsigned blockFrames)
+{
+	if (sample.frameCount == 0 || sample.channels == 0)
+	{
+		return nullptr;
+	}
+
+	std::shared_ptr<ImpulseResponse> result(new ImpulseResponse());
+	result->channels = std::min(sample.channels, 2u);
+	result->sampleRate = sample.sampleRate;
+	result->frameCount = sample.frameCount;
+	result->headBlockFrames = RoundUpToPowerOfTwo(std::max(blockFrames, 16u));
+
+	const unsigned tailStart = result->GetTailStart();
+	const unsigned headEnd = std::min(sample.frameCount, tailStart);
+
+	std::vector<float> channel(sample.frameCount);
+	for (unsigned c = 0; c < result->channels; c++)
+	{
+		// Pulled out of the interleaved frames, whatever format they're in
+		for (unsigned i = 0; i < sample.frameCount; i++)
+		{
+			size_t index = (size_t)i * sample.channels + c;
+			if (sample.format == SampleFormat::Int16)
+			{
+				channel[i] = sample.GetFrames<int16_t>()[index] * (1.0f / 32768.0f);
+			}
+			else
+			{
+				channel[i] = sample.GetFrames<float>()[index];
+			}
+		}
+
+		Partition(channel, 0, headEnd, result->headBlockFrames, result->head[c]);
+		Partition(channel, tailStart, sample.frameCount, result->GetTailBlockFrames(), result->tail[c]);
+	}
+	return result;
+}
@@ -0,0 +1,62 @@
+// ImpulseResponse.h
+// A recorded impulse response (a hall, a room, a spring tank...) cut into pieces and turned into spectra,
+// ready for ConvolutionEffect. The FFTs are the slow part, so they're done once when the IR is loaded
+// and every effect using it shares the one copy.
+//
+// It's cut up two ways. The first stretch (the head) goes in small partitions the size of a mixer block,
+// so the early part of the reverb comes out with no added latency. Everything after that (the tail)
+// goes in partitions sixteen times bigger, which take far fewer operations per sample, and since the
+// tail doesn't start until two of those partitions in, there's time to do it on another thread.
+
+#pragma once
+#include <memory>
+#include <vector>
+
+struct Sample;
+
+// A stretch of one channel of an IR, as the spectra of equal length pieces
+struct ConvolutionPartitions
+{
+	// Length of each piece. The FFTs are twice that
+	unsigned blockFrames = 0;
+	unsigned binCount = 0;
+	unsigned count = 0;
+	// count * binCount of each, one partition after another
+	std::vector<float> real;
+	std::vector<float> imag;
+
+	const float* GetReal(unsigned partition) const { return real.data() + (size_t)partition * binCount; }
+	const float* GetImag(unsigned partition) const { return imag.data() + (size_t)partition * binCount; }
+};
+
+class ImpulseResponse
+{
+public:
+	// The tail's partitions are this many times the head's
+	static const unsigned kTailBlockMultiple = 16;
+
+	// headBlockFrames is the mixer's block size (rounded up to a power of two). Returns null if the sample is empty
+	static std::shared_ptr<const ImpulseResponse> Create(const Sample& sample, unsigned headBlockFrames);
+
+	unsigned GetChannels() const { return channels; }
+	unsigned GetSampleRate() const { return sampleRate; }
+	unsigned GetFrameCount() const { return frameCount; }
+
+	const ConvolutionPartitions& GetHead(unsigned channel) const { return head[channel < channels ? channel : 0]; }
+	const ConvolutionPartitions& GetTail(unsigned channel) const { return tail[channel < channels ? channel : 0]; }
+	unsigned GetHeadBlockFrames() const { return headBlockFrames; }
+	unsigned GetTailBlockFrames() const { return headBlockFrames * kTailBlockMultiple; }
+	// Where the tail starts in the IR, in frames
+	unsigned GetTailStart() const { return GetTailBlockFrames() * 2; }
+	bool HasTail() const { return frameCount > GetTailStart(); }
+
+private:
+	ImpulseResponse() = default;
+
+	unsigned channels = 0;
+	unsigned sampleRate = 0;
+	unsigned frameCount = 0;
+	unsigned headBlockFrames = 0;
+	ConvolutionPartitions head[2];
+	ConvolutionPartitions tail[2];
+};
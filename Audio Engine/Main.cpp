@@ -1,12 +1,116 @@
 #include <iostream>
 #include <string>
+#include <string.h>
+#include <stdlib.h>
 #include "Sound.h"
+#include "WavFileBackend.h"
+#include "SoundBankBuilder.h"
+#include "MixBenchmark.h"
 
-int main()
+// Audio Engine --build-bank <out.bank> [--int16] <file.wav or folder>...
+// Packs the files into one sound bank that SoundEngine::LoadSoundBank() can open
+static int BuildBank(int argc, char* argv[])
 {
+	if (argc < 4)
+	{
+		std::cout << "Usage: " << argv[0] << " --build-bank <out.bank> [--int16] <file.wav or folder>..." << std::endl;
+		return 1;
+	}
+
+	SoundBankBuilder builder;
+	SampleFormat format = SampleFormat::Float32;
+	bool ok = true;
+	for (int i = 3; i < argc; i++)
+	{
+		std::string input = argv[i];
+		if (input == "--int16")
+		{
+			format = SampleFormat::Int16;
+		}
+		else if (input.size() > 4 && input.compare(input.size() - 4, 4, ".wav") == 0)
+		{
+			ok = builder.AddFile(input) && ok;
+		}
+		else
+		{
+			ok = builder.AddDirectory(input) && ok;
+		}
+	}
+
+	if (!ok || !builder.Write(argv[2], format))
+	{
+		return 1;
+	}
+	return 0;
+}
+
+// Audio Engine --make-notes <folder> [--rate <Hz>] [--mono] [--float] [--seconds <s>] [--overwrite]
+// Writes a .wav of every note, C0 to B8
+static int WriteNotes(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		std::cout << "Usage: " << argv[0] << " --make-notes <folder> [--rate <Hz>] [--mono] [--float] [--seconds <s>] [--overwrite]" << std::endl;
+		return 1;
+	}
+
+	NoteRenderOptions options;
+	options.folder = argv[2];
+	for (int i = 3; i < argc; i++)
+	{
+		std::string option = argv[i];
+		if (option == "--rate" && i + 1 < argc)
+		{
+			options.sampleRate = (unsigned)atoi(argv[++i]);
+		}
+		else if (option == "--seconds" && i + 1 < argc)
+		{
+			options.seconds = (float)atof(argv[++i]);
+		}
+		else if (option == "--mono")
+		{
+			options.channels = 1;
+		}
+		else if (option == "--float")
+		{
+			options.bitsPerSample = 32;
+		}
+		else if (option == "--overwrite")
+		{
+			options.skipExisting = false;
+		}
+	}
+	return MakeNotes(options) ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1 && strcmp(argv[1], "--build-bank") == 0)
+	{
+		return BuildBank(argc, argv);
+	}
+	if (argc > 1 && strcmp(argv[1], "--make-notes") == 0)
+	{
+		return WriteNotes(argc, argv);
+	}
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+	{
+		return RunMixBenchmark();
+	}
+
+#ifdef _WIN32
 	HWND windowHandle = GetConsoleWindow();
 	SoundEngine::GetInstance().Initialize(windowHandle);
+#else
+	// No DirectSound here, so record the mix to a file instead of playing it
+	SoundEngine::GetInstance().Initialize(std::unique_ptr<AudioBackend>(new WavFileBackend("./Output.wav", true)));
+#endif
 	PlayASound("./Bells.wav", true, FX::DISTORTION, DSBVOLUME_MAX, DSBFREQUENCY_ORIGINAL, DSBPAN_CENTER);
+#ifdef _WIN32
 	system("pause");
+#else
+	std::cout << "Press enter to stop..." << std::endl;
+	std::cin.get();
+#endif
 	return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,196 @@
+#include "MappedFile.h"
+#include "ConsoleColor.h"
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : data(nullptr), size(0)
+#ifdef _WIN32
+	, fileHandle(nullptr), mappingHandle(nullptr)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const char* filename)
+{
+	Close();
+
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		std::cout << red << "ERROR: Couldn't open " << filename << " for mapping!" << white << std::endl;
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		std::cout << red << "ERROR: Couldn't get the size of " << filename << white << std::endl;
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping)
+	{
+		std::cout << red << "ERROR: Couldn't create a file mapping for " << filename << white << std::endl;
+		CloseHandle(file);
+		return false;
+	}
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!view)
+	{
+		std::cout << red << "ERROR: Couldn't map a view of " << filename << white << std::endl;
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	fileHandle = file;
+	mappingHandle = mapping;
+	data = (const unsigned char*)view;
+	size = (size_t)fileSize.QuadPart;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data)
+	{
+		UnmapViewOfFile(data);
+		data = nullptr;
+	}
+	if (mappingHandle)
+	{
+		CloseHandle(mappingHandle);
+		mappingHandle = nullptr;
+	}
+	if (fileHandle)
+	{
+		CloseHandle(fileHandle);
+		fileHandle = nullptr;
+	}
+	size = 0;
+}
+
+void MappedFile::Advise(AccessHint hint)
+{
+	// Windows picks its read-ahead when the file is opened, there's nothing to change afterwards
+}
+
+void MappedFile::Prefetch(size_t offset, size_t length)
+{
+	if (!data || offset >= size)
+	{
+		return;
+	}
+	if (length > size - offset)
+	{
+		length = size - offset;
+	}
+
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = (void*)(data + offset);
+	range.NumberOfBytes = length;
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+#else
+
+bool MappedFile::Open(const char* filename)
+{
+	Close();
+
+	int file = open(filename, O_RDONLY);
+	if (file < 0)
+	{
+		std::cout << red << "ERROR: Couldn't open " << filename << " for mapping!" << white << std::endl;
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(file, &info) != 0 || info.st_size == 0)
+	{
+		std::cout << red << "ERROR: Couldn't get the size of " << filename << white << std::endl;
+		close(file);
+		return false;
+	}
+
+	void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, file, 0);
+
+	// The mapping keeps its own reference to the file, so we can close it straight away
+	close(file);
+
+	if (view == MAP_FAILED)
+	{
+		std::cout << red << "ERROR: Couldn't map " << filename << white << std::endl;
+		return false;
+	}
+
+	data = (const unsigned char*)view;
+	size = (size_t)info.st_size;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data)
+	{
+		munmap((void*)data, size);
+		data = nullptr;
+	}
+	size = 0;
+}
+
+void MappedFile::Advise(AccessHint hint)
+{
+	if (!data)
+	{
+		return;
+	}
+
+	int advice = MADV_NORMAL;
+	if (hint == AccessHint::Sequential)
+	{
+		advice = MADV_SEQUENTIAL;
+	}
+	else if (hint == AccessHint::Random)
+	{
+		advice = MADV_RANDOM;
+	}
+	madvise((void*)data, size, advice);
+}
+
+void MappedFile::Prefetch(size_t offset, size_t length)
+{
+	if (!data || offset >= size)
+	{
+		return;
+	}
+	if (length > size - offset)
+	{
+		length = size - offset;
+	}
+
+	// madvise wants a page-aligned start
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	size_t alignedOffset = offset - (offset % pageSize);
+	madvise((void*)(data + alignedOffset), length + (offset - alignedOffset), MADV_WILLNEED);
+}
+
+#endif
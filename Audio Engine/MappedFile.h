@@ -0,0 +1,50 @@
+// MappedFile.h
+// Read-only memory mapping of a whole file (mmap on Linux, a file mapping on Windows).
+// Mapping is basically free: nothing gets read until you touch a page, and the pages live in the
+// OS's file cache, so every process that maps the same file shares one copy.
+// That means a sound can play straight out of the mapping without us ever copying it.
+
+#pragma once
+#include <stddef.h>
+
+class MappedFile
+{
+public:
+	// Tells the OS how we're going to read the file, so it can read ahead (or not) to suit
+	enum class AccessHint
+	{
+		Normal,
+		// Front to back, like playing a sound. Reads ahead aggressively
+		Sequential,
+		// Jumping about, like looking things up in an index. Don't bother reading ahead
+		Random
+	};
+
+	MappedFile();
+	~MappedFile();
+
+	// No copying, there's only one mapping to unmap
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool Open(const char* filename);
+	void Close();
+
+	bool IsOpen() const { return data != nullptr; }
+	const unsigned char* GetData() const { return data; }
+	size_t GetSize() const { return size; }
+
+	// Optional hints, both are just advice and fine to skip
+	void Advise(AccessHint hint);
+	// Ask the OS to start paging in part of the file now, in the background, so it's there when we need it
+	void Prefetch(size_t offset, size_t length);
+
+private:
+	const unsigned char* data;
+	size_t size;
+
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#endif
+};
@@ -0,0 +1,159 @@
+// MidiNotes.h
+// Every MIDI note's frequency, name and period, worked out by the compiler rather than every time a note plays.
+// Notes are numbered the MIDI way: 0 is C-1, 60 is middle C (C4), 69 is A4 at 440Hz, 127 is G9.
+// Equal temperament, so each note is the twelfth root of 2 above the one before.
+//
+// Looking a note up is an array index, so a sequencer can go straight from note numbers to frequencies without
+// touching a string. Names ("A4", "C#3", "Bb2"...) can still be turned into note numbers with GetMidiNote(),
+// which doesn't allocate either.
+
+#pragma once
+
+static const unsigned kMidiNoteCount = 128;
+// The rate MidiNote::period is in frames at, the engine's (Mixer::kDefaultSampleRate)
+static const unsigned kMidiPeriodRate = 44100;
+
+struct MidiNote
+{
+	// In Hz
+	float frequency;
+	// One cycle, in frames at kMidiPeriodRate
+	float period;
+	// "C-1", "C#4"... always sharps
+	char name[5];
+};
+
+namespace MidiTables
+{
+	// 2^(n/12), one octave's worth
+	inline constexpr double kSemitoneRatios[12] =
+	{
+		1.0,
+		1.0594630943592953,
+		1.122462048309373,
+		1.189207115002721,
+		1.2599210498948732,
+		1.3348398541700344,
+		1.4142135623730951,
+		1.4983070768766815,
+		1.5874010519681994,
+		1.681792830507429,
+		1.7817974362806785,
+		1.8877486253633868,
+	};
+
+	// C-1, 69 semitones under A4
+	inline constexpr double kLowestC = 8.175798915643707;
+
+	inline constexpr const char* kNoteNames[12] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+
+	struct Table
+	{
+		MidiNote notes[kMidiNoteCount];
+	};
+
+	constexpr Table Build()
+	{
+		Table table = {};
+		for (unsigned note = 0; note < kMidiNoteCount; note++)
+		{
+			unsigned octave = note / 12;
+			double frequency = kLowestC * kSemitoneRatios[note % 12];
+			for (unsigned i = 0; i < octave; i++)
+			{
+				frequency *= 2.0;
+			}
+
+			MidiNote& entry = table.notes[note];
+			entry.frequency = (float)frequency;
+			entry.period = (float)(kMidiPeriodRate / frequency);
+
+			// Octaves start at -1
+			unsigned length = 0;
+			for (const char* letter = kNoteNames[note % 12]; *letter; letter++)
+			{
+				entry.name[length++] = *letter;
+			}
+			if (octave == 0)
+			{
+				entry.name[length++] = '-';
+				entry.name[length++] = '1';
+			}
+			else
+			{
+				entry.name[length++] = (char)('0' + octave - 1);
+			}
+			entry.name[length] = '\0';
+		}
+		return table;
+	}
+
+	inline constexpr Table kTable = Build();
+}
+
+constexpr const MidiNote& GetMidiNoteInfo(unsigned note)
+{
+	return MidiTables::kTable.notes[note < kMidiNoteCount ? note : kMidiNoteCount - 1];
+}
+
+constexpr float GetMidiFrequency(unsigned note)
+{
+	return GetMidiNoteInfo(note).frequency;
+}
+
+// At any rate, not just kMidiPeriodRate
+constexpr float GetMidiPeriod(unsigned note, unsigned sampleRate = kMidiPeriodRate)
+{
+	return sampleRate == kMidiPeriodRate ? GetMidiNoteInfo(note).period : sampleRate / GetMidiNoteInfo(note).frequency;
+}
+
+constexpr const char* GetMidiNoteName(unsigned note)
+{
+	return GetMidiNoteInfo(note).name;
+}
+
+// Turns a note name into its number: a letter, then any sharps (#) or flats (b), then the octave (-1 to 9).
+// Returns -1 if it isn't a note, or is one MIDI doesn't go to (like G#9)
+constexpr int GetMidiNote(const char* name)
+{
+	if (!name)
+	{
+		return -1;
+	}
+
+	// Semitones above C for A to G
+	constexpr int kLetterSemitones[7] = { 9, 11, 0, 2, 4, 5, 7 };
+	char letter = name[0];
+	if (letter >= 'a' && letter <= 'g')
+	{
+		letter = (char)(letter - 'a' + 'A');
+	}
+	if (letter < 'A' || letter > 'G')
+	{
+		return -1;
+	}
+	int semitone = kLetterSemitones[letter - 'A'];
+
+	const char* c = name + 1;
+	for (; *c == '#' || *c == 'b'; c++)
+	{
+		semitone += *c == '#' ? 1 : -1;
+	}
+
+	bool negative = *c == '-';
+	if (negative)
+	{
+		c++;
+	}
+	if (*c < '0' || *c > '9' || c[1] != '\0')
+	{
+		return -1;
+	}
+	int octave = negative ? -(*c - '0') : *c - '0';
+
+	int note = (octave + 1) * 12 + semitone;
+	return note >= 0 && note < (int)kMidiNoteCount ? note : -1;
+}
+
+static_assert(GetMidiNote("A4") == 69 && GetMidiNote("C-1") == 0 && GetMidiNote("G9") == 127, "MIDI note numbering is off");
+static_assert(GetMidiFrequency(69) == 440.0f, "A4 should be exactly 440Hz");
@@ -0,0 +1,302 @@
+#include "MixBenchmark.h"
+#include "MixKernels.h"
+#include "Mixer.h"
+#include "EffectChain.h"
+#include "DistortionEffect.h"
+#include "GargleEffect.h"
+#include "EqEffect.h"
+#include "ReverbEffect.h"
+#include "ChorusEffect.h"
+#include "EchoEffect.h"
+#include "CompressorEffect.h"
+#include "ConsoleColor.h"
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string.h>
+#include <vector>
+
+// Small enough to sit in cache, the way a mixer block does
+static const unsigned kBenchFrames = 1024;
+// Run each test for at least this long so the timer's resolution doesn't matter
+static const double kMinSeconds = 0.2;
+
+// Calls 'work' (which handles 'frames' frames each time) over and over, and returns frames per second
+static double Measure(const std::function<void()>& work, unsigned frames)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	// Once to warm up the caches (and get the CPU out of any low power state)
+	work();
+
+	unsigned long long calls = 0;
+	double seconds = 0.0;
+	auto start = Clock::now();
+	while (seconds < kMinSeconds)
+	{
+		for (int i = 0; i < 64; i++)
+		{
+			work();
+		}
+		calls += 64;
+		seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	}
+	return calls * frames / seconds;
+}
+
+static void PrintRow(const char* name, const std::vector<double>& framesPerSecond)
+{
+	std::cout << "  " << std::left << std::setw(20) << name << std::right;
+	for (double rate : framesPerSecond)
+	{
+		std::cout << std::setw(12) << std::fixed << std::setprecision(1) << rate / 1000000.0;
+	}
+	if (framesPerSecond.size() > 1)
+	{
+		std::cout << "   x" << std::setprecision(2) << framesPerSecond.back() / framesPerSecond.front();
+	}
+	std::cout << std::endl;
+}
+
+static void BenchKernels(const std::vector<const MixKernels*>& sets)
+{
+	// Noise-ish input that stays inside -1..1 but clips once it's been gained up a bit
+	std::vector<float> stereo((size_t)kBenchFrames * 2);
+	std::vector<float> mono(kBenchFrames);
+	std::vector<int16_t> pcm((size_t)kBenchFrames * 2);
+	for (size_t i = 0; i < stereo.size(); i++)
+	{
+		stereo[i] = (float)((i * 7919) % 2000) / 1000.0f - 1.0f;
+		pcm[i] = (int16_t)(stereo[i] * 32767.0f);
+	}
+	for (size_t i = 0; i < mono.size(); i++)
+	{
+		mono[i] = stereo[i * 2];
+	}
+	std::vector<float> out(stereo.size(), 0.0f);
+	std::vector<float> clipped(stereo.size());
+	std::vector<int16_t> pcmOut(stereo.size());
+
+	std::cout << blue << "Kernels, millions of stereo frames a second:" << white << std::endl;
+	std::cout << "  " << std::left << std::setw(20) << "" << std::right;
+	for (const MixKernels* kernels : sets)
+	{
+		std::cout << std::setw(12) << kernels->name;
+	}
+	std::cout << "   best vs scalar" << std::endl;
+
+	std::vector<double> rates;
+
+	rates.clear();
+	for (const MixKernels* k : sets)
+	{
+		rates.push_back(Measure([&] { k->accumulate(out.data(), stereo.data(), 0.5f, stereo.size()); }, kBenchFrames));
+	}
+	PrintRow("accumulate", rates);
+
+	rates.clear();
+	for (const MixKernels* k : sets)
+	{
+		rates.push_back(Measure([&] { k->accumulateStereo(out.data(), stereo.data(), 0.5f, 0.25f, kBenchFrames); }, kBenchFrames));
+	}
+	PrintRow("accumulateStereo", rates);
+
+	rates.clear();
+	for (const MixKernels* k : sets)
+	{
+		rates.push_back(Measure([&] { k->accumulatePanned(out.data(), mono.data(), 0.5f, 0.25f, kBenchFrames); }, kBenchFrames));
+	}
+	PrintRow("accumulatePanned", rates);
+
+	rates.clear();
+	for (const MixKernels* k : sets)
+	{
+		rates.push_back(Measure([&] { k->int16ToFloat(out.data(), pcm.data(), pcm.size()); }, kBenchFrames));
+	}
+	PrintRow("int16ToFloat", rates);
+
+	// The rest of the .wav formats, from the same bytes (what's in them doesn't change how long they take)
+	const uint8_t* bytes = (const uint8_t*)pcm.data();
+	rates.clear();
+	for (const MixKernels* k : sets)
+	{
+		rates.push_back(Measure([&] { k->uint8ToFloat(out.data(), bytes, pcm.size()); }, kBenchFrames));
+	}
+	PrintRow("uint8ToFloat", rates);
+
+	std::vector<uint8_t> wide(stereo.size() * 4);
+	memcpy(wide.data(), stereo.data(), wide.size());
+	rates.clear();
+	for (const MixKernels* k : sets)
+	{
+		rates.push_back(Measure([&] { k->int24ToFloat(out.data(), wide.data(), stereo.size()); }, kBenchFrames));
+	}
+	PrintRow("int24ToFloat", rates);
+
+	rates.clear();
+	for (const MixKernels* k : sets)
+	{
+		rates.push_back(Measure([&] { k->int32ToFloat(out.data(), wide.data(), stereo.size()); }, kBenchFrames));
+	}
+	PrintRow("int32ToFloat", rates);
+
+	rates.clear();
+	for (const MixKernels* k : sets)
+	{
+		rates.push_back(Measure([&] { k->floatToInt16(pcmOut.data(), stereo.data(), stereo.size()); }, kBenchFrames));
+	}
+	PrintRow("floatToInt16", rates);
+
+	rates.clear();
+	for (const MixKernels* k : sets)
+	{
+		// Clip a fresh copy each time, otherwise after the first go there's nothing left to clip
+		rates.push_back(Measure([&] { clipped = stereo; k->clip(clipped.data(), clipped.size(), 0.5f); }, kBenchFrames));
+	}
+	PrintRow("clip (+ copy)", rates);
+
+	// The same frames compressed, decoded a whole buffer at a time
+	Sample compressed;
+	compressed.channels = 2;
+	compressed.sampleRate = 44100;
+	compressed.frameCount = kBenchFrames;
+	compressed.storage = stereo;
+	compressed.frames = compressed.storage.data();
+	CompressSample(compressed);
+	rates.clear();
+	for (const MixKernels* k : sets)
+	{
+		rates.push_back(Measure([&] { k->decodeAdpcm(out.data(), compressed.GetFrames<uint8_t>(), kBenchFrames / kAdpcmUnitFrames * 2, 2); }, kBenchFrames));
+	}
+	PrintRow("decodeAdpcm", rates);
+}
+
+static const char* const kQualityNames[] = { "linear", "medium (8 taps)", "high (16 taps)", "best (32 taps)" };
+
+// Every voice busy, half of them mono and half stereo. At pitch 1 they take the SIMD path,
+// at any other pitch they're resampled: through the polyphase kernel, or a frame at a time if that's linear.
+// Compressed, every voice decodes its frames as well
+static void BenchMixer(const std::vector<const MixKernels*>& sets, float pitch, ResampleQuality quality, bool compress = false)
+{
+	Mixer mixer;
+	mixer.SetResampleQuality(quality);
+	const unsigned rate = mixer.GetSampleRate();
+	const unsigned voiceCount = Mixer::kDefaultMaxVoices;
+
+	Sample samples[2];
+	for (unsigned s = 0; s < 2; s++)
+	{
+		Sample& sample = samples[s];
+		sample.channels = s + 1;
+		sample.sampleRate = rate;
+		sample.frameCount = rate;
+		sample.storage.resize((size_t)sample.frameCount * sample.channels);
+		for (size_t i = 0; i < sample.storage.size(); i++)
+		{
+			sample.storage[i] = (float)((i * 7919) % 2000) / 1000.0f - 1.0f;
+		}
+		sample.frames = sample.storage.data();
+		if (compress)
+		{
+			CompressSample(sample);
+		}
+	}
+
+	std::vector<float> out((size_t)mixer.GetBlockFrames() * Mixer::kChannels);
+	std::vector<double> rates;
+	for (const MixKernels* kernels : sets)
+	{
+		mixer.Reset();
+		mixer.SetKernels(*kernels);
+		for (unsigned v = 0; v < voiceCount; v++)
+		{
+			VoiceParams params;
+			params.gain = 1.0f / voiceCount;
+			params.pan = (float)v / voiceCount * 2.0f - 1.0f;
+			params.pitch = pitch;
+			params.looping = true;
+			params.startFrame = v * 97;
+			mixer.Play(&samples[v % 2], params);
+		}
+		rates.push_back(Measure([&] { mixer.Render(out.data(), mixer.GetBlockFrames()); }, mixer.GetBlockFrames()));
+	}
+	mixer.Reset();
+
+	std::cout << std::endl << blue << voiceCount << (compress ? " compressed" : "") << " voices at pitch " << pitch;
+	if (pitch != 1.0f)
+	{
+		std::cout << ", " << kQualityNames[(int)quality] << " resampling";
+	}
+	std::cout << ", millions of output frames a second:" << white << std::endl;
+	PrintRow("Mixer::Render", rates);
+	for (size_t i = 0; i < sets.size(); i++)
+	{
+		// How much of one core it takes to keep up with real time
+		std::cout << "  " << std::setw(8) << sets[i]->name << ": " << std::fixed << std::setprecision(1)
+			<< rates[i] / rate << "x real time, " << std::setprecision(2) << 100.0 * rate / rates[i] << "% of a core" << std::endl;
+	}
+}
+
+// Each native effect on its own, a mixer block at a time (whatever the best kernels are, for the ones that use them)
+static void BenchEffects()
+{
+	const unsigned rate = 44100;
+	const unsigned blockFrames = 256;
+
+	std::vector<std::unique_ptr<EffectChain>> chains;
+	auto add = [&](EffectChain* chain) { chains.emplace_back(chain); return chain; };
+	add(new EffectChain(rate, blockFrames))->Add<DistortionEffect>();
+	add(new EffectChain(rate, blockFrames))->Add<GargleEffect>();
+	EqEffect* eq = add(new EffectChain(rate, blockFrames))->Add<EqEffect>();
+	for (unsigned band = 0; band < EqEffect::kBands; band++)
+	{
+		eq->SetParameter(EqEffect::BandParameter(band, EqEffect::Type), (float)BiquadType::Peaking);
+	}
+	add(new EffectChain(rate, blockFrames))->Add<ReverbEffect>();
+	add(new EffectChain(rate, blockFrames))->Add<ChorusEffect>();
+	add(new EffectChain(rate, blockFrames))->Add<FlangerEffect>();
+	add(new EffectChain(rate, blockFrames))->Add<EchoEffect>();
+	add(new EffectChain(rate, blockFrames))->Add<CompressorEffect>();
+
+	std::vector<float> block((size_t)blockFrames * 2);
+	std::cout << std::endl << blue << "Effects, " << blockFrames << " frame blocks, millions of stereo frames a second:" << white << std::endl;
+	for (const std::unique_ptr<EffectChain>& chain : chains)
+	{
+		double framesPerSecond = Measure([&]
+		{
+			for (size_t i = 0; i < block.size(); i++)
+			{
+				block[i] = (float)((i * 7919) % 2000) / 1000.0f - 1.0f;
+			}
+			chain->Process(block.data(), blockFrames);
+		}, blockFrames);
+
+		std::vector<double> rates(1, framesPerSecond);
+		PrintRow(chain->GetEffect(0)->GetName(), rates);
+	}
+}
+
+int RunMixBenchmark()
+{
+	std::vector<const MixKernels*> sets;
+	for (int level = 0; level < (int)SimdLevel::Count; level++)
+	{
+		const MixKernels* kernels = GetMixKernels((SimdLevel)level);
+		if (kernels)
+		{
+			sets.push_back(kernels);
+		}
+	}
+	std::cout << green << "Best kernels on this CPU: " << GetMixKernels().name << white << std::endl << std::endl;
+
+	BenchKernels(sets);
+	BenchMixer(sets, 1.0f, ResampleQuality::High);
+	BenchMixer(sets, 1.0f, ResampleQuality::High, true);
+	for (int quality = 0; quality < (int)ResampleQuality::Count; quality++)
+	{
+		BenchMixer(sets, 1.5f, (ResampleQuality)quality);
+	}
+	BenchEffects();
+	return 0;
+}
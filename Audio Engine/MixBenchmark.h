@@ -0,0 +1,8 @@
+// MixBenchmark.h
+// "Audio Engine --bench": times every mixing kernel on every instruction set this CPU has,
+// then a full mixer with every voice busy, then each of the native effects, and prints how many frames
+// a second each one manages.
+
+#pragma once
+
+int RunMixBenchmark();
@@ -0,0 +1,346 @@
+#include "MixKernels.h"
+#include "Biquad.h"
+#include "Resampler.h"
+#include "Adpcm.h"
+#include <math.h>
+#include <string.h>
+
+#ifdef MIX_KERNELS_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <xmmintrin.h>
+#endif
+
+// ********************** Plain C++ ******************************* //
+// The reference versions. Everything else has to match these exactly
+
+static void Accumulate(float* out, const float* in, float gain, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		out[i] += in[i] * gain;
+	}
+}
+
+static void AccumulateStereo(float* out, const float* in, float gainLeft, float gainRight, size_t frameCount)
+{
+	for (size_t i = 0; i < frameCount; i++)
+	{
+		out[i * 2] += in[i * 2] * gainLeft;
+		out[i * 2 + 1] += in[i * 2 + 1] * gainRight;
+	}
+}
+
+static void AccumulatePanned(float* out, const float* in, float gainLeft, float gainRight, size_t frameCount)
+{
+	for (size_t i = 0; i < frameCount; i++)
+	{
+		out[i * 2] += in[i] * gainLeft;
+		out[i * 2 + 1] += in[i] * gainRight;
+	}
+}
+
+static void Int16ToFloat(float* out, const int16_t* in, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		out[i] = in[i] * (1.0f / 32768.0f);
+	}
+}
+
+static void Uint8ToFloat(float* out, const uint8_t* in, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		out[i] = ((int)in[i] - 128) * (1.0f / 128.0f);
+	}
+}
+
+// Both put the value in the top bits of an int32, so 24-bit and 32-bit come out on the same scale
+static void Int24ToFloat(float* out, const uint8_t* in, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		const uint8_t* bytes = in + i * 3;
+		int32_t value = (int32_t)(((uint32_t)bytes[0] << 8) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 24));
+		out[i] = value * (1.0f / 2147483648.0f);
+	}
+}
+
+static void Int32ToFloat(float* out, const uint8_t* in, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		int32_t value;
+		memcpy(&value, in + i * 4, sizeof(value));
+		out[i] = value * (1.0f / 2147483648.0f);
+	}
+}
+
+static void FloatToInt16(int16_t* out, const float* in, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		float value = in[i] * 32767.0f;
+		value = value > 32767.0f ? 32767.0f : (value < -32768.0f ? -32768.0f : value);
+		out[i] = (int16_t)value;
+	}
+}
+
+static void Clip(float* samples, size_t count, float limit)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		float value = samples[i];
+		samples[i] = value > limit ? limit : (value < -limit ? -limit : value);
+	}
+}
+
+static void ProcessBiquadStage(BiquadStage& stage, float* frames, size_t frameCount)
+{
+	// A lane at a time over the whole block (band 0 left, band 0 right, band 1 left...)
+	for (unsigned lane = 0; lane < BiquadStage::kLanes; lane++)
+	{
+		const float b0 = stage.b0[lane];
+		const float b1 = stage.b1[lane];
+		const float b2 = stage.b2[lane];
+		const float a1 = stage.a1[lane];
+		const float a2 = stage.a2[lane];
+		float z1 = stage.z1[lane];
+		float z2 = stage.z2[lane];
+
+		float* samples = frames + (lane & 1);
+		for (size_t i = 0; i < frameCount; i++)
+		{
+			float x = samples[i * 2];
+			float y = b0 * x + z1;
+			z1 = b1 * x - a1 * y + z2;
+			z2 = b2 * x - a2 * y;
+			samples[i * 2] = y;
+		}
+
+		stage.z1[lane] = z1;
+		stage.z2[lane] = z2;
+	}
+}
+
+static void MeasureLevel(const float* samples, size_t count, float* peak, float* sumOfSquares)
+{
+	float lanes[8] = {};
+	float loudest = 0.0f;
+	for (size_t i = 0; i < count; i++)
+	{
+		float value = samples[i];
+		float magnitude = fabsf(value);
+		loudest = magnitude > loudest ? magnitude : loudest;
+		lanes[i & 7] += value * value;
+	}
+	*peak = loudest;
+	*sumOfSquares = SumLevelLanes(lanes);
+}
+
+static void Polyphase(float* out, const float* window, unsigned channels, double position, double step,
+	unsigned frameCount, const PolyphaseTable& table)
+{
+	const unsigned count = table.taps * channels;
+	for (unsigned j = 0; j < frameCount; j++)
+	{
+		double at = position + j * step;
+		size_t index = (size_t)at;
+		double scaled = (at - index) * PolyphaseTable::kPhases;
+		unsigned phase = (unsigned)scaled;
+		float blend = (float)(scaled - phase);
+
+		// The two phases either side of where this frame falls, blended after
+		const float* source = window + index * channels;
+		const float* first = channels == 1 ? table.GetMono(phase) : table.GetStereo(phase);
+		const float* second = channels == 1 ? table.GetMono(phase + 1) : table.GetStereo(phase + 1);
+		float lanesFirst[8] = {};
+		float lanesSecond[8] = {};
+		for (unsigned k = 0; k < count; k++)
+		{
+			lanesFirst[k & 7] += source[k] * first[k];
+			lanesSecond[k & 7] += source[k] * second[k];
+		}
+
+		if (channels == 1)
+		{
+			float a = SumLevelLanes(lanesFirst);
+			float b = SumLevelLanes(lanesSecond);
+			out[j] = a + (b - a) * blend;
+		}
+		else
+		{
+			float leftA, rightA, leftB, rightB;
+			SumStereoLanes(lanesFirst, &leftA, &rightA);
+			SumStereoLanes(lanesSecond, &leftB, &rightB);
+			out[j * 2] = leftA + (leftB - leftA) * blend;
+			out[j * 2 + 1] = rightA + (rightB - rightA) * blend;
+		}
+	}
+}
+
+static void DecodeAdpcm(float* out, const uint8_t* units, unsigned unitCount, unsigned channels)
+{
+	for (unsigned u = 0; u < unitCount; u++)
+	{
+		const uint8_t* unit = units + (size_t)u * kAdpcmUnitBytes;
+		int predictor = (int16_t)(unit[0] | (unit[1] << 8));
+		int index = unit[2] < kAdpcmStepCount ? unit[2] : kAdpcmStepCount - 1;
+		float* channel = out + (size_t)(u / channels) * kAdpcmUnitFrames * channels + u % channels;
+		for (unsigned k = 0; k < kAdpcmUnitFrames; k++)
+		{
+			unsigned code = (unit[4 + k / 2] >> ((k & 1) * 4)) & 15;
+			channel[k * channels] = DecodeAdpcmCode(predictor, index, code) * (1.0f / 32768.0f);
+		}
+	}
+}
+
+const MixKernels kScalarMixKernels =
+{
+	SimdLevel::Scalar,
+	"Scalar",
+	Accumulate,
+	AccumulateStereo,
+	AccumulatePanned,
+	Int16ToFloat,
+	Uint8ToFloat,
+	Int24ToFloat,
+	Int32ToFloat,
+	FloatToInt16,
+	Clip,
+	ProcessBiquadStage,
+	MeasureLevel,
+	Polyphase,
+	DecodeAdpcm
+};
+
+// ********************** Picking one ******************************* //
+
+#ifdef MIX_KERNELS_X86
+static void Cpuid(int info[4], int leaf, int subleaf)
+{
+#ifdef _MSC_VER
+	__cpuidex(info, leaf, subleaf);
+#else
+	__cpuid_count(leaf, subleaf, info[0], info[1], info[2], info[3]);
+#endif
+}
+
+// Which register sets the OS saves on a thread switch. The CPU having AVX is no use if the OS doesn't
+static unsigned long long ReadXcr0()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned eax;
+	unsigned edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+
+static SimdLevel DetectSimdLevel()
+{
+	int info[4];
+	Cpuid(info, 0, 0);
+	const int maxLeaf = info[0];
+	if (maxLeaf < 1)
+	{
+		return SimdLevel::Scalar;
+	}
+
+	Cpuid(info, 1, 0);
+	const bool sse2 = (info[3] & (1 << 26)) != 0;
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+	if (!sse2)
+	{
+		return SimdLevel::Scalar;
+	}
+	if (!osxsave || !avx || maxLeaf < 7)
+	{
+		return SimdLevel::SSE2;
+	}
+
+	// XMM and YMM state for AVX, plus the mask and upper ZMM registers for AVX-512
+	const unsigned long long xcr0 = ReadXcr0();
+	const bool osAvx = (xcr0 & 0x6) == 0x6;
+	const bool osAvx512 = (xcr0 & 0xe6) == 0xe6;
+
+	Cpuid(info, 7, 0);
+	const bool avx2 = (info[1] & (1 << 5)) != 0;
+	const bool avx512f = (info[1] & (1 << 16)) != 0;
+
+	if (avx512f && avx2 && osAvx512)
+	{
+		return SimdLevel::AVX512;
+	}
+	if (avx2 && osAvx)
+	{
+		return SimdLevel::AVX2;
+	}
+	return SimdLevel::SSE2;
+}
+#endif
+
+SimdLevel GetSupportedSimdLevel()
+{
+#ifdef MIX_KERNELS_X86
+	static const SimdLevel level = DetectSimdLevel();
+	return level;
+#else
+	return SimdLevel::Scalar;
+#endif
+}
+
+const MixKernels* GetMixKernels(SimdLevel level)
+{
+	if (level > GetSupportedSimdLevel())
+	{
+		return nullptr;
+	}
+
+	switch (level)
+	{
+#ifdef MIX_KERNELS_X86
+	case SimdLevel::SSE2:
+		return &kSse2MixKernels;
+	case SimdLevel::AVX2:
+		return &kAvx2MixKernels;
+	case SimdLevel::AVX512:
+		return &kAvx512MixKernels;
+#endif
+	case SimdLevel::Scalar:
+		return &kScalarMixKernels;
+	default:
+		return nullptr;
+	}
+}
+
+const MixKernels& GetMixKernels()
+{
+	static const MixKernels* best = GetMixKernels(GetSupportedSimdLevel());
+	return *best;
+}
+
+// Flush to zero (bit 15) for results and denormals are zero (bit 6) for inputs
+static const unsigned kFlushDenormalBits = 0x8040;
+
+ScopedFlushDenormals::ScopedFlushDenormals() : previous(0)
+{
+#ifdef MIX_KERNELS_X86
+	previous = _mm_getcsr();
+	_mm_setcsr(previous | kFlushDenormalBits);
+#endif
+}
+
+ScopedFlushDenormals::~ScopedFlushDenormals()
+{
+#ifdef MIX_KERNELS_X86
+	_mm_setcsr(previous);
+#endif
+}
@@ -0,0 +1,131 @@
+// MixKernels.h
+// The handful of tight loops that every block of mixing spends its time in: adding one buffer into another
+// with a gain, panning mono into stereo, converting between 16-bit and float, filtering and metering.
+// Each one is written several times over, once per instruction set (plain C++, SSE2, AVX2 and AVX-512),
+// and the best one this CPU can run is picked once at startup by asking CPUID.
+//
+// Every version gives exactly the same answer as the plain one (no fused multiply-adds, same rounding),
+// so which one you end up on never changes what comes out of the speakers, only how fast.
+// "Audio Engine --bench" shows what each of them is worth on this machine.
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Only x86 and x64 get the SIMD versions, everything else runs the plain ones
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MIX_KERNELS_X86 1
+#endif
+
+// GCC and Clang only let a function use instructions past the baseline if it says so.
+// MSVC lets any function use any intrinsic, so there it's nothing
+#if defined(__GNUC__) || defined(__clang__)
+#define KERNEL_TARGET(isa) __attribute__((target(isa)))
+#else
+#define KERNEL_TARGET(isa)
+#endif
+
+struct BiquadStage;
+struct PolyphaseTable;
+
+enum class SimdLevel
+{
+	Scalar,
+	SSE2,
+	AVX2,
+	AVX512,
+	Count
+};
+
+struct MixKernels
+{
+	SimdLevel level;
+	const char* name;
+
+	// out[i] += in[i] * gain
+	void (*accumulate)(float* out, const float* in, float gain, size_t count);
+
+	// Interleaved stereo in, interleaved stereo out, with the left and right sides scaled separately
+	void (*accumulateStereo)(float* out, const float* in, float gainLeft, float gainRight, size_t frameCount);
+
+	// Mono in, panned out into interleaved stereo. The gains come from whatever pan law the caller uses
+	void (*accumulatePanned)(float* out, const float* in, float gainLeft, float gainRight, size_t frameCount);
+
+	// 16-bit PCM to float in -1..1
+	void (*int16ToFloat)(float* out, const int16_t* in, size_t count);
+
+	// The rest of what a .wav can hold, to float in -1..1: unsigned 8-bit, and packed 24-bit and 32-bit
+	// little-endian, read a byte at a time so they can start anywhere in a file
+	void (*uint8ToFloat)(float* out, const uint8_t* in, size_t count);
+	void (*int24ToFloat)(float* out, const uint8_t* in, size_t count);
+	void (*int32ToFloat)(float* out, const uint8_t* in, size_t count);
+
+	// Float to 16-bit PCM: scaled by 32767, clipped and truncated, the way the backends always have
+	void (*floatToInt16)(int16_t* out, const float* in, size_t count);
+
+	// Hard clips everything into -limit..limit, in place
+	void (*clip)(float* samples, size_t count, float limit);
+
+	// Runs four biquad bands one after another over interleaved stereo, in place (see Biquad.h)
+	void (*biquadStage)(BiquadStage& stage, float* frames, size_t frameCount);
+
+	// The loudest sample (ignoring sign) and the sum of every sample squared, for level meters and dynamics.
+	// The squares are summed in 8 lanes (sample i into lane i % 8) which are then added up in a fixed order,
+	// so every version rounds the same way
+	void (*measureLevel)(const float* samples, size_t count, float* peak, float* sumOfSquares);
+
+	// Resamples mono or interleaved stereo through a polyphase sinc filter (see Resampler.h). Output frame j is
+	// at 'position + j * step' source frames into 'window', and takes its taps from the frame at the whole part
+	// of that onwards, so 'window' needs 'taps' frames past the last position. Each tap is summed into lane
+	// k % 8 (k counting floats, so stereo's left is in the even lanes), the same as measureLevel
+	void (*polyphase)(float* out, const float* window, unsigned channels, double position, double step,
+		unsigned frameCount, const PolyphaseTable& table);
+
+	// Decodes unitCount IMA ADPCM units (see Adpcm.h) into interleaved float. Unit u is channel u % channels of
+	// frames (u / channels) * 64 onwards, so whole blocks of 'channels' units come out as whole frames.
+	// The SIMD versions decode several units side by side, one per lane; it's all integer maths until the end
+	void (*decodeAdpcm)(float* out, const uint8_t* units, unsigned unitCount, unsigned channels);
+};
+
+// Adds up measureLevel's 8 lanes, in the order every version uses
+inline float SumLevelLanes(const float lanes[8])
+{
+	return ((lanes[0] + lanes[4]) + (lanes[2] + lanes[6])) + ((lanes[1] + lanes[5]) + (lanes[3] + lanes[7]));
+}
+
+// Adds up polyphase's 8 lanes for stereo, left from the even ones and right from the odd, in the same order
+inline void SumStereoLanes(const float lanes[8], float* left, float* right)
+{
+	*left = (lanes[0] + lanes[4]) + (lanes[2] + lanes[6]);
+	*right = (lanes[1] + lanes[5]) + (lanes[3] + lanes[7]);
+}
+
+// One table per instruction set, each in its own file (MixKernelsSSE2.cpp and so on)
+extern const MixKernels kScalarMixKernels;
+#ifdef MIX_KERNELS_X86
+extern const MixKernels kSse2MixKernels;
+extern const MixKernels kAvx2MixKernels;
+extern const MixKernels kAvx512MixKernels;
+#endif
+
+// The best set this CPU (and OS) supports. Worked out on the first call and never changes after that
+const MixKernels& GetMixKernels();
+
+// A particular set, or nullptr if this CPU can't run it or it wasn't built in (anything but x86/x64 only gets Scalar)
+const MixKernels* GetMixKernels(SimdLevel level);
+
+// The best level this CPU (and OS) supports
+SimdLevel GetSupportedSimdLevel();
+
+// Numbers too small to matter (denormals) are dozens of times slower to work with on x86, and filters and
+// reverbs decaying towards silence make lots of them. While one of these is in scope, this thread treats
+// them as zero. The mixer holds one for every Render()
+class ScopedFlushDenormals
+{
+public:
+	ScopedFlushDenormals();
+	~ScopedFlushDenormals();
+
+private:
+	unsigned previous;
+};
@@ -0,0 +1,384 @@
+// The AVX2 kernels, 8 floats at a time. Anything left over at the end goes through the plain versions.
+// No FMA on purpose: a fused multiply-add rounds once instead of twice, which would make these
+// come out slightly different to every other version
+
+#include "MixKernels.h"
+#include "Biquad.h"
+#include "Resampler.h"
+#include "Adpcm.h"
+#include <algorithm>
+#include <math.h>
+
+#ifdef MIX_KERNELS_X86
+#include <immintrin.h>
+
+#define AVX2_FUNCTION KERNEL_TARGET("avx2")
+
+AVX2_FUNCTION static void Accumulate(float* out, const float* in, float gain, size_t count)
+{
+	const __m256 g = _mm256_set1_ps(gain);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m256 a = _mm256_add_ps(_mm256_loadu_ps(out + i), _mm256_mul_ps(_mm256_loadu_ps(in + i), g));
+		__m256 b = _mm256_add_ps(_mm256_loadu_ps(out + i + 8), _mm256_mul_ps(_mm256_loadu_ps(in + i + 8), g));
+		_mm256_storeu_ps(out + i, a);
+		_mm256_storeu_ps(out + i + 8, b);
+	}
+	kScalarMixKernels.accumulate(out + i, in + i, gain, count - i);
+}
+
+AVX2_FUNCTION static void AccumulateStereo(float* out, const float* in, float gainLeft, float gainRight, size_t frameCount)
+{
+	const __m256 g = _mm256_setr_ps(gainLeft, gainRight, gainLeft, gainRight, gainLeft, gainRight, gainLeft, gainRight);
+	const size_t count = frameCount * 2;
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m256 a = _mm256_add_ps(_mm256_loadu_ps(out + i), _mm256_mul_ps(_mm256_loadu_ps(in + i), g));
+		__m256 b = _mm256_add_ps(_mm256_loadu_ps(out + i + 8), _mm256_mul_ps(_mm256_loadu_ps(in + i + 8), g));
+		_mm256_storeu_ps(out + i, a);
+		_mm256_storeu_ps(out + i + 8, b);
+	}
+	kScalarMixKernels.accumulateStereo(out + i, in + i, gainLeft, gainRight, (count - i) / 2);
+}
+
+AVX2_FUNCTION static void AccumulatePanned(float* out, const float* in, float gainLeft, float gainRight, size_t frameCount)
+{
+	const __m256 g = _mm256_setr_ps(gainLeft, gainRight, gainLeft, gainRight, gainLeft, gainRight, gainLeft, gainRight);
+	size_t i = 0;
+	for (; i + 8 <= frameCount; i += 8)
+	{
+		// The unpacks work inside each 128-bit half: a..h -> a a b b | e e f f and c c d d | g g h h.
+		// Swapping the halves round puts them back in order
+		__m256 mono = _mm256_loadu_ps(in + i);
+		__m256 low = _mm256_unpacklo_ps(mono, mono);
+		__m256 high = _mm256_unpackhi_ps(mono, mono);
+		__m256 first = _mm256_permute2f128_ps(low, high, 0x20);
+		__m256 second = _mm256_permute2f128_ps(low, high, 0x31);
+		float* o = out + i * 2;
+		_mm256_storeu_ps(o, _mm256_add_ps(_mm256_loadu_ps(o), _mm256_mul_ps(first, g)));
+		_mm256_storeu_ps(o + 8, _mm256_add_ps(_mm256_loadu_ps(o + 8), _mm256_mul_ps(second, g)));
+	}
+	kScalarMixKernels.accumulatePanned(out + i * 2, in + i, gainLeft, gainRight, frameCount - i);
+}
+
+AVX2_FUNCTION static void Int16ToFloat(float* out, const int16_t* in, size_t count)
+{
+	const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m256i low = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(in + i)));
+		__m256i high = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(in + i + 8)));
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(low), scale));
+		_mm256_storeu_ps(out + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(high), scale));
+	}
+	kScalarMixKernels.int16ToFloat(out + i, in + i, count - i);
+}
+
+AVX2_FUNCTION static void Uint8ToFloat(float* out, const uint8_t* in, size_t count)
+{
+	const __m256 scale = _mm256_set1_ps(1.0f / 128.0f);
+	const __m256i offset = _mm256_set1_epi32(128);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m256i low = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(in + i)));
+		__m256i high = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(in + i + 8)));
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(low, offset)), scale));
+		_mm256_storeu_ps(out + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(high, offset)), scale));
+	}
+	kScalarMixKernels.uint8ToFloat(out + i, in + i, count - i);
+}
+
+AVX2_FUNCTION static void Int24ToFloat(float* out, const uint8_t* in, size_t count)
+{
+	// Four values (12 bytes) into each 128-bit half, each shuffled up into the top three bytes of its lane.
+	// The second half's load starts 12 bytes in and reads 4 past the 8 values, hence stopping 2 values early
+	const __m256i spread = _mm256_setr_epi8(
+		-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+		-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+	const __m256 scale = _mm256_set1_ps(1.0f / 2147483648.0f);
+	size_t i = 0;
+	for (; i + 10 <= count; i += 8)
+	{
+		const uint8_t* bytes = in + i * 3;
+		__m256i packed = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)bytes)),
+			_mm_loadu_si128((const __m128i*)(bytes + 12)), 1);
+		__m256i values = _mm256_shuffle_epi8(packed, spread);
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(values), scale));
+	}
+	kScalarMixKernels.int24ToFloat(out + i, in + i * 3, count - i);
+}
+
+AVX2_FUNCTION static void Int32ToFloat(float* out, const uint8_t* in, size_t count)
+{
+	const __m256 scale = _mm256_set1_ps(1.0f / 2147483648.0f);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i*)(in + i * 4));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(in + i * 4 + 32));
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(a), scale));
+		_mm256_storeu_ps(out + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(b), scale));
+	}
+	kScalarMixKernels.int32ToFloat(out + i, in + i * 4, count - i);
+}
+
+AVX2_FUNCTION static void FloatToInt16(int16_t* out, const float* in, size_t count)
+{
+	const __m256 scale = _mm256_set1_ps(32767.0f);
+	const __m256 top = _mm256_set1_ps(32767.0f);
+	const __m256 bottom = _mm256_set1_ps(-32768.0f);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m256 a = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i), scale), bottom), top);
+		__m256 b = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i + 8), scale), bottom), top);
+		// The pack interleaves the two inputs a half at a time (a0-3 b0-3 a4-7 b4-7), the permute undoes that
+		__m256i packed = _mm256_packs_epi32(_mm256_cvttps_epi32(a), _mm256_cvttps_epi32(b));
+		packed = _mm256_permute4x64_epi64(packed, 0xd8);
+		_mm256_storeu_si256((__m256i*)(out + i), packed);
+	}
+	kScalarMixKernels.floatToInt16(out + i, in + i, count - i);
+}
+
+AVX2_FUNCTION static void Clip(float* samples, size_t count, float limit)
+{
+	const __m256 top = _mm256_set1_ps(limit);
+	const __m256 bottom = _mm256_set1_ps(-limit);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		_mm256_storeu_ps(samples + i, _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(samples + i), bottom), top));
+	}
+	kScalarMixKernels.clip(samples + i, count - i, limit);
+}
+
+AVX2_FUNCTION static void ProcessBiquadStage(BiquadStage& stage, float* frames, size_t frameCount)
+{
+	if (frameCount == 0)
+	{
+		return;
+	}
+
+	// All 8 lanes in one register. At step t band 0 does frame t, band 1 frame t-1 and so on, so every
+	// band's input is just what the band before it output last step
+	alignas(32) float outputs[BiquadStage::kLanes] = {};
+	const unsigned count = (unsigned)frameCount;
+	const unsigned lastStep = count + BiquadStage::kBands - 1;
+	const unsigned firstFull = BiquadStage::kBands - 1;
+
+	// Until band 3 has a frame to work on
+	unsigned step = 0;
+	for (; step < firstFull; step++)
+	{
+		stage.Step(frames, count, step, outputs);
+	}
+
+	const __m256 b0 = _mm256_load_ps(stage.b0);
+	const __m256 b1 = _mm256_load_ps(stage.b1);
+	const __m256 b2 = _mm256_load_ps(stage.b2);
+	const __m256 a1 = _mm256_load_ps(stage.a1);
+	const __m256 a2 = _mm256_load_ps(stage.a2);
+	__m256 z1 = _mm256_load_ps(stage.z1);
+	__m256 z2 = _mm256_load_ps(stage.z2);
+	__m256 y = _mm256_load_ps(outputs);
+
+	// Every band busy
+	for (; step < count; step++)
+	{
+		// Move last step's outputs up a band (a stereo pair is 64 bits) and put the new frame in band 0
+		__m256 shifted = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(y), _MM_SHUFFLE(2, 1, 0, 0)));
+		__m256 frame = _mm256_castpd_ps(_mm256_broadcast_sd((const double*)(frames + step * 2)));
+		__m256 x = _mm256_blend_ps(shifted, frame, 0x03);
+
+		y = _mm256_add_ps(_mm256_mul_ps(b0, x), z1);
+		z1 = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(b1, x), _mm256_mul_ps(a1, y)), z2);
+		z2 = _mm256_sub_ps(_mm256_mul_ps(b2, x), _mm256_mul_ps(a2, y));
+
+		// Band 3 finished the frame from three steps back
+		_mm_storeh_pi((__m64*)(frames + (step - firstFull) * 2), _mm256_extractf128_ps(y, 1));
+	}
+
+	_mm256_store_ps(stage.z1, z1);
+	_mm256_store_ps(stage.z2, z2);
+	_mm256_store_ps(outputs, y);
+
+	// And the last few frames working their way out of the later bands
+	for (; step <= lastStep; step++)
+	{
+		stage.Step(frames, count, step, outputs);
+	}
+}
+
+AVX2_FUNCTION static void MeasureLevel(const float* samples, size_t count, float* peak, float* sumOfSquares)
+{
+	// Exactly the 8 lanes the plain version sums into
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+	__m256 sums = _mm256_setzero_ps();
+	__m256 loudest = _mm256_setzero_ps();
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 value = _mm256_loadu_ps(samples + i);
+		sums = _mm256_add_ps(sums, _mm256_mul_ps(value, value));
+		loudest = _mm256_max_ps(loudest, _mm256_andnot_ps(signBit, value));
+	}
+
+	alignas(32) float lanes[8];
+	alignas(32) float peaks[8];
+	_mm256_store_ps(lanes, sums);
+	_mm256_store_ps(peaks, loudest);
+	float result = 0.0f;
+	for (float lanePeak : peaks)
+	{
+		result = std::max(result, lanePeak);
+	}
+	for (; i < count; i++)
+	{
+		result = std::max(result, fabsf(samples[i]));
+		lanes[i & 7] += samples[i] * samples[i];
+	}
+	*peak = result;
+	*sumOfSquares = SumLevelLanes(lanes);
+}
+
+AVX2_FUNCTION static void Polyphase(float* out, const float* window, unsigned channels, double position, double step,
+	unsigned frameCount, const PolyphaseTable& table)
+{
+	// One register is exactly the 8 lanes, the taps are always a multiple of 8 floats
+	const unsigned count = table.taps * channels;
+	for (unsigned j = 0; j < frameCount; j++)
+	{
+		double at = position + j * step;
+		size_t index = (size_t)at;
+		double scaled = (at - index) * PolyphaseTable::kPhases;
+		unsigned phase = (unsigned)scaled;
+		float blend = (float)(scaled - phase);
+
+		const float* source = window + index * channels;
+		const float* first = channels == 1 ? table.GetMono(phase) : table.GetStereo(phase);
+		const float* second = channels == 1 ? table.GetMono(phase + 1) : table.GetStereo(phase + 1);
+		__m256 sumFirst = _mm256_setzero_ps();
+		__m256 sumSecond = _mm256_setzero_ps();
+		for (unsigned k = 0; k < count; k += 8)
+		{
+			__m256 value = _mm256_loadu_ps(source + k);
+			sumFirst = _mm256_add_ps(sumFirst, _mm256_mul_ps(value, _mm256_loadu_ps(first + k)));
+			sumSecond = _mm256_add_ps(sumSecond, _mm256_mul_ps(value, _mm256_loadu_ps(second + k)));
+		}
+
+		alignas(32) float lanesFirst[8];
+		alignas(32) float lanesSecond[8];
+		_mm256_store_ps(lanesFirst, sumFirst);
+		_mm256_store_ps(lanesSecond, sumSecond);
+		if (channels == 1)
+		{
+			float a = SumLevelLanes(lanesFirst);
+			float b = SumLevelLanes(lanesSecond);
+			out[j] = a + (b - a) * blend;
+		}
+		else
+		{
+			float leftA, rightA, leftB, rightB;
+			SumStereoLanes(lanesFirst, &leftA, &rightA);
+			SumStereoLanes(lanesSecond, &leftB, &rightB);
+			out[j * 2] = leftA + (leftB - leftA) * blend;
+			out[j * 2 + 1] = rightA + (rightB - rightA) * blend;
+		}
+	}
+}
+
+AVX2_FUNCTION static void DecodeAdpcm(float* out, const uint8_t* units, unsigned unitCount, unsigned channels)
+{
+	// Eight units at once, one to a lane, with the headers, codes and steps all gathered straight in
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i two = _mm256_set1_epi32(2);
+	const __m256i three = _mm256_set1_epi32(3);
+	const __m256i four = _mm256_set1_epi32(4);
+	const __m256i eight = _mm256_set1_epi32(8);
+	const __m256i fifteen = _mm256_set1_epi32(15);
+	const __m256i minusOne = _mm256_set1_epi32(-1);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i maxIndex = _mm256_set1_epi32(kAdpcmStepCount - 1);
+	const __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(kAdpcmUnitBytes));
+	const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+
+	// Lanes have to line up with whole frames for the leftovers to carry on in the right place
+	const unsigned whole = (8 % channels == 0) ? unitCount / 8 * 8 : 0;
+	unsigned u = 0;
+	for (; u < whole; u += 8)
+	{
+		const uint8_t* first = units + (size_t)u * kAdpcmUnitBytes;
+		float* channel[8];
+		for (unsigned lane = 0; lane < 8; lane++)
+		{
+			channel[lane] = out + (size_t)((u + lane) / channels) * kAdpcmUnitFrames * channels + (u + lane) % channels;
+		}
+
+		// The header: predictor in the low 16 bits, step index in the next 8
+		__m256i header = _mm256_i32gather_epi32((const int*)first, offsets, 1);
+		__m256i predictor = _mm256_srai_epi32(_mm256_slli_epi32(header, 16), 16);
+		__m256i index = _mm256_min_epi32(_mm256_and_si256(_mm256_srli_epi32(header, 16), _mm256_set1_epi32(0xFF)), maxIndex);
+
+		alignas(32) float values[8];
+		for (unsigned word = 0; word < kAdpcmUnitFrames / 8; word++)
+		{
+			// Eight codes a lane
+			__m256i codes = _mm256_i32gather_epi32((const int*)(first + 4 + word * 4), offsets, 1);
+			for (unsigned j = 0; j < 8; j++)
+			{
+				__m256i code = _mm256_and_si256(codes, fifteen);
+				codes = _mm256_srli_epi32(codes, 4);
+				__m256i step = _mm256_i32gather_epi32((const int*)kAdpcmSteps, index, 4);
+
+				__m256i big = _mm256_cmpeq_epi32(_mm256_and_si256(code, four), four);
+				__m256i difference = _mm256_srai_epi32(step, 3);
+				difference = _mm256_add_epi32(difference, _mm256_and_si256(step, big));
+				difference = _mm256_add_epi32(difference, _mm256_and_si256(_mm256_srai_epi32(step, 1), _mm256_cmpeq_epi32(_mm256_and_si256(code, two), two)));
+				difference = _mm256_add_epi32(difference, _mm256_and_si256(_mm256_srai_epi32(step, 2), _mm256_cmpeq_epi32(_mm256_and_si256(code, one), one)));
+				__m256i negative = _mm256_cmpeq_epi32(_mm256_and_si256(code, eight), eight);
+				difference = _mm256_sub_epi32(_mm256_xor_si256(difference, negative), negative);
+				predictor = _mm256_add_epi32(predictor, difference);
+				predictor = _mm256_max_epi32(_mm256_min_epi32(predictor, _mm256_set1_epi32(32767)), _mm256_set1_epi32(-32768));
+
+				__m256i up = _mm256_slli_epi32(_mm256_add_epi32(_mm256_and_si256(code, three), one), 1);
+				index = _mm256_add_epi32(index, _mm256_blendv_epi8(minusOne, up, big));
+				index = _mm256_min_epi32(_mm256_max_epi32(index, zero), maxIndex);
+
+				_mm256_store_ps(values, _mm256_mul_ps(_mm256_cvtepi32_ps(predictor), scale));
+				const size_t at = (size_t)(word * 8 + j) * channels;
+				for (unsigned lane = 0; lane < 8; lane++)
+				{
+					channel[lane][at] = values[lane];
+				}
+			}
+		}
+	}
+	// A mono voice's block is only four or five units, so what's left is worth SSE2's four lanes
+	kSse2MixKernels.decodeAdpcm(out + (size_t)(u / channels) * kAdpcmUnitFrames * channels, units + (size_t)u * kAdpcmUnitBytes,
+		unitCount - u, channels);
+}
+
+const MixKernels kAvx2MixKernels =
+{
+	SimdLevel::AVX2,
+	"AVX2",
+	Accumulate,
+	AccumulateStereo,
+	AccumulatePanned,
+	Int16ToFloat,
+	Uint8ToFloat,
+	Int24ToFloat,
+	Int32ToFloat,
+	FloatToInt16,
+	Clip,
+	ProcessBiquadStage,
+	MeasureLevel,
+	Polyphase,
+	DecodeAdpcm
+};
+
+#endif
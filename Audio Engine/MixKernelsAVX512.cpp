@@ -0,0 +1,159 @@
+// The AVX-512 kernels, 16 floats at a time. Only needs the foundation instructions (AVX-512F),
+// which every AVX-512 CPU has. Anything left over at the end goes through the plain versions
+
+#include "MixKernels.h"
+
+#ifdef MIX_KERNELS_X86
+#include <immintrin.h>
+
+#define AVX512_FUNCTION KERNEL_TARGET("avx512f")
+
+// AVX-512 comes with FMA, and GCC will happily fuse a multiply and an add into one, which
+// rounds differently to the other versions. (Its headers also trip a bogus uninitialized warning)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize("fp-contract=off")
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+AVX512_FUNCTION static void Accumulate(float* out, const float* in, float gain, size_t count)
+{
+	const __m512 g = _mm512_set1_ps(gain);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		_mm512_storeu_ps(out + i, _mm512_add_ps(_mm512_loadu_ps(out + i), _mm512_mul_ps(_mm512_loadu_ps(in + i), g)));
+	}
+	kScalarMixKernels.accumulate(out + i, in + i, gain, count - i);
+}
+
+AVX512_FUNCTION static void AccumulateStereo(float* out, const float* in, float gainLeft, float gainRight, size_t frameCount)
+{
+	const __m512 g = _mm512_setr4_ps(gainLeft, gainRight, gainLeft, gainRight);
+	const size_t count = frameCount * 2;
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		_mm512_storeu_ps(out + i, _mm512_add_ps(_mm512_loadu_ps(out + i), _mm512_mul_ps(_mm512_loadu_ps(in + i), g)));
+	}
+	kScalarMixKernels.accumulateStereo(out + i, in + i, gainLeft, gainRight, (count - i) / 2);
+}
+
+AVX512_FUNCTION static void AccumulatePanned(float* out, const float* in, float gainLeft, float gainRight, size_t frameCount)
+{
+	const __m512 g = _mm512_setr4_ps(gainLeft, gainRight, gainLeft, gainRight);
+	// A full cross-lane shuffle does it in one go: each output takes mono sample (index / 2)
+	const __m512i firstHalf = _mm512_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7);
+	const __m512i secondHalf = _mm512_setr_epi32(8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 14, 14, 15, 15);
+	size_t i = 0;
+	for (; i + 16 <= frameCount; i += 16)
+	{
+		__m512 mono = _mm512_loadu_ps(in + i);
+		__m512 first = _mm512_permutexvar_ps(firstHalf, mono);
+		__m512 second = _mm512_permutexvar_ps(secondHalf, mono);
+		float* o = out + i * 2;
+		_mm512_storeu_ps(o, _mm512_add_ps(_mm512_loadu_ps(o), _mm512_mul_ps(first, g)));
+		_mm512_storeu_ps(o + 16, _mm512_add_ps(_mm512_loadu_ps(o + 16), _mm512_mul_ps(second, g)));
+	}
+	kScalarMixKernels.accumulatePanned(out + i * 2, in + i, gainLeft, gainRight, frameCount - i);
+}
+
+AVX512_FUNCTION static void Int16ToFloat(float* out, const int16_t* in, size_t count)
+{
+	const __m512 scale = _mm512_set1_ps(1.0f / 32768.0f);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m512i pcm = _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i*)(in + i)));
+		_mm512_storeu_ps(out + i, _mm512_mul_ps(_mm512_cvtepi32_ps(pcm), scale));
+	}
+	kScalarMixKernels.int16ToFloat(out + i, in + i, count - i);
+}
+
+// The rest of the conversions only run as files load, when it's the file that's the bottleneck rather than these
+static void Uint8ToFloat(float* out, const uint8_t* in, size_t count)
+{
+	kAvx2MixKernels.uint8ToFloat(out, in, count);
+}
+
+static void Int24ToFloat(float* out, const uint8_t* in, size_t count)
+{
+	kAvx2MixKernels.int24ToFloat(out, in, count);
+}
+
+static void Int32ToFloat(float* out, const uint8_t* in, size_t count)
+{
+	kAvx2MixKernels.int32ToFloat(out, in, count);
+}
+
+AVX512_FUNCTION static void FloatToInt16(int16_t* out, const float* in, size_t count)
+{
+	const __m512 scale = _mm512_set1_ps(32767.0f);
+	const __m512 top = _mm512_set1_ps(32767.0f);
+	const __m512 bottom = _mm512_set1_ps(-32768.0f);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m512 value = _mm512_min_ps(_mm512_max_ps(_mm512_mul_ps(_mm512_loadu_ps(in + i), scale), bottom), top);
+		// Narrowing with saturation, straight down to 16 bits in order
+		_mm256_storeu_si256((__m256i*)(out + i), _mm512_cvtsepi32_epi16(_mm512_cvttps_epi32(value)));
+	}
+	kScalarMixKernels.floatToInt16(out + i, in + i, count - i);
+}
+
+AVX512_FUNCTION static void Clip(float* samples, size_t count, float limit)
+{
+	const __m512 top = _mm512_set1_ps(limit);
+	const __m512 bottom = _mm512_set1_ps(-limit);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		_mm512_storeu_ps(samples + i, _mm512_min_ps(_mm512_max_ps(_mm512_loadu_ps(samples + i), bottom), top));
+	}
+	kScalarMixKernels.clip(samples + i, count - i, limit);
+}
+
+static void ProcessBiquadStage(BiquadStage& stage, float* frames, size_t frameCount)
+{
+	// A stage is 8 lanes, which AVX2 already fills, so nothing to gain from wider registers
+	kAvx2MixKernels.biquadStage(stage, frames, frameCount);
+}
+
+static void MeasureLevel(const float* samples, size_t count, float* peak, float* sumOfSquares)
+{
+	// 16 lanes would add the squares up in a different order, so this stays on AVX2's 8
+	kAvx2MixKernels.measureLevel(samples, count, peak, sumOfSquares);
+}
+
+static void Polyphase(float* out, const float* window, unsigned channels, double position, double step,
+	unsigned frameCount, const PolyphaseTable& table)
+{
+	// Same again, 16 lanes would sum the taps in a different order
+	kAvx2MixKernels.polyphase(out, window, channels, position, step, frameCount, table);
+}
+
+static void DecodeAdpcm(float* out, const uint8_t* units, unsigned unitCount, unsigned channels)
+{
+	// The mixer only ever decodes a few units per voice at a time, not enough to fill 16 lanes
+	kAvx2MixKernels.decodeAdpcm(out, units, unitCount, channels);
+}
+
+const MixKernels kAvx512MixKernels =
+{
+	SimdLevel::AVX512,
+	"AVX-512",
+	Accumulate,
+	AccumulateStereo,
+	AccumulatePanned,
+	Int16ToFloat,
+	Uint8ToFloat,
+	Int24ToFloat,
+	Int32ToFloat,
+	FloatToInt16,
+	Clip,
+	ProcessBiquadStage,
+	MeasureLevel,
+	Polyphase,
+	DecodeAdpcm
+};
+
+#endif
@@ -0,0 +1,400 @@
+// The SSE2 kernels, 4 floats at a time. Anything left over at the end goes through the plain versions
+
+#include "MixKernels.h"
+#include "Biquad.h"
+#include "Resampler.h"
+#include "Adpcm.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#ifdef MIX_KERNELS_X86
+#include <emmintrin.h>
+
+#define SSE2_FUNCTION KERNEL_TARGET("sse2")
+
+SSE2_FUNCTION static void Accumulate(float* out, const float* in, float gain, size_t count)
+{
+	const __m128 g = _mm_set1_ps(gain);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128 a = _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(_mm_loadu_ps(in + i), g));
+		__m128 b = _mm_add_ps(_mm_loadu_ps(out + i + 4), _mm_mul_ps(_mm_loadu_ps(in + i + 4), g));
+		_mm_storeu_ps(out + i, a);
+		_mm_storeu_ps(out + i + 4, b);
+	}
+	kScalarMixKernels.accumulate(out + i, in + i, gain, count - i);
+}
+
+SSE2_FUNCTION static void AccumulateStereo(float* out, const float* in, float gainLeft, float gainRight, size_t frameCount)
+{
+	// L R L R lines up with the gains as they come, no shuffling needed
+	const __m128 g = _mm_setr_ps(gainLeft, gainRight, gainLeft, gainRight);
+	const size_t count = frameCount * 2;
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128 a = _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(_mm_loadu_ps(in + i), g));
+		__m128 b = _mm_add_ps(_mm_loadu_ps(out + i + 4), _mm_mul_ps(_mm_loadu_ps(in + i + 4), g));
+		_mm_storeu_ps(out + i, a);
+		_mm_storeu_ps(out + i + 4, b);
+	}
+	kScalarMixKernels.accumulateStereo(out + i, in + i, gainLeft, gainRight, (count - i) / 2);
+}
+
+SSE2_FUNCTION static void AccumulatePanned(float* out, const float* in, float gainLeft, float gainRight, size_t frameCount)
+{
+	const __m128 g = _mm_setr_ps(gainLeft, gainRight, gainLeft, gainRight);
+	size_t i = 0;
+	for (; i + 4 <= frameCount; i += 4)
+	{
+		// a b c d -> a a b b, c c d d
+		__m128 mono = _mm_loadu_ps(in + i);
+		__m128 low = _mm_unpacklo_ps(mono, mono);
+		__m128 high = _mm_unpackhi_ps(mono, mono);
+		float* o = out + i * 2;
+		_mm_storeu_ps(o, _mm_add_ps(_mm_loadu_ps(o), _mm_mul_ps(low, g)));
+		_mm_storeu_ps(o + 4, _mm_add_ps(_mm_loadu_ps(o + 4), _mm_mul_ps(high, g)));
+	}
+	kScalarMixKernels.accumulatePanned(out + i * 2, in + i, gainLeft, gainRight, frameCount - i);
+}
+
+SSE2_FUNCTION static void Int16ToFloat(float* out, const int16_t* in, size_t count)
+{
+	const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		// No sign extend instruction until SSE4.1, so put each value in the top half and shift it back down
+		__m128i pcm = _mm_loadu_si128((const __m128i*)(in + i));
+		__m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(pcm, pcm), 16);
+		__m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(pcm, pcm), 16);
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+		_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+	}
+	kScalarMixKernels.int16ToFloat(out + i, in + i, count - i);
+}
+
+SSE2_FUNCTION static void Uint8ToFloat(float* out, const uint8_t* in, size_t count)
+{
+	const __m128 scale = _mm_set1_ps(1.0f / 128.0f);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i offset = _mm_set1_epi32(128);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		// Widened with zeros a step at a time, 8 to 16 to 32 bits
+		__m128i bytes = _mm_loadu_si128((const __m128i*)(in + i));
+		__m128i low = _mm_unpacklo_epi8(bytes, zero);
+		__m128i high = _mm_unpackhi_epi8(bytes, zero);
+		__m128i values[4] = { _mm_unpacklo_epi16(low, zero), _mm_unpackhi_epi16(low, zero), _mm_unpacklo_epi16(high, zero), _mm_unpackhi_epi16(high, zero) };
+		for (unsigned j = 0; j < 4; j++)
+		{
+			_mm_storeu_ps(out + i + j * 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(values[j], offset)), scale));
+		}
+	}
+	kScalarMixKernels.uint8ToFloat(out + i, in + i, count - i);
+}
+
+static void Int24ToFloat(float* out, const uint8_t* in, size_t count)
+{
+	// Spreading 3-byte values out to 4 needs a byte shuffle, which only comes in with SSSE3
+	kScalarMixKernels.int24ToFloat(out, in, count);
+}
+
+SSE2_FUNCTION static void Int32ToFloat(float* out, const uint8_t* in, size_t count)
+{
+	const __m128 scale = _mm_set1_ps(1.0f / 2147483648.0f);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(in + i * 4));
+		__m128i b = _mm_loadu_si128((const __m128i*)(in + i * 4 + 16));
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(a), scale));
+		_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(b), scale));
+	}
+	kScalarMixKernels.int32ToFloat(out + i, in + i * 4, count - i);
+}
+
+SSE2_FUNCTION static void FloatToInt16(int16_t* out, const float* in, size_t count)
+{
+	const __m128 scale = _mm_set1_ps(32767.0f);
+	const __m128 top = _mm_set1_ps(32767.0f);
+	const __m128 bottom = _mm_set1_ps(-32768.0f);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i), scale), bottom), top);
+		__m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale), bottom), top);
+		// cvtt truncates like a cast does, and the pack saturates (not that anything's out of range by now)
+		__m128i packed = _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
+		_mm_storeu_si128((__m128i*)(out + i), packed);
+	}
+	kScalarMixKernels.floatToInt16(out + i, in + i, count - i);
+}
+
+SSE2_FUNCTION static void Clip(float* samples, size_t count, float limit)
+{
+	const __m128 top = _mm_set1_ps(limit);
+	const __m128 bottom = _mm_set1_ps(-limit);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		_mm_storeu_ps(samples + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(samples + i), bottom), top));
+	}
+	kScalarMixKernels.clip(samples + i, count - i, limit);
+}
+
+SSE2_FUNCTION static void ProcessBiquadStage(BiquadStage& stage, float* frames, size_t frameCount)
+{
+	if (frameCount == 0)
+	{
+		return;
+	}
+
+	// Two registers of lanes: bands 0 and 1 in 'low', 2 and 3 in 'high'. At step t band 0 does frame t,
+	// band 1 frame t-1 and so on, so every band's input is just what the band before it output last step
+	alignas(16) float outputs[BiquadStage::kLanes] = {};
+	const unsigned count = (unsigned)frameCount;
+	const unsigned lastStep = count + BiquadStage::kBands - 1;
+	const unsigned firstFull = BiquadStage::kBands - 1;
+
+	// Until band 3 has a frame to work on
+	unsigned step = 0;
+	for (; step < firstFull; step++)
+	{
+		stage.Step(frames, count, step, outputs);
+	}
+
+	const __m128 b0Low = _mm_load_ps(stage.b0), b0High = _mm_load_ps(stage.b0 + 4);
+	const __m128 b1Low = _mm_load_ps(stage.b1), b1High = _mm_load_ps(stage.b1 + 4);
+	const __m128 b2Low = _mm_load_ps(stage.b2), b2High = _mm_load_ps(stage.b2 + 4);
+	const __m128 a1Low = _mm_load_ps(stage.a1), a1High = _mm_load_ps(stage.a1 + 4);
+	const __m128 a2Low = _mm_load_ps(stage.a2), a2High = _mm_load_ps(stage.a2 + 4);
+	__m128 z1Low = _mm_load_ps(stage.z1), z1High = _mm_load_ps(stage.z1 + 4);
+	__m128 z2Low = _mm_load_ps(stage.z2), z2High = _mm_load_ps(stage.z2 + 4);
+	__m128 yLow = _mm_load_ps(outputs), yHigh = _mm_load_ps(outputs + 4);
+
+	// Every band busy
+	for (; step < count; step++)
+	{
+		// Band 0 gets the new frame, the rest get the previous band's output from last step
+		__m128 frame = _mm_castpd_ps(_mm_load_sd((const double*)(frames + step * 2)));
+		__m128 xLow = _mm_movelh_ps(frame, yLow);
+		__m128 xHigh = _mm_shuffle_ps(yLow, yHigh, _MM_SHUFFLE(1, 0, 3, 2));
+
+		yLow = _mm_add_ps(_mm_mul_ps(b0Low, xLow), z1Low);
+		yHigh = _mm_add_ps(_mm_mul_ps(b0High, xHigh), z1High);
+		z1Low = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1Low, xLow), _mm_mul_ps(a1Low, yLow)), z2Low);
+		z1High = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1High, xHigh), _mm_mul_ps(a1High, yHigh)), z2High);
+		z2Low = _mm_sub_ps(_mm_mul_ps(b2Low, xLow), _mm_mul_ps(a2Low, yLow));
+		z2High = _mm_sub_ps(_mm_mul_ps(b2High, xHigh), _mm_mul_ps(a2High, yHigh));
+
+		// Band 3 finished the frame from three steps back
+		_mm_storeh_pi((__m64*)(frames + (step - firstFull) * 2), yHigh);
+	}
+
+	_mm_store_ps(stage.z1, z1Low);
+	_mm_store_ps(stage.z1 + 4, z1High);
+	_mm_store_ps(stage.z2, z2Low);
+	_mm_store_ps(stage.z2 + 4, z2High);
+	_mm_store_ps(outputs, yLow);
+	_mm_store_ps(outputs + 4, yHigh);
+
+	// And the last few frames working their way out of the later bands
+	for (; step <= lastStep; step++)
+	{
+		stage.Step(frames, count, step, outputs);
+	}
+}
+
+SSE2_FUNCTION static void MeasureLevel(const float* samples, size_t count, float* peak, float* sumOfSquares)
+{
+	// Lanes 0-3 in 'low' and 4-7 in 'high', same as the plain version's
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+	__m128 low = _mm_setzero_ps();
+	__m128 high = _mm_setzero_ps();
+	__m128 loudest = _mm_setzero_ps();
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128 a = _mm_loadu_ps(samples + i);
+		__m128 b = _mm_loadu_ps(samples + i + 4);
+		low = _mm_add_ps(low, _mm_mul_ps(a, a));
+		high = _mm_add_ps(high, _mm_mul_ps(b, b));
+		loudest = _mm_max_ps(loudest, _mm_max_ps(_mm_andnot_ps(signBit, a), _mm_andnot_ps(signBit, b)));
+	}
+
+	alignas(16) float lanes[8];
+	alignas(16) float peaks[4];
+	_mm_store_ps(lanes, low);
+	_mm_store_ps(lanes + 4, high);
+	_mm_store_ps(peaks, loudest);
+	float result = std::max(std::max(peaks[0], peaks[1]), std::max(peaks[2], peaks[3]));
+	for (; i < count; i++)
+	{
+		result = std::max(result, fabsf(samples[i]));
+		lanes[i & 7] += samples[i] * samples[i];
+	}
+	*peak = result;
+	*sumOfSquares = SumLevelLanes(lanes);
+}
+
+SSE2_FUNCTION static void Polyphase(float* out, const float* window, unsigned channels, double position, double step,
+	unsigned frameCount, const PolyphaseTable& table)
+{
+	// Lanes 0-3 in the low registers and 4-7 in the high, the taps are always a multiple of 8 floats
+	const unsigned count = table.taps * channels;
+	for (unsigned j = 0; j < frameCount; j++)
+	{
+		double at = position + j * step;
+		size_t index = (size_t)at;
+		double scaled = (at - index) * PolyphaseTable::kPhases;
+		unsigned phase = (unsigned)scaled;
+		float blend = (float)(scaled - phase);
+
+		const float* source = window + index * channels;
+		const float* first = channels == 1 ? table.GetMono(phase) : table.GetStereo(phase);
+		const float* second = channels == 1 ? table.GetMono(phase + 1) : table.GetStereo(phase + 1);
+		__m128 firstLow = _mm_setzero_ps();
+		__m128 firstHigh = _mm_setzero_ps();
+		__m128 secondLow = _mm_setzero_ps();
+		__m128 secondHigh = _mm_setzero_ps();
+		for (unsigned k = 0; k < count; k += 8)
+		{
+			__m128 low = _mm_loadu_ps(source + k);
+			__m128 high = _mm_loadu_ps(source + k + 4);
+			firstLow = _mm_add_ps(firstLow, _mm_mul_ps(low, _mm_loadu_ps(first + k)));
+			firstHigh = _mm_add_ps(firstHigh, _mm_mul_ps(high, _mm_loadu_ps(first + k + 4)));
+			secondLow = _mm_add_ps(secondLow, _mm_mul_ps(low, _mm_loadu_ps(second + k)));
+			secondHigh = _mm_add_ps(secondHigh, _mm_mul_ps(high, _mm_loadu_ps(second + k + 4)));
+		}
+
+		alignas(16) float lanesFirst[8];
+		alignas(16) float lanesSecond[8];
+		_mm_store_ps(lanesFirst, firstLow);
+		_mm_store_ps(lanesFirst + 4, firstHigh);
+		_mm_store_ps(lanesSecond, secondLow);
+		_mm_store_ps(lanesSecond + 4, secondHigh);
+		if (channels == 1)
+		{
+			float a = SumLevelLanes(lanesFirst);
+			float b = SumLevelLanes(lanesSecond);
+			out[j] = a + (b - a) * blend;
+		}
+		else
+		{
+			float leftA, rightA, leftB, rightB;
+			SumStereoLanes(lanesFirst, &leftA, &rightA);
+			SumStereoLanes(lanesSecond, &leftB, &rightB);
+			out[j * 2] = leftA + (leftB - leftA) * blend;
+			out[j * 2 + 1] = rightA + (rightB - rightA) * blend;
+		}
+	}
+}
+
+SSE2_FUNCTION static void DecodeAdpcm(float* out, const uint8_t* units, unsigned unitCount, unsigned channels)
+{
+	// Four units at once, one to a lane. SSE2 has no 32-bit min or max, but packing down to 16 bits saturates,
+	// which is exactly the predictor's clamp, and the step index fits in 16 bits for its own
+	const __m128i one = _mm_set1_epi32(1);
+	const __m128i two = _mm_set1_epi32(2);
+	const __m128i three = _mm_set1_epi32(3);
+	const __m128i four = _mm_set1_epi32(4);
+	const __m128i eight = _mm_set1_epi32(8);
+	const __m128i fifteen = _mm_set1_epi32(15);
+	const __m128i minusOne = _mm_set1_epi32(-1);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i maxIndex = _mm_set1_epi16(kAdpcmStepCount - 1);
+	const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+
+	// Lanes have to line up with whole frames for the leftovers to carry on in the right place
+	const unsigned whole = (4 % channels == 0) ? unitCount / 4 * 4 : 0;
+	unsigned u = 0;
+	for (; u < whole; u += 4)
+	{
+		const uint8_t* unit[4];
+		float* channel[4];
+		alignas(16) int32_t words[4];
+		for (unsigned lane = 0; lane < 4; lane++)
+		{
+			unit[lane] = units + (size_t)(u + lane) * kAdpcmUnitBytes;
+			channel[lane] = out + (size_t)((u + lane) / channels) * kAdpcmUnitFrames * channels + (u + lane) % channels;
+			memcpy(&words[lane], unit[lane], 4);
+		}
+
+		// The header: predictor in the low 16 bits, step index in the next 8
+		__m128i header = _mm_load_si128((const __m128i*)words);
+		__m128i predictor = _mm_srai_epi32(_mm_slli_epi32(header, 16), 16);
+		__m128i packedIndex = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(header, 16), _mm_set1_epi32(0xFF)), zero);
+		__m128i index = _mm_unpacklo_epi16(_mm_min_epi16(packedIndex, maxIndex), zero);
+
+		alignas(16) int32_t indices[4];
+		alignas(16) float values[4];
+		for (unsigned word = 0; word < kAdpcmUnitFrames / 8; word++)
+		{
+			// Eight codes a lane
+			for (unsigned lane = 0; lane < 4; lane++)
+			{
+				memcpy(&words[lane], unit[lane] + 4 + word * 4, 4);
+			}
+			__m128i codes = _mm_load_si128((const __m128i*)words);
+
+			for (unsigned j = 0; j < 8; j++)
+			{
+				__m128i code = _mm_and_si128(codes, fifteen);
+				codes = _mm_srli_epi32(codes, 4);
+
+				_mm_store_si128((__m128i*)indices, index);
+				__m128i step = _mm_setr_epi32(kAdpcmSteps[indices[0]], kAdpcmSteps[indices[1]], kAdpcmSteps[indices[2]], kAdpcmSteps[indices[3]]);
+
+				__m128i big = _mm_cmpeq_epi32(_mm_and_si128(code, four), four);
+				__m128i difference = _mm_srai_epi32(step, 3);
+				difference = _mm_add_epi32(difference, _mm_and_si128(step, big));
+				difference = _mm_add_epi32(difference, _mm_and_si128(_mm_srai_epi32(step, 1), _mm_cmpeq_epi32(_mm_and_si128(code, two), two)));
+				difference = _mm_add_epi32(difference, _mm_and_si128(_mm_srai_epi32(step, 2), _mm_cmpeq_epi32(_mm_and_si128(code, one), one)));
+				__m128i negative = _mm_cmpeq_epi32(_mm_and_si128(code, eight), eight);
+				difference = _mm_sub_epi32(_mm_xor_si128(difference, negative), negative);
+
+				__m128i packed = _mm_packs_epi32(_mm_add_epi32(predictor, difference), zero);
+				predictor = _mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16);
+
+				__m128i up = _mm_slli_epi32(_mm_add_epi32(_mm_and_si128(code, three), one), 1);
+				index = _mm_add_epi32(index, _mm_or_si128(_mm_and_si128(big, up), _mm_andnot_si128(big, minusOne)));
+				packedIndex = _mm_packs_epi32(index, zero);
+				index = _mm_unpacklo_epi16(_mm_min_epi16(_mm_max_epi16(packedIndex, zero), maxIndex), zero);
+
+				_mm_store_ps(values, _mm_mul_ps(_mm_cvtepi32_ps(predictor), scale));
+				const size_t at = (size_t)(word * 8 + j) * channels;
+				channel[0][at] = values[0];
+				channel[1][at] = values[1];
+				channel[2][at] = values[2];
+				channel[3][at] = values[3];
+			}
+		}
+	}
+	kScalarMixKernels.decodeAdpcm(out + (size_t)(u / channels) * kAdpcmUnitFrames * channels, units + (size_t)u * kAdpcmUnitBytes,
+		unitCount - u, channels);
+}
+
+const MixKernels kSse2MixKernels =
+{
+	SimdLevel::SSE2,
+	"SSE2",
+	Accumulate,
+	AccumulateStereo,
+	AccumulatePanned,
+	Int16ToFloat,
+	Uint8ToFloat,
+	Int24ToFloat,
+	Int32ToFloat,
+	FloatToInt16,
+	Clip,
+	ProcessBiquadStage,
+	MeasureLevel,
+	Polyphase,
+	DecodeAdpcm
+};
+
+#endif
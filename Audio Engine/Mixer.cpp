@@ -0,0 +1,1376 @@
+#include "Mixer.h"
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <string.h>
+
+Mixer::Mixer(unsigned rate, unsigned frames, unsigned maxVoices) :
+	sampleRate(rate),
+	blockFrames(frames),
+	voices(maxVoices),
+	commands(kCommandQueueSize),
+	scheduled(kMaxScheduledCommands),
+	kernels(&GetMixKernels()),
+	masterEffects(nullptr),
+	resampleQuality(ResampleQuality::High),
+	blocksRendered(0),
+	framesRendered(0),
+	lastBlockMicros(0.0),
+	peakBlockMicros(0.0),
+	load(0.0),
+	activeVoices(0),
+	voicesStolen(0),
+	voicesRejected(0),
+	commandsDropped(0)
+{
+	// Everything the audio thread needs gets allocated here, never while rendering
+	mixBuffer.resize((size_t)blockFrames * kChannels);
+	streamBuffer.resize(((size_t)blockFrames * kMaxStreamStep + 2) * kChannels);
+	convertBuffer.resize((size_t)blockFrames * kChannels);
+	voiceBuffer.resize((size_t)blockFrames * kChannels);
+	resampleWindow.resize(((size_t)(blockFrames * kMaxSincStep) + 64) * kChannels);
+	resampleBuffer.resize((size_t)blockFrames * kChannels);
+	decodeBuffer.resize(resampleWindow.size() + (size_t)kAdpcmUnitFrames * 2 * kChannels);
+	// Builds every filter table now rather than on the audio thread the first time one's needed
+	GetPolyphaseTable(ResampleQuality::High, 1.0);
+	for (Bus& bus : buses)
+	{
+		bus.buffer.resize((size_t)blockFrames * kChannels);
+		bus.gain = 1.0f;
+		bus.effects = nullptr;
+		bus.used = false;
+	}
+	voiceChains.reserve(kMaxVoiceChains);
+}
+
+void Mixer::Render(float* out, unsigned frameCount)
+{
+	// Filter and effect tails decay into denormals, which would otherwise get very slow
+	ScopedFlushDenormals flushDenormals;
+
+	// Chop whatever the backend asked for into fixed-size blocks
+	while (frameCount > 0)
+	{
+		unsigned frames = std::min(frameCount, blockFrames);
+		RenderBlock(out, frames);
+		out += frames * kChannels;
+		frameCount -= frames;
+	}
+}
+
+void Mixer::RenderBlock(float* out, unsigned frameCount)
+{
+	auto startTime = std::chrono::steady_clock::now();
+	const size_t blockSamples = (size_t)frameCount * kChannels;
+
+	const uint64_t blockStart = framesRendered.load(std::memory_order_relaxed);
+
+	// Everything that was asked for since the last block happens now, on the block boundary,
+	// unless it was asked for at a later frame
+	ApplyCommands(blockStart);
+
+	for (Bus& bus : buses)
+	{
+		bus.used = false;
+	}
+	for (EffectChain* chain : voiceChains)
+	{
+		chain->used = false;
+	}
+
+	// Scheduled commands split the block up: the voices get mixed up to the frame one's due on, then it runs.
+	// Effects still run once over the whole block afterwards, so an effect parameter lands on the block it's due in
+	unsigned mixed = 0;
+	if (!scheduled.IsEmpty())
+	{
+		for (unsigned frame = 0; frame < frameCount; frame++)
+		{
+			scheduled.Advance([&](const MixerCommand& command)
+			{
+				if (frame > mixed)
+				{
+					MixVoices(blockSamples, mixed, frame - mixed);
+					mixed = frame;
+				}
+				Apply(command);
+			});
+		}
+	}
+	MixVoices(blockSamples, mixed, frameCount - mixed);
+	scheduled.SetTime(blockStart + frameCount);
+
+	RunEffects(frameCount);
+
+	// Sum the buses
+	float* mix = mixBuffer.data();
+	memset(mix, 0, sizeof(float) * blockSamples);
+	for (const Bus& bus : buses)
+	{
+		if (!bus.used)
+		{
+			continue;
+		}
+		kernels->accumulate(mix, bus.buffer.data(), bus.gain, blockSamples);
+	}
+	if (masterEffects)
+	{
+		masterEffects->Process(mix, frameCount);
+	}
+
+	memcpy(out, mix, sizeof(float) * blockSamples);
+
+	// Keep score of how long that took compared to how long the block lasts
+	double micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - startTime).count();
+	double blockMicros = frameCount * 1000000.0 / sampleRate;
+	lastBlockMicros.store(micros, std::memory_order_relaxed);
+	if (micros > peakBlockMicros.load(std::memory_order_relaxed))
+	{
+		peakBlockMicros.store(micros, std::memory_order_relaxed);
+	}
+	load.store(micros / blockMicros, std::memory_order_relaxed);
+	activeVoices.store(voices.GetActiveCount(), std::memory_order_relaxed);
+	voicesStolen.store(voices.GetStealCount(), std::memory_order_relaxed);
+	voicesRejected.store(voices.GetRejectCount(), std::memory_order_relaxed);
+	blocksRendered.fetch_add(1, std::memory_order_relaxed);
+	framesRendered.fetch_add(frameCount, std::memory_order_relaxed);
+}
+
+void Mixer::MixVoices(size_t blockSamples, unsigned offset, unsigned frameCount)
+{
+	if (frameCount == 0)
+	{
+		return;
+	}
+
+	unsigned i = 0;
+	while (i < voices.GetActiveCount())
+	{
+		Voice* voice = voices.GetActive(i);
+		if (MixVoiceAndSend(*voice, blockSamples, offset, frameCount))
+		{
+			i++;
+		}
+		else
+		{
+			// Releasing swaps the last voice into slot i, so don't move on.
+			// The pool also knocks down the sound's voice count and moves the handle's generation on
+			voices.Release(voice);
+		}
+	}
+}
+
+bool Mixer::MixVoiceAndSend(Voice& voice, size_t blockSamples, unsigned offset, unsigned frameCount)
+{
+	// The buffers get cleared for the whole block the first time they're used in it, wherever in it that is
+	const size_t start = (size_t)offset * kChannels;
+	const size_t samples = (size_t)frameCount * kChannels;
+	float* target = GetVoiceTarget(voice, blockSamples) + start;
+	if (voice.sendLevel <= 0.0f)
+	{
+		return MixVoice(voice, target, frameCount);
+	}
+
+	// Mixed once on its own, then copied to both places, rather than resampled twice.
+	// Adding it in at a gain of 1 comes out exactly the same as mixing it straight in would have
+	float* dry = voiceBuffer.data();
+	memset(dry, 0, sizeof(float) * samples);
+	bool playing = MixVoice(voice, dry, frameCount);
+	kernels->accumulate(target, dry, 1.0f, samples);
+	kernels->accumulate(GetBusBuffer(voice.sendBus, blockSamples) + start, dry, voice.sendLevel, samples);
+	return playing;
+}
+
+float* Mixer::GetBusBuffer(unsigned index, size_t blockSamples)
+{
+	Bus& bus = buses[index];
+	if (!bus.used)
+	{
+		memset(bus.buffer.data(), 0, sizeof(float) * blockSamples);
+		bus.used = true;
+	}
+	return bus.buffer.data();
+}
+
+float* Mixer::GetVoiceTarget(const Voice& voice, size_t blockSamples)
+{
+	EffectChain* chain = voice.effects;
+	if (!chain || !chain->active)
+	{
+		return GetBusBuffer(voice.bus, blockSamples);
+	}
+
+	// The first voice into the chain this block decides where its output goes
+	if (!chain->used)
+	{
+		memset(chain->input.data(), 0, sizeof(float) * blockSamples);
+		chain->used = true;
+		chain->outputBus = voice.bus;
+	}
+	return chain->input.data();
+}
+
+void Mixer::RunEffects(unsigned frameCount)
+{
+	const size_t blockSamples = (size_t)frameCount * kChannels;
+
+	// Voice chains first, since they feed the buses
+	unsigned i = 0;
+	while (i < voiceChains.size())
+	{
+		EffectChain* chain = voiceChains[i];
+		if (chain->used)
+		{
+			chain->tailRemaining = chain->GetTailFrames();
+		}
+		else if (chain->tailRemaining > 0)
+		{
+			// Nothing's playing through it any more, but it's still ringing
+			memset(chain->input.data(), 0, sizeof(float) * blockSamples);
+			chain->tailRemaining -= std::min(chain->tailRemaining, frameCount);
+		}
+		else
+		{
+			// Finished with, until a voice starts on it again
+			chain->active = false;
+			voiceChains[i] = voiceChains.back();
+			voiceChains.pop_back();
+			continue;
+		}
+
+		chain->Process(chain->input.data(), frameCount);
+		kernels->accumulate(GetBusBuffer(chain->outputBus, blockSamples), chain->input.data(), 1.0f, blockSamples);
+		i++;
+	}
+
+	for (Bus& bus : buses)
+	{
+		EffectChain* chain = bus.effects;
+		if (!chain)
+		{
+			continue;
+		}
+
+		if (bus.used)
+		{
+			chain->tailRemaining = chain->GetTailFrames();
+		}
+		else if (chain->tailRemaining > 0)
+		{
+			memset(bus.buffer.data(), 0, sizeof(float) * blockSamples);
+			bus.used = true;
+			chain->tailRemaining -= std::min(chain->tailRemaining, frameCount);
+		}
+		else
+		{
+			continue;
+		}
+		chain->Process(bus.buffer.data(), frameCount);
+	}
+}
+
+void Mixer::AttachEffects(Voice& voice, EffectChain* chain)
+{
+	voice.effects = chain;
+	if (chain && !chain->active && voiceChains.size() < kMaxVoiceChains)
+	{
+		// Room for it was reserved up front, so this never allocates
+		chain->active = true;
+		chain->used = false;
+		chain->tailRemaining = 0;
+		voiceChains.push_back(chain);
+	}
+}
+
+// Turning whatever the sample is stored as into float
+static inline float ToFloat(float value)
+{
+	return value;
+}
+
+static inline float ToFloat(int16_t value)
+{
+	return value * (1.0f / 32768.0f);
+}
+
+// Same again for a whole run of frames at once. Float samples can be mixed from where they are,
+// 16-bit ones get converted into the scratch buffer first
+static const float* ToFloat(const MixKernels&, const float* pcm, size_t, float*)
+{
+	return pcm;
+}
+
+static const float* ToFloat(const MixKernels& kernels, const int16_t* pcm, size_t count, float* scratch)
+{
+	kernels.int16ToFloat(scratch, pcm, count);
+	return scratch;
+}
+
+// A voice at its original speed sitting exactly on a frame has nothing to interpolate,
+// so every frame is just the source times the gain
+static bool IsUnresampled(const Voice& voice)
+{
+	return voice.step == 1.0 && voice.fade >= 1.0f && voice.position == (double)(unsigned)voice.position;
+}
+
+// Where a voice runs out of frames: the end of its loop if it's looping, otherwise the end of the sample
+static unsigned GetEnd(const Voice& voice)
+{
+	return voice.looping ? voice.sample->GetLoopEnd() : voice.sample->frameCount;
+}
+
+// Takes a looping voice that's gone past the end of its loop back round onto it
+static void WrapLoop(Voice& voice)
+{
+	const double loopStart = (double)voice.sample->loopStart;
+	voice.position = loopStart + fmod(voice.position - loopStart, (double)(voice.sample->GetLoopEnd() - voice.sample->loopStart));
+}
+
+// That's the common case, and then whole runs of frames (up to the end of the sample) can go through the SIMD kernels.
+// The answer's exactly the same as the frame-at-a-time loop would have given
+template <typename T>
+static bool MixRuns(Voice& voice, const T* pcm, float* out, unsigned frameCount, const MixKernels& kernels, float* scratch)
+{
+	const Sample* sample = voice.sample;
+	const unsigned channels = sample->channels;
+	const unsigned end = GetEnd(voice);
+
+	unsigned i = 0;
+	while (i < frameCount)
+	{
+		// A while, since a voice started past a short loop can be more than once round it
+		while (voice.position >= end)
+		{
+			if (!voice.looping)
+			{
+				return false;
+			}
+			voice.position -= end - sample->loopStart;
+		}
+
+		unsigned index = (unsigned)voice.position;
+		unsigned run = std::min(frameCount - i, end - index);
+		const float* source = ToFloat(kernels, pcm + (size_t)index * channels, (size_t)run * channels, scratch);
+		if (channels == 1)
+		{
+			kernels.accumulatePanned(out + i * 2, source, voice.gainLeft, voice.gainRight, run);
+		}
+		else
+		{
+			kernels.accumulateStereo(out + i * 2, source, voice.gainLeft, voice.gainRight, run);
+		}
+
+		voice.position += run;
+		i += run;
+	}
+	return true;
+}
+
+// The actual mixing loop, written once and stamped out for each sample format
+template <typename T>
+static bool MixFrames(Voice& voice, const T* pcm, float* out, unsigned frameCount, const MixKernels& kernels, float* scratch)
+{
+	if (IsUnresampled(voice))
+	{
+		return MixRuns(voice, pcm, out, frameCount, kernels, scratch);
+	}
+
+	const Sample* sample = voice.sample;
+	const unsigned channels = sample->channels;
+	const unsigned end = GetEnd(voice);
+	const double length = (double)end;
+	const double loopLength = (double)(end - sample->loopStart);
+	float fade = voice.fade;
+
+	for (unsigned i = 0; i < frameCount; i++)
+	{
+		while (voice.position >= length)
+		{
+			if (!voice.looping)
+			{
+				return false;
+			}
+			voice.position -= loopLength;
+		}
+
+		// Linear interpolation between the two source frames either side of where we are
+		unsigned index = (unsigned)voice.position;
+		unsigned next = index + 1;
+		if (next >= end)
+		{
+			next = voice.looping ? sample->loopStart : index;
+		}
+		float fraction = (float)(voice.position - index);
+
+		float left;
+		float right;
+		if (channels == 1)
+		{
+			float a = ToFloat(pcm[index]);
+			float b = ToFloat(pcm[next]);
+			left = right = a + (b - a) * fraction;
+		}
+		else
+		{
+			float aLeft = ToFloat(pcm[index * 2]);
+			float bLeft = ToFloat(pcm[next * 2]);
+			float aRight = ToFloat(pcm[index * 2 + 1]);
+			float bRight = ToFloat(pcm[next * 2 + 1]);
+			left = aLeft + (bLeft - aLeft) * fraction;
+			right = aRight + (bRight - aRight) * fraction;
+		}
+
+		out[i * 2] += left * voice.gainLeft * fade;
+		out[i * 2 + 1] += right * voice.gainRight * fade;
+
+		voice.position += voice.step;
+		fade = std::min(fade + voice.fadeStep, 1.0f);
+	}
+	voice.fade = fade;
+	return true;
+}
+
+bool Mixer::MixVoice(Voice& voice, float* out, unsigned frameCount)
+{
+	if (voice.stream)
+	{
+		return MixStream(voice, out, frameCount);
+	}
+	if (!voice.sample)
+	{
+		// A synth note, made up as it goes
+		float* note = resampleBuffer.data();
+		bool playing = voice.synth.Render(note, frameCount);
+		kernels->accumulatePanned(out, note, voice.gainLeft, voice.gainRight, frameCount);
+		return playing;
+	}
+
+	// Anything not at its own rate goes through the sinc filter, unless it's set to linear or going too fast for it
+	const PolyphaseTable* table = IsUnresampled(voice) || voice.step > kMaxSincStep ? nullptr :
+		GetPolyphaseTable(resampleQuality.load(std::memory_order_relaxed), voice.step);
+
+	if (table)
+	{
+		return MixSinc(voice, out, frameCount, *table);
+	}
+
+	// Mapped samples are still 16-bit, compressed ones can only be read a window at a time,
+	// everything else was converted to float when it loaded
+	switch (voice.sample->format)
+	{
+	case SampleFormat::Int16:
+		return MixFrames(voice, voice.sample->GetFrames<int16_t>(), out, frameCount, *kernels, convertBuffer.data());
+	case SampleFormat::ImaAdpcm:
+		return MixDecoded(voice, out, frameCount);
+	default:
+		return MixFrames(voice, voice.sample->GetFrames<float>(), out, frameCount, *kernels, convertBuffer.data());
+	}
+}
+
+void Mixer::ReadFrames(const Sample& sample, unsigned first, unsigned frameCount, float* out)
+{
+	const size_t offset = (size_t)first * sample.channels;
+	const size_t count = (size_t)frameCount * sample.channels;
+	switch (sample.format)
+	{
+	case SampleFormat::Int16:
+		kernels->int16ToFloat(out, sample.GetFrames<int16_t>() + offset, count);
+		break;
+	case SampleFormat::ImaAdpcm:
+		DecodeAdpcmFrames(*kernels, sample, first, frameCount, out, decodeBuffer.data());
+		break;
+	default:
+		memcpy(out, sample.GetFrames<float>() + offset, count * sizeof(float));
+		break;
+	}
+}
+
+void Mixer::FillWindow(const Sample& sample, long long first, unsigned span, bool looping, float* window)
+{
+	const unsigned channels = sample.channels;
+	const unsigned end = looping ? sample.GetLoopEnd() : sample.frameCount;
+	const long long loopLength = (long long)(end - sample.loopStart);
+	unsigned filled = 0;
+	while (filled < span)
+	{
+		long long frame = first + filled;
+		if (looping && frame >= (long long)end)
+		{
+			// Seamlessly round to the start of the loop again...
+			frame = sample.loopStart + (frame - end) % loopLength;
+		}
+		else if (looping && frame < 0 && sample.loopStart == 0)
+		{
+			// ...and, at the very start, from the end (if the loop goes right back to the start)
+			frame %= loopLength;
+			frame += frame < 0 ? loopLength : 0;
+		}
+
+		unsigned run;
+		if (frame < 0 || frame >= (long long)end)
+		{
+			// Silence either side
+			run = frame < 0 ? (unsigned)std::min<long long>(span - filled, -frame) : span - filled;
+			memset(window + (size_t)filled * channels, 0, (size_t)run * channels * sizeof(float));
+		}
+		else
+		{
+			run = std::min(span - filled, end - (unsigned)frame);
+			ReadFrames(sample, (unsigned)frame, run, window + (size_t)filled * channels);
+		}
+		filled += run;
+	}
+}
+
+bool Mixer::MixSinc(Voice& voice, float* out, unsigned frameCount, const PolyphaseTable& table)
+{
+	const Sample* sample = voice.sample;
+	const unsigned channels = sample->channels;
+	const double length = (double)GetEnd(voice);
+
+	if (voice.position >= length)
+	{
+		if (!voice.looping)
+		{
+			return false;
+		}
+		WrapLoop(voice);
+		if (sample->loopStart > 0)
+		{
+			// Counted on from the end of the loop rather than its start, so the taps reaching back see the end
+			// of the loop (what's actually just played) rather than whatever's before it in the sample.
+			// A loop from the very start gets that from FillWindow() wrapping round instead
+			voice.position += sample->GetLoopEnd() - sample->loopStart;
+		}
+	}
+
+	// Same as the linear version, a sound that doesn't loop stops on the first frame past its end
+	unsigned count = frameCount;
+	if (!voice.looping)
+	{
+		count = (unsigned)std::min((double)frameCount, ceil((length - voice.position) / voice.step));
+		while (count > 0 && voice.position + (count - 1) * voice.step >= length)
+		{
+			count--;
+		}
+	}
+
+	// Every source frame the taps reach this block: from 'centre' frames before the first position
+	// to the last position's whole frame plus the rest of the taps
+	long long first = (long long)voice.position - table.GetCentre();
+	unsigned span = (unsigned)(voice.position + (count - 1) * voice.step) - (unsigned)voice.position + table.taps;
+	float* window = resampleWindow.data();
+	FillWindow(*sample, first, span, voice.looping, window);
+
+	float* resampled = resampleBuffer.data();
+	kernels->polyphase(resampled, window, channels, voice.position - (double)(unsigned)voice.position, voice.step, count, table);
+
+	if (voice.fade < 1.0f)
+	{
+		float fade = voice.fade;
+		for (unsigned i = 0; i < count; i++)
+		{
+			for (unsigned channel = 0; channel < channels; channel++)
+			{
+				resampled[i * channels + channel] *= fade;
+			}
+			fade = std::min(fade + voice.fadeStep, 1.0f);
+		}
+		voice.fade = fade;
+	}
+
+	if (channels == 1)
+	{
+		kernels->accumulatePanned(out, resampled, voice.gainLeft, voice.gainRight, count);
+	}
+	else
+	{
+		kernels->accumulateStereo(out, resampled, voice.gainLeft, voice.gainRight, count);
+	}
+
+	voice.position += count * voice.step;
+	return count == frameCount;
+}
+
+bool Mixer::MixDecoded(Voice& voice, float* out, unsigned frameCount)
+{
+	const Sample* sample = voice.sample;
+	const unsigned channels = sample->channels;
+	const double length = (double)GetEnd(voice);
+	float* window = resampleWindow.data();
+	// However fast it's going, a frame and the one after it always fit
+	const unsigned windowFrames = (unsigned)(resampleWindow.size() / channels);
+	const unsigned maxCount = std::max(1u, (unsigned)((windowFrames - 2) / voice.step));
+
+	// Decoded a window's worth at a time: once a block, unless it's going fast enough to need more than that
+	unsigned i = 0;
+	while (i < frameCount)
+	{
+		if (voice.position >= length)
+		{
+			if (!voice.looping)
+			{
+				return false;
+			}
+			WrapLoop(voice);
+		}
+
+		unsigned count = std::min(frameCount - i, maxCount);
+		if (!voice.looping)
+		{
+			count = (unsigned)std::min((double)count, ceil((length - voice.position) / voice.step));
+			while (count > 0 && voice.position + (count - 1) * voice.step >= length)
+			{
+				count--;
+			}
+			if (count == 0)
+			{
+				return false;
+			}
+		}
+
+		// The frames either side of every position, counting from the first one's whole frame
+		const unsigned base = (unsigned)voice.position;
+		const unsigned span = (unsigned)(voice.position + (count - 1) * voice.step) - base + 2;
+		FillWindow(*sample, base, span, voice.looping, window);
+		if (!voice.looping && base + span > sample->frameCount)
+		{
+			// The last frame has nothing after it to head towards, so it holds, like MixFrames()
+			float* last = window + (size_t)(sample->frameCount - 1 - base) * channels;
+			memcpy(last + channels, last, channels * sizeof(float));
+		}
+
+		float* target = out + (size_t)i * 2;
+		if (IsUnresampled(voice))
+		{
+			if (channels == 1)
+			{
+				kernels->accumulatePanned(target, window, voice.gainLeft, voice.gainRight, count);
+			}
+			else
+			{
+				kernels->accumulateStereo(target, window, voice.gainLeft, voice.gainRight, count);
+			}
+			voice.position += count;
+		}
+		else
+		{
+			// Linear interpolation, the same as MixFrames() but out of the window
+			const double start = voice.position;
+			float fade = voice.fade;
+			for (unsigned j = 0; j < count; j++)
+			{
+				double at = start + j * voice.step;
+				unsigned index = (unsigned)at - base;
+				float fraction = (float)(at - (unsigned)at);
+
+				float left;
+				float right;
+				if (channels == 1)
+				{
+					float a = window[index];
+					float b = window[index + 1];
+					left = right = a + (b - a) * fraction;
+				}
+				else
+				{
+					const float* a = window + index * 2;
+					const float* b = a + 2;
+					left = a[0] + (b[0] - a[0]) * fraction;
+					right = a[1] + (b[1] - a[1]) * fraction;
+				}
+
+				target[j * 2] += left * voice.gainLeft * fade;
+				target[j * 2 + 1] += right * voice.gainRight * fade;
+				fade = std::min(fade + voice.fadeStep, 1.0f);
+			}
+			voice.fade = fade;
+			voice.position = start + count * voice.step;
+		}
+		i += count;
+	}
+	return true;
+}
+
+bool Mixer::MixStream(Voice& voice, float* out, unsigned frameCount)
+{
+	StreamingSound* stream = voice.stream;
+	const unsigned channels = stream->GetChannels();
+
+	// Frame 0 of the buffer is the last frame of the previous block, and position counts from there.
+	// Pull in however many new frames this block's interpolation reaches, or steps over
+	float* source = streamBuffer.data();
+	unsigned lastNeeded = (unsigned)(voice.position + (frameCount - 1) * voice.step) + 1;
+	unsigned needed = std::max(lastNeeded, (unsigned)(voice.position + frameCount * voice.step));
+	float fade = voice.fade;
+	source[0] = voice.history[0];
+	source[1] = voice.history[1];
+	unsigned got = stream->Read(source + channels, needed);
+	if (got == 0 && stream->IsFinished())
+	{
+		return false;
+	}
+
+	if (IsUnresampled(voice))
+	{
+		// Straight through, no interpolating
+		const float* first = source + (size_t)voice.position * channels;
+		if (channels == 1)
+		{
+			kernels->accumulatePanned(out, first, voice.gainLeft, voice.gainRight, frameCount);
+		}
+		else
+		{
+			kernels->accumulateStereo(out, first, voice.gainLeft, voice.gainRight, frameCount);
+		}
+		voice.position += frameCount;
+	}
+	else
+	{
+		for (unsigned i = 0; i < frameCount; i++)
+		{
+			unsigned index = (unsigned)voice.position;
+			float fraction = (float)(voice.position - index);
+
+			float left;
+			float right;
+			if (channels == 1)
+			{
+				float a = source[index];
+				float b = source[index + 1];
+				left = right = a + (b - a) * fraction;
+			}
+			else
+			{
+				const float* a = source + index * 2;
+				const float* b = a + 2;
+				left = a[0] + (b[0] - a[0]) * fraction;
+				right = a[1] + (b[1] - a[1]) * fraction;
+			}
+
+			out[i * 2] += left * voice.gainLeft * fade;
+			out[i * 2 + 1] += right * voice.gainRight * fade;
+
+			voice.position += voice.step;
+			fade = std::min(fade + voice.fadeStep, 1.0f);
+		}
+		voice.fade = fade;
+	}
+
+	// Keep the frame we're now sitting just after, and count from it next time
+	unsigned consumed = (unsigned)voice.position;
+	voice.history[0] = source[consumed * channels];
+	voice.history[1] = source[consumed * channels + channels - 1];
+	voice.position -= consumed;
+	return true;
+}
+
+// Pan just turns down the opposite side, the same way DirectSound does it
+static void SetGains(Voice& voice, float gain, float pan)
+{
+	pan = std::max(-1.0f, std::min(1.0f, pan));
+	voice.gain = gain;
+	voice.pan = pan;
+	voice.gainLeft = gain * (pan > 0.0f ? 1.0f - pan : 1.0f);
+	voice.gainRight = gain * (pan < 0.0f ? 1.0f + pan : 1.0f);
+}
+
+// Play back at the right speed even if the source wasn't recorded at our output rate
+static double GetStep(float pitch, unsigned sourceRate, unsigned outputRate)
+{
+	return pitch * (double)sourceRate / outputRate;
+}
+
+static void SetFade(Voice& voice, unsigned fadeInFrames)
+{
+	voice.fade = fadeInFrames > 0 ? 0.0f : 1.0f;
+	voice.fadeStep = fadeInFrames > 0 ? 1.0f / fadeInFrames : 0.0f;
+}
+
+// ********************** Any thread ******************************* //
+
+bool Mixer::Send(const MixerCommand& command)
+{
+	if (!commands.Push(command))
+	{
+		commandsDropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	return true;
+}
+
+VoiceHandle Mixer::ReserveHandle()
+{
+	return voices.ReserveHandle();
+}
+
+VoiceHandle Mixer::PlayAt(uint64_t time, const Sample* sample, const VoiceParams& params, VoiceHandle handle)
+{
+	if (!handle.IsValid())
+	{
+		handle = voices.ReserveHandle();
+	}
+	if (!sample || sample->frameCount == 0 || !handle.IsValid())
+	{
+		voices.CancelHandle(handle);
+		return VoiceHandle();
+	}
+
+	// Counted now rather than when it starts, so IsPlaying() is right straight away
+	sample->voiceCount.fetch_add(1, std::memory_order_relaxed);
+
+	MixerCommand command = {};
+	command.type = MixerCommand::Type::PlaySample;
+	command.time = time;
+	command.handle = handle;
+	command.sample = sample;
+	command.params = params;
+	if (!Send(command))
+	{
+		sample->voiceCount.fetch_sub(1, std::memory_order_release);
+		voices.CancelHandle(handle);
+		return VoiceHandle();
+	}
+	return handle;
+}
+
+VoiceHandle Mixer::Play(StreamingSound* stream, const VoiceParams& params)
+{
+	VoiceHandle handle = voices.ReserveHandle();
+	if (!stream || stream->GetChannels() == 0 || !handle.IsValid())
+	{
+		voices.CancelHandle(handle);
+		return VoiceHandle();
+	}
+
+	stream->GetVoiceCount().fetch_add(1, std::memory_order_relaxed);
+
+	MixerCommand command = {};
+	command.type = MixerCommand::Type::PlayStream;
+	command.handle = handle;
+	command.stream = stream;
+	command.params = params;
+	if (!Send(command))
+	{
+		stream->GetVoiceCount().fetch_sub(1, std::memory_order_release);
+		voices.CancelHandle(handle);
+		return VoiceHandle();
+	}
+	return handle;
+}
+
+VoiceHandle Mixer::PlayAt(uint64_t time, const SynthParams& synth, const VoiceParams& params)
+{
+	VoiceHandle handle = voices.ReserveHandle();
+	if (!handle.IsValid())
+	{
+		return VoiceHandle();
+	}
+
+	MixerCommand command = {};
+	command.type = MixerCommand::Type::PlaySynth;
+	command.time = time;
+	command.handle = handle;
+	command.synth = synth;
+	command.params = params;
+	if (!Send(command))
+	{
+		voices.CancelHandle(handle);
+		return VoiceHandle();
+	}
+	return handle;
+}
+
+void Mixer::StopAt(uint64_t time, VoiceHandle handle)
+{
+	MixerCommand command = {};
+	command.type = MixerCommand::Type::StopVoice;
+	command.time = time;
+	command.handle = handle;
+	Send(command);
+}
+
+void Mixer::ReleaseNoteAt(uint64_t time, VoiceHandle handle)
+{
+	MixerCommand command = {};
+	command.type = MixerCommand::Type::ReleaseNote;
+	command.time = time;
+	command.handle = handle;
+	Send(command);
+}
+
+bool Mixer::IsPlaying(VoiceHandle handle) const
+{
+	return voices.IsHandleCurrent(handle);
+}
+
+bool Mixer::SetGainAt(uint64_t time, VoiceHandle handle, float gain)
+{
+	MixerCommand command = {};
+	command.type = MixerCommand::Type::SetGain;
+	command.time = time;
+	command.handle = handle;
+	command.value = gain;
+	return voices.IsHandleCurrent(handle) && Send(command);
+}
+
+bool Mixer::SetPanAt(uint64_t time, VoiceHandle handle, float pan)
+{
+	MixerCommand command = {};
+	command.type = MixerCommand::Type::SetPan;
+	command.time = time;
+	command.handle = handle;
+	command.value = pan;
+	return voices.IsHandleCurrent(handle) && Send(command);
+}
+
+bool Mixer::SetPitchAt(uint64_t time, VoiceHandle handle, float pitch)
+{
+	MixerCommand command = {};
+	command.type = MixerCommand::Type::SetPitch;
+	command.time = time;
+	command.handle = handle;
+	command.value = pitch;
+	return voices.IsHandleCurrent(handle) && Send(command);
+}
+
+bool Mixer::SetBus(VoiceHandle handle, unsigned bus)
+{
+	MixerCommand command = {};
+	command.type = MixerCommand::Type::SetBus;
+	command.handle = handle;
+	command.target = bus;
+	return voices.IsHandleCurrent(handle) && Send(command);
+}
+
+bool Mixer::SetSend(VoiceHandle handle, unsigned bus, float level)
+{
+	MixerCommand command = {};
+	command.type = MixerCommand::Type::SetSend;
+	command.handle = handle;
+	command.target = bus;
+	command.value = level;
+	return voices.IsHandleCurrent(handle) && Send(command);
+}
+
+void Mixer::Stop(const Sample* sample)
+{
+	MixerCommand command = {};
+	command.type = MixerCommand::Type::StopSample;
+	command.sample = sample;
+	Send(command);
+}
+
+void Mixer::Stop(StreamingSound* stream)
+{
+	MixerCommand command = {};
+	command.type = MixerCommand::Type::StopStream;
+	command.stream = stream;
+	Send(command);
+}
+
+void Mixer::StopAll()
+{
+	MixerCommand command = {};
+	command.type = MixerCommand::Type::StopAll;
+	Send(command);
+}
+
+bool Mixer::IsPlaying(const Sample* sample) const
+{
+	return sample->voiceCount.load(std::memory_order_acquire) > 0;
+}
+
+bool Mixer::IsPlaying(StreamingSound* stream) const
+{
+	return stream->GetVoiceCount().load(std::memory_order_acquire) > 0;
+}
+
+void Mixer::SetBusGain(unsigned bus, float gain)
+{
+	MixerCommand command = {};
+	command.type = MixerCommand::Type::SetBusGain;
+	command.target = bus;
+	command.value = gain;
+	Send(command);
+}
+
+void Mixer::SetGroupLimit(unsigned group, unsigned limit)
+{
+	MixerCommand command = {};
+	command.type = MixerCommand::Type::SetGroupLimit;
+	command.target = group;
+	command.value = (float)limit;
+	Send(command);
+}
+
+bool Mixer::SetEffects(VoiceHandle handle, EffectChain* chain)
+{
+	MixerCommand command = {};
+	command.type = MixerCommand::Type::SetVoiceEffects;
+	command.handle = handle;
+	command.chain = chain;
+	return voices.IsHandleCurrent(handle) && Send(command);
+}
+
+void Mixer::SetBusEffects(unsigned bus, EffectChain* chain)
+{
+	MixerCommand command = {};
+	command.type = MixerCommand::Type::SetBusEffects;
+	command.target = bus;
+	command.chain = chain;
+	Send(command);
+}
+
+void Mixer::SetMasterEffects(EffectChain* chain)
+{
+	MixerCommand command = {};
+	command.type = MixerCommand::Type::SetMasterEffects;
+	command.chain = chain;
+	Send(command);
+}
+
+void Mixer::SetEffectParameterAt(uint64_t time, Effect* effect, unsigned parameter, float value)
+{
+	MixerCommand command = {};
+	command.type = MixerCommand::Type::SetEffectParameter;
+	command.time = time;
+	command.effect = effect;
+	command.target = parameter;
+	command.value = value;
+	Send(command);
+}
+
+void Mixer::SetResampleQuality(ResampleQuality quality)
+{
+	if (quality >= ResampleQuality::Count)
+	{
+		return;
+	}
+	MixerCommand command = {};
+	command.type = MixerCommand::Type::SetResampleQuality;
+	command.target = (unsigned)quality;
+	Send(command);
+}
+
+void Mixer::Reset()
+{
+	// Anything queued happens straight away, and anything scheduled never does
+	ApplyCommands(UINT64_MAX);
+	scheduled.Clear([this](const MixerCommand& command) { Discard(command); });
+	voices.ReleaseAll();
+
+	// Silence everything that was still ringing, so it starts clean next time
+	for (EffectChain* chain : voiceChains)
+	{
+		chain->active = false;
+		chain->Reset();
+	}
+	voiceChains.clear();
+	for (Bus& bus : buses)
+	{
+		if (bus.effects)
+		{
+			bus.effects->Reset();
+		}
+	}
+	if (masterEffects)
+	{
+		masterEffects->Reset();
+	}
+
+	activeVoices.store(0, std::memory_order_relaxed);
+}
+
+// ********************** Audio thread ******************************* //
+
+void Mixer::ApplyCommands(uint64_t blockStart)
+{
+	MixerCommand command;
+	while (commands.Pop(command))
+	{
+		if (command.time <= blockStart)
+		{
+			Apply(command);
+		}
+		else if (!scheduled.Schedule(command.time, command))
+		{
+			// No room to wait, and running it early would be wrong, so it's lost like a full queue's would be
+			Discard(command);
+			commandsDropped.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+}
+
+void Mixer::Discard(const MixerCommand& command)
+{
+	switch (command.type)
+	{
+	case MixerCommand::Type::PlaySample:
+	case MixerCommand::Type::PlayStream:
+	case MixerCommand::Type::PlaySynth:
+		if (command.sample)
+		{
+			command.sample->voiceCount.fetch_sub(1, std::memory_order_release);
+		}
+		else if (command.stream)
+		{
+			command.stream->GetVoiceCount().fetch_sub(1, std::memory_order_release);
+		}
+		voices.CancelHandle(command.handle);
+		break;
+
+	default:
+		break;
+	}
+}
+
+void Mixer::Apply(const MixerCommand& command)
+{
+	switch (command.type)
+	{
+	case MixerCommand::Type::PlaySample:
+	case MixerCommand::Type::PlayStream:
+	case MixerCommand::Type::PlaySynth:
+		StartVoice(command);
+		break;
+
+	case MixerCommand::Type::ReleaseNote:
+	{
+		Voice* voice = voices.GetVoice(command.handle);
+		if (voice && !voice->sample && !voice->stream)
+		{
+			voice->synth.Release();
+		}
+		else if (voice)
+		{
+			voices.Release(voice);
+		}
+		else
+		{
+			voices.CancelHandle(command.handle);
+		}
+		break;
+	}
+
+	case MixerCommand::Type::StopVoice:
+	{
+		Voice* voice = voices.GetVoice(command.handle);
+		if (voice)
+		{
+			voices.Release(voice);
+		}
+		else
+		{
+			// Might be reserved and waiting to start, in which case now it never will
+			voices.CancelHandle(command.handle);
+		}
+		break;
+	}
+
+	case MixerCommand::Type::StopSample:
+	case MixerCommand::Type::StopStream:
+	{
+		unsigned i = 0;
+		while (i < voices.GetActiveCount())
+		{
+			Voice* voice = voices.GetActive(i);
+			if ((command.sample && voice->sample == command.sample) || (command.stream && voice->stream == command.stream))
+			{
+				voices.Release(voice);
+			}
+			else
+			{
+				i++;
+			}
+		}
+		break;
+	}
+
+	case MixerCommand::Type::StopAll:
+		voices.ReleaseAll();
+		break;
+
+	case MixerCommand::Type::SetGain:
+	case MixerCommand::Type::SetPan:
+	case MixerCommand::Type::SetPitch:
+	case MixerCommand::Type::SetBus:
+	case MixerCommand::Type::SetSend:
+	{
+		Voice* voice = voices.GetVoice(command.handle);
+		if (!voice)
+		{
+			break;
+		}
+
+		if (command.type == MixerCommand::Type::SetGain)
+		{
+			SetGains(*voice, command.value, voice->pan);
+		}
+		else if (command.type == MixerCommand::Type::SetPan)
+		{
+			SetGains(*voice, voice->gain, command.value);
+		}
+		else if (command.type == MixerCommand::Type::SetPitch)
+		{
+			if (voice->stream)
+			{
+				voice->step = std::min(GetStep(command.value, voice->stream->GetSampleRate(), sampleRate), (double)kMaxStreamStep);
+			}
+			else if (voice->sample)
+			{
+				voice->step = GetStep(command.value, voice->sample->sampleRate, sampleRate);
+			}
+			else
+			{
+				voice->synth.SetPitch(command.value);
+			}
+		}
+		else if (command.type == MixerCommand::Type::SetSend)
+		{
+			voice->sendBus = std::min(command.target, kMaxBuses - 1);
+			voice->sendLevel = command.value;
+		}
+		else
+		{
+			voice->bus = std::min(command.target, kMaxBuses - 1);
+		}
+		break;
+	}
+
+	case MixerCommand::Type::SetBusGain:
+		if (command.target < kMaxBuses)
+		{
+			buses[command.target].gain = command.value;
+		}
+		break;
+
+	case MixerCommand::Type::SetGroupLimit:
+		voices.SetGroupLimit(command.target, (unsigned)command.value);
+		break;
+
+	case MixerCommand::Type::SetVoiceEffects:
+	{
+		Voice* voice = voices.GetVoice(command.handle);
+		if (voice)
+		{
+			AttachEffects(*voice, command.chain);
+		}
+		break;
+	}
+
+	case MixerCommand::Type::SetBusEffects:
+		if (command.target < kMaxBuses)
+		{
+			buses[command.target].effects = command.chain;
+			if (command.chain)
+			{
+				command.chain->tailRemaining = 0;
+			}
+		}
+		break;
+
+	case MixerCommand::Type::SetMasterEffects:
+		masterEffects = command.chain;
+		break;
+
+	case MixerCommand::Type::SetEffectParameter:
+		if (command.effect)
+		{
+			command.effect->SetParameter(command.target, command.value);
+		}
+		break;
+
+	case MixerCommand::Type::SetResampleQuality:
+		resampleQuality.store((ResampleQuality)command.target, std::memory_order_relaxed);
+		break;
+	}
+}
+
+void Mixer::StartVoice(const MixerCommand& command)
+{
+	const VoiceParams& params = command.params;
+	// Synth notes aren't counted against anything, there's only the handle
+	std::atomic<unsigned>* voiceCount = command.sample ? &command.sample->voiceCount :
+		command.stream ? &command.stream->GetVoiceCount() : nullptr;
+
+	// A stream can only feed one voice, so the new one takes over from the old
+	if (command.stream)
+	{
+		for (unsigned i = 0; i < voices.GetActiveCount(); i++)
+		{
+			Voice* voice = voices.GetActive(i);
+			if (voice->stream == command.stream)
+			{
+				voices.Release(voice);
+				break;
+			}
+		}
+	}
+
+	VoiceHandle handle = command.handle;
+	Voice* voice = voices.Allocate(params.priority, params.group, handle);
+	if (!voice)
+	{
+		// Didn't get a voice (or was stopped before it started), so it isn't playing after all
+		if (voiceCount)
+		{
+			voiceCount->fetch_sub(1, std::memory_order_release);
+		}
+		return;
+	}
+
+	voice->voiceCount = voiceCount;
+	voice->bus = std::min(params.bus, kMaxBuses - 1);
+	voice->sendBus = std::min(params.sendBus, kMaxBuses - 1);
+	voice->sendLevel = params.sendLevel;
+	SetGains(*voice, params.gain, params.pan);
+	SetFade(*voice, params.fadeInFrames);
+	AttachEffects(*voice, params.effects);
+
+	if (command.sample)
+	{
+		const Sample* sample = command.sample;
+		voice->sample = sample;
+		voice->stream = nullptr;
+		voice->position = (double)std::min(params.startFrame, sample->frameCount - 1);
+		voice->step = GetStep(params.pitch, sample->sampleRate, sampleRate);
+		voice->looping = params.looping;
+	}
+	else if (!command.stream)
+	{
+		voice->sample = nullptr;
+		voice->stream = nullptr;
+		voice->synth.Start(command.synth, params.pitch, sampleRate);
+		voice->position = 0.0;
+		voice->step = 1.0;
+		voice->looping = false;
+	}
+	else
+	{
+		StreamingSound* stream = command.stream;
+		voice->sample = nullptr;
+		voice->stream = stream;
+		voice->history[0] = 0.0f;
+		voice->history[1] = 0.0f;
+		// Position 1 is the first real frame, 0 is the (silent) history frame before it
+		voice->position = 1.0;
+		voice->step = std::min(GetStep(params.pitch, stream->GetSampleRate(), sampleRate), (double)kMaxStreamStep);
+		// The stream does its own looping, the voice just keeps pulling
+		voice->looping = false;
+	}
+}
+
+MixerStats Mixer::GetStats() const
+{
+	MixerStats stats;
+	stats.blocksRendered = blocksRendered.load(std::memory_order_relaxed);
+	stats.framesRendered = framesRendered.load(std::memory_order_relaxed);
+	stats.lastBlockMicros = lastBlockMicros.load(std::memory_order_relaxed);
+	stats.peakBlockMicros = peakBlockMicros.load(std::memory_order_relaxed);
+	stats.load = load.load(std::memory_order_relaxed);
+	stats.activeVoices = activeVoices.load(std::memory_order_relaxed);
+	stats.voicesStolen = voicesStolen.load(std::memory_order_relaxed);
+	stats.voicesRejected = voicesRejected.load(std::memory_order_relaxed);
+	stats.commandsDropped = commandsDropped.load(std::memory_order_relaxed);
+	return stats;
+}
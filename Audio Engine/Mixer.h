@@ -0,0 +1,298 @@
+// Mixer.h
+// The software mixer: the heart of the engine now that DirectSound isn't doing the mixing for us.
+// It's "pull based" - whatever is driving the output (a sound card, a file, nothing at all) calls
+// Render() when it needs more audio, and the mixer sums every playing voice into that buffer.
+// Output is always interleaved stereo float at GetSampleRate().
+//
+// The audio thread never takes a lock. Anything another thread wants changed goes through a lock-free
+// command queue (see CommandQueue.h) that Render() empties at the start of every block, so changes land
+// exactly on a block boundary and a slow game thread can never hold up the audio.
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include "CommandQueue.h"
+#include "EffectChain.h"
+#include "MixKernels.h"
+#include "Resampler.h"
+#include "Sample.h"
+#include "TimingWheel.h"
+#include "StreamingSound.h"
+#include "VoicePool.h"
+
+// Timing numbers so we can see what mixing costs. Safe to read from any thread
+struct MixerStats
+{
+	unsigned long long blocksRendered = 0;
+	unsigned long long framesRendered = 0;
+	// Time spent in the last block and the worst block so far, in microseconds
+	double lastBlockMicros = 0.0;
+	double peakBlockMicros = 0.0;
+	// Last block's render time as a fraction of the block's playback time (1.0 = we can't keep up)
+	double load = 0.0;
+	unsigned activeVoices = 0;
+	// Voices taken off a playing sound to make room, and sounds that couldn't get a voice at all
+	unsigned long long voicesStolen = 0;
+	unsigned long long voicesRejected = 0;
+	// Commands that didn't fit in the queue and got thrown away
+	unsigned long long commandsDropped = 0;
+};
+
+// Everything a game thread can ask the audio thread to do. These get queued up and applied
+// at the start of the next block, in the order they were sent
+struct MixerCommand
+{
+	enum class Type : uint8_t
+	{
+		PlaySample,
+		PlayStream,
+		PlaySynth,
+		ReleaseNote,
+		StopVoice,
+		StopSample,
+		StopStream,
+		StopAll,
+		SetGain,
+		SetPan,
+		SetPitch,
+		SetBus,
+		SetSend,
+		SetBusGain,
+		SetGroupLimit,
+		SetVoiceEffects,
+		SetBusEffects,
+		SetMasterEffects,
+		SetEffectParameter,
+		SetResampleQuality
+	};
+
+	Type type;
+	// The output frame it happens on (see Mixer::GetTime()), 0 or anything already gone for the next block
+	uint64_t time;
+	VoiceHandle handle;
+	const Sample* sample;
+	StreamingSound* stream;
+	VoiceParams params;
+	SynthParams synth;
+	// The new gain/pan/pitch, or the bus or group being changed and its new gain or limit,
+	// or the send bus and level, or the effect parameter being changed and its new value, or the resample quality
+	float value;
+	unsigned target;
+	EffectChain* chain;
+	Effect* effect;
+};
+
+class Mixer
+{
+public:
+	static const unsigned kChannels = 2;
+	static const unsigned kDefaultSampleRate = 44100;
+	static const unsigned kDefaultBlockFrames = 256;
+	static const unsigned kDefaultMaxVoices = 256;
+	// Streams only have what's in their ring to work with, so they can't be sped up more than this
+	static const unsigned kMaxStreamStep = 4;
+	// Voices are summed into buses, then the buses are summed into the output. Bus 0 is the main bus.
+	// A bus can also be an aux (send/return) bus: voices send some of themselves to it as well as playing
+	// on their own bus, and its effects (a reverb, say) run once on the lot
+	static const unsigned kMaxBuses = 8;
+	// Room for this many commands between blocks. Pushing more than that fails rather than waits
+	static const unsigned kCommandQueueSize = 4096;
+	// How many commands can be scheduled for later at once (see PlayAt()). Any more get dropped
+	static const unsigned kMaxScheduledCommands = 8192;
+	// How many different effect chains can be running on voices at once. Voices past that play dry
+	static const unsigned kMaxVoiceChains = 64;
+
+	Mixer(unsigned sampleRate = kDefaultSampleRate, unsigned blockFrames = kDefaultBlockFrames, unsigned maxVoices = kDefaultMaxVoices);
+
+	// The pull callback, for the audio thread. Fills 'out' with frameCount interleaved stereo frames.
+	// Internally works through it in fixed blockFrames-sized chunks, applying queued commands before each one.
+	// Never blocks and never allocates
+	void Render(float* out, unsigned frameCount);
+
+	// Everything from here down is safe to call from any thread, any number of threads at once.
+	// None of it takes a lock: changes are queued and the audio thread picks them up at the next block.
+
+	// Starts a new voice playing the sample. Every call gets its own voice, so the same sample can
+	// overlap itself. Returns a handle for controlling it straight away, which will go stale if all the voices
+	// turn out to be busy with more important sounds. Pass a handle from ReserveHandle() to have the voice use that one
+	VoiceHandle Play(const Sample* sample, const VoiceParams& params, VoiceHandle handle = VoiceHandle()) { return PlayAt(0, sample, params, handle); }
+
+	// Starts a voice pulling from a stream. A stream can only feed one voice, so this
+	// replaces the stream's voice if it already has one
+	VoiceHandle Play(StreamingSound* stream, const VoiceParams& params);
+
+	// Starts a synth note (see Synth.h). VoiceParams::pitch multiplies its frequency; looping, startFrame and
+	// fadeInFrames don't mean anything to a note, its envelope does all that
+	VoiceHandle Play(const SynthParams& synth, const VoiceParams& params) { return PlayAt(0, synth, params); }
+
+	// Sample-accurate versions of the above and below: 'time' is an output frame on the GetTime() clock, and
+	// whatever's asked for happens on exactly that frame, even in the middle of a block. A time that's already
+	// gone means the start of the next block. Until then they wait on a timing wheel on the audio thread
+	// (see TimingWheel.h), so sequencing thousands of notes a second costs no allocations and no wake-ups.
+	// A voice counts as playing from the moment PlayAt() returns, the same as a reserved handle
+	VoiceHandle PlayAt(uint64_t time, const Sample* sample, const VoiceParams& params, VoiceHandle handle = VoiceHandle());
+	VoiceHandle PlayAt(uint64_t time, const SynthParams& synth, const VoiceParams& params);
+	void StopAt(uint64_t time, VoiceHandle handle);
+	void ReleaseNoteAt(uint64_t time, VoiceHandle handle);
+	bool SetGainAt(uint64_t time, VoiceHandle handle, float gain);
+	bool SetPanAt(uint64_t time, VoiceHandle handle, float pan);
+	bool SetPitchAt(uint64_t time, VoiceHandle handle, float pitch);
+	void SetEffectParameterAt(uint64_t time, Effect* effect, unsigned parameter, float value);
+
+	// The output frame the next block starts on: 0 when the mixer starts, and up by every frame rendered.
+	// Add the backend's latency to get the frame that's about to be heard
+	uint64_t GetTime() const { return framesRendered.load(std::memory_order_relaxed); }
+
+	// Hands out a handle now for a sound that's going to Play() later. It counts as playing until then,
+	// and stopping it means that Play() won't happen
+	VoiceHandle ReserveHandle();
+
+	// Per-voice control. All O(1). The setters return false if the voice has already finished
+	void Stop(VoiceHandle handle) { StopAt(0, handle); }
+	// Lets go of a synth note, so it fades out over its release. Anything else just stops
+	void ReleaseNote(VoiceHandle handle) { ReleaseNoteAt(0, handle); }
+	bool IsPlaying(VoiceHandle handle) const;
+	bool SetGain(VoiceHandle handle, float gain) { return SetGainAt(0, handle, gain); }
+	bool SetPan(VoiceHandle handle, float pan) { return SetPanAt(0, handle, pan); }
+	bool SetPitch(VoiceHandle handle, float pitch) { return SetPitchAt(0, handle, pitch); }
+	// Moves a playing voice onto another bus
+	bool SetBus(VoiceHandle handle, unsigned bus);
+	// Sends this much of a voice to an aux bus as well (level 0 turns the send off)
+	bool SetSend(VoiceHandle handle, unsigned bus, float level);
+
+	// Stops every voice playing this sample (or stream)
+	void Stop(const Sample* sample);
+	void Stop(StreamingSound* stream);
+	void StopAll();
+	bool IsPlaying(const Sample* sample) const;
+	bool IsPlaying(StreamingSound* stream) const;
+
+	// Linear gain for everything on a bus
+	void SetBusGain(unsigned bus, float gain);
+
+	// Caps how many voices a group can use at once (0 = no cap)
+	void SetGroupLimit(unsigned group, unsigned limit);
+
+	// Effects (see EffectChain.h). Chains have to be built before they're attached, and null takes them off.
+	// Puts a playing voice through a chain (PlaySound can do it from the start with VoiceParams::effects)
+	bool SetEffects(VoiceHandle handle, EffectChain* chain);
+	// Runs everything on a bus through a chain
+	void SetBusEffects(unsigned bus, EffectChain* chain);
+	// Runs the final mix through a chain, once every bus has been summed (a limiter, say). It runs every block
+	void SetMasterEffects(EffectChain* chain);
+	// Changes a parameter of an effect that's in a chain the mixer might be running
+	void SetEffectParameter(Effect* effect, unsigned parameter, float value) { SetEffectParameterAt(0, effect, parameter, value); }
+
+	// How voices playing at anything but their own rate get resampled (see Resampler.h). High to start with.
+	// Streams, and voices going faster than kMaxSincStep, always get the linear version
+	void SetResampleQuality(ResampleQuality quality);
+	ResampleQuality GetResampleQuality() const { return resampleQuality.load(std::memory_order_relaxed); }
+
+	// Drops every voice and every queued command on the spot. Only for when nothing is calling Render()
+	// (the backend's been stopped), since it does the audio thread's job for it
+	void Reset();
+
+	// Which SIMD kernels the inner loops use. Starts on the best the CPU has, so this is really just
+	// for comparing them (see --bench). Same rule as Reset(): only while nothing is calling Render()
+	void SetKernels(const MixKernels& mixKernels) { kernels = &mixKernels; }
+	const MixKernels& GetKernels() const { return *kernels; }
+
+	unsigned GetSampleRate() const { return sampleRate; }
+	unsigned GetBlockFrames() const { return blockFrames; }
+	MixerStats GetStats() const;
+
+private:
+	void RenderBlock(float* out, unsigned frameCount);
+	// Mixes every voice over frames offset to offset + frameCount of the block
+	void MixVoices(size_t blockSamples, unsigned offset, unsigned frameCount);
+	// Returns false once the voice has finished
+	bool MixVoice(Voice& voice, float* out, unsigned frameCount);
+	bool MixStream(Voice& voice, float* out, unsigned frameCount);
+	// MixVoice() through the sinc filter
+	bool MixSinc(Voice& voice, float* out, unsigned frameCount, const PolyphaseTable& table);
+	// MixVoice() for compressed samples that aren't going through the sinc filter
+	bool MixDecoded(Voice& voice, float* out, unsigned frameCount);
+	// Gathers 'span' of the sample's frames from 'first' on into 'window' as float: wrapping round its loop
+	// points if it's looping, silence past either end if not
+	void FillWindow(const Sample& sample, long long first, unsigned span, bool looping, float* window);
+	// Copies frames out as float, converting or decoding them if they aren't already
+	void ReadFrames(const Sample& sample, unsigned first, unsigned frameCount, float* out);
+	// MixVoice() into wherever the voice goes, plus its send if it has one
+	bool MixVoiceAndSend(Voice& voice, size_t blockSamples, unsigned offset, unsigned frameCount);
+	// Where a voice gets mixed to: its bus, or its effect chain's input
+	float* GetVoiceTarget(const Voice& voice, size_t blockSamples);
+	float* GetBusBuffer(unsigned bus, size_t blockSamples);
+	void RunEffects(unsigned frameCount);
+	void AttachEffects(Voice& voice, EffectChain* chain);
+
+	// Queues a command, counting it if the queue was full
+	bool Send(const MixerCommand& command);
+	// The audio thread's side: runs everything that's been queued since the last block,
+	// or puts it on the timing wheel if it's for later than blockStart
+	void ApplyCommands(uint64_t blockStart);
+	void Apply(const MixerCommand& command);
+	// Undoes what sending a command did, for one that's never going to run
+	void Discard(const MixerCommand& command);
+	void StartVoice(const MixerCommand& command);
+
+	unsigned sampleRate;
+	unsigned blockFrames;
+
+	// Fixed number of voices, allocated up front so playing a sound never allocates.
+	// Only the audio thread touches the voices (apart from claiming handles)
+	VoicePool voices;
+
+	// Commands from every other thread to the audio thread
+	CommandQueue<MixerCommand> commands;
+	// And the ones waiting for their frame to come round
+	TimingWheel<MixerCommand> scheduled;
+
+	const MixKernels* kernels;
+
+	// One accumulation buffer per bus, summed into mixBuffer before it goes out
+	struct Bus
+	{
+		std::vector<float> buffer;
+		float gain;
+		EffectChain* effects;
+		// Only buses something was mixed into this block get summed
+		bool used;
+	};
+	Bus buses[kMaxBuses];
+
+	// The chains on voices that are running (or still ringing on)
+	std::vector<EffectChain*> voiceChains;
+
+	// The final mix, and what it goes through on the way out
+	std::vector<float> mixBuffer;
+	EffectChain* masterEffects;
+
+	// Where a stream voice's frames land before they're resampled into the mix
+	std::vector<float> streamBuffer;
+
+	// Where 16-bit frames get converted to float on their way into the SIMD kernels
+	std::vector<float> convertBuffer;
+
+	// The source frames a block of a resampled voice reaches, gathered up (wrapped round or padded with
+	// silence at the ends) for the sinc filter to run along, and what comes out of it (or a synth note)
+	std::vector<float> resampleWindow;
+	std::vector<float> resampleBuffer;
+	// Compressed frames get decoded here a whole unit at a time, then copied into the window
+	std::vector<float> decodeBuffer;
+	std::atomic<ResampleQuality> resampleQuality;
+
+	// A voice with a send gets mixed here first, then added to both its bus and the send bus
+	std::vector<float> voiceBuffer;
+
+	std::atomic<unsigned long long> blocksRendered;
+	std::atomic<unsigned long long> framesRendered;
+	std::atomic<double> lastBlockMicros;
+	std::atomic<double> peakBlockMicros;
+	std::atomic<double> load;
+	std::atomic<unsigned> activeVoices;
+	std::atomic<unsigned long long> voicesStolen;
+	std::atomic<unsigned long long> voicesRejected;
+	std::atomic<unsigned long long> commandsDropped;
+};
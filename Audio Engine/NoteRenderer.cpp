@@ -0,0 +1,158 @@
+#include "NoteRenderer.h"
+#include "WaveFile.h"
+#include "MixKernels.h"
+#include "FileHelpers.h"
+#include "ThreadPool.h"
+#include "ConsoleColor.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <string.h>
+
+// Frames rendered at a time before they're converted into the file's buffer
+static const unsigned kChunkFrames = 4096;
+
+struct NoteResult
+{
+	bool written = false;
+	bool skipped = false;
+	unsigned long long bytes = 0;
+	double renderMillis = 0.0;
+	double writeMillis = 0.0;
+};
+
+static double MillisSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static NoteResult RenderNote(const NoteFile& note, const NoteRenderOptions& options)
+{
+	NoteResult result;
+	std::string path = options.folder + "/" + note.name + ".wav";
+	std::error_code error;
+	if (options.skipExisting && std::filesystem::exists(path, error))
+	{
+		result.skipped = true;
+		return result;
+	}
+
+	auto renderStart = std::chrono::steady_clock::now();
+	const unsigned channels = options.channels;
+	const unsigned frameCount = (unsigned)(options.seconds * options.sampleRate);
+	const unsigned bytesPerSample = options.bitsPerSample / 8;
+	const size_t dataSize = (size_t)frameCount * channels * bytesPerSample;
+
+	// The whole file in one go
+	std::vector<unsigned char> file(sizeof(WaveHeaderType) + dataSize);
+	WaveHeaderType header;
+	FillWaveHeader(header, channels, options.sampleRate, options.bitsPerSample, (uint32_t)dataSize);
+	memcpy(file.data(), &header, sizeof(header));
+
+	// Let go just soon enough for the release to be over by the end
+	SynthParams synth = options.synth;
+	synth.frequency = note.frequency;
+	synth.duration = std::max(1.0f / options.sampleRate, options.seconds - std::max(0.0f, synth.envelope.release));
+	SynthVoice voice;
+	voice.Start(synth, 1.0f, options.sampleRate);
+
+	const MixKernels& kernels = GetMixKernels();
+	std::vector<float> mono(kChunkFrames);
+	std::vector<float> frames((size_t)kChunkFrames * channels);
+	unsigned char* out = file.data() + sizeof(WaveHeaderType);
+	for (unsigned first = 0; first < frameCount; first += kChunkFrames)
+	{
+		unsigned count = std::min(kChunkFrames, frameCount - first);
+		voice.Render(mono.data(), count);
+		for (unsigned i = 0; i < count; i++)
+		{
+			for (unsigned channel = 0; channel < channels; channel++)
+			{
+				frames[(size_t)i * channels + channel] = mono[i] * options.gain;
+			}
+		}
+
+		size_t samples = (size_t)count * channels;
+		if (options.bitsPerSample == 32)
+		{
+			memcpy(out, frames.data(), samples * sizeof(float));
+		}
+		else
+		{
+			// Clipped and converted the same way the WAV backend does it (the buffer's always 2-byte aligned)
+			kernels.floatToInt16((int16_t*)out, frames.data(), samples);
+		}
+		out += samples * bytesPerSample;
+	}
+	result.renderMillis = MillisSince(renderStart);
+
+	auto writeStart = std::chrono::steady_clock::now();
+	FILE* filePtr = openFile(path.c_str(), "wb");
+	if (!filePtr)
+	{
+		std::cout << red << "ERROR: Couldn't open " << path << " for writing!" << white << std::endl;
+		return result;
+	}
+	result.written = fwrite(file.data(), 1, file.size(), filePtr) == file.size();
+	result.written = fclose(filePtr) == 0 && result.written;
+	if (!result.written)
+	{
+		std::cout << red << "ERROR: Couldn't write " << path << white << std::endl;
+	}
+	result.bytes = result.written ? file.size() : 0;
+	result.writeMillis = MillisSince(writeStart);
+	return result;
+}
+
+bool RenderNoteFiles(const std::vector<NoteFile>& notes, const NoteRenderOptions& options, NoteRenderStats* stats)
+{
+	NoteRenderStats totals;
+	if (options.channels < 1 || options.channels > 2 || (options.bitsPerSample != 16 && options.bitsPerSample != 32) ||
+		options.sampleRate == 0 || options.seconds <= 0.0f)
+	{
+		std::cout << red << "ERROR: Notes can only be rendered to mono or stereo, 16-bit PCM or 32-bit float" << white << std::endl;
+		return false;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	std::error_code error;
+	std::filesystem::create_directories(options.folder, error);
+
+	std::vector<NoteResult> results(notes.size());
+	{
+		// All of them at once, every core rendering its own notes and writing its own files
+		ThreadPool pool(options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency()));
+		std::vector<std::future<void>> jobs;
+		jobs.reserve(notes.size());
+		for (size_t i = 0; i < notes.size(); i++)
+		{
+			jobs.push_back(pool.Submit([&notes, &options, &results, i] { results[i] = RenderNote(notes[i], options); }));
+		}
+		for (std::future<void>& job : jobs)
+		{
+			job.get();
+		}
+	}
+
+	for (const NoteResult& result : results)
+	{
+		totals.written += result.written ? 1 : 0;
+		totals.skipped += result.skipped ? 1 : 0;
+		totals.failed += !result.written && !result.skipped ? 1 : 0;
+		totals.bytesWritten += result.bytes;
+		totals.renderMillis += result.renderMillis;
+		totals.writeMillis += result.writeMillis;
+	}
+	totals.totalMillis = MillisSince(start);
+
+	std::cout << blue << "INFO: Wrote " << totals.written << " notes (" << totals.bytesWritten / 1024 << " KB) to " << options.folder
+		<< " in " << totals.totalMillis << " ms: " << totals.renderMillis << " ms rendering and " << totals.writeMillis
+		<< " ms writing across every thread. " << totals.skipped << " already there, " << totals.failed << " failed" << white << std::endl;
+
+	if (stats)
+	{
+		*stats = totals;
+	}
+	return totals.failed == 0;
+}
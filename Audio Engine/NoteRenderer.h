@@ -0,0 +1,55 @@
+// NoteRenderer.h
+// Writes synth notes out as .wav files, for when something really does want them on disk rather than
+// played live (see Synth.h). Every note is rendered at once on a thread pool, each into one buffer holding
+// its whole file, header and all, which goes to disk in a single write.
+// This is a build-time tool, it allocates freely.
+
+#pragma once
+#include <string>
+#include <vector>
+#include "Synth.h"
+
+struct NoteFile
+{
+	// Written to <folder>/<name>.wav
+	std::string name;
+	float frequency;
+};
+
+struct NoteRenderOptions
+{
+	std::string folder = "./Sounds";
+	unsigned sampleRate = 44100;
+	// 1 or 2, stereo has the note in both sides
+	unsigned channels = 2;
+	// 16-bit PCM or 32-bit float
+	unsigned bitsPerSample = 16;
+	// How long each file is. The note's held until its release will just finish by the end
+	float seconds = 1.0f;
+	// The waveform and envelope, the frequency gets filled in for each note
+	SynthParams synth;
+	// Linear, the notes go out at full scale otherwise
+	float gain = 0.9f;
+	// Leave any file that's already there alone
+	bool skipExisting = true;
+	// 0 for one per core
+	unsigned threads = 0;
+
+	// Sine to start with, like the note files always were
+	NoteRenderOptions() { synth.waveform = Waveform::Sine; }
+};
+
+struct NoteRenderStats
+{
+	unsigned written = 0;
+	unsigned skipped = 0;
+	unsigned failed = 0;
+	unsigned long long bytesWritten = 0;
+	// Wall clock time for the whole batch, and the time spent rendering and writing added up over every thread
+	double totalMillis = 0.0;
+	double renderMillis = 0.0;
+	double writeMillis = 0.0;
+};
+
+// Renders and writes every note, then says how long it took. Returns false if any of them failed
+bool RenderNoteFiles(const std::vector<NoteFile>& notes, const NoteRenderOptions& options, NoteRenderStats* stats = nullptr);
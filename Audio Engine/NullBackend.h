@@ -0,0 +1,22 @@
+// NullBackend.h
+// Renders the mix and throws it away. Useful on machines with no sound card (build boxes, CI),
+// and for measuring what the mixer costs without a driver in the way.
+// Unpaced it mixes flat out, paced it behaves like a real device ticking at the output rate.
+
+#pragma once
+#include "AudioBackend.h"
+
+class NullBackend : public ThreadedBackend
+{
+public:
+	NullBackend(bool realTimePaced = false) : ThreadedBackend(realTimePaced), paced(realTimePaced) {}
+	virtual ~NullBackend() { Stop(); }
+
+	virtual const char* GetName() const override { return paced ? "Null (real-time)" : "Null"; }
+
+protected:
+	virtual void Consume(const float* frames, unsigned frameCount) override {}
+
+private:
+	bool paced;
+};
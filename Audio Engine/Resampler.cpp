@@ -0,0 +1,160 @@
+#include "Resampler.h"
+#include "MixKernels.h"
+#include "Sample.h"
+#include "ConsoleColor.h"
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+
+static const double kPi = 3.14159265358979323846;
+
+// The speeds each quality has a table for: a voice uses the first one at least as fast as it's playing
+static const double kStepBands[] = { 1.0, 1.5, 2.0, 3.0, kMaxSincStep };
+static const unsigned kStepBandCount = sizeof(kStepBands) / sizeof(kStepBands[0]);
+
+struct QualitySettings
+{
+	unsigned taps;
+	// Where it cuts off, as a fraction of the Nyquist frequency, at step 1
+	double cutoff;
+	// The Kaiser window's shape: higher is less ripple and more stopband, but a wider transition
+	double beta;
+};
+
+static const QualitySettings kQualitySettings[] =
+{
+	{ 0, 0.0, 0.0 },
+	{ 8, 0.78, 5.0 },
+	{ 16, 0.88, 7.0 },
+	{ 32, 0.94, 9.0 },
+};
+
+// Modified Bessel function of the first kind, order 0, which the Kaiser window is made of
+static double BesselI0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+	for (int k = 1; k < 32; k++)
+	{
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+static void DesignTable(PolyphaseTable& table, const QualitySettings& settings, double step)
+{
+	const unsigned taps = settings.taps;
+	const double cutoff = settings.cutoff / std::max(1.0, step);
+	const double halfWidth = taps / 2.0;
+	const double centre = taps / 2 - 1;
+
+	table.taps = taps;
+	table.mono.resize((size_t)(PolyphaseTable::kPhases + 1) * taps);
+	table.stereo.resize(table.mono.size() * 2);
+
+	std::vector<double> weights(taps);
+	for (unsigned phase = 0; phase <= PolyphaseTable::kPhases; phase++)
+	{
+		double fraction = (double)phase / PolyphaseTable::kPhases;
+		double sum = 0.0;
+		for (unsigned tap = 0; tap < taps; tap++)
+		{
+			// How far this tap's frame is from the point being worked out, in source frames
+			double t = (tap - centre) - fraction;
+			double x = cutoff * t;
+			double sinc = fabs(x) < 1e-9 ? 1.0 : sin(kPi * x) / (kPi * x);
+			double edge = t / halfWidth;
+			double window = fabs(edge) >= 1.0 ? 0.0 : BesselI0(settings.beta * sqrt(1.0 - edge * edge)) / BesselI0(settings.beta);
+			weights[tap] = cutoff * sinc * window;
+			sum += weights[tap];
+		}
+
+		// Every phase passes DC at exactly 1, or a steady tone would wobble as the phase moved
+		float* mono = table.mono.data() + (size_t)phase * taps;
+		float* stereo = table.stereo.data() + (size_t)phase * taps * 2;
+		for (unsigned tap = 0; tap < taps; tap++)
+		{
+			float weight = (float)(weights[tap] / sum);
+			mono[tap] = weight;
+			stereo[tap * 2] = weight;
+			stereo[tap * 2 + 1] = weight;
+		}
+	}
+}
+
+struct PolyphaseTables
+{
+	PolyphaseTable tables[(int)ResampleQuality::Count][kStepBandCount];
+
+	PolyphaseTables()
+	{
+		for (int quality = (int)ResampleQuality::Medium; quality < (int)ResampleQuality::Count; quality++)
+		{
+			for (unsigned band = 0; band < kStepBandCount; band++)
+			{
+				DesignTable(tables[quality][band], kQualitySettings[quality], kStepBands[band]);
+			}
+		}
+	}
+};
+
+const PolyphaseTable* GetPolyphaseTable(ResampleQuality quality, double step)
+{
+	static const PolyphaseTables polyphaseTables;
+	if (quality <= ResampleQuality::Linear || quality >= ResampleQuality::Count)
+	{
+		return nullptr;
+	}
+
+	unsigned band = 0;
+	while (band < kStepBandCount - 1 && step > kStepBands[band])
+	{
+		band++;
+	}
+	return &polyphaseTables.tables[(int)quality][band];
+}
+
+bool ConvertSampleRate(Sample& sample, unsigned targetRate, ResampleQuality quality)
+{
+	if (sample.format != SampleFormat::Float32 || sample.storage.empty() || sample.sampleRate == 0 || targetRate == 0)
+	{
+		std::cout << red << "ERROR: Can only convert the rate of samples loaded as float" << white << std::endl;
+		return false;
+	}
+	if (sample.sampleRate == targetRate)
+	{
+		return true;
+	}
+
+	const double step = (double)sample.sampleRate / targetRate;
+	const PolyphaseTable* table = GetPolyphaseTable(std::max(quality, ResampleQuality::Medium), step);
+	const unsigned channels = sample.channels;
+	const unsigned centre = table->GetCentre();
+
+	// Silence either side, so the taps never run off the ends
+	std::vector<float> padded(((size_t)sample.frameCount + table->taps * 2) * channels, 0.0f);
+	std::copy(sample.storage.begin(), sample.storage.end(), padded.begin() + (size_t)centre * channels);
+
+	// Output frame i is at source frame i * step, and in 'padded' that's 'centre' frames further in,
+	// which is exactly where the kernel expects the first tap to start
+	unsigned frameCount = (unsigned)ceil(sample.frameCount / step);
+	std::vector<float> converted((size_t)frameCount * channels);
+	const MixKernels& kernels = GetMixKernels();
+	const unsigned kChunkFrames = 4096;
+	for (unsigned first = 0; first < frameCount; first += kChunkFrames)
+	{
+		// Each chunk starts from the nearest whole frame, so the position the kernel steps along stays small
+		double position = first * step;
+		unsigned start = (unsigned)position;
+		unsigned count = std::min(kChunkFrames, frameCount - first);
+		kernels.polyphase(converted.data() + (size_t)first * channels, padded.data() + (size_t)start * channels, channels,
+			position - start, step, count, *table);
+	}
+
+	sample.storage.swap(converted);
+	sample.frames = sample.storage.data();
+	sample.frameCount = frameCount;
+	sample.sampleRate = targetRate;
+	return true;
+}
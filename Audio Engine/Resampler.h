@@ -0,0 +1,66 @@
+// Resampler.h
+// Windowed-sinc resampling, for voices played at a different speed to the one they were recorded at
+// (pitched, or just recorded at 48kHz going out at 44.1kHz).
+//
+// Linear interpolation, what the mixer did before, is cheap but dulls the top end and lets a lot of aliasing
+// through, worse the further the pitch is pushed. A sinc filter does it properly: each output frame is a
+// weighted sum of the source frames around it, weights from a sinc cut off a little below the Nyquist
+// frequency (lower again when playing faster, so nothing above it folds back down) and tapered by a Kaiser window.
+//
+// The weights for every position in between two source frames are worked out once, up front, for a fixed
+// number of positions (phases). At run time a frame is two dot products with neighbouring phases and a blend,
+// which the SIMD kernels do eight multiply-adds at a time (see MixKernels::polyphase).
+//
+// More taps is a sharper filter and a cleaner sound, at more cost per frame: hence the quality tiers.
+
+#pragma once
+#include <stddef.h>
+#include <vector>
+
+struct Sample;
+
+enum class ResampleQuality
+{
+	// Straight line between the two nearest frames. The cheapest, and how it always used to be done
+	Linear,
+	// 8 taps
+	Medium,
+	// 16 taps, the mixer's default
+	High,
+	// 32 taps, for offline conversion or when nothing else is going on
+	Best,
+	Count
+};
+
+struct PolyphaseTable
+{
+	// Positions between two frames the weights are worked out for (the ones in between get blended)
+	static const unsigned kPhases = 128;
+
+	// How many source frames go into each output frame, a multiple of 8
+	unsigned taps = 0;
+	// kPhases + 1 rows of 'taps' weights (the last is the first moved along a frame, so blending never wraps)...
+	std::vector<float> mono;
+	// ...and the same with every weight twice over, to line up with interleaved stereo
+	std::vector<float> stereo;
+
+	const float* GetMono(unsigned phase) const { return mono.data() + (size_t)phase * taps; }
+	const float* GetStereo(unsigned phase) const { return stereo.data() + (size_t)phase * taps * 2; }
+
+	// The frame at the centre of the taps, counting from the first: output at position p takes its taps from
+	// frames floor(p) - kCentre to floor(p) - kCentre + taps - 1
+	unsigned GetCentre() const { return taps / 2 - 1; }
+};
+
+// The fastest a voice can be played with a sinc filter, in source frames per output frame. Any faster and it
+// goes back to linear: a filter cutting off low enough to stop the aliasing would need far more taps
+static const double kMaxSincStep = 4.0;
+
+// The table for a quality, for playing at 'step' source frames per output frame. Null for Linear.
+// All of them get built the first time any is asked for, so do that before the audio starts (the Mixer does)
+const PolyphaseTable* GetPolyphaseTable(ResampleQuality quality, double step);
+
+// Converts a sample's frames to another rate, once, so the mixer doesn't have to every time it's played.
+// Only for samples that own float frames; Linear gets done as Medium since there's no rush.
+// The edges are treated as silence, so a looping sample may get a tiny click at its loop point
+bool ConvertSampleRate(Sample& sample, unsigned targetRate, ResampleQuality quality);
@@ -0,0 +1,183 @@
+#include "ReverbEffect.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+// Delay lengths in milliseconds. None of them a multiple of another, so their echoes don't pile up
+// on the same moments and ring
+static const float kDelayMs[] = { 29.71f, 37.11f, 41.13f, 43.73f, 47.93f, 53.27f, 59.11f, 67.73f };
+
+static float DecibelsToGain(float decibels)
+{
+	return powf(10.0f, decibels / 20.0f);
+}
+
+ReverbEffect::ReverbEffect() : Effect(ParameterCount), chunkFrames(0), tailFrames(0)
+{
+	// DirectSound's defaults
+	SetParameter(InputGain, 0.0f);
+	SetParameter(ReverbMix, 0.0f);
+	SetParameter(ReverbTime, 1000.0f);
+	SetParameter(HighFreqRTRatio, 0.001f);
+
+	for (unsigned line = 0; line < kLines; line++)
+	{
+		lineStart[line] = 0;
+		lineLength[line] = 0;
+	}
+	Reset();
+}
+
+void ReverbEffect::OnPrepare()
+{
+	size_t total = 0;
+	unsigned shortest = 0xFFFFFFFF;
+	for (unsigned line = 0; line < kLines; line++)
+	{
+		lineLength[line] = std::max(1u, (unsigned)(kDelayMs[line] * sampleRate / 1000.0f));
+		lineStart[line] = (unsigned)total;
+		// Padded out to a multiple of 8 floats, so every line starts on the same alignment as the first
+		total += (lineLength[line] + 7) & ~7u;
+		shortest = std::min(shortest, lineLength[line]);
+	}
+	delayMemory.assign(total, 0.0f);
+
+	chunkFrames = std::min(maxBlockFrames, shortest);
+	scratch.assign((size_t)chunkFrames * (kLines + 2), 0.0f);
+	Reset();
+}
+
+void ReverbEffect::Reset()
+{
+	std::fill(delayMemory.begin(), delayMemory.end(), 0.0f);
+	for (unsigned line = 0; line < kLines; line++)
+	{
+		linePosition[line] = 0;
+		dampingState[line] = 0.0f;
+	}
+}
+
+void ReverbEffect::Update()
+{
+	inputGain = DecibelsToGain(std::max(-96.0f, std::min(0.0f, Get(InputGain))));
+	// Four lines go to each side
+	outputGain = DecibelsToGain(std::max(-96.0f, std::min(0.0f, Get(ReverbMix)))) * 0.5f;
+
+	float seconds = std::max(1.0f, std::min(3000.0f, Get(ReverbTime))) / 1000.0f;
+	float ratio = std::max(0.001f, std::min(0.999f, Get(HighFreqRTRatio)));
+
+	// The Hadamard matrix is only lossless once it's scaled down by the square root of its size.
+	// That gets folded into the line gains
+	const float matrixScale = 1.0f / sqrtf((float)kLines);
+
+	for (unsigned line = 0; line < kLines; line++)
+	{
+		// Going round a line's loop once has to knock it down by its share of 60dB over the reverb time,
+		// so a longer line loses more each trip. The highs use the shorter time
+		float trips = (float)sampleRate * seconds / lineLength[line];
+		float low = powf(10.0f, -3.0f / trips);
+		float high = powf(10.0f, -3.0f / (trips * ratio));
+		lineGain[line] = low * matrixScale;
+
+		// A one pole lowpass with a gain of 1 at DC and high/low at the top: y = x + p * (y - x)
+		float top = high / low;
+		damping[line] = (1.0f - top) / (1.0f + top);
+	}
+
+	tailFrames = (unsigned)(seconds * sampleRate) + lineLength[kLines - 1];
+}
+
+void ReverbEffect::Process(float* frames, unsigned frameCount)
+{
+	while (frameCount > 0)
+	{
+		unsigned chunk = std::min(frameCount, chunkFrames);
+		ProcessChunk(frames, chunk);
+		frames += chunk * 2;
+		frameCount -= chunk;
+	}
+}
+
+void ReverbEffect::ProcessChunk(float* frames, unsigned frameCount)
+{
+	float* rows[kLines];
+	for (unsigned line = 0; line < kLines; line++)
+	{
+		rows[line] = scratch.data() + (size_t)line * chunkFrames;
+	}
+	float* left = scratch.data() + (size_t)kLines * chunkFrames;
+	float* right = left + chunkFrames;
+
+	// What's coming out of the end of each line, through its lowpass and loss
+	for (unsigned line = 0; line < kLines; line++)
+	{
+		const float* memory = delayMemory.data() + lineStart[line];
+		unsigned position = linePosition[line];
+		unsigned first = std::min(frameCount, lineLength[line] - position);
+		memcpy(rows[line], memory + position, sizeof(float) * first);
+		memcpy(rows[line] + first, memory, sizeof(float) * (frameCount - first));
+
+		float* row = rows[line];
+		const float p = damping[line];
+		const float gain = lineGain[line];
+		float state = dampingState[line];
+		for (unsigned i = 0; i < frameCount; i++)
+		{
+			state = row[i] + p * (state - row[i]);
+			row[i] = state * gain;
+		}
+		dampingState[line] = state;
+	}
+
+	// Even lines to the left, odd ones to the right
+	for (unsigned i = 0; i < frameCount; i++)
+	{
+		left[i] = (rows[0][i] + rows[2][i] + rows[4][i] + rows[6][i]) * outputGain;
+		right[i] = (rows[1][i] + rows[3][i] + rows[5][i] + rows[7][i]) * outputGain;
+	}
+
+	// Every line into every other one, through the Hadamard matrix. Done the fast way (like an FFT),
+	// three rounds of sums and differences between pairs of lines
+	for (unsigned span = 1; span < kLines; span *= 2)
+	{
+		for (unsigned line = 0; line < kLines; line += span * 2)
+		{
+			for (unsigned pair = line; pair < line + span; pair++)
+			{
+				float* a = rows[pair];
+				float* b = rows[pair + span];
+				for (unsigned i = 0; i < frameCount; i++)
+				{
+					float sum = a[i] + b[i];
+					float difference = a[i] - b[i];
+					a[i] = sum;
+					b[i] = difference;
+				}
+			}
+		}
+	}
+
+	// Back into the lines along with the new input, left into the even ones and right into the odd
+	for (unsigned line = 0; line < kLines; line++)
+	{
+		float* row = rows[line];
+		const float* input = frames + (line & 1);
+		for (unsigned i = 0; i < frameCount; i++)
+		{
+			row[i] += input[i * 2] * inputGain;
+		}
+
+		float* memory = delayMemory.data() + lineStart[line];
+		unsigned position = linePosition[line];
+		unsigned first = std::min(frameCount, lineLength[line] - position);
+		memcpy(memory + position, row, sizeof(float) * first);
+		memcpy(memory, row + first, sizeof(float) * (frameCount - first));
+		linePosition[line] = (position + frameCount) % lineLength[line];
+	}
+
+	for (unsigned i = 0; i < frameCount; i++)
+	{
+		frames[i * 2] = left[i];
+		frames[i * 2 + 1] = right[i];
+	}
+}
@@ -0,0 +1,69 @@
+// ReverbEffect.h
+// Native reverb, in place of DirectSound's Waves reverb and taking the same parameters as DSFXWavesReverb.
+// It's a feedback delay network: eight delay lines of different lengths, each one fed back into all
+// of the others through a Hadamard matrix, with a lowpass in each loop so the highs die away faster.
+//
+// The output is the reverb only, no dry signal, because it's made to sit on an aux bus: every voice that
+// wants reverb sends some of itself there (VoiceParams::sendLevel) and one reverb runs on the lot, so it
+// costs the same however many voices are going through it. The dry sound is still on the voice's own bus.
+//
+// The lines are processed a chunk at a time, each chunk no longer than the shortest line, so nothing
+// written in a chunk gets read back in the same one. That lets every step work along one line at a time
+// over plain arrays (reading, feeding back, mixing through the matrix), which vectorizes nicely.
+
+#pragma once
+#include <vector>
+#include "EffectChain.h"
+
+class ReverbEffect : public Effect
+{
+public:
+	enum Parameter
+	{
+		// How much goes in, -96 to 0 dB, default 0
+		InputGain,
+		// How much reverb comes out, -96 to 0 dB, default 0
+		ReverbMix,
+		// How long it takes to die away by 60dB, 1 to 3000 ms, default 1000
+		ReverbTime,
+		// How long the highs last compared to ReverbTime, 0.001 to 0.999, default 0.001
+		HighFreqRTRatio,
+		ParameterCount
+	};
+
+	ReverbEffect();
+
+	virtual const char* GetName() const override { return "Reverb"; }
+	virtual void Reset() override;
+	virtual unsigned GetTailFrames() const override { return tailFrames; }
+
+protected:
+	virtual void OnPrepare() override;
+	virtual void Process(float* frames, unsigned frameCount) override;
+	virtual void Update() override;
+
+private:
+	static const unsigned kLines = 8;
+
+	void ProcessChunk(float* frames, unsigned frameCount);
+
+	// All the lines, back to back in one allocation
+	std::vector<float> delayMemory;
+	unsigned lineStart[kLines];
+	unsigned lineLength[kLines];
+	unsigned linePosition[kLines];
+
+	// Each line's chunk, one after the other (then the left and right outputs)
+	std::vector<float> scratch;
+	unsigned chunkFrames;
+
+	// Worked out from the parameters
+	float inputGain;
+	float outputGain;
+	float lineGain[kLines];
+	float damping[kLines];
+	unsigned tailFrames;
+
+	// The lowpass in each line's loop
+	float dampingState[kLines];
+};
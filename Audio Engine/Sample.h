@@ -0,0 +1,152 @@
+// Sample.h
+// A chunk of audio that voices in the mixer can play from.
+// Either we own the frames (converted to float at load time), or they're 16-bit PCM sitting
+// right where they are inside a memory-mapped file, and the mixer converts as it reads.
+// Or we own them compressed to 4-bit ADPCM (see Adpcm.h), and the mixer decodes what it needs as it reads.
+// Or another sample has exactly the same frames, in which case this one just points at those (see Share()).
+// Or it's just part of another sample, a region cut out of it without copying anything (see ShareRegion()).
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "Adpcm.h"
+#include "MappedFile.h"
+
+enum class SampleFormat
+{
+	Float32,
+	Int16,
+	ImaAdpcm
+};
+
+struct Sample
+{
+	Sample() = default;
+
+	// 'frames' can point into 'storage', so copying one of these would leave it pointing at the wrong thing
+	Sample(const Sample&) = delete;
+	Sample& operator=(const Sample&) = delete;
+
+	// Interleaved frames: for stereo it goes L R L R L R ... (compressed ones go their own way, see Adpcm.h)
+	const void* frames = nullptr;
+	SampleFormat format = SampleFormat::Float32;
+
+	// How many frames (one sample per channel) there are
+	unsigned frameCount = 0;
+
+	// 1 for mono, 2 for stereo
+	unsigned channels = 0;
+
+	// What rate the sound was recorded at. The mixer resamples if it doesn't match the output rate
+	unsigned sampleRate = 0;
+
+	// The rate the file was at, if it was converted to sampleRate as it loaded (0 if it wasn't)
+	unsigned fileSampleRate = 0;
+
+	// Where a looping voice goes round: it plays up to loopEnd, then carries on from loopStart.
+	// A loopEnd of 0 is the end, so by default the whole thing loops
+	unsigned loopStart = 0;
+	unsigned loopEnd = 0;
+
+	// Compressed frames can only be pointed at a unit at a time, so a region of them starts this far into its first
+	unsigned frameOffset = 0;
+
+	// Frames we decoded ourselves live here...
+	std::vector<float> storage;
+
+	// ...or here, once they've been compressed...
+	std::vector<uint8_t> compressed;
+
+	// ...or, for zero-copy samples, this keeps the file mapped for as long as the sample is around
+	std::shared_ptr<MappedFile> mapping;
+
+	// ...or they belong to this sample, which is kept around for as long as this one is
+	std::shared_ptr<const Sample> source;
+
+	// A hash of the frames as they were loaded, and how they were loaded, so two files with the same audio in
+	// them can share it. 0 if it wasn't worked out
+	uint64_t contentHash = 0;
+
+	// How many voices are playing this, or have been asked to. The Mixer keeps it up to date so
+	// whether a sound is playing can be answered from any thread without asking the audio thread.
+	// Voices count down with release and Mixer::IsPlaying() reads with acquire, so once it reads 0 the audio
+	// thread's done reading the frames and the sample can be freed
+	mutable std::atomic<unsigned> voiceCount{ 0 };
+
+	template <typename T>
+	const T* GetFrames() const { return (const T*)frames; }
+
+	bool IsMapped() const { return mapping != nullptr; }
+	bool IsShared() const { return source != nullptr; }
+
+	unsigned GetLoopEnd() const { return loopEnd != 0 ? loopEnd : frameCount; }
+
+	// Plays other's frames from now on instead of its own, letting go of whatever it had.
+	// Its voice count stays its own, so stopping or asking about this one doesn't touch the other
+	void Share(const std::shared_ptr<const Sample>& other)
+	{
+		source = other->source ? other->source : other;
+		frames = other->frames;
+		format = other->format;
+		frameCount = other->frameCount;
+		channels = other->channels;
+		sampleRate = other->sampleRate;
+		fileSampleRate = other->fileSampleRate;
+		loopStart = other->loopStart;
+		loopEnd = other->loopEnd;
+		frameOffset = other->frameOffset;
+		contentHash = other->contentHash;
+		std::vector<float>().swap(storage);
+		std::vector<uint8_t>().swap(compressed);
+		mapping.reset();
+	}
+
+	// Shares just 'length' of other's frames, from 'start' on (the caller checks they're there), as a sound of
+	// its own. Nothing's copied, so any number of these can be cut out of one big sample
+	void ShareRegion(const std::shared_ptr<const Sample>& other, unsigned start, unsigned length)
+	{
+		Share(other);
+		start += frameOffset;
+		if (format == SampleFormat::ImaAdpcm)
+		{
+			frames = (const uint8_t*)frames + (size_t)(start / kAdpcmUnitFrames) * channels * kAdpcmUnitBytes;
+			frameOffset = start % kAdpcmUnitFrames;
+		}
+		else
+		{
+			size_t bytesPerSample = (format == SampleFormat::Int16) ? sizeof(int16_t) : sizeof(float);
+			frames = (const uint8_t*)frames + (size_t)start * channels * bytesPerSample;
+			frameOffset = 0;
+		}
+		frameCount = length;
+		loopStart = 0;
+		loopEnd = 0;
+		// It isn't the same audio as anything that's been hashed
+		contentHash = 0;
+	}
+
+	// Whether the frames are the same, byte for byte
+	bool HasSameFrames(const Sample& other) const
+	{
+		return format == other.format && frameCount == other.frameCount && channels == other.channels &&
+			sampleRate == other.sampleRate && (frames == other.frames || memcmp(frames, other.frames, GetSizeInBytes()) == 0);
+	}
+
+	// Bytes of audio data, wherever it lives
+	size_t GetSizeInBytes() const
+	{
+		if (format == SampleFormat::ImaAdpcm)
+		{
+			return GetAdpcmSize(frameOffset + frameCount, channels);
+		}
+		size_t bytesPerSample = (format == SampleFormat::Int16) ? sizeof(int16_t) : sizeof(float);
+		return (size_t)frameCount * channels * bytesPerSample;
+	}
+
+	// Bytes we allocated ourselves (mapped data is the OS's page cache, not ours, and shared data is the source's)
+	size_t GetResidentBytes() const { return storage.size() * sizeof(float) + compressed.size(); }
+};
@@ -1,25 +1,28 @@
 #pragma once
 #include "SoundEngine.h"
 #include "NotePlayer.h"
+#include "NoteRenderer.h"
 #include "FileHelpers.h"
-#include <windows.h>
-#include <dos.h>
 #include <stdio.h>
+#include <string.h>
 #include <vector>
 
 // WELCOME TO THE SOUNDERDOME 
 // Functions for playing and stopping sounds, making effects, 
-// playing sounds with those effects, and creating new sounds in the form of wav files
+// playing sounds with those effects, and playing notes on the synth
 
 
 // BASIC PLAY/STOP FUNCTIONS 
 
-void PlayASound(const char* fileName, bool looping, FX effectType, float volume = DSBVOLUME_MAX, float frequency = DSBFREQUENCY_ORIGINAL, float pan = DSBPAN_CENTER)
+// Each call is a new voice, so calling it again while the sound is playing layers another copy on top.
+// priority/group: see VoicePool.h
+void PlayASound(const char* fileName, bool looping, FX effectType, float volume = DSBVOLUME_MAX, float frequency = DSBFREQUENCY_ORIGINAL, float pan = DSBPAN_CENTER, int priority = 0, unsigned group = 0)
 {
 	DWORD flags = (looping) ? DSBPLAY_LOOPING : 0;
-	SoundEngine::GetInstance().PlaySound(fileName, flags, effectType, volume, frequency, pan);
+	SoundEngine::GetInstance().PlaySound(fileName, flags, effectType, volume, frequency, pan, priority, group);
 }
 
+// Stops every copy of the sound that's playing
 void StopSound(const char* fileName)
 {
 	SoundEngine::GetInstance().StopSound(fileName);
@@ -32,28 +35,50 @@ bool IsSoundPlaying(const char* fileName)
 
 // FUN STUFF
 
-// Array of notes
-std::vector<std::string> notes = { "A", "A#", "B", "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#" };
+// Plays a note from C0 to B8 ("A4", "C#3"...) on the synth, no .wav files needed.
+// seconds is how long it's held before it lets go (0 holds it until ReleaseNote)
+VoiceHandle PlayNote(const std::string& note, float seconds = 1.0f, Waveform waveform = Waveform::Sine, float volume = DSBVOLUME_MAX, float pan = DSBPAN_CENTER)
+{
+	SynthParams synth;
+	synth.waveform = waveform;
+	synth.frequency = GetFrequency(note);
+	synth.duration = seconds;
+	return SoundEngine::GetInstance().PlayNote(synth, volume, pan);
+}
+
+// The same by MIDI note number (60 is middle C, 69 is A4), skipping the name altogether
+VoiceHandle PlayNote(unsigned midiNote, float seconds = 1.0f, Waveform waveform = Waveform::Sine, float volume = DSBVOLUME_MAX, float pan = DSBPAN_CENTER)
+{
+	SynthParams synth;
+	synth.waveform = waveform;
+	synth.frequency = GetMidiFrequency(midiNote);
+	synth.duration = seconds;
+	return SoundEngine::GetInstance().PlayNote(synth, volume, pan);
+}
+
+// Lets go of a note, which then fades out
+void ReleaseNote(VoiceHandle note)
+{
+	SoundEngine::GetInstance().ReleaseNote(note);
+}
 
-// Function to make .wav file of every note from c0 to b8 (if they don't exist already in the Sounds folder)
-void MakeNotes()
+// Writes a .wav of every note from C0 to B8 into options.folder (./Sounds unless you say otherwise), for anything
+// that wants files rather than PlayNote. Rate, channels, bit depth and length are all in the options.
+// They're rendered in parallel and each one written in one go (see NoteRenderer.h)
+bool MakeNotes(const NoteRenderOptions& options = NoteRenderOptions())
 {
-	for (string note : notes)
+	// C0 to B8 are MIDI notes 12 to 119
+	std::vector<NoteFile> files;
+	for (unsigned note = 12; note < 120; note++)
 	{
-		for (int i = 0; i < 9; i++)
-		{
-			// check if file exists
-			if (fileExists("./Sounds/" + note + to_string(i) + ".wav"))
-			{
-				// do nothing
-				cout << "Sound file exists, not creating it" << endl;
-			}
-			else
-			{
-				CreateWavFile(note + to_string(i));
-			}
-		}
+		NoteFile file;
+		// Copied with a bound, since GCC can't see the table's names are all terminated and warns otherwise
+		const char* name = GetMidiNoteName(note);
+		file.name.assign(name, strnlen(name, sizeof(MidiNote::name)));
+		file.frequency = GetMidiFrequency(note);
+		files.push_back(file);
 	}
+	return RenderNoteFiles(files, options);
 }
 
 // EFFECTS ZONE
@@ -0,0 +1,125 @@
+#include "SoundBank.h"
+#include "Hash.h"
+#include "ConsoleColor.h"
+#include <string.h>
+#include <iostream>
+
+SoundBank::SoundBank() : header(nullptr), entries(nullptr), index(nullptr), names(nullptr), namesSize(0)
+{
+}
+
+bool SoundBank::Open(const char* filename)
+{
+	file = std::make_shared<MappedFile>();
+	if (!file->Open(filename))
+	{
+		return false;
+	}
+
+	const unsigned char* data = file->GetData();
+	const size_t size = file->GetSize();
+
+	if (size < sizeof(BankHeader) || memcmp(data, kBankMagic, 4) != 0)
+	{
+		std::cout << red << "ERROR: " << filename << " is not a sound bank!" << white << std::endl;
+		return false;
+	}
+
+	const BankHeader* bankHeader = (const BankHeader*)data;
+	if (bankHeader->version != kBankVersion)
+	{
+		std::cout << red << "ERROR: " << filename << " is bank version " << bankHeader->version << ", we need " << kBankVersion << white << std::endl;
+		return false;
+	}
+
+	// Make sure every table actually fits in the file before we trust any of it
+	if (bankHeader->entriesOffset + (uint64_t)bankHeader->soundCount * sizeof(BankEntry) > size ||
+		bankHeader->indexOffset + (uint64_t)bankHeader->indexSize * sizeof(uint32_t) > size ||
+		bankHeader->namesOffset > size || bankHeader->dataOffset > size ||
+		bankHeader->indexSize == 0 || (bankHeader->indexSize & (bankHeader->indexSize - 1)) != 0)
+	{
+		std::cout << red << "ERROR: " << filename << " is truncated or corrupt!" << white << std::endl;
+		return false;
+	}
+
+	header = bankHeader;
+	entries = (const BankEntry*)(data + header->entriesOffset);
+	index = (const uint32_t*)(data + header->indexOffset);
+	names = (const char*)(data + header->namesOffset);
+
+	// Names are only ever read up to their NUL, so all that matters is there's one somewhere after them before the
+	// mapping ends. Finding the last one means each entry's name is checked with a single compare
+	namesSize = size - header->namesOffset;
+	while (namesSize > 0 && names[namesSize - 1] != '\0')
+	{
+		namesSize--;
+	}
+
+	// Build a Sample for each entry. These are just pointers into the mapping
+	samples.reset(new Sample[header->soundCount]);
+	for (unsigned i = 0; i < header->soundCount; i++)
+	{
+		const BankEntry& entry = entries[i];
+		Sample& sample = samples[i];
+		sample.format = (SampleFormat)entry.format;
+		sample.channels = entry.channels;
+		sample.sampleRate = entry.sampleRate;
+		sample.frameCount = entry.frameCount;
+		sample.mapping = file;
+
+		if (entry.nameOffset >= namesSize)
+		{
+			std::cout << red << "ERROR: Sound " << i << " in " << filename << " has a corrupt name!" << white << std::endl;
+			sample.frameCount = 0;
+			continue;
+		}
+		if (entry.format > (uint16_t)SampleFormat::Int16 || (entry.channels != 1 && entry.channels != 2) ||
+			entry.dataOffset + sample.GetSizeInBytes() > size)
+		{
+			std::cout << red << "ERROR: Sound " << GetName(i) << " in " << filename << " is corrupt!" << white << std::endl;
+			sample.frameCount = 0;
+			continue;
+		}
+		sample.frames = data + entry.dataOffset;
+	}
+
+	std::cout << green << "Opened sound bank " << filename << " (" << header->soundCount << " sounds)" << white << std::endl;
+	return true;
+}
+
+const Sample* SoundBank::Find(const char* name) const
+{
+	if (!header)
+	{
+		return nullptr;
+	}
+
+	// Linear probing: start at the hash's slot and walk forward until we find it or hit an empty slot.
+	// The builder keeps the index at most half full, so this is one or two probes
+	const uint64_t hash = HashName(name);
+	const uint32_t mask = header->indexSize - 1;
+	uint32_t slot = (uint32_t)hash & mask;
+	for (uint32_t probe = 0; probe < header->indexSize; probe++)
+	{
+		uint32_t entryNumber = index[slot];
+		if (entryNumber == 0 || entryNumber > header->soundCount)
+		{
+			return nullptr;
+		}
+
+		const BankEntry& entry = entries[entryNumber - 1];
+		if (entry.nameHash == hash && entry.nameOffset < namesSize && strcmp(names + entry.nameOffset, name) == 0)
+		{
+			return &samples[entryNumber - 1];
+		}
+		slot = (slot + 1) & mask;
+	}
+	return nullptr;
+}
+
+const char* SoundBank::GetName(unsigned entryIndex) const
+{
+	// Open() has already complained about any name that runs off the end
+	const uint32_t nameOffset = entries[entryIndex].nameOffset;
+	return nameOffset < namesSize ? names + nameOffset : "";
+}
@@ -0,0 +1,81 @@
+// SoundBank.h
+// A sound bank is lots of sounds packed into one file, so startup is one open and one map
+// instead of an open, a header parse and an allocation for every .wav.
+//
+// Layout (all little-endian, all offsets from the start of the file):
+//   BankHeader
+//   BankEntry[soundCount]         - one per sound, says where its frames are
+//   uint32_t index[indexSize]     - open-addressing hash table of (entry number + 1), 0 = empty slot
+//   names                         - every name, null terminated, one after the other
+//   frames                        - each sound's PCM, already in the mixer's format, kDataAlignment aligned
+//
+// Build one with SoundBankBuilder (or "Audio Engine --build-bank", see Main.cpp).
+
+#pragma once
+#include <stdint.h>
+#include <memory>
+#include "MappedFile.h"
+#include "Sample.h"
+
+static const char kBankMagic[4] = { 'S', 'B', 'N', 'K' };
+static const uint32_t kBankVersion = 1;
+
+// PCM blobs start on a 64-byte boundary so they line up with cache lines and any SIMD loads
+static const uint32_t kBankDataAlignment = 64;
+
+struct BankHeader
+{
+	char		magic[4];
+	uint32_t	version;
+	uint32_t	soundCount;
+	// Number of slots in the hash index, always a power of two
+	uint32_t	indexSize;
+	uint64_t	entriesOffset;
+	uint64_t	indexOffset;
+	uint64_t	namesOffset;
+	uint64_t	dataOffset;
+};
+
+struct BankEntry
+{
+	uint64_t	nameHash;
+	uint64_t	dataOffset;
+	uint32_t	nameOffset;
+	uint32_t	frameCount;
+	uint32_t	sampleRate;
+	uint16_t	channels;
+	// A SampleFormat value
+	uint16_t	format;
+};
+
+static_assert(sizeof(BankHeader) == 48, "BankHeader must match the file layout");
+static_assert(sizeof(BankEntry) == 32, "BankEntry must match the file layout");
+
+class SoundBank
+{
+public:
+	SoundBank();
+
+	// Maps the bank and sets up a Sample for every sound in it. Nothing past the header,
+	// entries and index gets read until a sound actually plays
+	bool Open(const char* filename);
+
+	// O(1) lookup by name, returns null if the bank doesn't have it
+	const Sample* Find(const char* name) const;
+
+	unsigned GetSoundCount() const { return header ? header->soundCount : 0; }
+	const char* GetName(unsigned index) const;
+	const Sample* GetSample(unsigned index) const { return &samples[index]; }
+
+private:
+	std::shared_ptr<MappedFile> file;
+	const BankHeader* header;
+	const BankEntry* entries;
+	const uint32_t* index;
+	const char* names;
+	// Bytes from the start of the names that end in a NUL, so any nameOffset below this is a terminated string
+	size_t namesSize;
+
+	// One per entry, all pointing into the mapping
+	std::unique_ptr<Sample[]> samples;
+};
@@ -0,0 +1,182 @@
+#include "SoundBankBuilder.h"
+#include "SoundBank.h"
+#include "WaveFile.h"
+#include "Hash.h"
+#include "FileHelpers.h"
+#include "ConsoleColor.h"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <string.h>
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+bool SoundBankBuilder::AddFile(const std::string& path, const std::string& name)
+{
+	PendingSound sound;
+	sound.name = name.empty() ? path : name;
+
+	for (const PendingSound& existing : sounds)
+	{
+		if (existing.name == sound.name)
+		{
+			std::cout << red << "ERROR: There's already a sound called " << sound.name << " in this bank" << white << std::endl;
+			return false;
+		}
+	}
+
+	// Always decode to float here, the bank gets written in whatever format was asked for
+	Sample sample;
+	WaveLoadOptions options;
+	options.zeroCopy = false;
+	if (!LoadWaveFile(path.c_str(), sample, options))
+	{
+		return false;
+	}
+
+	sound.channels = sample.channels;
+	sound.sampleRate = sample.sampleRate;
+	sound.frameCount = sample.frameCount;
+	sound.frames = std::move(sample.storage);
+	sounds.push_back(std::move(sound));
+	return true;
+}
+
+bool SoundBankBuilder::AddDirectory(const std::string& path)
+{
+	std::error_code error;
+	std::vector<std::string> files;
+	for (const auto& item : std::filesystem::directory_iterator(path, error))
+	{
+		if (item.is_regular_file() && item.path().extension() == ".wav")
+		{
+			files.push_back(item.path().generic_string());
+		}
+	}
+	if (error)
+	{
+		std::cout << red << "ERROR: Couldn't read folder " << path << white << std::endl;
+		return false;
+	}
+
+	// Directory order is up to the file system, sort so the same folder always makes the same bank
+	std::sort(files.begin(), files.end());
+
+	bool allAdded = true;
+	for (const std::string& file : files)
+	{
+		allAdded = AddFile(file) && allAdded;
+	}
+	return allAdded;
+}
+
+bool SoundBankBuilder::Write(const std::string& filename, SampleFormat format)
+{
+	const uint32_t soundCount = (uint32_t)sounds.size();
+
+	// Keep the index no more than half full so lookups almost never need more than one probe
+	uint32_t indexSize = 2;
+	while (indexSize < soundCount * 2)
+	{
+		indexSize *= 2;
+	}
+
+	// Work out where everything goes
+	BankHeader header;
+	memcpy(header.magic, kBankMagic, 4);
+	header.version = kBankVersion;
+	header.soundCount = soundCount;
+	header.indexSize = indexSize;
+	header.entriesOffset = sizeof(BankHeader);
+	header.indexOffset = header.entriesOffset + (uint64_t)soundCount * sizeof(BankEntry);
+	header.namesOffset = header.indexOffset + (uint64_t)indexSize * sizeof(uint32_t);
+
+	std::vector<char> names;
+	std::vector<BankEntry> entries(soundCount);
+	for (uint32_t i = 0; i < soundCount; i++)
+	{
+		entries[i].nameHash = HashName(sounds[i].name.c_str());
+		entries[i].nameOffset = (uint32_t)names.size();
+		names.insert(names.end(), sounds[i].name.begin(), sounds[i].name.end());
+		names.push_back('\0');
+	}
+
+	header.dataOffset = AlignUp(header.namesOffset + names.size(), kBankDataAlignment);
+
+	const size_t bytesPerSample = (format == SampleFormat::Int16) ? sizeof(int16_t) : sizeof(float);
+	uint64_t offset = header.dataOffset;
+	for (uint32_t i = 0; i < soundCount; i++)
+	{
+		entries[i].dataOffset = offset;
+		entries[i].frameCount = sounds[i].frameCount;
+		entries[i].sampleRate = sounds[i].sampleRate;
+		entries[i].channels = (uint16_t)sounds[i].channels;
+		entries[i].format = (uint16_t)format;
+		offset = AlignUp(offset + (uint64_t)sounds[i].frames.size() * bytesPerSample, kBankDataAlignment);
+	}
+
+	// Fill in the hash index (entry number + 1, so 0 can mean empty)
+	std::vector<uint32_t> index(indexSize, 0);
+	for (uint32_t i = 0; i < soundCount; i++)
+	{
+		uint32_t slot = (uint32_t)entries[i].nameHash & (indexSize - 1);
+		while (index[slot] != 0)
+		{
+			slot = (slot + 1) & (indexSize - 1);
+		}
+		index[slot] = i + 1;
+	}
+
+	// And write it all out, front to back
+	FILE* filePtr = openFile(filename.c_str(), "wb");
+	if (!filePtr)
+	{
+		std::cout << red << "ERROR: Couldn't open " << filename << " for writing!" << white << std::endl;
+		return false;
+	}
+
+	static const char padding[kBankDataAlignment] = {};
+	bool ok = fwrite(&header, sizeof(header), 1, filePtr) == 1;
+	ok = ok && (soundCount == 0 || fwrite(entries.data(), sizeof(BankEntry), soundCount, filePtr) == soundCount);
+	ok = ok && fwrite(index.data(), sizeof(uint32_t), indexSize, filePtr) == indexSize;
+	ok = ok && (names.empty() || fwrite(names.data(), 1, names.size(), filePtr) == names.size());
+
+	uint64_t written = header.namesOffset + names.size();
+	std::vector<int16_t> converted;
+	for (uint32_t i = 0; i < soundCount && ok; i++)
+	{
+		ok = fwrite(padding, 1, (size_t)(entries[i].dataOffset - written), filePtr) == entries[i].dataOffset - written;
+
+		const std::vector<float>& frames = sounds[i].frames;
+		if (format == SampleFormat::Int16)
+		{
+			converted.resize(frames.size());
+			for (size_t s = 0; s < frames.size(); s++)
+			{
+				float value = frames[s] * 32768.0f;
+				value = value > 32767.0f ? 32767.0f : (value < -32768.0f ? -32768.0f : value);
+				converted[s] = (int16_t)value;
+			}
+			ok = ok && (converted.empty() || fwrite(converted.data(), sizeof(int16_t), converted.size(), filePtr) == converted.size());
+		}
+		else
+		{
+			ok = ok && (frames.empty() || fwrite(frames.data(), sizeof(float), frames.size(), filePtr) == frames.size());
+		}
+		written = entries[i].dataOffset + frames.size() * bytesPerSample;
+	}
+
+	fclose(filePtr);
+
+	if (!ok)
+	{
+		std::cout << red << "ERROR: Couldn't write sound bank " << filename << white << std::endl;
+		return false;
+	}
+
+	std::cout << green << "Wrote sound bank " << filename << " (" << soundCount << " sounds, " << written << " bytes)" << white << std::endl;
+	return true;
+}
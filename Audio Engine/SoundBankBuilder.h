@@ -0,0 +1,37 @@
+// SoundBankBuilder.h
+// The offline half of SoundBank: collects .wav files, converts them to the mixer's format and
+// writes the whole lot out as one bank. This is a build-time tool, it allocates and copies freely.
+
+#pragma once
+#include <string>
+#include <vector>
+#include "Sample.h"
+
+class SoundBankBuilder
+{
+public:
+	// Adds one .wav. 'name' is what you'll look it up by later, and defaults to the path as given
+	// (so PlaySound("./Sounds/A4.wav") finds what AddFile("./Sounds/A4.wav") put in)
+	bool AddFile(const std::string& path, const std::string& name = std::string());
+
+	// Adds every .wav in a folder (not subfolders), named by their paths
+	bool AddDirectory(const std::string& path);
+
+	// Float32 is the mixer's own format and needs no conversion at all when played,
+	// Int16 halves the size and is converted as it's mixed
+	bool Write(const std::string& filename, SampleFormat format = SampleFormat::Float32);
+
+	size_t GetSoundCount() const { return sounds.size(); }
+
+private:
+	struct PendingSound
+	{
+		std::string name;
+		unsigned channels;
+		unsigned sampleRate;
+		unsigned frameCount;
+		std::vector<float> frames;
+	};
+
+	std::vector<PendingSound> sounds;
+};
@@ -1,17 +1,93 @@
-#pragma comment(lib, "dsound.lib")
-#pragma comment(lib, "dxguid.lib")
-
-#include <stdio.h>
-#include <tchar.h>
-#include <SDKDDKVer.h>
-#include <windows.h>
 #include <stdio.h>
 #include <assert.h>
+#include <math.h>
 
 #include "SoundEngine.h"
+#include "WaveFile.h"
 #include "ConsoleColor.h"
+#include "DistortionEffect.h"
+#include "GargleEffect.h"
+#include "ChorusEffect.h"
+#include "EchoEffect.h"
+#include "CompressorEffect.h"
+#include "EqEffect.h"
+#include "ReverbEffect.h"
+#include "ConvolutionEffect.h"
+#include "MidiNotes.h"
+#include <algorithm>
 #include <iostream>
 
+#ifdef _WIN32
+#include "DirectSoundBackend.h"
+#endif
+
+
+static_assert(kMidiPeriodRate == Mixer::kDefaultSampleRate, "MidiNote::period should be at the engine's rate");
+
+// DirectSound units -> mixer units
+
+// Volume is in hundredths of a decibel (0 is full, -10000 is silent), the mixer wants a linear gain
+static float VolumeToGain(float volume)
+{
+	if (volume <= DSBVOLUME_MIN)
+	{
+		return 0.0f;
+	}
+	return powf(10.0f, volume / 2000.0f);
+}
+
+// Pan is how many hundredths of a decibel to turn the other side down by, the mixer wants -1 to 1
+static float PanToBalance(float pan)
+{
+	if (pan > 0.0f)
+	{
+		return 1.0f - VolumeToGain(-pan);
+	}
+	if (pan < 0.0f)
+	{
+		return VolumeToGain(pan) - 1.0f;
+	}
+	return 0.0f;
+}
+
+// Frequency is the playback rate in Hz (0 means as recorded), the mixer wants a speed multiplier
+static float FrequencyToPitch(float frequency, const Sample* sample)
+{
+	if (frequency == DSBFREQUENCY_ORIGINAL)
+	{
+		return 1.0f;
+	}
+	return frequency / sample->sampleRate;
+}
+
+// A region in the sample's own frames, which aren't the file's if it was converted to another rate as it loaded.
+// False if it doesn't fit in the sample
+static bool ScaleRegion(const Sample& whole, const SoundRegion& region, SoundRegion& scaled)
+{
+	const uint64_t fileRate = whole.fileSampleRate != 0 ? whole.fileSampleRate : whole.sampleRate;
+	auto scale = [&](uint64_t frame) { return (frame * whole.sampleRate + fileRate / 2) / fileRate; };
+
+	const uint64_t start = scale(region.start);
+	const uint64_t end = region.length != 0 ? scale((uint64_t)region.start + region.length) : whole.frameCount;
+	if (end > whole.frameCount || end <= start)
+	{
+		return false;
+	}
+	scaled.start = (unsigned)start;
+	scaled.length = (unsigned)(end - start);
+	scaled.loopStart = (unsigned)(scale((uint64_t)region.start + region.loopStart) - start);
+	scaled.loopEnd = region.loopEnd != 0 ? (unsigned)(scale((uint64_t)region.start + region.loopEnd) - start) : 0;
+	const unsigned loopEnd = scaled.loopEnd != 0 ? scaled.loopEnd : scaled.length;
+	return loopEnd <= scaled.length && scaled.loopStart < loopEnd;
+}
+
+
+// Loading is mostly waiting on the disk, more threads than this just queue up behind it
+static const unsigned kLoadThreads = 2;
+
+// How long a late sound takes to fade in
+static const float kLateFadeSeconds = 0.02f;
+
 
 // Singleton Accessor - we definitely (probably) don't need more than one sound player
 SoundEngine& SoundEngine::GetInstance()
@@ -20,8 +96,51 @@ SoundEngine& SoundEngine::GetInstance()
 	return theSoundClass;
 }
 
-SoundEngine::SoundEngine() : directSound(nullptr), primaryBuffer(nullptr), secondaryBuffer(nullptr)
+SoundEngine::SoundEngine() :
+	notReadyPolicy(NotReadyPolicy::DELAY),
+	maxWaitSeconds(0.0f),
+	cacheNewest(nullptr),
+	cacheOldest(nullptr),
+	cacheBudget(0),
+	cacheBytes(0),
+	cacheEvictions(0),
+	cacheReloads(0),
+	loadPool(kLoadThreads),
+	streamReadAheadFrames(StreamingSound::kDefaultReadAheadFrames)
 {
+	// The effects that run in the mixer, one chain each, built once and shared by every sound played with them
+	distortionChain = CreateEffectChain();
+	distortionEffect = distortionChain->Add<DistortionEffect>();
+	gargleChain = CreateEffectChain();
+	gargleEffect = gargleChain->Add<GargleEffect>();
+	chorusChain = CreateEffectChain();
+	chorusEffect = chorusChain->Add<ChorusEffect>();
+	flangerChain = CreateEffectChain();
+	flangerEffect = flangerChain->Add<FlangerEffect>();
+	echoChain = CreateEffectChain();
+	echoEffect = echoChain->Add<EchoEffect>();
+	compressorChain = CreateEffectChain();
+	compressorEffect = compressorChain->Add<CompressorEffect>();
+	paramEQChain = CreateEffectChain();
+	paramEQEffect = paramEQChain->Add<EqEffect>();
+
+	// Reverb is one shared send bus instead
+	reverbChain = CreateEffectChain();
+	reverbEffect = reverbChain->Add<ReverbEffect>();
+	mixer.SetBusEffects(kReverbBus, reverbChain);
+
+	// And a limiter on the way out, so however many voices pile up the mix doesn't clip
+	masterChain = CreateEffectChain();
+	masterLimiter = masterChain->Add<CompressorEffect>();
+	// Attack as fast as it goes: the lookahead is longer than a detection chunk, so the gain is already
+	// down by the time a peak comes out
+	masterLimiter->SetParameter(CompressorEffect::Attack, 0.01f);
+	masterLimiter->SetParameter(CompressorEffect::Release, 150.0f);
+	masterLimiter->SetParameter(CompressorEffect::Ratio, 100.0f);
+	masterLimiter->SetParameter(CompressorEffect::Predelay, 2.0f);
+	masterLimiter->SetParameter(CompressorEffect::Detector, 0.0f);
+	SetMasterLimiter(true);
+
 	// Set some values for effects (better than the original MS default values, which are boring)
 	SetChorusParams(50, 50, 20, 1.5, DSFXCHORUS_WAVE_SIN, 16, DSFXCHORUS_PHASE_ZERO);
 	SetCompressorParams(10, 10, 100, -50, 3, 4);
@@ -36,627 +155,1169 @@ SoundEngine::SoundEngine() : directSound(nullptr), primaryBuffer(nullptr), secon
 SoundEngine::~SoundEngine()
 {
 	Shutdown();
+
+	// Sounds point into the banks, so they go first
+	sounds.clear();
+	soundIds.clear();
+	banks.clear();
+	cacheNewest = nullptr;
+	cacheOldest = nullptr;
+	cacheBytes = 0;
+	cachedStores.clear();
+	samplesByContent.clear();
 }
 
+#ifdef _WIN32
 bool SoundEngine::Initialize(HWND hwnd)
 {
-	// Initialize direct sound and the primary sound buffer.
-	return InitializeDirectSound(hwnd);
-}
+	StopBackend();
 
-void SoundEngine::Shutdown()
-{
-	// Release the secondary buffers in our sound map
-	for (auto sound : sounds)
+	// Initialize direct sound and the primary sound buffer, then hand it the mixer to play
+	DirectSoundBackend* directSound = new DirectSoundBackend(hwnd);
+	if (!directSound->GetDevice())
 	{
-		if (sound.second)
-		{
-			sound.second->Release();
-		}
+		delete directSound;
+		return false;
 	}
-	// Shutdown the Direct Sound API (this releases the primary buffer and the DirectSound interface)
-	ShutdownDirectSound();
-	sounds.clear();
-	return;
+
+	return StartBackend(std::unique_ptr<AudioBackend>(directSound));
 }
+#endif
 
-// Gets an interface pointer to DirectSound and the default primary sound buffer.
-bool SoundEngine::InitializeDirectSound(HWND hwnd)
+bool SoundEngine::Initialize(std::unique_ptr<AudioBackend> newBackend)
 {
-	// An HRESULT is an opaque result handle defined to be zero or positive for a successful return from a function, and negative for a failure.
-	HRESULT result;
-
-	// The DSBUFFERDESC structure describes the characteristics of a new buffer object
-	DSBUFFERDESC bufferDesc;
+	StopBackend();
+	return StartBackend(std::move(newBackend));
+}
 
-	// WAVEFORMATEX structure defines the format of waveform-audio data
-	WAVEFORMATEX waveFormat;
+void SoundEngine::StopBackend()
+{
+	// The mixer isn't the backend's, so everything in it just waits for the next one to start pulling
+	if (backend)
+	{
+		backend->Stop();
+	}
+	backend.reset();
+}
 
-	// Initialize the direct sound interface pointer for the default sound device.
-	result = DirectSoundCreate8(NULL, &directSound, NULL);
-	if (FAILED(result))
+bool SoundEngine::StartBackend(std::unique_ptr<AudioBackend> newBackend)
+{
+	backend = std::move(newBackend);
+	if (!backend || !backend->Start(&mixer))
 	{
-		std::cout << red << "ERROR: Failed to initialize direct sound interface pointer for default sound device." << white << std::endl;
+		std::cout << red << "ERROR: Couldn't start the audio backend!" << white << std::endl;
+		backend.reset();
 		return false;
 	}
 
-	// Set the cooperative level to priority so the format of the primary sound buffer can be modified.
-	result = directSound->SetCooperativeLevel(hwnd, DSSCL_PRIORITY);
-	if (FAILED(result))
+	// Shutdown() stops the convolution workers, but the reverbs on the engine's chains are still there
+	// and need their tails worked out again
+	if (convolutionWorkers.GetTailCount() > 0)
 	{
-		std::cout << red << "ERROR: Failed to set cooperative level to priority." << white << std::endl;
-		return false;
+		convolutionWorkers.Start();
 	}
 
-	// Setup the primary buffer description.
+	std::cout << green << "Mixer running on " << backend->GetName() << " backend (" << mixer.GetSampleRate() << "Hz, "
+		<< mixer.GetBlockFrames() << " frame blocks, " << backend->GetLatencyFrames() << " frames latency)" << white << std::endl;
+	return true;
+}
 
-	bufferDesc.dwSize = sizeof(DSBUFFERDESC); // The size of the structure
+void SoundEngine::Shutdown()
+{
+	// Let any loads finish first, they might start voices when they're done
+	loadPool.WaitIdle();
 
-	// The dwFlags are the important part of this structure since they tell the buffer what capabilities the audio engine will need to use
-	bufferDesc.dwFlags = DSBCAPS_PRIMARYBUFFER | DSBCAPS_CTRLVOLUME;
-	bufferDesc.dwBufferBytes = 0; // Size of this buffer, in bytes.
-	bufferDesc.dwReserved = 0; // Reserved. Must be 0.
-	bufferDesc.lpwfxFormat = NULL; // Address of a WAVEFORMATEX or WAVEFORMATEXTENSIBLE structure specifying the waveform format for the buffer. This value must be NULL for primary buffers.
-	bufferDesc.guid3DAlgorithm = GUID_NULL; // Unique identifier of the two-speaker virtualization algorithm to be used by DirectSound3D hardware emulation
+	// Stop the backend first so nothing is mixing while we pull the sounds out from under it
+	StopBackend();
+	// Nothing's rendering now, so the mixer can be cleared out directly rather than through its queue
+	mixer.Reset();
 
-	// Get control of the primary sound buffer on the default sound device.
-	result = directSound->CreateSoundBuffer(&bufferDesc, &primaryBuffer, NULL);
-	if (FAILED(result))
+	// Nothing's pulling from the streams now, so the reader can let go of them too
+	streamReader.Stop();
 	{
-		std::cout << red << "ERROR: Failed to get control of primary sound buffer." << white << std::endl;
-		return false;
+		std::lock_guard<std::mutex> lock(streamsMutex);
+		streams.clear();
 	}
+	// Same for the convolution tails
+	convolutionWorkers.Stop();
 
-	// Setup the format of the primary sound bufffer.
-	waveFormat.wFormatTag = WAVE_FORMAT_PCM; // Waveform-audio format type
-	waveFormat.nSamplesPerSec = 44100; // Sample rate, in samples per second (hertz).
-	waveFormat.wBitsPerSample = 16; // Bits per sample for the wFormatTag format type
-	waveFormat.nChannels = 2; // Number of channels in the waveform-audio data. Stereo data uses two channels
-	waveFormat.nBlockAlign = (waveFormat.wBitsPerSample / 8) * waveFormat.nChannels; // Block alignment, in bytes
-	waveFormat.nAvgBytesPerSec = waveFormat.nSamplesPerSec * waveFormat.nBlockAlign; // Required average data - transfer rate, in bytes per second, for the format tag
-	waveFormat.cbSize = 0; // For WAVE_FORMAT_PCM formats (and only WAVE_FORMAT_PCM formats), this member is ignored
+	// The sounds stay loaded, but plays still waiting on a load went with the mixer's handles
+	std::lock_guard<std::mutex> lock(soundsMutex);
+	for (const std::unique_ptr<SoundEntry>& entry : sounds)
+	{
+		entry->pendingPlays.clear();
+	}
+}
 
-	// Set the primary buffer to be the wave format specified.
-	result = primaryBuffer->SetFormat(&waveFormat);
-	if (FAILED(result))
+bool SoundEngine::LoadSoundBank(const char* filename)
+{
+	std::unique_ptr<SoundBank> bank(new SoundBank());
+	if (!bank->Open(filename))
 	{
-		std::cout << red << "ERROR: Failed to set format of primary buffer." << white << std::endl;
+		std::cout << red << "ERROR: Couldn't load sound bank " << filename << white << std::endl;
 		return false;
 	}
-
-	std::cout << green << "DirectSound successfully initialized!" << white << std::endl;
+	std::lock_guard<std::mutex> lock(soundsMutex);
+	banks.push_back(std::move(bank));
 	return true;
 }
 
-
-void SoundEngine::ShutdownDirectSound()
+const Sample* SoundEngine::FindInBanks(const char* filename) const
 {
-	// Release the primary sound buffer pointer.
-	if (primaryBuffer)
+	// Banks first, they're already loaded and a lookup is just a hash
+	for (const std::unique_ptr<SoundBank>& bank : banks)
 	{
-		primaryBuffer->Release();
-		primaryBuffer = 0;
+		const Sample* sample = bank->Find(filename);
+		if (sample)
+		{
+			return sample;
+		}
 	}
+	return nullptr;
+}
 
-	// Release the direct sound interface pointer.
-	if (directSound)
+SoundEngine::SoundEntry* SoundEngine::GetEntry(SoundId sound)
+{
+	return sound.index < sounds.size() ? sounds[sound.index].get() : nullptr;
+}
+
+SoundId SoundEngine::FindSoundIdLocked(uint64_t nameHash)
+{
+	SoundId sound;
+	auto found = soundIds.find(nameHash);
+	if (found != soundIds.end())
 	{
-		directSound->Release();
-		directSound = 0;
+		sound.index = found->second;
 	}
-
-	return;
+	return sound;
 }
 
-// Play the sound!
+SoundId SoundEngine::FindSoundId(uint64_t nameHash)
+{
+	std::lock_guard<std::mutex> lock(soundsMutex);
+	return FindSoundIdLocked(nameHash);
+}
 
-bool SoundEngine::PlaySound(const char* filename, DWORD flags, FX effectType, float volume = DSBVOLUME_MAX, float frequency = DSBFREQUENCY_ORIGINAL, float pan = DSBPAN_CENTER)
+SoundId SoundEngine::GetSoundId(const char* filename)
 {
-	HRESULT result;
+	const uint64_t nameHash = HashName(filename);
 
-	// Set position at the beginning of the sound buffer.
-	if (sounds[filename] == nullptr)
+	std::lock_guard<std::mutex> lock(soundsMutex);
+	SoundId sound = FindSoundIdLocked(nameHash);
+	if (sound.IsValid())
 	{
-		std::cout << blue << "INFO: Adding sound to sound map" << white << std::endl;
-		result = LoadWaveFile(filename);
-		if (FAILED(result))
+		if (sounds[sound.index]->name != filename)
 		{
-			std::cout << red << "ERROR: Couldn't add sound to sound map" << white << std::endl;
-			return false;
+			std::cout << red << "ERROR: " << filename << " and " << sounds[sound.index]->name << " have the same hash!" << white << std::endl;
+			return SoundId();
 		}
+		return sound;
 	}
 
-	if (sounds[filename])
+	sound.index = (uint32_t)sounds.size();
+	SoundEntry* entry = new SoundEntry();
+	entry->name = filename;
+	sounds.emplace_back(entry);
+	soundIds[nameHash] = sound.index;
+
+	// Sounds in a bank are ready to go already
+	const Sample* bankSample = FindInBanks(filename);
+	if (bankSample)
 	{
-		std::cout << blue << "INFO: Playing existing sound" << white << std::endl;
-		result = sounds[filename]->SetCurrentPosition(0);
-		if (FAILED(result))
-		{
-			std::cout << red << "ERROR: Couldn't play existing sound" << white << std::endl;
-			return false;
-		}
+		entry->state = SoundEntry::State::READY;
+		entry->sample = bankSample;
+		std::promise<bool> alreadyLoaded;
+		alreadyLoaded.set_value(true);
+		entry->loaded = alreadyLoaded.get_future().share();
+		return sound;
+	}
 
-		// Set volume of the buffer to 100%.
-		result = sounds[filename]->SetVolume(volume);
-		if (FAILED(result))
-		{
-			std::cout << red << "ERROR: Couldn't change volume" << std::endl;
-			return false;
-		}
+	std::cout << blue << "INFO: Adding sound to sound map" << white << std::endl;
+	StartLoad(entry);
+	return sound;
+}
 
-		// CHANGE FREQUENCY (takes a number from 100 to 100000. Defaults to ORIGINAL)
-		// calculate good number to pass in
-		// pass it in
-		result = sounds[filename]->SetFrequency(frequency);
-		if (FAILED(result))
+void SoundEngine::StartLoad(SoundEntry* entry)
+{
+	// A region's audio is its sound's, so that's what loads
+	if (entry->parent)
+	{
+		if (entry->parent->state == SoundEntry::State::UNLOADED)
 		{
-			std::cout << red << "ERROR: Couldn't change frequency" << std::endl;
-			return false;
+			StartLoad(entry->parent);
 		}
+		return;
+	}
 
-		// APPLY PAN (takes a number from -10000 to 10000 where -10 is left, 0 is both, 10 is right)
-		// calculate good number to pass in
-		// pass it in
+	if (entry->state == SoundEntry::State::UNLOADED)
+	{
+		cacheReloads++;
+	}
+	entry->state = SoundEntry::State::LOADING;
 
-		result = sounds[filename]->SetPan(pan);
-		if (FAILED(result))
+	// Entries never move or go away until Shutdown, which waits for the pool first, so the worker can hang on to it
+	entry->loaded = loadPool.Submit([this, entry] { return LoadSound(entry); }).share();
+	for (SoundEntry* region : entry->regions)
+	{
+		if (region->state != SoundEntry::State::FAILED)
 		{
-			std::cout << red << "ERROR: Couldn't change pan" << std::endl;
-			return false;
+			region->state = SoundEntry::State::LOADING;
+			region->loaded = entry->loaded;
 		}
+	}
+}
 
-		// EFFECTS
-
-		// Make an effects structure
-
-		DSEFFECTDESC effectsDesc;
-		
-		effectsDesc.dwSize = sizeof(DSEFFECTDESC); // Size of the structure
-		effectsDesc.dwFlags = DSFX_LOCSOFTWARE; // Effect must be in software!
-		effectsDesc.dwReserved1 = 0;
-		effectsDesc.dwReserved2 = 0;
-
-		switch (effectType) {
-		case FX::NONE:
-			break;
-		case FX::CHORUS:
-			// Add effect to struct
-			effectsDesc.guidDSFXClass = GUID_DSFX_STANDARD_CHORUS;
-			resultsCodes = nullptr;
-			// SetFX
-			// DWORD dwEffectsCount - number of elements in the pDSFXDesc and pdwResultCodes arrays - set to 0 to remove all effects
-			// LPDSEFFECTDESC pDSFXDesc - address of an array of DSEFFECTDESC structs
-			// LPDWORD pdwResultCodes - address of an array of DWORD elements of size dwEffectsCount
-			result = sounds[filename]->SetFX(1, &effectsDesc, resultsCodes);
-			if (FAILED(result))
-			{
-				return false;
-			}
-			fxChorus = nullptr;
-			sounds[filename]->GetObjectInPath(GUID_DSFX_STANDARD_CHORUS, 0, IID_IDirectSoundFXChorus8, (LPVOID*)&fxChorus);
-			//sounds[filename]->QueryInterface(IID_IDirectSoundFXChorus8, (LPVOID*)fxChorus);
-			result = fxChorus->SetAllParameters(&chorus);
-			if (FAILED(result))
-			{
-				std::cout << red << "ERROR: couldn't set chorus params" << white << std::endl;
-			}
-			break;
-		case FX::COMPRESSOR:
-			// Add effect to struct
-			effectsDesc.guidDSFXClass = GUID_DSFX_STANDARD_COMPRESSOR;
-			resultsCodes = nullptr;
-			// SetFX
-			// DWORD dwEffectsCount - number of elements in the pDSFXDesc and pdwResultCodes arrays - set to 0 to remove all effects
-			// LPDSEFFECTDESC pDSFXDesc - address of an array of DSEFFECTDESC structs
-			// LPDWORD pdwResultCodes - address of an array of DWORD elements of size dwEffectsCount
-			result = sounds[filename]->SetFX(1, &effectsDesc, resultsCodes);
-			if (FAILED(result))
-			{
-				return false;
-			}
-			fxCompressor = nullptr;
-			sounds[filename]->GetObjectInPath(GUID_DSFX_STANDARD_COMPRESSOR, 0, IID_IDirectSoundFXCompressor8, (LPVOID*)&fxCompressor);
-			result = fxCompressor->SetAllParameters(&compressor);
-			if (FAILED(result))
-			{
-				std::cout << red << "ERROR: couldn't set compressor params" << white << std::endl;
-			}
-			break;
-		case FX::DISTORTION:
-			// Add effect to struct
-			effectsDesc.guidDSFXClass = GUID_DSFX_STANDARD_DISTORTION;
-			resultsCodes = nullptr;
-			// SetFX
-			// DWORD dwEffectsCount - number of elements in the pDSFXDesc and pdwResultCodes arrays - set to 0 to remove all effects
-			// LPDSEFFECTDESC pDSFXDesc - address of an array of DSEFFECTDESC structs
-			// LPDWORD pdwResultCodes - address of an array of DWORD elements of size dwEffectsCount
-			result = sounds[filename]->SetFX(1, &effectsDesc, resultsCodes);
-			if (FAILED(result))
-			{
-				return false;
-			}
-			fxDistortion = nullptr;
-			sounds[filename]->GetObjectInPath(GUID_DSFX_STANDARD_DISTORTION, 0, IID_IDirectSoundFXDistortion8, (LPVOID*)&fxDistortion);
-			result = fxDistortion->SetAllParameters(&distortion);
-			if (FAILED(result))
-			{
-				std::cout << red << "ERROR: couldn't set distortion params" << white << std::endl;
-			}
-			break;
-		case FX::ECHO:
-			// Add effect to struct
-			effectsDesc.guidDSFXClass = GUID_DSFX_STANDARD_ECHO;
-			resultsCodes = nullptr;
-			// SetFX
-			// DWORD dwEffectsCount - number of elements in the pDSFXDesc and pdwResultCodes arrays - set to 0 to remove all effects
-			// LPDSEFFECTDESC pDSFXDesc - address of an array of DSEFFECTDESC structs
-			// LPDWORD pdwResultCodes - address of an array of DWORD elements of size dwEffectsCount
-			result = sounds[filename]->SetFX(1, &effectsDesc, resultsCodes);
-			if (FAILED(result))
-			{
-				return false;
-			}
-			fxEcho = nullptr;
-			sounds[filename]->GetObjectInPath(GUID_DSFX_STANDARD_ECHO, 0, IID_IDirectSoundFXEcho8, (LPVOID*)&fxEcho);
-			result = fxEcho->SetAllParameters(&echo);
-			if (FAILED(result))
-			{
-				std::cout << red << "ERROR: couldn't set echo params" << white << std::endl;
-			}
-			break;
-		case FX::FLANGER:
-			// Add effect to struct
-			effectsDesc.guidDSFXClass = GUID_DSFX_STANDARD_FLANGER;
-			resultsCodes = nullptr;
-			// SetFX
-			// DWORD dwEffectsCount - number of elements in the pDSFXDesc and pdwResultCodes arrays - set to 0 to remove all effects
-			// LPDSEFFECTDESC pDSFXDesc - address of an array of DSEFFECTDESC structs
-			// LPDWORD pdwResultCodes - address of an array of DWORD elements of size dwEffectsCount
-			result = sounds[filename]->SetFX(1, &effectsDesc, resultsCodes);
-			if (FAILED(result))
-			{
-				return false;
-			}
-			fxFlanger = nullptr;
-			sounds[filename]->GetObjectInPath(GUID_DSFX_STANDARD_FLANGER, 0, IID_IDirectSoundFXFlanger8, (LPVOID*)&fxFlanger);
-			result = fxFlanger->SetAllParameters(&flanger);
-			if (FAILED(result))
-			{
-				std::cout << red << "ERROR: couldn't set flanger params" << white << std::endl;
-			}
-			break;
-		case FX::GARGLE:
-			// Add effect to struct
-			effectsDesc.guidDSFXClass = GUID_DSFX_STANDARD_GARGLE;
-			resultsCodes = nullptr;
-			// SetFX
-			// DWORD dwEffectsCount - number of elements in the pDSFXDesc and pdwResultCodes arrays - set to 0 to remove all effects
-			// LPDSEFFECTDESC pDSFXDesc - address of an array of DSEFFECTDESC structs
-			// LPDWORD pdwResultCodes - address of an array of DWORD elements of size dwEffectsCount
-			result = sounds[filename]->SetFX(1, &effectsDesc, resultsCodes);
-			if (FAILED(result))
-			{
-				return false;
-			}
-			fxGargle = nullptr;
-			sounds[filename]->GetObjectInPath(GUID_DSFX_STANDARD_GARGLE, 0, IID_IDirectSoundFXGargle8, (LPVOID*)&fxGargle);
-			result = fxGargle->SetAllParameters(&gargle);
-			if (FAILED(result))
+bool SoundEngine::LoadSound(SoundEntry* entry)
+{
+	std::shared_ptr<Sample> sample = std::make_shared<Sample>();
+	WaveLoadOptions options;
+	std::string filename;
+	{
+		std::lock_guard<std::mutex> lock(soundsMutex);
+		options = loadOptions;
+		filename = entry->name;
+	}
+
+	// The slow part, done without holding anything
+	bool ok = LoadWaveFile(filename.c_str(), *sample, options);
+	if (!ok)
+	{
+		std::cout << red << "ERROR: Couldn't add sound to sound map" << white << std::endl;
+	}
+
+	// If something already loaded has exactly the same audio in it, whatever it's called, share that instead
+	if (ok && sample->contentHash != 0)
+	{
+		std::shared_ptr<const Sample> existing;
+		{
+			std::lock_guard<std::mutex> lock(soundsMutex);
+			auto found = samplesByContent.find(sample->contentHash);
+			if (found != samplesByContent.end())
 			{
-				std::cout << red << "ERROR: couldn't set flanger params" << white << std::endl;
+				existing = found->second.lock();
 			}
-			break;
-		case FX::PARAMEQ:
-			// Add effect to struct
-			effectsDesc.guidDSFXClass = GUID_DSFX_STANDARD_PARAMEQ;
-			resultsCodes = nullptr;
-			// SetFX
-			// DWORD dwEffectsCount - number of elements in the pDSFXDesc and pdwResultCodes arrays - set to 0 to remove all effects
-			// LPDSEFFECTDESC pDSFXDesc - address of an array of DSEFFECTDESC structs
-			// LPDWORD pdwResultCodes - address of an array of DWORD elements of size dwEffectsCount
-			result = sounds[filename]->SetFX(1, &effectsDesc, resultsCodes);
-			if (FAILED(result))
+		}
+		// The hash only says they're probably the same, so check (without holding anything, it's a read of both)
+		if (existing && sample->HasSameFrames(*existing))
+		{
+			sample->Share(existing);
+			std::cout << blue << "INFO: " << filename << " is the same audio as a sound already loaded, sharing it" << white << std::endl;
+		}
+	}
+
+	std::vector<std::shared_ptr<Sample>> unloaded;
+	{
+		std::lock_guard<std::mutex> lock(soundsMutex);
+		entry->state = ok ? SoundEntry::State::READY : SoundEntry::State::FAILED;
+		entry->ownedSample = std::move(sample);
+		entry->sample = ok ? entry->ownedSample.get() : nullptr;
+		if (ok)
+		{
+			const Sample* loaded = entry->sample;
+			if (!loaded->IsShared() && loaded->contentHash != 0)
 			{
-				return false;
+				// The first to load with this audio is the one the rest share
+				std::weak_ptr<const Sample>& known = samplesByContent[loaded->contentHash];
+				if (known.expired())
+				{
+					known = entry->ownedSample;
+				}
 			}
-			fxParamEQ = nullptr;
-			sounds[filename]->GetObjectInPath(GUID_DSFX_STANDARD_PARAMEQ, 0, IID_IDirectSoundFXParamEq8, (LPVOID*)&fxParamEQ);
-			result = fxParamEQ->SetAllParameters(&paramEQ);
-			if (FAILED(result))
+			ChargeCache(loaded);
+			TouchCached(entry);
+		}
+
+		// Now start anything that was waiting on it (or let go of their handles if it didn't load).
+		// Still holding the lock, so nothing can unload it before its voices have been counted
+		StartPendingPlays(entry, ok);
+
+		// And its regions, which were waiting on the same load
+		for (SoundEntry* region : entry->regions)
+		{
+			if (region->state == SoundEntry::State::LOADING)
 			{
-				std::cout << red << "ERROR: couldn't set param EQ params" << white << std::endl;
+				bool ready = ok && ResolveRegion(region);
+				if (!ready)
+				{
+					region->state = SoundEntry::State::FAILED;
+				}
+				StartPendingPlays(region, ready);
 			}
-			break;
-		case FX::REVERB:
-			// Add effect to struct
-			effectsDesc.guidDSFXClass = GUID_DSFX_WAVES_REVERB;
-			resultsCodes = nullptr;
-			// SetFX
-			// DWORD dwEffectsCount - number of elements in the pDSFXDesc and pdwResultCodes arrays - set to 0 to remove all effects
-			// LPDSEFFECTDESC pDSFXDesc - address of an array of DSEFFECTDESC structs
-			// LPDWORD pdwResultCodes - address of an array of DWORD elements of size dwEffectsCount
-			result = sounds[filename]->SetFX(1, &effectsDesc, resultsCodes);
-			if (FAILED(result))
+		}
+
+		TrimSampleCache(entry, unloaded);
+	}
+	return ok;
+}
+
+void SoundEngine::StartPendingPlays(SoundEntry* entry, bool loaded)
+{
+	for (PendingPlay& pending : entry->pendingPlays)
+	{
+		if (loaded)
+		{
+			PlayPending(entry->sample, pending);
+		}
+		else
+		{
+			mixer.Stop(pending.handle);
+		}
+	}
+	entry->pendingPlays.clear();
+}
+
+void SoundEngine::PlayPending(const Sample* sample, PendingPlay& pending)
+{
+	double waited = std::chrono::duration<double>(std::chrono::steady_clock::now() - pending.requestTime).count();
+	if (pending.maxWaitSeconds > 0.0f && waited > pending.maxWaitSeconds)
+	{
+		std::cout << blue << "INFO: Sound took " << waited << "s to load, dropping it" << white << std::endl;
+		mixer.Stop(pending.handle);
+		return;
+	}
+
+	VoiceParams& params = pending.params;
+	params.pitch = FrequencyToPitch(pending.frequency, sample);
+
+	// One scheduled for later than this isn't late at all yet
+	if (pending.policy == NotReadyPolicy::PLAY_LATE_WITH_FADE && pending.time <= mixer.GetTime())
+	{
+		// Pick it up where it would be by now if it had started on time
+		double frames = waited * sample->sampleRate * params.pitch;
+		const double loopEnd = (double)sample->GetLoopEnd();
+		if (params.looping && frames >= loopEnd)
+		{
+			frames = sample->loopStart + fmod(frames - loopEnd, loopEnd - sample->loopStart);
+		}
+		else if (frames >= sample->frameCount)
+		{
+			// It would have finished already
+			mixer.Stop(pending.handle);
+			return;
+		}
+		params.startFrame = (unsigned)frames;
+		params.fadeInFrames = (unsigned)(kLateFadeSeconds * mixer.GetSampleRate());
+	}
+
+	// If the handle was stopped while it waited this does nothing, which is what we want
+	mixer.PlayAt(pending.time, sample, params, pending.handle);
+}
+
+std::shared_future<bool> SoundEngine::PreloadAsync(const char* filename)
+{
+	SoundId sound = GetSoundId(filename);
+
+	std::lock_guard<std::mutex> lock(soundsMutex);
+	SoundEntry* entry = GetEntry(sound);
+	if (!entry)
+	{
+		std::promise<bool> failed;
+		failed.set_value(false);
+		return failed.get_future().share();
+	}
+	if (entry->state == SoundEntry::State::UNLOADED)
+	{
+		StartLoad(entry);
+	}
+	return entry->loaded;
+}
+
+std::shared_future<bool> SoundEngine::PreloadBatch(const std::vector<std::string>& filenames)
+{
+	// Everything gets queued at once so the pool works through them in parallel, then one more job
+	// waits on the lot so the caller only has one thing to wait for. The queue is first in first out,
+	// so by the time a worker picks that job up every load is either done or running on another worker
+	std::vector<std::shared_future<bool>> loads;
+	loads.reserve(filenames.size());
+	for (const std::string& filename : filenames)
+	{
+		loads.push_back(PreloadAsync(filename.c_str()));
+	}
+
+	return loadPool.Submit([loads]
+	{
+		bool allLoaded = true;
+		for (const std::shared_future<bool>& load : loads)
+		{
+			allLoaded = load.get() && allLoaded;
+		}
+		return allLoaded;
+	}).share();
+}
+
+void SoundEngine::SetNotReadyPolicy(NotReadyPolicy policy, float maxWait)
+{
+	std::lock_guard<std::mutex> lock(soundsMutex);
+	notReadyPolicy = policy;
+	maxWaitSeconds = maxWait;
+}
+
+void SoundEngine::SetWaveLoadOptions(const WaveLoadOptions& options)
+{
+	std::lock_guard<std::mutex> lock(soundsMutex);
+	loadOptions = options;
+}
+
+// Play the sound!
+
+bool SoundEngine::PlaySound(const char* filename, DWORD flags, FX effectType, float volume, float frequency, float pan, int priority, unsigned group)
+{
+	EffectChain* effects = GetEffectChain(effectType);
+	float reverbSend = effectType == FX::REVERB ? 1.0f : 0.0f;
+	return PlaySound(GetSoundId(filename), flags, volume, frequency, pan, priority, group, effects, reverbSend).IsValid();
+}
+
+VoiceHandle SoundEngine::PlaySoundAt(uint64_t time, SoundId sound, DWORD flags, float volume, float frequency, float pan, int priority, unsigned group, EffectChain* effects, float reverbSend)
+{
+	VoiceParams params;
+	params.effects = effects;
+	params.sendBus = kReverbBus;
+	params.sendLevel = reverbSend;
+	params.gain = VolumeToGain(volume);
+	params.pan = PanToBalance(pan);
+	params.looping = (flags & DSBPLAY_LOOPING) != 0;
+	params.priority = priority;
+	params.group = group;
+
+	VoiceHandle voice;
+	{
+		std::lock_guard<std::mutex> lock(soundsMutex);
+		SoundEntry* entry = GetEntry(sound);
+		if (!entry || entry->state == SoundEntry::State::FAILED)
+		{
+			return VoiceHandle();
+		}
+
+		// Thrown out of the cache, so it's back to loading
+		if (entry->state == SoundEntry::State::UNLOADED)
+		{
+			StartLoad(entry);
+		}
+
+		if (entry->state == SoundEntry::State::LOADING)
+		{
+			if (notReadyPolicy == NotReadyPolicy::DROP)
 			{
-				return false;
+				std::cout << blue << "INFO: " << entry->name << " isn't loaded yet, not playing it" << white << std::endl;
+				return VoiceHandle();
 			}
-			fxReverb= nullptr;
-			sounds[filename]->GetObjectInPath(GUID_DSFX_WAVES_REVERB, 0, IID_IDirectSoundFXWavesReverb8, (LPVOID*)&fxReverb);
-			result = fxReverb->SetAllParameters(&reverb);
-			if (FAILED(result))
+
+			// The load pool starts it when it's ready
+			PendingPlay pending;
+			pending.params = params;
+			pending.time = time;
+			pending.frequency = frequency;
+			pending.policy = notReadyPolicy;
+			pending.maxWaitSeconds = maxWaitSeconds;
+			pending.handle = mixer.ReserveHandle();
+			pending.requestTime = std::chrono::steady_clock::now();
+			if (!pending.handle.IsValid())
 			{
-				std::cout << red << "ERROR: couldn't set param EQ params" << white << std::endl;
+				std::cout << red << "ERROR: Too many sounds waiting to start" << white << std::endl;
+				return VoiceHandle();
 			}
-			break;
-		default:
-			break;
+			entry->pendingPlays.push_back(pending);
+			return pending.handle;
 		}
 
-		// Play the contents of the secondary sound buffer.
-		result = sounds[filename]->Play(0, 0, flags);
-		if (FAILED(result))
+		// Started with the lock held, so the cache can't unload the sample before the voice is counted
+		const Sample* sample = entry->sample;
+		params.pitch = FrequencyToPitch(frequency, sample);
+		voice = mixer.PlayAt(time, sample, params);
+		// A region keeps its whole sound fresh in the cache
+		SoundEntry* cachedEntry = entry->parent ? entry->parent : entry;
+		if (cachedEntry->cached)
 		{
-			std::cout << red << "ERROR: Couldn't play sound" << white <<std::endl;
-			return false;
+			TouchCached(cachedEntry);
 		}
-		return true;
 	}
-	return false;
+
+	if (!voice.IsValid())
+	{
+		std::cout << red << "ERROR: Couldn't play sound, every voice is busy with something more important" << white << std::endl;
+	}
+	return voice;
 }
 
-// Returns true if the sound passed in is currently playing
+VoiceHandle SoundEngine::PlayNoteAt(uint64_t time, const SynthParams& note, float volume, float pan, int priority, unsigned group, EffectChain* effects, float reverbSend)
+{
+	VoiceParams params;
+	params.effects = effects;
+	params.sendBus = kReverbBus;
+	params.sendLevel = reverbSend;
+	params.gain = VolumeToGain(volume);
+	params.pan = PanToBalance(pan);
+	params.priority = priority;
+	params.group = group;
+
+	VoiceHandle voice = mixer.PlayAt(time, note, params);
+	if (!voice.IsValid())
+	{
+		std::cout << red << "ERROR: Couldn't play note, every voice is busy with something more important" << white << std::endl;
+	}
+	return voice;
+}
 
-bool SoundEngine::IsPlaying(const char* filename)
+VoiceHandle SoundEngine::PlayMidiNoteAt(uint64_t time, unsigned note, unsigned velocity, const SynthParams& synth, float pan, int priority, unsigned group, EffectChain* effects, float reverbSend)
 {
-	if (sounds[filename] != nullptr)
+	if (note >= kMidiNoteCount || velocity == 0)
 	{
-		DWORD dwStatus;
-		HRESULT result = sounds[filename]->GetStatus(&dwStatus);
-		if (!FAILED(result))
-		{
-			return (dwStatus & DSBSTATUS_PLAYING) != 0;
-		}
+		return VoiceHandle();
 	}
-	return false;
+
+	SynthParams params = synth;
+	params.frequency = GetMidiFrequency(note);
+	// The usual velocity curve, gain going with its square: 40dB from 127 down to 1
+	float level = std::min(velocity, 127u) / 127.0f;
+	float volume = std::max((float)DSBVOLUME_MIN, 4000.0f * log10f(level));
+	return PlayNoteAt(time, params, volume, pan, priority, group, effects, reverbSend);
 }
 
-void SoundEngine::SetChorusParams(float wetDryMix, float depth, float feedback, float frequency, long waveform, float delay, long phase)
+bool SoundEngine::ReleaseNoteAt(uint64_t time, VoiceHandle note)
+{
+	if (!mixer.IsPlaying(note))
+	{
+		return false;
+	}
+	mixer.ReleaseNoteAt(time, note);
+	return true;
+}
+
+bool SoundEngine::StopVoiceAt(uint64_t time, VoiceHandle voice)
 {
-	chorus.fDelay = delay;
-	chorus.fDepth = depth;
-	chorus.fFeedback = feedback;
-	chorus.fFrequency = frequency;
-	chorus.fWetDryMix = wetDryMix;
-	chorus.lPhase = phase;
-	chorus.lWaveform = waveform;
+	if (!mixer.IsPlaying(voice))
+	{
+		return false;
+	}
+	mixer.StopAt(time, voice);
+	return true;
 }
 
-void SoundEngine::SetCompressorParams(float gain, float attack, float release, float threshold, float ratio, float predelay)
+bool SoundEngine::IsVoicePlaying(VoiceHandle voice)
 {
-	compressor.fGain = gain;
-	compressor.fAttack = attack;
-	compressor.fRelease = release;
-	compressor.fThreshold = threshold;
-	compressor.fRatio = ratio;
-	compressor.fPredelay = predelay;
+	return mixer.IsPlaying(voice);
 }
 
-void SoundEngine::SetDistortionParams(float gain, float edge, float postEQCenterFreq, float postEQBandwidth, float preLowpassCutoff)
+bool SoundEngine::SetVoiceVolume(VoiceHandle voice, float volume)
 {
-	distortion.fGain = gain;
-	distortion.fEdge = edge;
-	distortion.fPostEQCenterFrequency = postEQCenterFreq;
-	distortion.fPostEQBandwidth = postEQBandwidth;
-	distortion.fPreLowpassCutoff = preLowpassCutoff;
+	return mixer.SetGain(voice, VolumeToGain(volume));
 }
 
-void SoundEngine::SetEchoParams(float wetDryMix, float feedback, float leftDelay, float rightDelay, long panDelay)
+bool SoundEngine::SetVoicePan(VoiceHandle voice, float pan)
 {
-	echo.fWetDryMix = wetDryMix;
-	echo.fFeedback = feedback;
-	echo.fLeftDelay = leftDelay;
-	echo.fRightDelay = rightDelay;
-	echo.lPanDelay = panDelay;
+	return mixer.SetPan(voice, PanToBalance(pan));
 }
 
-void SoundEngine::SetFlangerParams(float wetDryMix, float depth, float feedback, float frequency, long waveform, float delay, long phase)
+bool SoundEngine::SetVoicePitch(VoiceHandle voice, float pitch)
 {
-	flanger.fDelay = delay;
-	flanger.fDepth = depth;
-	flanger.fFeedback = feedback;
-	flanger.fFrequency = frequency;
-	flanger.fWetDryMix = wetDryMix;
-	flanger.lPhase = phase;
-	flanger.lWaveform = waveform;
+	return mixer.SetPitch(voice, pitch);
 }
 
-void SoundEngine::SetGargleParams(DWORD rateHz, DWORD waveShape)
+bool SoundEngine::SetVoiceBus(VoiceHandle voice, unsigned bus)
 {
-	gargle.dwRateHz = rateHz;
-	gargle.dwWaveShape = waveShape;
+	return mixer.SetBus(voice, bus);
 }
 
-void SoundEngine::SetParamEQ(float centre, float bandwidth, float gain)
+void SoundEngine::SetBusVolume(unsigned bus, float volume)
 {
-	paramEQ.fCenter = centre;
-	paramEQ.fBandwidth = bandwidth;
-	paramEQ.fGain = gain;
+	mixer.SetBusGain(bus, VolumeToGain(volume));
 }
 
-void SoundEngine::SetReverbParams(float inputGain, float reverbMix, float reverbTime, float HFRTRatio)
+bool SoundEngine::SetVoiceReverbSend(VoiceHandle voice, float level)
 {
-	reverb.fInGain = inputGain;
-	reverb.fReverbMix = reverbMix;
-	reverb.fReverbTime = reverbTime;
-	reverb.fHighFreqRTRatio = HFRTRatio;
+	return mixer.SetSend(voice, kReverbBus, level);
 }
 
+bool SoundEngine::SetVoiceSend(VoiceHandle voice, unsigned bus, float level)
+{
+	return mixer.SetSend(voice, bus, level);
+}
 
+StreamingSound* SoundEngine::FindStream(const char* filename)
+{
+	// Streams stay put until Shutdown, so the pointer's good after the lock goes
+	std::lock_guard<std::mutex> lock(streamsMutex);
+	auto found = streams.find(filename);
+	return found != streams.end() ? found->second.get() : nullptr;
+}
 
-bool SoundEngine::StopSound(const char* filename)
+bool SoundEngine::PlayStream(const char* filename, DWORD flags, float volume, float pan, int priority, unsigned group)
 {
-	if (IsPlaying(filename))
+	std::lock_guard<std::mutex> lock(streamsMutex);
+	StreamingSound* stream = nullptr;
+	auto found = streams.find(filename);
+	if (found != streams.end())
+	{
+		// Already open, so take it back to the start. The new voice takes over from the old one
+		stream = found->second.get();
+		stream->SetLooping((flags & DSBPLAY_LOOPING) != 0);
+		stream->Seek(0);
+		streamReader.Wake();
+	}
+	else
 	{
-		if (sounds[filename] != nullptr)
+		std::unique_ptr<StreamingSound> newStream(new StreamingSound());
+		newStream->SetLooping((flags & DSBPLAY_LOOPING) != 0);
+		if (!newStream->Open(filename, streamReadAheadFrames))
 		{
-			HRESULT result = sounds[filename]->Stop();
-			return (FAILED(result));
+			return false;
 		}
+		stream = newStream.get();
+		streams[filename] = std::move(newStream);
+		streamReader.Add(stream);
 	}
-	return false;
+
+	VoiceParams params;
+	params.gain = VolumeToGain(volume);
+	params.pan = PanToBalance(pan);
+	params.priority = priority;
+	params.group = group;
+
+	if (!mixer.Play(stream, params).IsValid())
+	{
+		std::cout << red << "ERROR: Couldn't play stream, every voice is busy with something more important" << white << std::endl;
+		return false;
+	}
+	return true;
 }
 
-// Handles loading in a .wav audio file, copying the data onto a secondary buffer.
-bool SoundEngine::LoadWaveFile(const char* filename)
+bool SoundEngine::StopStream(const char* filename)
 {
-	int error; // for finding out what went wrong
-	FILE* filePtr = nullptr; // for accessing the file
-	unsigned int count; // for reading wave file header
-	WaveHeaderType waveFileHeader;
-	WAVEFORMATEX waveFormat;
-	DSBUFFERDESC bufferDesc; // for the secondary buffers
-	HRESULT result; // for finding out what went wrong
-	IDirectSoundBuffer* tempBuffer;
-	unsigned char* waveData;
-	unsigned char* bufferPtr;
-	unsigned long bufferSize;
+	StreamingSound* stream = FindStream(filename);
+	if (!stream || !mixer.IsPlaying(stream))
+	{
+		return false;
+	}
+	mixer.Stop(stream);
+	return true;
+}
 
-	// Create a pointer-to-pointer-to a buffer which will serve as a secondary buffer and assign to it the address of
-	// a new buffer in our <string, buffer> map using the filename passed in to the function
-	IDirectSoundBuffer8** secondaryBuffer = &sounds[filename];
+bool SoundEngine::IsStreamPlaying(const char* filename)
+{
+	StreamingSound* stream = FindStream(filename);
+	return stream && mixer.IsPlaying(stream);
+}
 
-	// Open the wave file in binary.
-	error = fopen_s(&filePtr, filename, "rb");
+bool SoundEngine::SeekStream(const char* filename, float seconds)
+{
+	StreamingSound* stream = FindStream(filename);
+	if (!stream)
+	{
+		return false;
+	}
 
+	double frame = std::max(0.0, (double)seconds * stream->GetSampleRate());
+	stream->Seek((unsigned)std::min(frame, (double)stream->GetFrameCount()));
+	streamReader.Wake();
+	return true;
+}
 
-	// Read in the wave file header.
-	count = (unsigned int)fread(&waveFileHeader, sizeof(waveFileHeader), 1, filePtr);
-	if (count != 1)
+bool SoundEngine::GetStreamStats(const char* filename, StreamStats& stats)
+{
+	StreamingSound* stream = FindStream(filename);
+	if (!stream)
 	{
-		std::cout << red << "ERROR: Couldn't read wave file!" << white << std::endl;
 		return false;
 	}
+	stats = stream->GetStats();
+	return true;
+}
+
+// Returns true if the sound passed in is currently playing
+
+bool SoundEngine::IsPlaying(const char* filename)
+{
+	// Only looks, a name we've never seen isn't playing (and doesn't get added)
+	return IsPlaying(FindSoundId(HashName(filename)));
+}
 
-	// Check that the chunk ID is the RIFF format.
-	if ((waveFileHeader.chunkId[0] != 'R') || (waveFileHeader.chunkId[1] != 'I') ||
-		(waveFileHeader.chunkId[2] != 'F') || (waveFileHeader.chunkId[3] != 'F'))
+bool SoundEngine::IsPlaying(SoundId sound)
+{
+	// Asked with the lock held, since the cache could unload the sample otherwise
+	std::lock_guard<std::mutex> lock(soundsMutex);
+	SoundEntry* entry = GetEntry(sound);
+	if (!entry)
 	{
-		std::cout << red << "ERROR: Chunk ID is not RIFF!" << white << std::endl;
 		return false;
 	}
+	// Waiting on its load counts, it's going to play
+	if (!entry->pendingPlays.empty())
+	{
+		return true;
+	}
+	return entry->sample && mixer.IsPlaying(entry->sample);
+}
 
-	// Check that the file format is the WAVE format.
-	if ((waveFileHeader.format[0] != 'W') || (waveFileHeader.format[1] != 'A') ||
-		(waveFileHeader.format[2] != 'V') || (waveFileHeader.format[3] != 'E'))
+bool SoundEngine::StopSound(const char* filename)
+{
+	return StopSound(FindSoundId(HashName(filename)));
+}
+
+bool SoundEngine::StopSound(SoundId sound)
+{
+	bool stopped = false;
+	std::lock_guard<std::mutex> lock(soundsMutex);
+	SoundEntry* entry = GetEntry(sound);
+	if (!entry)
 	{
-		std::cout << red << "ERROR: File format is not WAVE!" << white << std::endl;
 		return false;
 	}
 
-	// Check that the sub chunk ID is the fmt format.
-	if ((waveFileHeader.subChunkId[0] != 'f') || (waveFileHeader.subChunkId[1] != 'm') ||
-		(waveFileHeader.subChunkId[2] != 't') || (waveFileHeader.subChunkId[3] != ' '))
+	// Plays still waiting on the load shouldn't start after they've been stopped
+	for (const PendingPlay& pending : entry->pendingPlays)
 	{
-		std::cout << red << "ERROR: Sub chunk ID is not fmt!" << white << std::endl;
-		return false;
+		mixer.Stop(pending.handle);
+		stopped = true;
 	}
+	entry->pendingPlays.clear();
 
-	// Check for the data chunk header.
-	if ((waveFileHeader.dataChunkId[0] != 'd') || (waveFileHeader.dataChunkId[1] != 'a') ||
-		(waveFileHeader.dataChunkId[2] != 't') || (waveFileHeader.dataChunkId[3] != 'a'))
+	const Sample* sample = entry->sample;
+	if (sample && mixer.IsPlaying(sample))
 	{
-		std::cout << red << "ERROR: Couldn't find data chunk header!" << white << std::endl;
-		return false;
+		mixer.Stop(sample);
+		stopped = true;
 	}
+	return stopped;
+}
 
-	// Set the wave format of secondary buffer that this wave file will be loaded onto.
-	waveFormat.wFormatTag = waveFileHeader.audioFormat;
-	waveFormat.nSamplesPerSec = waveFileHeader.sampleRate;
-	waveFormat.wBitsPerSample = waveFileHeader.bitsPerSample;
-	waveFormat.nChannels = waveFileHeader.numChannels;
-	waveFormat.nBlockAlign = (waveFormat.wBitsPerSample / 8) * waveFormat.nChannels;
-	waveFormat.nAvgBytesPerSec = waveFormat.nSamplesPerSec * waveFormat.nBlockAlign;
-	waveFormat.cbSize = 0;
-
-	// Set the buffer description of the secondary sound buffer that the wave file will be loaded onto.
-	bufferDesc.dwSize = sizeof(DSBUFFERDESC);
-	bufferDesc.dwFlags = DSBCAPS_CTRLVOLUME | DSBCAPS_CTRLFREQUENCY | DSBCAPS_CTRLFX | DSBCAPS_CTRLPAN;
-	bufferDesc.dwBufferBytes = waveFileHeader.dataSize;
-	bufferDesc.dwReserved = 0;
-	bufferDesc.lpwfxFormat = &waveFormat;
-	bufferDesc.guid3DAlgorithm = GUID_NULL;
-
-	// Create a temporary sound buffer with the specific buffer settings.
-	result = directSound->CreateSoundBuffer(&bufferDesc, &tempBuffer, NULL);
-	if (FAILED(result))
-	{
-		std::cout << red << "ERROR: Couldn't create secondary sound buffer!" << white << std::endl;
-		return false;
+// ********************** Regions ******************************* //
+
+SoundId SoundEngine::DefineRegion(SoundId sound, const char* name, const SoundRegion& region)
+{
+	const uint64_t nameHash = HashName(name);
+
+	std::lock_guard<std::mutex> lock(soundsMutex);
+	SoundEntry* parent = GetEntry(sound);
+	if (!parent || parent->parent || parent->state == SoundEntry::State::FAILED)
+	{
+		// Regions of regions would work, but there's nothing they'd do that a region of the whole sound can't
+		std::cout << red << "ERROR: Can't define region " << name << ", it has to be part of a whole sound that loaded" << white << std::endl;
+		return SoundId();
 	}
 
-	// Test the buffer format against the direct sound 8 interface and create the secondary buffer.
-	result = tempBuffer->QueryInterface(IID_IDirectSoundBuffer8, (void**)&*secondaryBuffer);
-	if (FAILED(result))
+	SoundId existing = FindSoundIdLocked(nameHash);
+	if (existing.IsValid())
 	{
-		std::cout << red << "Temporary buffer did not have correct interface implementation!" << white << std::endl;
-		return false;
+		// Defining the same region again is fine, it's the one already there
+		const SoundEntry* other = sounds[existing.index].get();
+		if (other->parent == parent && other->name == name && other->region.start == region.start &&
+			other->region.length == region.length && other->region.loopStart == region.loopStart &&
+			other->region.loopEnd == region.loopEnd)
+		{
+			return existing;
+		}
+		std::cout << red << "ERROR: There's already a sound called " << name << white << std::endl;
+		return SoundId();
 	}
 
-	// Release the temporary buffer.
-	tempBuffer->Release();
-	tempBuffer = 0;
+	// If its sound is here already it can be checked now, otherwise it's checked once it's loaded
+	SoundRegion scaled;
+	if (parent->state == SoundEntry::State::READY && !ScaleRegion(*parent->sample, region, scaled))
+	{
+		std::cout << red << "ERROR: Region " << name << " doesn't fit in " << parent->name << white << std::endl;
+		return SoundId();
+	}
 
-	// Move to the beginning of the wave data which starts at the end of the data chunk header
-	// (For more on how this works, see WavFileCreator class)
-	fseek(filePtr, sizeof(WaveHeaderType), SEEK_SET);
+	SoundId regionSound;
+	regionSound.index = (uint32_t)sounds.size();
+	SoundEntry* entry = new SoundEntry();
+	entry->name = name;
+	entry->parent = parent;
+	entry->region = region;
+	entry->state = parent->state;
+	entry->loaded = parent->loaded;
+	sounds.emplace_back(entry);
+	soundIds[nameHash] = regionSound.index;
+	parent->regions.push_back(entry);
+
+	if (entry->state == SoundEntry::State::READY)
+	{
+		ResolveRegion(entry);
+	}
+	return regionSound;
+}
 
-	// Create a temporary buffer to hold the wave file data.
-	waveData = new unsigned char[waveFileHeader.dataSize];
-	if (!waveData)
+bool SoundEngine::ResolveRegion(SoundEntry* entry)
+{
+	const SoundEntry* parent = entry->parent;
+	SoundRegion scaled;
+	if (!ScaleRegion(*parent->sample, entry->region, scaled))
 	{
-		std::cout << red << "ERROR: Couldn't ceate a temporary buffer!" << white << std::endl;
+		std::cout << red << "ERROR: Region " << entry->name << " doesn't fit in " << parent->name << white << std::endl;
 		return false;
 	}
 
-	// Read in the wave file data into the newly created buffer.
-	count = (unsigned int)fread(waveData, 1, waveFileHeader.dataSize, filePtr);
-	if (count != waveFileHeader.dataSize)
+	// Bank sounds aren't owned by anything, but they're there until Shutdown, and so are regions of them
+	std::shared_ptr<const Sample> whole = parent->ownedSample;
+	if (!whole)
 	{
-		//std::cout << red << "ERROR: Couldn't read wave file data into temp buffer!" << white << std::endl;
-		//return false;
+		whole = std::shared_ptr<const Sample>(std::shared_ptr<const Sample>(), parent->sample);
 	}
 
-	// Close the file once done reading.
-	error = fclose(filePtr);
-	if (error != 0)
+	std::shared_ptr<Sample> sample = std::make_shared<Sample>();
+	sample->ShareRegion(whole, scaled.start, scaled.length);
+	sample->loopStart = scaled.loopStart;
+	sample->loopEnd = scaled.loopEnd;
+	entry->ownedSample = std::move(sample);
+	entry->sample = entry->ownedSample.get();
+	entry->state = SoundEntry::State::READY;
+	return true;
+}
+
+bool SoundEngine::IsInUse(const SoundEntry* entry)
+{
+	if (entry->pins > 0 || !entry->pendingPlays.empty() || (entry->sample && mixer.IsPlaying(entry->sample)))
+	{
+		return true;
+	}
+	for (const SoundEntry* region : entry->regions)
+	{
+		if (IsInUse(region))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// ********************** Sample cache ******************************* //
+
+void SoundEngine::SetSampleCacheBudget(size_t bytes)
+{
+	std::vector<std::shared_ptr<Sample>> unloaded;
+	std::lock_guard<std::mutex> lock(soundsMutex);
+	cacheBudget = bytes;
+	TrimSampleCache(nullptr, unloaded);
+}
+
+bool SoundEngine::PinSound(SoundId sound)
+{
+	std::lock_guard<std::mutex> lock(soundsMutex);
+	SoundEntry* entry = GetEntry(sound);
+	if (!entry || entry->state == SoundEntry::State::FAILED)
 	{
-		std::cout << red << "ERROR: Couldn't close wave file!" << white << std::endl;
 		return false;
 	}
+	entry->pins++;
+	if (entry->state == SoundEntry::State::UNLOADED)
+	{
+		StartLoad(entry);
+	}
+	return true;
+}
 
-	// Lock the secondary buffer to write wave data into it.
-	result = (*secondaryBuffer)->Lock(0, waveFileHeader.dataSize, (void**)&bufferPtr, (DWORD*)&bufferSize, NULL, 0, 0);
-	if (FAILED(result))
+bool SoundEngine::UnpinSound(SoundId sound)
+{
+	std::vector<std::shared_ptr<Sample>> unloaded;
+	std::lock_guard<std::mutex> lock(soundsMutex);
+	SoundEntry* entry = GetEntry(sound);
+	if (!entry || entry->pins == 0)
 	{
-		std::cout << red << "ERROR: Couldn't lock secondary buffer!" << white << std::endl;
 		return false;
 	}
+	entry->pins--;
+	// It might have been the only thing keeping the cache over budget
+	TrimSampleCache(nullptr, unloaded);
+	return true;
+}
+
+SampleCacheStats SoundEngine::GetSampleCacheStats()
+{
+	std::lock_guard<std::mutex> lock(soundsMutex);
+	SampleCacheStats stats;
+	stats.bytesUsed = cacheBytes;
+	stats.budget = cacheBudget;
+	stats.evictions = cacheEvictions;
+	stats.reloads = cacheReloads;
+	for (const std::unique_ptr<SoundEntry>& entry : sounds)
+	{
+		stats.loadedSounds += entry->cached ? 1 : 0;
+		stats.pinnedSounds += entry->pins > 0 ? 1 : 0;
+		if (entry->cached && entry->sample->IsShared())
+		{
+			stats.sharedSounds++;
+			stats.bytesShared += entry->sample->GetSizeInBytes();
+		}
+	}
+	return stats;
+}
 
-	// Copy the wave data into the buffer.
-	memcpy(bufferPtr, waveData, waveFileHeader.dataSize);
+void SoundEngine::ChargeCache(const Sample* sample)
+{
+	// Charged once per copy of the audio, however many sounds are sharing it
+	const Sample* store = sample->IsShared() ? sample->source.get() : sample;
+	if (cachedStores[store]++ == 0)
+	{
+		cacheBytes += store->GetSizeInBytes();
+	}
+}
 
-	// Unlock the secondary buffer after the data has been written to it.
-	result = (*secondaryBuffer)->Unlock((void*)bufferPtr, bufferSize, NULL, 0);
-	if (FAILED(result))
+void SoundEngine::UnchargeCache(const Sample* sample)
+{
+	const Sample* store = sample->IsShared() ? sample->source.get() : sample;
+	auto found = cachedStores.find(store);
+	if (found != cachedStores.end() && --found->second == 0)
 	{
-		std::cout << red << "ERROR: Couldn't unlock secondary buffer!" << white << std::endl;
-		return false;
+		cacheBytes -= store->GetSizeInBytes();
+		cachedStores.erase(found);
 	}
+}
 
-	// Release the wave data since it was copied into the secondary buffer and we do not need it anymore
-	delete[] waveData;
-	waveData = 0;
+void SoundEngine::TouchCached(SoundEntry* entry)
+{
+	if (entry == cacheNewest)
+	{
+		return;
+	}
+	if (entry->cached)
+	{
+		RemoveCached(entry);
+	}
 
-	return true;
+	entry->cached = true;
+	entry->older = cacheNewest;
+	entry->newer = nullptr;
+	if (cacheNewest)
+	{
+		cacheNewest->newer = entry;
+	}
+	cacheNewest = entry;
+	if (!cacheOldest)
+	{
+		cacheOldest = entry;
+	}
+}
+
+void SoundEngine::RemoveCached(SoundEntry* entry)
+{
+	(entry->newer ? entry->newer->older : cacheNewest) = entry->older;
+	(entry->older ? entry->older->newer : cacheOldest) = entry->newer;
+	entry->newer = nullptr;
+	entry->older = nullptr;
+	entry->cached = false;
+}
+
+void SoundEngine::TrimSampleCache(const SoundEntry* keep, std::vector<std::shared_ptr<Sample>>& unloaded)
+{
+	// Oldest first. Anything playing (or about to), pinned, or just loaded stays put
+	SoundEntry* entry = cacheOldest;
+	while (entry && cacheBudget > 0 && cacheBytes > cacheBudget)
+	{
+		SoundEntry* newer = entry->newer;
+		if (entry != keep && !IsInUse(entry))
+		{
+			RemoveCached(entry);
+			UnchargeCache(entry->sample);
+			cacheEvictions++;
+
+			// Its regions were only ever pointing into it (they're still holding on to it until 'unloaded' goes)
+			long regionsHolding = 0;
+			for (SoundEntry* region : entry->regions)
+			{
+				if (region->state == SoundEntry::State::READY)
+				{
+					region->state = SoundEntry::State::UNLOADED;
+					region->sample = nullptr;
+					unloaded.push_back(std::move(region->ownedSample));
+					regionsHolding++;
+				}
+			}
+
+			// Nothing else is sharing it, so nothing else can share it from now on either
+			auto known = samplesByContent.find(entry->sample->contentHash);
+			if (!entry->sample->IsShared() && known != samplesByContent.end() &&
+				entry->ownedSample.use_count() == 1 + regionsHolding &&
+				known->second.lock() == entry->ownedSample)
+			{
+				samplesByContent.erase(known);
+			}
+			entry->state = SoundEntry::State::UNLOADED;
+			entry->sample = nullptr;
+			unloaded.push_back(std::move(entry->ownedSample));
+		}
+		entry = newer;
+	}
+}
+
+void SoundEngine::SetVoiceGroupLimit(unsigned group, unsigned limit)
+{
+	mixer.SetGroupLimit(group, limit);
+}
+
+// ********************** Effect chains ******************************* //
+
+EffectChain* SoundEngine::CreateEffectChain()
+{
+	std::lock_guard<std::mutex> lock(effectChainsMutex);
+	effectChains.emplace_back(new EffectChain(mixer.GetSampleRate(), mixer.GetBlockFrames()));
+	return effectChains.back().get();
+}
+
+EffectChain* SoundEngine::GetEffectChain(FX effectType)
+{
+	switch (effectType)
+	{
+	case FX::DISTORTION:
+		return distortionChain;
+	case FX::GARGLE:
+		return gargleChain;
+	case FX::CHORUS:
+		return chorusChain;
+	case FX::FLANGER:
+		return flangerChain;
+	case FX::ECHO:
+		return echoChain;
+	case FX::COMPRESSOR:
+		return compressorChain;
+	case FX::PARAMEQ:
+		return paramEQChain;
+	default:
+		// Not native yet (or no effect at all)
+		return nullptr;
+	}
+}
+
+bool SoundEngine::SetVoiceEffects(VoiceHandle voice, EffectChain* chain)
+{
+	return mixer.SetEffects(voice, chain);
 }
 
+void SoundEngine::SetBusEffects(unsigned bus, EffectChain* chain)
+{
+	mixer.SetBusEffects(bus, chain);
+}
+
+void SoundEngine::SetEffectParameter(Effect* effect, unsigned parameter, float value)
+{
+	mixer.SetEffectParameter(effect, parameter, value);
+}
+
+ConvolutionEffect* SoundEngine::AddConvolutionReverb(EffectChain* chain, const char* impulseFile)
+{
+	std::shared_ptr<const ImpulseResponse> ir;
+	{
+		std::lock_guard<std::mutex> lock(effectChainsMutex);
+		auto found = impulseResponses.find(impulseFile);
+		if (found != impulseResponses.end())
+		{
+			ir = found->second;
+		}
+		else
+		{
+			// Always converted to float, it only gets read once
+			Sample sample;
+			WaveLoadOptions options;
+			options.zeroCopy = false;
+			if (!LoadWaveFile(impulseFile, sample, options))
+			{
+				std::cout << red << "ERROR: Couldn't load impulse response " << impulseFile << white << std::endl;
+				return nullptr;
+			}
+			if (sample.sampleRate != mixer.GetSampleRate())
+			{
+				std::cout << blue << "INFO: " << impulseFile << " was recorded at " << sample.sampleRate << "Hz but the mixer runs at "
+					<< mixer.GetSampleRate() << "Hz, so the reverb will come out a bit longer or shorter" << white << std::endl;
+			}
+
+			ir = ImpulseResponse::Create(sample, mixer.GetBlockFrames());
+			if (!ir)
+			{
+				std::cout << red << "ERROR: " << impulseFile << " is empty" << white << std::endl;
+				return nullptr;
+			}
+			impulseResponses[impulseFile] = ir;
+		}
+	}
+
+	ConvolutionEffect* effect = new ConvolutionEffect(ir, &convolutionWorkers);
+	chain->Add(std::unique_ptr<Effect>(effect));
+	return effect;
+}
+
+void SoundEngine::SetChorusParams(float wetDryMix, float depth, float feedback, float frequency, long waveform, float delay, long phase)
+{
+	mixer.SetEffectParameter(chorusEffect, ChorusEffect::WetDryMix, wetDryMix);
+	mixer.SetEffectParameter(chorusEffect, ChorusEffect::Depth, depth);
+	mixer.SetEffectParameter(chorusEffect, ChorusEffect::Feedback, feedback);
+	mixer.SetEffectParameter(chorusEffect, ChorusEffect::Frequency, frequency);
+	mixer.SetEffectParameter(chorusEffect, ChorusEffect::Waveform, (float)waveform);
+	mixer.SetEffectParameter(chorusEffect, ChorusEffect::Delay, delay);
+	mixer.SetEffectParameter(chorusEffect, ChorusEffect::Phase, (float)phase);
+}
+
+void SoundEngine::SetCompressorParams(float gain, float attack, float release, float threshold, float ratio, float predelay)
+{
+	mixer.SetEffectParameter(compressorEffect, CompressorEffect::Gain, gain);
+	mixer.SetEffectParameter(compressorEffect, CompressorEffect::Attack, attack);
+	mixer.SetEffectParameter(compressorEffect, CompressorEffect::Release, release);
+	mixer.SetEffectParameter(compressorEffect, CompressorEffect::Threshold, threshold);
+	mixer.SetEffectParameter(compressorEffect, CompressorEffect::Ratio, ratio);
+	mixer.SetEffectParameter(compressorEffect, CompressorEffect::Predelay, predelay);
+}
+
+void SoundEngine::SetMasterLimiter(bool enabled, float ceilingDb)
+{
+	mixer.SetEffectParameter(masterLimiter, CompressorEffect::Threshold, ceilingDb);
+	mixer.SetMasterEffects(enabled ? masterChain : nullptr);
+}
+
+void SoundEngine::SetDistortionParams(float gain, float edge, float postEQCenterFreq, float postEQBandwidth, float preLowpassCutoff)
+{
+	mixer.SetEffectParameter(distortionEffect, DistortionEffect::Gain, gain);
+	mixer.SetEffectParameter(distortionEffect, DistortionEffect::Edge, edge);
+	mixer.SetEffectParameter(distortionEffect, DistortionEffect::PostEQCenterFrequency, postEQCenterFreq);
+	mixer.SetEffectParameter(distortionEffect, DistortionEffect::PostEQBandwidth, postEQBandwidth);
+	mixer.SetEffectParameter(distortionEffect, DistortionEffect::PreLowpassCutoff, preLowpassCutoff);
+}
+
+void SoundEngine::SetEchoParams(float wetDryMix, float feedback, float leftDelay, float rightDelay, long panDelay)
+{
+	mixer.SetEffectParameter(echoEffect, EchoEffect::WetDryMix, wetDryMix);
+	mixer.SetEffectParameter(echoEffect, EchoEffect::Feedback, feedback);
+	mixer.SetEffectParameter(echoEffect, EchoEffect::LeftDelay, leftDelay);
+	mixer.SetEffectParameter(echoEffect, EchoEffect::RightDelay, rightDelay);
+	mixer.SetEffectParameter(echoEffect, EchoEffect::PanDelay, (float)panDelay);
+}
+
+void SoundEngine::SetFlangerParams(float wetDryMix, float depth, float feedback, float frequency, long waveform, float delay, long phase)
+{
+	mixer.SetEffectParameter(flangerEffect, FlangerEffect::WetDryMix, wetDryMix);
+	mixer.SetEffectParameter(flangerEffect, FlangerEffect::Depth, depth);
+	mixer.SetEffectParameter(flangerEffect, FlangerEffect::Feedback, feedback);
+	mixer.SetEffectParameter(flangerEffect, FlangerEffect::Frequency, frequency);
+	mixer.SetEffectParameter(flangerEffect, FlangerEffect::Waveform, (float)waveform);
+	mixer.SetEffectParameter(flangerEffect, FlangerEffect::Delay, delay);
+	mixer.SetEffectParameter(flangerEffect, FlangerEffect::Phase, (float)phase);
+}
+
+void SoundEngine::SetGargleParams(DWORD rateHz, DWORD waveShape)
+{
+	mixer.SetEffectParameter(gargleEffect, GargleEffect::RateHz, (float)rateHz);
+	mixer.SetEffectParameter(gargleEffect, GargleEffect::WaveShape, (float)waveShape);
+}
+
+void SoundEngine::SetParamEQ(float centre, float bandwidth, float gain)
+{
+	SetEQBand(0, BiquadType::Peaking, centre, SemitonesToQ(bandwidth), gain);
+}
+
+void SoundEngine::SetEQBand(unsigned band, BiquadType type, float frequency, float q, float gainDb)
+{
+	if (band >= EqEffect::kBands)
+	{
+		std::cout << red << "ERROR: there's no EQ band " << band << white << std::endl;
+		return;
+	}
+	mixer.SetEffectParameter(paramEQEffect, EqEffect::BandParameter(band, EqEffect::Type), (float)type);
+	mixer.SetEffectParameter(paramEQEffect, EqEffect::BandParameter(band, EqEffect::Frequency), frequency);
+	mixer.SetEffectParameter(paramEQEffect, EqEffect::BandParameter(band, EqEffect::Q), q);
+	mixer.SetEffectParameter(paramEQEffect, EqEffect::BandParameter(band, EqEffect::Gain), gainDb);
+}
+
+void SoundEngine::SetReverbParams(float inputGain, float reverbMix, float reverbTime, float HFRTRatio)
+{
+	mixer.SetEffectParameter(reverbEffect, ReverbEffect::InputGain, inputGain);
+	mixer.SetEffectParameter(reverbEffect, ReverbEffect::ReverbMix, reverbMix);
+	mixer.SetEffectParameter(reverbEffect, ReverbEffect::ReverbTime, reverbTime);
+	mixer.SetEffectParameter(reverbEffect, ReverbEffect::HighFreqRTRatio, HFRTRatio);
+}
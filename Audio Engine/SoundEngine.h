@@ -1,4 +1,4 @@
-// The new audio engine! 
+// The new audio engine!
 // Warning: aggressively commented for learning purposes
 // Console color codes for Audio Engine:
 // RED - ERROR
@@ -8,20 +8,33 @@
 #ifndef _SOUNDENGINE_H_
 #define _SOUNDENGINE_H_
 
-#include <dsound.h>
+#include "DirectSoundCompat.h"
+#include <chrono>
+#include <future>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
-
-#include <stdio.h>
-#include <tchar.h>
-#include <SDKDDKVer.h>
-#include <windows.h>
 #include <stdio.h>
 #include <assert.h>
 #include <iostream>
 
-/* 
+#include "Mixer.h"
+#include "EffectChain.h"
+#include "AudioBackend.h"
+#include "Sample.h"
+#include "WaveFile.h"
+#include "SoundBank.h"
+#include "StreamingSound.h"
+#include "StreamReader.h"
+#include "ConvolutionWorkers.h"
+#include "ThreadPool.h"
+#include "Hash.h"
+
+/*
 From Game Engine Architecture, Third Edition:
 WAV is an uncompressed file format created by Microsoft and IBM. Its
 use is commonplace on the Windows operating system. Its correct name
@@ -30,7 +43,7 @@ is 
 of formats known as resource interchange file format (RIFF). The contents
 of a RIFF file are arranged in chunks, each with a four-character code
 (FOURCC) that defines the contents of the chunk and a chunk size field.
-The bitstream in a WAV file conforms to the linear pulse-code modulation (LPCM) format. 
+The bitstream in a WAV file conforms to the linear pulse-code modulation (LPCM) format.
 WAV files can also contain compressed audio, but
 they are most commonly used for storing uncompressed audio data.
 */
@@ -39,12 +52,17 @@ they are most commonly used for storing uncompressed audio data.
 
 // Code for wav loading/playing is based on https://www.rastertek.com/dx10tut14.html
 
+// How it hangs together now:
+// SoundEngine (this) owns a Mixer, which sums all the playing sounds in software, and an AudioBackend,
+// which pulls finished blocks out of the mixer and sends them somewhere. DirectSound is just one backend;
+// NullBackend and WavFileBackend let the whole thing run headless on machines without a sound card.
+
 enum class FX
 {
 	NONE,
 	CHORUS,
 	COMPRESSOR,
-	DISTORTION, 
+	DISTORTION,
 	ECHO,
 	FLANGER,
 	GARGLE,
@@ -52,103 +70,421 @@ enum class FX
 	REVERB
 };
 
-class SoundEngine
+// Names a sound without the string. Look one up once with GetSoundId() (when the level loads, say)
+// and from then on playing or stopping that sound is an array index rather than a string compare.
+// Good for as long as the engine's around, whatever backends come and go
+struct SoundId
 {
-private:
-	// We're supporting wave files and need to know about them using their HEADER in order to load in the data
-	struct WaveHeaderType
-	{
-		char			chunkId[4];
-		unsigned long	chunkSize;
-		char			format[4];
-		char			subChunkId[4];
-		unsigned long	subChunkSize;
-		unsigned short	audioFormat;
-		unsigned short	numChannels;
-		unsigned long	sampleRate;
-		unsigned long	bytesPerSecond;
-		unsigned short	blockAlign;
-		unsigned short	bitsPerSample;
-		char			dataChunkId[4];
-		unsigned long	dataSize;
-	};
+	static const uint32_t kInvalidIndex = 0xFFFFFFFF;
+
+	uint32_t index = kInvalidIndex;
+
+	bool IsValid() const { return index != kInvalidIndex; }
+};
+
+// Part of a sound, to be played as a sound of its own (see SoundEngine::DefineRegion).
+// In frames of the file, at its own rate, even if it's been converted to another as it loaded
+struct SoundRegion
+{
+	unsigned start = 0;
+	// 0 for the rest of the sound
+	unsigned length = 0;
+	// Where it goes round when it's played looping, counted from the region's start: it plays up to loopEnd,
+	// then carries on from loopStart. A loopEnd of 0 is the end of the region, so by default it all loops
+	unsigned loopStart = 0;
+	unsigned loopEnd = 0;
+};
+
+// How the sample cache is doing (see SoundEngine::SetSampleCacheBudget)
+struct SampleCacheStats
+{
+	// Bytes of audio in loaded loose sounds. Banks don't count: they're mapped once and never unloaded
+	size_t bytesUsed = 0;
+	// 0 for no limit
+	size_t budget = 0;
+	unsigned loadedSounds = 0;
+	unsigned pinnedSounds = 0;
+	// Sounds unloaded to get back under budget, and sounds loaded again after being unloaded
+	unsigned evictions = 0;
+	unsigned reloads = 0;
+	// Loaded sounds playing another's audio because it was exactly the same (see WaveLoadOptions::hashContent),
+	// and the bytes they'd have taken up otherwise
+	unsigned sharedSounds = 0;
+	size_t bytesShared = 0;
+};
 
+// What PlaySound does with a sound that's still loading
+enum class NotReadyPolicy
+{
+	// Forget it, the moment has passed (good for sounds that only make sense right now, like gunshots)
+	DROP,
+	// Start it from the beginning as soon as it's loaded
+	DELAY,
+	// Start it as soon as it's loaded, but part way in - where it would have been if it had started
+	// on time - fading in so it doesn't click (good for music and loops that need to stay in sync)
+	PLAY_LATE_WITH_FADE
+};
+
+class DistortionEffect;
+class GargleEffect;
+class ChorusEffect;
+class FlangerEffect;
+class EchoEffect;
+class CompressorEffect;
+class EqEffect;
+class ReverbEffect;
+class ConvolutionEffect;
+class ImpulseResponse;
+enum class BiquadType;
+
+// Playing, stopping and changing sounds and voices is safe from any thread: the mixer only hears about it
+// through its command queue, so nothing here can hold up the audio thread. Initialize() and Shutdown()
+// are the exceptions, call those from one place while nothing else is using the engine.
+class SoundEngine
+{
 public:
 	static SoundEngine& GetInstance();
 	SoundEngine();
 	~SoundEngine();
 
+#ifdef _WIN32
 	// HWND is a 'Window Handle', and it will tell DirectSound which window to play the sound from
 	// Get this from Ogre's RenderWindow->GetCustomAttribute() function
 	bool Initialize(HWND);
+#endif
+	// Run on any backend you like (the engine takes ownership of it). Calling it again switches backends:
+	// sounds, banks and SoundIds all stay as they are, and whatever's playing carries on on the new one
+	bool Initialize(std::unique_ptr<AudioBackend> backend);
+	// Stops the backend and everything playing. Loaded sounds and banks stay loaded for the next Initialize()
 	void Shutdown();
 
 	// A DWORD is an unsigned int with a range 0 to 4,294,967,295. Windows likes them
 	// Pass in a string to the filename, obviously
-	bool PlaySound(const char* filename, DWORD flags, FX effectType, float volume, float frequency, float pan);
+	// volume, frequency and pan use DirectSound's units (hundredths of a dB, Hz, hundredths of a dB)
+	// Every call starts a new voice, so rapid-fire sounds overlap instead of cutting each other off.
+	// priority and group decide which voices get stolen when we run out (see VoicePool.h)
+	// PlaySound never loads anything itself: a sound that isn't loaded yet gets loaded in the background
+	// and the not-ready policy decides what happens to this play (so preload the sounds you know you'll need)
+	bool PlaySound(const char* filename, DWORD flags, FX effectType, float volume = DSBVOLUME_MAX, float frequency = DSBFREQUENCY_ORIGINAL, float pan = DSBPAN_CENTER, int priority = 0, unsigned group = 0);
+	// Stops every voice that's playing this file
 	bool StopSound(const char* filename);
 	bool IsPlaying(const char* filename);
 
-	// Effects parameter settings
+	// The fast way to do all of the above. GetSoundId() hashes the name and starts it
+	// loading if it hasn't seen it before; FindSoundId() only looks, and takes a hash so names written
+	// in the code can be hashed at compile time: FindSoundId(HashName("./Sounds/A4.wav"))
+	SoundId GetSoundId(const char* filename);
+	SoundId FindSoundId(uint64_t nameHash);
+	// Returns a handle to this particular play of the sound, invalid if it couldn't be played.
+	// Sounds still loading get their handle straight away, and it works as soon as they start.
+	// Effects come from a chain (see CreateEffectChain) rather than the FX enum, as many as you like
+	// reverbSend is how much of it goes to the reverb bus, linear (0 = none, 1 = all of it)
+	VoiceHandle PlaySound(SoundId sound, DWORD flags, float volume = DSBVOLUME_MAX, float frequency = DSBFREQUENCY_ORIGINAL, float pan = DSBPAN_CENTER, int priority = 0, unsigned group = 0, EffectChain* effects = nullptr, float reverbSend = 0.0f)
+	{
+		return PlaySoundAt(0, sound, flags, volume, frequency, pan, priority, group, effects, reverbSend);
+	}
+	bool StopSound(SoundId sound);
+
+	// Regions: lots of short sounds packed into one file (an atlas), loaded as one sample and played as many.
+	// Names part of a sound, and returns a SoundId that plays, loops, schedules, stops and pins like any other:
+	//     SoundId ui = engine.GetSoundId("./Sounds/UI.wav");
+	//     SoundRegion click; click.start = 0; click.length = 2205;
+	//     SoundId clickSound = engine.DefineRegion(ui, "ui/click", click);
+	// The region's audio is the whole sound's, nothing's copied, so the sound can be defined before it's loaded
+	// and stays loaded (as far as the sample cache goes) while any of its regions are playing or pinned.
+	// Each region is a sound of its own, so stopping or asking about the whole one doesn't touch its regions.
+	// The name's looked up like a filename (GetSoundId, FindSoundId). Returns an invalid id if the region doesn't
+	// fit in the sound (found out once it's loaded, if it isn't yet) or the name's already taken
+	SoundId DefineRegion(SoundId sound, const char* name, const SoundRegion& region);
+
+	// Plays a synth note (see Synth.h): nothing to load, it's made up in the mixer as it plays.
+	// Returns its handle, which SetVoicePitch and the rest work on like any other voice's
+	VoiceHandle PlayNote(const SynthParams& note, float volume = DSBVOLUME_MAX, float pan = DSBPAN_CENTER, int priority = 0, unsigned group = 0, EffectChain* effects = nullptr, float reverbSend = 0.0f)
+	{
+		return PlayNoteAt(0, note, volume, pan, priority, group, effects, reverbSend);
+	}
+	// Lets go of a note held with no duration, so it fades out over its release
+	bool ReleaseNote(VoiceHandle note) { return ReleaseNoteAt(0, note); }
+
+	// For sequencing: the same again, but on an exact output frame rather than whenever the call gets to the
+	// mixer. Times are on the mixer's clock, so work forward from GetTime(), e.g. a note every eighth of a second:
+	//     unsigned rate = engine.GetMixer().GetSampleRate();
+	//     uint64_t start = engine.GetTime() + rate / 10;
+	//     for (int i = 0; i < 16; i++) engine.PlayNoteAt(start + i * rate / 8, note);
+	// Leave enough headroom for the backend's latency or the first few come out together at the next block
+	uint64_t GetTime() const { return mixer.GetTime(); }
+	VoiceHandle PlaySoundAt(uint64_t time, SoundId sound, DWORD flags, float volume = DSBVOLUME_MAX, float frequency = DSBFREQUENCY_ORIGINAL, float pan = DSBPAN_CENTER, int priority = 0, unsigned group = 0, EffectChain* effects = nullptr, float reverbSend = 0.0f);
+	VoiceHandle PlayNoteAt(uint64_t time, const SynthParams& note, float volume = DSBVOLUME_MAX, float pan = DSBPAN_CENTER, int priority = 0, unsigned group = 0, EffectChain* effects = nullptr, float reverbSend = 0.0f);
+	bool ReleaseNoteAt(uint64_t time, VoiceHandle note);
+	bool StopVoiceAt(uint64_t time, VoiceHandle voice);
+
+	// Plays a synth note by MIDI number (60 is middle C, see MidiNotes.h) and velocity (1-127, 0 plays nothing,
+	// like a MIDI note-off). The frequency's a table lookup and 'synth' supplies everything else, so it's as cheap
+	// as PlayNote gets: what a sequencer should use
+	VoiceHandle PlayMidiNoteAt(uint64_t time, unsigned note, unsigned velocity, const SynthParams& synth = SynthParams(), float pan = DSBPAN_CENTER, int priority = 0, unsigned group = 0, EffectChain* effects = nullptr, float reverbSend = 0.0f);
+	VoiceHandle PlayMidiNote(unsigned note, unsigned velocity, const SynthParams& synth = SynthParams(), float pan = DSBPAN_CENTER, int priority = 0, unsigned group = 0, EffectChain* effects = nullptr, float reverbSend = 0.0f)
+	{
+		return PlayMidiNoteAt(0, note, velocity, synth, pan, priority, group, effects, reverbSend);
+	}
+	bool IsPlaying(SoundId sound);
+
+	// Control over one voice. All O(1) and allocation free, and safe to call with a handle whose sound
+	// has finished (they just return false). volume and pan are in DirectSound units like PlaySound,
+	// pitch is a speed multiplier (1 = as recorded)
+	bool StopVoice(VoiceHandle voice) { return StopVoiceAt(0, voice); }
+	bool IsVoicePlaying(VoiceHandle voice);
+	bool SetVoiceVolume(VoiceHandle voice, float volume);
+	bool SetVoicePan(VoiceHandle voice, float pan);
+	bool SetVoicePitch(VoiceHandle voice, float pitch);
+
+	// Buses: every voice is summed into one (bus 0 unless you move it), then the buses are summed
+	// into the output, so e.g. all the music or all the footsteps can be turned down together
+	bool SetVoiceBus(VoiceHandle voice, unsigned bus);
+	void SetBusVolume(unsigned bus, float volume);
+
+	// The last bus is the reverb's. There's one reverb for the whole engine (set up with SetReverbParams) and
+	// voices send as much of themselves to it as they like, so a hundred echoing footsteps cost one reverb.
+	// SetBusVolume(kReverbBus, ...) turns the whole reverb up or down
+	static const unsigned kReverbBus = Mixer::kMaxBuses - 1;
+	bool SetVoiceReverbSend(VoiceHandle voice, float level);
+
+	// Effect chains, built once and then used on as many voices and buses as you like (see EffectChain.h).
+	// Add effects to a new chain straight away, before it's used:
+	//     EffectChain* chain = engine.CreateEffectChain();
+	//     DistortionEffect* distortion = chain->Add<DistortionEffect>();
+	// The engine keeps every chain it makes until it's destroyed, so they never disappear from under the mixer
+	EffectChain* CreateEffectChain();
+	bool SetVoiceEffects(VoiceHandle voice, EffectChain* chain);
+	// A chain on a bus runs on everything summed into it (null takes it off)
+	void SetBusEffects(unsigned bus, EffectChain* chain);
+	// Changes an effect's parameter once its chain is in use. Safe from any thread
+	void SetEffectParameter(Effect* effect, unsigned parameter, float value);
+
+	// Convolution reverb from a recorded impulse response (a .wav of a hall, a room...). The IR is cut up and
+	// FFT'd the first time it's asked for and shared from then on. Adds the effect to the end of 'chain':
+	// put the chain on a bus and send voices to it (SetVoiceSend) so one reverb serves them all.
+	// Returns null if the IR couldn't be loaded
+	ConvolutionEffect* AddConvolutionReverb(EffectChain* chain, const char* impulseFile);
+	// Whether the worker threads are keeping up with the convolution tails
+	ConvolutionStats GetConvolutionStats() { return convolutionWorkers.GetStats(); }
+	// Sends this much of a voice (linear) to an aux bus as well as its own, 0 to stop
+	bool SetVoiceSend(VoiceHandle voice, unsigned bus, float level);
+
+	// Loads a sound on a worker thread. The future turns true when it's ready to play, or false if it
+	// couldn't be loaded. Calling it for a sound that's already loaded (or loading) is fine
+	std::shared_future<bool> PreloadAsync(const char* filename);
+	// Loads a whole list in parallel, the future turns true once every one of them has loaded
+	std::shared_future<bool> PreloadBatch(const std::vector<std::string>& filenames);
+
+	// The sample cache. Loose sounds stay loaded once they're loaded, so playing them again never touches the disk.
+	// Give it a budget in bytes (0, the default, is no limit) and whenever a load takes it over, the sounds played
+	// least recently get unloaded until it's back under, skipping any that are playing or pinned. An unloaded sound
+	// keeps its SoundId and loads again the next time it's played or preloaded (with the not-ready policy deciding
+	// what happens to that play, as for any sound that's still loading)
+	void SetSampleCacheBudget(size_t bytes);
+	// Keeps a sound loaded whatever the budget, loading it now if it isn't. Pins nest: it can be unloaded again
+	// once every PinSound has had its UnpinSound
+	bool PinSound(SoundId sound);
+	bool UnpinSound(SoundId sound);
+	SampleCacheStats GetSampleCacheStats();
+
+	// maxWaitSeconds: plays still waiting on their sound after this long get dropped (0 = wait as long as it takes)
+	void SetNotReadyPolicy(NotReadyPolicy policy, float maxWaitSeconds = 0.0f);
+
+	// Caps how many voices one group of sounds can take up at once (0 = no cap)
+	void SetVoiceGroupLimit(unsigned group, unsigned limit);
+
+	// Opens a bank built by SoundBankBuilder. Sounds in it are found by name in O(1), and
+	// PlaySound checks the banks before it goes looking for a loose .wav on disk
+	bool LoadSoundBank(const char* filename);
+
+	// Streaming: for music and ambience, anything long. The file is read off disk a bit at a time as it
+	// plays instead of being loaded, so it only ever takes up the read-ahead buffer (see StreamingSound.h).
+	// Each file is one stream, so playing it again restarts it rather than adding another voice
+	bool PlayStream(const char* filename, DWORD flags, float volume = DSBVOLUME_MAX, float pan = DSBPAN_CENTER, int priority = 0, unsigned group = 0);
+	bool StopStream(const char* filename);
+	bool IsStreamPlaying(const char* filename);
+	// Jumps a playing (or stopped) stream to a time in seconds
+	bool SeekStream(const char* filename, float seconds);
+	// Underruns and buffer levels, for checking the read-ahead is big enough
+	bool GetStreamStats(const char* filename, StreamStats& stats);
+	// Buffer size, in frames, for streams opened from now on
+	void SetStreamReadAhead(unsigned frames) { streamReadAheadFrames = frames; }
+
+	// How sounds get loaded from now on (zero-copy mapping, prefetching, converting to the mixer's rate)
+	void SetWaveLoadOptions(const WaveLoadOptions& options);
+
+	// Effects parameter settings, for the effects picked with the FX enum.
+	// They all run in the mixer now, on any backend.
+	// Reverb is shared by every voice on the reverb bus (see kReverbBus) rather than one per sound
 	void SetChorusParams(float wetDryMix, float depth, float feedback, float frequency, long waveform, float delay, long phase);
 	void SetCompressorParams(float gain, float attack, float release, float threshold, float ratio, float predelay);
 	void SetDistortionParams(float gain, float edge, float postEQCenterFreq, float postEQBandwidth, float preLowpassCutoff);
 	void SetEchoParams(float wetDryMix, float feedback, float leftDelay, float rightDelay, long panDelay);
 	void SetFlangerParams(float wetDryMix, float depth, float feedback, float frequency, long waveform, float delay, long phase);
 	void SetGargleParams(DWORD rateHz, DWORD waveShape);
+	// DirectSound's one peaking band: centre in Hz, bandwidth in semitones, gain in dB. Sets band 0 of the EQ
 	void SetParamEQ(float centre, float bandwidth, float gain);
+	// Any of the EQ's bands (0 to 7), any type. Q is the width, 0.707 for a plain low or high pass
+	void SetEQBand(unsigned band, BiquadType type, float frequency, float q, float gainDb);
 	void SetReverbParams(float inputGain, float reverbMix, float reverbTime, float HFRTRatio);
 
-private:
-	// For talking to DirectSound
-	bool InitializeDirectSound(HWND);
-	void ShutdownDirectSound();
-
-	// Where the magic loading happens
-	bool LoadWaveFile(const char*);
-
-private:
-	// For creating buffer objects, managing devices, and setting up the environment in DirectSound
-	IDirectSound8* directSound;
-
-	// Primary buffer for playing sounds
-	IDirectSoundBuffer* primaryBuffer;
-
-	// Seconary buffer for loading in sounds
-	IDirectSoundBuffer8* secondaryBuffer;
-
-	// A map of sounds, so we can load in and play multiple sounds
-	std::map<std::string, IDirectSoundBuffer8*> sounds;
-
-	// ********************** Effects ******************************* //
-	DSFXChorus chorus;
-	IDirectSoundFXChorus8* fxChorus;
+	// The limiter on the master output, on from the start. Nothing gets out louder than ceilingDb, at the cost of
+	// 2ms of extra latency (its lookahead). GetMasterLimiter()->GetGainReduction() shows how hard it's working
+	void SetMasterLimiter(bool enabled, float ceilingDb = -1.0f);
+	CompressorEffect* GetMasterLimiter() { return masterLimiter; }
 
-	DSFXCompressor compressor;
-	IDirectSoundFXCompressor8* fxCompressor;
+	// How sounds played at another pitch or rate get resampled: Linear is cheapest, Best sounds cleanest
+	void SetResampleQuality(ResampleQuality quality) { mixer.SetResampleQuality(quality); }
 
-	DSFXDistortion distortion;
-	IDirectSoundFXDistortion8* fxDistortion;
+	// The software mixer, for stats or for driving Render() by hand
+	Mixer& GetMixer() { return mixer; }
+	AudioBackend* GetBackend() { return backend.get(); }
 
-	DSFXEcho echo;
-	IDirectSoundFXEcho8* fxEcho;
-
-	DSFXFlanger flanger;
-	IDirectSoundFXFlanger8* fxFlanger;
-
-	DSFXGargle gargle;
-	IDirectSoundFXGargle8* fxGargle;
-
-	DSFXParamEq paramEQ;
-	IDirectSoundFXParamEq8* fxParamEQ;
+private:
+	bool StartBackend(std::unique_ptr<AudioBackend> newBackend);
+	void StopBackend();
 
-	DSFXWavesReverb reverb;
-	IDirectSoundFXWavesReverb8* fxReverb;
+	// A play that came in while its sound was still loading
+	struct PendingPlay
+	{
+		VoiceParams params;
+		// The frame it was asked for at, 0 for straight away
+		uint64_t time;
+		float frequency;
+		NotReadyPolicy policy;
+		float maxWaitSeconds;
+		// Handed out when the play was asked for, the voice takes it over when it starts
+		VoiceHandle handle;
+		std::chrono::steady_clock::time_point requestTime;
+	};
 
+	// One per SoundId. Either a sound in a bank, a loose .wav loaded (or being loaded) on the load pool,
+	// or a region of one of those
+	struct SoundEntry
+	{
+		// UNLOADED: it was loaded, but the sample cache threw it out to stay under budget
+		enum class State { LOADING, READY, FAILED, UNLOADED };
+		std::string name;
+		State state = State::LOADING;
+		// Points into a bank, or at ownedSample (which may be sharing another sound's audio)
+		const Sample* sample = nullptr;
+		std::shared_ptr<Sample> ownedSample;
+		std::shared_future<bool> loaded;
+		std::vector<PendingPlay> pendingPlays;
+		// How many more PinSound()s it's had than UnpinSound()s
+		unsigned pins = 0;
+		// Its place in the sample cache's list, while it's a loaded loose sound
+		bool cached = false;
+		SoundEntry* newer = nullptr;
+		SoundEntry* older = nullptr;
+		// For a region: the sound it's part of, and where. Regions are never in the cache themselves, they
+		// load and unload with their sound
+		SoundEntry* parent = nullptr;
+		SoundRegion region;
+		// For a sound: its regions
+		std::vector<SoundEntry*> regions;
+	};
 
-	LPDWORD resultsCodes;
+	const Sample* FindInBanks(const char* filename) const;
+	// Only call these with soundsMutex held
+	SoundEntry* GetEntry(SoundId sound);
+	SoundId FindSoundIdLocked(uint64_t nameHash);
+	// Runs on the load pool
+	bool LoadSound(SoundEntry* entry);
+	void PlayPending(const Sample* sample, PendingPlay& pending);
+	// Starts (or, if it didn't load, drops) everything waiting on a sound
+	void StartPendingPlays(SoundEntry* entry, bool loaded);
+	// Cuts a region out of its sound once that's loaded. False if it doesn't fit
+	bool ResolveRegion(SoundEntry* entry);
+	// Whether anything's playing, waiting to play or pinned that needs the sound's audio (its regions count)
+	bool IsInUse(const SoundEntry* entry);
+	// The sample cache, also only with soundsMutex held. StartLoad() queues a loose sound's load (again, if it's
+	// been unloaded). TrimSampleCache() unloads sounds until it's under budget, never 'keep', and hands back
+	// what it unloaded so it can be freed once the lock's let go
+	void StartLoad(SoundEntry* entry);
+	void TouchCached(SoundEntry* entry);
+	void RemoveCached(SoundEntry* entry);
+	void TrimSampleCache(const SoundEntry* keep, std::vector<std::shared_ptr<Sample>>& unloaded);
+	// Adds a loaded sound's audio to the cache's bytes, or takes it off, counting shared audio once
+	void ChargeCache(const Sample* sample);
+	void UnchargeCache(const Sample* sample);
+	// The mixer's chain for an FX type (null for NONE and REVERB, which is a send instead)
+	EffectChain* GetEffectChain(FX effectType);
 
+private:
+	// Sums all the playing sounds together
+	Mixer mixer;
+
+	// Takes the mix and plays it (or writes it, or throws it away)
+	std::unique_ptr<AudioBackend> backend;
+
+	// Every sound we've been asked about, indexed by SoundId, and a map from the hash of each name to its id.
+	// The load pool fills entries in, so everything in here is guarded by soundsMutex
+	std::vector<std::unique_ptr<SoundEntry>> sounds;
+	std::unordered_map<uint64_t, uint32_t> soundIds;
+	std::mutex soundsMutex;
+	WaveLoadOptions loadOptions;
+	NotReadyPolicy notReadyPolicy;
+	float maxWaitSeconds;
+
+	// The sample cache (guarded by soundsMutex as well): every loaded loose sound, most recently played first
+	SoundEntry* cacheNewest;
+	SoundEntry* cacheOldest;
+	size_t cacheBudget;
+	size_t cacheBytes;
+	unsigned cacheEvictions;
+	unsigned cacheReloads;
+	// How many cached sounds are using each copy of audio (a sample, or the source of shared ones)
+	std::unordered_map<const Sample*, unsigned> cachedStores;
+	// Every loose sound's audio by Sample::contentHash, so loads with the same audio can share it
+	std::unordered_map<uint64_t, std::weak_ptr<const Sample>> samplesByContent;
+
+	// Loading is mostly waiting on the disk, so a couple of threads is plenty
+	ThreadPool loadPool;
+
+	// Packed sound banks, searched before the loose files (guarded by soundsMutex too)
+	std::vector<std::unique_ptr<SoundBank>> banks;
+
+	// Open streams by filename, and the thread that keeps them fed
+	StreamingSound* FindStream(const char* filename);
+	std::map<std::string, std::unique_ptr<StreamingSound>> streams;
+	std::mutex streamsMutex;
+	StreamReader streamReader;
+	unsigned streamReadAheadFrames;
 
+	// ********************** Effects ******************************* //
+	// Declared before the chains so it's still around while the convolutions in them unregister
+	ConvolutionWorkers convolutionWorkers;
+
+	// Every chain anyone has asked for. Only ever added to, so the mixer can rely on them being there
+	std::vector<std::unique_ptr<EffectChain>> effectChains;
+	// IRs already cut up for convolution, by filename
+	std::map<std::string, std::shared_ptr<const ImpulseResponse>> impulseResponses;
+	// Guards both of the above
+	std::mutex effectChainsMutex;
+
+	// The native FX types, and the effects in them (for the Set*Params functions)
+	EffectChain* distortionChain;
+	DistortionEffect* distortionEffect;
+	EffectChain* gargleChain;
+	GargleEffect* gargleEffect;
+	EffectChain* chorusChain;
+	ChorusEffect* chorusEffect;
+	EffectChain* flangerChain;
+	FlangerEffect* flangerEffect;
+	EffectChain* echoChain;
+	EchoEffect* echoEffect;
+	EffectChain* compressorChain;
+	CompressorEffect* compressorEffect;
+	EffectChain* paramEQChain;
+	EqEffect* paramEQEffect;
+	// Lives on kReverbBus
+	EffectChain* reverbChain;
+	ReverbEffect* reverbEffect;
+	// The mixer's master chain
+	EffectChain* masterChain;
+	CompressorEffect* masterLimiter;
 };
 
-#endif
\ No newline at end of file
+#endif
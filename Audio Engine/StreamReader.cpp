@@ -0,0 +1,81 @@
+#include "StreamReader.h"
+#include "StreamingSound.h"
+#include <algorithm>
+
+StreamReader::StreamReader() : pollInterval(kDefaultPollMilliseconds), running(false), woken(false)
+{
+}
+
+StreamReader::~StreamReader()
+{
+	Stop();
+}
+
+void StreamReader::Start()
+{
+	if (thread.joinable())
+	{
+		return;
+	}
+
+	running = true;
+	thread = std::thread(&StreamReader::ThreadMain, this);
+}
+
+void StreamReader::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+		streams.clear();
+	}
+	wakeUp.notify_one();
+
+	if (thread.joinable())
+	{
+		thread.join();
+	}
+}
+
+void StreamReader::Add(StreamingSound* stream)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (std::find(streams.begin(), streams.end(), stream) == streams.end())
+		{
+			streams.push_back(stream);
+		}
+	}
+	Start();
+}
+
+void StreamReader::Remove(StreamingSound* stream)
+{
+	// Can't return while the thread is part way through filling it, the lock makes sure of that
+	std::lock_guard<std::mutex> lock(mutex);
+	streams.erase(std::remove(streams.begin(), streams.end(), stream), streams.end());
+}
+
+void StreamReader::Wake()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		woken = true;
+	}
+	wakeUp.notify_one();
+}
+
+void StreamReader::ThreadMain()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (running)
+	{
+		for (StreamingSound* stream : streams)
+		{
+			stream->Fill();
+		}
+
+		wakeUp.wait_for(lock, pollInterval, [this] { return woken || !running; });
+		woken = false;
+	}
+}
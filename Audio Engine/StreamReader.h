@@ -0,0 +1,49 @@
+// StreamReader.h
+// The background thread that does all the disk reading for StreamingSounds, so neither the game
+// nor the audio thread ever waits on the disk. One thread serves every open stream: it wakes up
+// every so often (or when it's poked), tops up any ring that has room, and goes back to sleep.
+
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class StreamingSound;
+
+class StreamReader
+{
+public:
+	// Rings hold three quarters of a second by default, so checking every 10ms leaves plenty of slack
+	static constexpr unsigned kDefaultPollMilliseconds = 10;
+
+	StreamReader();
+	~StreamReader();
+
+	void Start();
+	// Stops the thread and forgets every stream
+	void Stop();
+
+	// Streams have to be removed before they're destroyed
+	void Add(StreamingSound* stream);
+	void Remove(StreamingSound* stream);
+
+	// Run a pass now rather than at the next poll (after a seek, say)
+	void Wake();
+
+	void SetPollInterval(unsigned milliseconds) { pollInterval = std::chrono::milliseconds(milliseconds); }
+
+private:
+	void ThreadMain();
+
+	std::thread thread;
+	std::chrono::milliseconds pollInterval;
+
+	// Guards everything below. Only the game thread and the reader take it, never the audio thread
+	std::mutex mutex;
+	std::condition_variable wakeUp;
+	bool running;
+	bool woken;
+	std::vector<StreamingSound*> streams;
+};
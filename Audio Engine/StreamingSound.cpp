@@ -0,0 +1,263 @@
+#include "StreamingSound.h"
+#include "FileHelpers.h"
+#include "ConsoleColor.h"
+#include <algorithm>
+#include <iostream>
+#include <string.h>
+
+// Never read less than this in one go, small reads are what make streaming slow
+static const unsigned kMinReadChunkFrames = 1024;
+static const unsigned kMaxReadChunkFrames = 8192;
+
+StreamingSound::StreamingSound() :
+	filePtr(nullptr),
+	capacity(0),
+	mask(0),
+	readChunkFrames(0),
+	filePosition(0),
+	writeIndex(0),
+	discardIndex(0),
+	endOfFile(false),
+	seekHandled(0),
+	readIndex(0),
+	underruns(0),
+	underrunFrames(0),
+	framesPlayed(0),
+	finished(false),
+	refilling(false),
+	seekRequest(0),
+	seekTarget(0),
+	looping(false),
+	voiceCount(0)
+{
+}
+
+StreamingSound::~StreamingSound()
+{
+	Close();
+}
+
+bool StreamingSound::Open(const char* filename, unsigned readAheadFrames)
+{
+	Close();
+
+	filePtr = openFile(filename, "rb");
+	if (!filePtr)
+	{
+		std::cout << red << "ERROR: Couldn't open " << filename << " to stream it!" << white << std::endl;
+		return false;
+	}
+
+	// Only the chunks in front of the audio get read here, the rest comes in a chunk at a time
+	fseek(filePtr, 0, SEEK_END);
+	long fileSize = ftell(filePtr);
+	fseek(filePtr, 0, SEEK_SET);
+	std::vector<unsigned char> header(std::min((size_t)std::max(fileSize, 0L), kWaveHeaderSearchBytes));
+	if (fileSize < 0 || fread(header.data(), 1, header.size(), filePtr) != header.size() ||
+		!ParseWaveHeader(header.data(), header.size(), (size_t)fileSize, format))
+	{
+		std::cout << red << "ERROR: Couldn't stream " << filename << white << std::endl;
+		Close();
+		return false;
+	}
+	// ADPCM can only be decoded from the start of a block, and the ring's read a frame count at a time
+	if (format.encoding == WaveEncoding::ImaAdpcm)
+	{
+		std::cout << red << "ERROR: Can't stream ADPCM, load " << filename << " instead" << white << std::endl;
+		Close();
+		return false;
+	}
+
+	// Power of two so the ring position is a mask rather than a divide
+	capacity = kMinReadChunkFrames;
+	while (capacity < readAheadFrames)
+	{
+		capacity *= 2;
+	}
+	mask = capacity - 1;
+	ring.assign((size_t)capacity * format.channels, 0.0f);
+
+	// Read in quarters of the ring, so there's always room for the next read well before it runs dry
+	readChunkFrames = std::min(std::max(capacity / 4, kMinReadChunkFrames), kMaxReadChunkFrames);
+	readBuffer.resize((size_t)readChunkFrames * format.GetBlockAlign());
+
+	writeIndex = 0;
+	discardIndex = 0;
+	readIndex = 0;
+	endOfFile = false;
+	seekRequest = 0;
+	seekHandled = 0;
+	underruns = 0;
+	underrunFrames = 0;
+	framesPlayed = 0;
+	finished = false;
+	refilling = false;
+	SeekFile(0);
+
+	// Fill the ring now so a voice can start on it straight away
+	Fill();
+
+	std::cout << green << "Streaming " << filename << " (" << GetFrameCount() << " frames, "
+		<< ring.size() * sizeof(float) / 1024 << "KB buffer)" << white << std::endl;
+	return true;
+}
+
+void StreamingSound::Close()
+{
+	if (filePtr)
+	{
+		fclose(filePtr);
+		filePtr = nullptr;
+	}
+	ring.clear();
+	readBuffer.clear();
+	format = WaveFormatInfo();
+	capacity = 0;
+	mask = 0;
+}
+
+void StreamingSound::Seek(unsigned frame)
+{
+	// Target first, then the request count, so the reader never sees a new request with an old target
+	seekTarget.store(frame, std::memory_order_relaxed);
+	seekRequest.fetch_add(1, std::memory_order_release);
+}
+
+void StreamingSound::SeekFile(unsigned frame)
+{
+	filePosition = std::min(frame, GetFrameCount());
+	fseek(filePtr, (long)(format.dataOffset + (size_t)filePosition * format.GetBlockAlign()), SEEK_SET);
+}
+
+StreamStats StreamingSound::GetStats() const
+{
+	StreamStats stats;
+	stats.underruns = underruns.load(std::memory_order_relaxed);
+	stats.underrunFrames = underrunFrames.load(std::memory_order_relaxed);
+	stats.framesPlayed = framesPlayed.load(std::memory_order_relaxed);
+	stats.bufferedFrames = (unsigned)(writeIndex.load(std::memory_order_relaxed) - readIndex.load(std::memory_order_relaxed));
+	stats.capacityFrames = capacity;
+	return stats;
+}
+
+bool StreamingSound::Fill()
+{
+	if (!filePtr)
+	{
+		return false;
+	}
+
+	bool didWork = false;
+	uint64_t write = writeIndex.load(std::memory_order_relaxed);
+
+	unsigned request = seekRequest.load(std::memory_order_acquire);
+	if (request != seekHandled.load(std::memory_order_relaxed))
+	{
+		SeekFile(seekTarget.load(std::memory_order_relaxed));
+
+		// Everything already in the ring is from before the seek. We can't take it back out
+		// (only the audio thread moves readIndex) so tell it where the new frames start instead
+		endOfFile.store(false, std::memory_order_relaxed);
+		discardIndex.store(write, std::memory_order_release);
+		seekHandled.store(request, std::memory_order_release);
+		didWork = true;
+	}
+
+	if (endOfFile.load(std::memory_order_relaxed))
+	{
+		return didWork;
+	}
+
+	const unsigned frameCount = GetFrameCount();
+	while (capacity - (unsigned)(write - readIndex.load(std::memory_order_acquire)) >= readChunkFrames)
+	{
+		if (filePosition >= frameCount)
+		{
+			if (!looping.load(std::memory_order_relaxed) || frameCount == 0)
+			{
+				endOfFile.store(true, std::memory_order_release);
+				break;
+			}
+			// Go round again. The first frame lands right after the last one in the ring, so there's no gap
+			SeekFile(0);
+		}
+
+		unsigned frames = ReadFrames(write, std::min(readChunkFrames, frameCount - filePosition));
+		if (frames == 0)
+		{
+			// The file is shorter than its header says, treat it as the end
+			filePosition = frameCount;
+			continue;
+		}
+
+		filePosition += frames;
+		write += frames;
+		writeIndex.store(write, std::memory_order_release);
+		didWork = true;
+	}
+	return didWork;
+}
+
+unsigned StreamingSound::ReadFrames(uint64_t write, unsigned frameCount)
+{
+	const unsigned blockAlign = format.GetBlockAlign();
+	unsigned frames = (unsigned)fread(readBuffer.data(), blockAlign, frameCount, filePtr);
+
+	// The ring might wrap part way through
+	unsigned position = (unsigned)(write & mask);
+	unsigned firstPart = std::min(frames, capacity - position);
+	ConvertPcmToFloat(readBuffer.data(), format, &ring[(size_t)position * format.channels], (size_t)firstPart * format.channels);
+	ConvertPcmToFloat(readBuffer.data() + (size_t)firstPart * blockAlign, format, ring.data(), (size_t)(frames - firstPart) * format.channels);
+	return frames;
+}
+
+unsigned StreamingSound::Read(float* out, unsigned frameCount)
+{
+	const unsigned channels = format.channels;
+	uint64_t read = readIndex.load(std::memory_order_relaxed);
+
+	// Skip anything from before a seek
+	uint64_t discard = discardIndex.load(std::memory_order_acquire);
+	if (discard > read)
+	{
+		read = discard;
+		refilling = true;
+	}
+
+	uint64_t write = writeIndex.load(std::memory_order_acquire);
+	unsigned frames = std::min((unsigned)(write - read), frameCount);
+
+	unsigned position = (unsigned)(read & mask);
+	unsigned firstPart = std::min(frames, capacity - position);
+	memcpy(out, &ring[(size_t)position * channels], sizeof(float) * firstPart * channels);
+	memcpy(out + (size_t)firstPart * channels, ring.data(), sizeof(float) * (frames - firstPart) * channels);
+
+	read += frames;
+	readIndex.store(read, std::memory_order_release);
+	framesPlayed.fetch_add(frames, std::memory_order_relaxed);
+
+	finished = false;
+	if (frames > 0)
+	{
+		refilling = false;
+	}
+
+	if (frames < frameCount)
+	{
+		unsigned missing = frameCount - frames;
+		memset(out + (size_t)frames * channels, 0, sizeof(float) * missing * channels);
+
+		// Running dry is only a problem if there should have been something there
+		bool seeking = seekRequest.load(std::memory_order_acquire) != seekHandled.load(std::memory_order_acquire);
+		if (!seeking && endOfFile.load(std::memory_order_acquire) && writeIndex.load(std::memory_order_acquire) == read)
+		{
+			finished = true;
+		}
+		else if (!seeking && !refilling)
+		{
+			underruns.fetch_add(1, std::memory_order_relaxed);
+			underrunFrames.fetch_add(missing, std::memory_order_relaxed);
+		}
+	}
+	return frames;
+}
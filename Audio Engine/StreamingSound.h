@@ -0,0 +1,117 @@
+// StreamingSound.h
+// A sound that's played straight off disk instead of being loaded in first. Only a small ring of
+// decoded float frames is ever in memory; StreamReader's thread keeps it topped up a read-ahead's
+// worth in front of the voice that's playing it. A ten minute music track costs the same few hundred KB
+// as a ten second one, and opening it only reads the header and the first ring-full.
+//
+// The ring has one writer (the reader thread) and one reader (the audio thread), so it needs no locks:
+// each side only ever moves its own index forward. Both indices count frames since the stream opened
+// and never wrap, the position in the ring is just index & mask.
+
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <vector>
+#include "WaveFile.h"
+
+struct StreamStats
+{
+	// Times the audio thread wanted frames and the ring was empty, and how many frames of silence that cost
+	unsigned long long underruns = 0;
+	unsigned long long underrunFrames = 0;
+	// Frames the audio thread has taken out of the ring so far
+	unsigned long long framesPlayed = 0;
+	// How full the ring is right now, out of capacityFrames
+	unsigned bufferedFrames = 0;
+	unsigned capacityFrames = 0;
+};
+
+class StreamingSound
+{
+public:
+	// About 0.75 seconds at 44.1kHz, 256KB for stereo
+	static const unsigned kDefaultReadAheadFrames = 32768;
+
+	StreamingSound();
+	~StreamingSound();
+
+	// No copying, the reader thread and a voice can both be pointing at this
+	StreamingSound(const StreamingSound&) = delete;
+	StreamingSound& operator=(const StreamingSound&) = delete;
+
+	// Opens the .wav and fills the ring from the start. readAheadFrames is rounded up to a power of two
+	bool Open(const char* filename, unsigned readAheadFrames = kDefaultReadAheadFrames);
+	void Close();
+
+	// Looping streams go straight from the last frame back to the first with no gap.
+	// Safe to change from any thread, takes effect the next time the reader gets to the end
+	void SetLooping(bool loop) { looping.store(loop, std::memory_order_relaxed); }
+
+	// Jumps to a frame. Safe from any thread: the reader thread does the actual seek next time it runs,
+	// and the audio thread throws away anything it had buffered from before
+	void Seek(unsigned frame);
+
+	unsigned GetChannels() const { return format.channels; }
+	unsigned GetSampleRate() const { return format.sampleRate; }
+	unsigned GetFrameCount() const { return format.GetFrameCount(); }
+	StreamStats GetStats() const;
+
+	// Same as Sample::voiceCount: how many voices are playing this, kept up to date by the Mixer
+	std::atomic<unsigned>& GetVoiceCount() { return voiceCount; }
+
+	// ---- Reader thread only ----
+	// Reads and decodes as much as fits in the ring (and handles any seek). Returns true if it did anything
+	bool Fill();
+
+	// ---- Audio thread only ----
+	// Copies up to frameCount interleaved frames out of the ring. Anything it couldn't supply is silence,
+	// and counts as an underrun unless the stream has finished or is in the middle of a seek
+	unsigned Read(float* out, unsigned frameCount);
+	// True once a stream that isn't looping has played its last frame
+	bool IsFinished() const { return finished; }
+
+private:
+	// Reader side: reads and decodes up to frameCount frames into the ring at 'write', returns how many it got
+	unsigned ReadFrames(uint64_t write, unsigned frameCount);
+	void SeekFile(unsigned frame);
+
+	FILE* filePtr;
+	WaveFormatInfo format;
+
+	// Decoded frames, capacity * channels floats
+	std::vector<float> ring;
+	unsigned capacity;
+	unsigned mask;
+
+	// Reader side state
+	std::vector<unsigned char> readBuffer;
+	unsigned readChunkFrames;
+	// Next frame of the file to read
+	unsigned filePosition;
+
+	// Written by the reader, read by the audio thread
+	std::atomic<uint64_t> writeIndex;
+	// Everything before this is from before the last seek and should be skipped
+	std::atomic<uint64_t> discardIndex;
+	// The reader got to the end of a stream that isn't looping
+	std::atomic<bool> endOfFile;
+	// The last seekRequest the reader has dealt with
+	std::atomic<unsigned> seekHandled;
+
+	// Written by the audio thread
+	std::atomic<uint64_t> readIndex;
+	std::atomic<unsigned long long> underruns;
+	std::atomic<unsigned long long> underrunFrames;
+	std::atomic<unsigned long long> framesPlayed;
+	bool finished;
+	// Just skipped the old frames after a seek, so an empty ring is expected until the reader catches up
+	bool refilling;
+
+	// Written by whoever calls Seek()/SetLooping()
+	std::atomic<unsigned> seekRequest;
+	std::atomic<unsigned> seekTarget;
+	std::atomic<bool> looping;
+
+	std::atomic<unsigned> voiceCount;
+};
@@ -0,0 +1,265 @@
+#include "Synth.h"
+#include <algorithm>
+#include <math.h>
+
+static const double kPi = 3.14159265358979323846;
+
+// Points per cycle in every table (plus one, so reading between the last two never wraps)
+static const unsigned kTableSize = 2048;
+// Triangle table k has the harmonics up to 2^k, so the last one goes up to 512
+static const unsigned kTriangleTables = 10;
+// Quieter than this (-80dB) and a note's finished
+static const float kSilentLevel = 0.0001f;
+// A note any higher than this fraction of the sample rate would only be aliasing
+static const float kMaxPhaseStep = 0.45f;
+
+struct SynthTables
+{
+	float sine[kTableSize + 1];
+	float triangle[kTriangleTables][kTableSize + 1];
+
+	SynthTables()
+	{
+		for (unsigned i = 0; i <= kTableSize; i++)
+		{
+			double angle = 2.0 * kPi * (i % kTableSize) / kTableSize;
+			sine[i] = (float)sin(angle);
+
+			// A triangle is the odd harmonics at 1/n squared, alternating in sign. Each table
+			// adds the next octave's worth to the one before
+			double sum = 0.0;
+			unsigned harmonic = 1;
+			for (unsigned table = 0; table < kTriangleTables; table++)
+			{
+				for (; harmonic <= (1u << table); harmonic += 2)
+				{
+					double sign = (harmonic / 2) % 2 == 0 ? 1.0 : -1.0;
+					sum += sign * sin(harmonic * angle) / ((double)harmonic * harmonic);
+				}
+				triangle[table][i] = (float)(sum * 8.0 / (kPi * kPi));
+			}
+		}
+	}
+};
+
+static const SynthTables& GetTables()
+{
+	static const SynthTables synthTables;
+	return synthTables;
+}
+
+static inline float ReadTable(const float* table, float phase)
+{
+	float position = phase * kTableSize;
+	unsigned index = (unsigned)position;
+	float fraction = position - (float)index;
+	return table[index] + (table[index + 1] - table[index]) * fraction;
+}
+
+// The correction for a jump from 1 down to -1 at phase 0, for a waveform moving 'step' per frame.
+// Only the frame either side of the jump gets anything
+static inline float PolyBlep(float t, float step)
+{
+	if (t < step)
+	{
+		t /= step;
+		return t + t - t * t - 1.0f;
+	}
+	if (t > 1.0f - step)
+	{
+		t = (t - 1.0f) / step;
+		return t * t + t + t + 1.0f;
+	}
+	return 0.0f;
+}
+
+// How much of the distance to go is left after each frame, so that after 'frames' of them only 'remaining' is
+static float GetCoefficient(float seconds, unsigned sampleRate, float remaining)
+{
+	float frames = seconds * sampleRate;
+	return frames < 1.0f ? 0.0f : expf(logf(remaining) / frames);
+}
+
+void SynthVoice::Start(const SynthParams& params, float pitch, unsigned rate)
+{
+	waveform = std::min(params.waveform, Waveform::Square);
+	frequency = std::max(0.0f, params.frequency);
+	sampleRate = std::max(1u, rate);
+	pulseWidth = std::max(0.01f, std::min(0.99f, params.pulseWidth));
+	phase = 0.0f;
+	SetPitch(pitch);
+
+	const Envelope& envelope = params.envelope;
+	sustain = std::max(0.0f, std::min(1.0f, envelope.sustain));
+	attackFrames = (unsigned)(std::max(0.0f, envelope.attack) * sampleRate);
+	attackStep = attackFrames > 0 ? 1.0f / attackFrames : 0.0f;
+	// The decay gets 99% of the way to the sustain level, the release all the way down to silence
+	decayCoefficient = GetCoefficient(envelope.decay, sampleRate, 0.01f);
+	releaseCoefficient = GetCoefficient(envelope.release, sampleRate, kSilentLevel);
+	holdFrames = params.duration > 0.0f ? std::max(1u, (unsigned)(params.duration * sampleRate)) : 0;
+
+	stage = attackFrames > 0 ? Stage::Attack : Stage::Decay;
+	level = attackFrames > 0 ? 0.0f : 1.0f;
+}
+
+void SynthVoice::SetPitch(float pitch)
+{
+	phaseStep = std::min(kMaxPhaseStep, frequency * std::max(0.0f, pitch) / sampleRate);
+
+	// The most harmonics that fit under the Nyquist frequency picks the triangle table
+	unsigned tableIndex = 0;
+	float harmonics = phaseStep > 0.0f ? 0.5f / phaseStep : (float)(1u << kTriangleTables);
+	while (tableIndex + 1 < kTriangleTables && (float)(1u << (tableIndex + 1)) <= harmonics)
+	{
+		tableIndex++;
+	}
+	table = GetTables().triangle[tableIndex];
+}
+
+void SynthVoice::Release()
+{
+	if (stage != Stage::Done)
+	{
+		StartRelease();
+	}
+}
+
+void SynthVoice::StartRelease()
+{
+	stage = releaseCoefficient > 0.0f ? Stage::Release : Stage::Done;
+	holdFrames = 0;
+}
+
+bool SynthVoice::Render(float* out, unsigned frameCount)
+{
+	if (stage == Stage::Done)
+	{
+		return false;
+	}
+	RenderOscillator(out, frameCount);
+	ApplyEnvelope(out, frameCount);
+	return stage != Stage::Done;
+}
+
+void SynthVoice::RenderOscillator(float* out, unsigned frameCount)
+{
+	// One tight loop per waveform, rather than picking one every frame
+	float p = phase;
+	const float step = phaseStep;
+	switch (waveform)
+	{
+	case Waveform::Sine:
+	case Waveform::Triangle:
+	{
+		const float* wave = waveform == Waveform::Sine ? GetTables().sine : table;
+		for (unsigned i = 0; i < frameCount; i++)
+		{
+			out[i] = ReadTable(wave, p);
+			p += step;
+			p -= p >= 1.0f ? 1.0f : 0.0f;
+		}
+		break;
+	}
+
+	case Waveform::Saw:
+		for (unsigned i = 0; i < frameCount; i++)
+		{
+			out[i] = 2.0f * p - 1.0f - PolyBlep(p, step);
+			p += step;
+			p -= p >= 1.0f ? 1.0f : 0.0f;
+		}
+		break;
+
+	default:
+		for (unsigned i = 0; i < frameCount; i++)
+		{
+			// Up at phase 0, down at pulseWidth
+			float down = p - pulseWidth;
+			down += down < 0.0f ? 1.0f : 0.0f;
+			out[i] = (p < pulseWidth ? 1.0f : -1.0f) + PolyBlep(p, step) - PolyBlep(down, step);
+			p += step;
+			p -= p >= 1.0f ? 1.0f : 0.0f;
+		}
+		break;
+	}
+	phase = p;
+}
+
+void SynthVoice::ApplyEnvelope(float* out, unsigned frameCount)
+{
+	unsigned i = 0;
+	while (i < frameCount && stage != Stage::Done)
+	{
+		// Up to wherever the stage changes, or the note lets go
+		unsigned run = frameCount - i;
+		if (holdFrames > 0)
+		{
+			run = std::min(run, holdFrames);
+		}
+		if (stage == Stage::Attack)
+		{
+			run = std::min(run, attackFrames);
+		}
+
+		float* samples = out + i;
+		float value = level;
+		switch (stage)
+		{
+		case Stage::Attack:
+			for (unsigned k = 0; k < run; k++)
+			{
+				value += attackStep;
+				samples[k] *= value;
+			}
+			attackFrames -= run;
+			if (attackFrames == 0)
+			{
+				value = 1.0f;
+				stage = Stage::Decay;
+			}
+			break;
+
+		case Stage::Decay:
+			for (unsigned k = 0; k < run; k++)
+			{
+				value = sustain + (value - sustain) * decayCoefficient;
+				samples[k] *= value;
+			}
+			// Nothing to sustain, so it's over as soon as it's decayed away
+			if (sustain == 0.0f && value < kSilentLevel)
+			{
+				stage = Stage::Done;
+			}
+			break;
+
+		default:
+			for (unsigned k = 0; k < run; k++)
+			{
+				value *= releaseCoefficient;
+				samples[k] *= value;
+			}
+			if (value < kSilentLevel)
+			{
+				stage = Stage::Done;
+			}
+			break;
+		}
+		level = value;
+		i += run;
+
+		if (holdFrames > 0)
+		{
+			holdFrames -= run;
+			if (holdFrames == 0 && stage != Stage::Done)
+			{
+				StartRelease();
+			}
+		}
+	}
+
+	// Silence after the end
+	for (; i < frameCount; i++)
+	{
+		out[i] = 0.0f;
+	}
+}
@@ -0,0 +1,98 @@
+// Synth.h
+// Notes made up on the spot, straight into the mix, rather than written out to a .wav and loaded back in.
+// A synth note is just another kind of voice: it gets panned, bussed, sent and put through effects like any other.
+//
+// Sine and triangle are read out of wavetables built once for the whole program. The triangle has one table
+// per octave, each with only the harmonics that fit under the Nyquist frequency at the top of that octave,
+// so high notes don't alias. Saw and square are worked out directly, with the jumps smoothed by PolyBLEP
+// (a little polynomial correction either side of each jump that takes most of the aliasing away) which is
+// far cheaper than a table per octave for waveforms with that many harmonics.
+//
+// Each note has an ADSR envelope: up to full volume over the attack, down to the sustain level over the
+// decay, held there until the note's let go, then down to silence over the release.
+
+#pragma once
+#include <stdint.h>
+
+enum class Waveform : uint8_t
+{
+	Sine,
+	Triangle,
+	Saw,
+	Square,
+	Count
+};
+
+// Times in seconds, sustain as a level from 0 to 1
+struct Envelope
+{
+	float attack = 0.005f;
+	float decay = 0.1f;
+	float sustain = 0.7f;
+	float release = 0.2f;
+};
+
+// Everything you can say about a note when you start it (where it goes and how loud is in VoiceParams)
+struct SynthParams
+{
+	Waveform waveform = Waveform::Saw;
+	// In Hz, before VoiceParams::pitch is applied
+	float frequency = 440.0f;
+	Envelope envelope;
+	// How long the note's held before it lets go by itself, in seconds. 0 holds it until Mixer::ReleaseNote().
+	// (With no sustain it stops once the decay's done either way)
+	float duration = 0.0f;
+	// Square only: how much of each cycle is high, 0.5 for a plain square
+	float pulseWidth = 0.5f;
+};
+
+// The oscillator and envelope for one playing note. Lives in a Voice, so starting a note never allocates
+class SynthVoice
+{
+public:
+	void Start(const SynthParams& params, float pitch, unsigned sampleRate);
+	// Changes the speed multiplier on top of the note's frequency, carrying on from the same point in the cycle
+	void SetPitch(float pitch);
+	// Lets go of the note, so it goes into its release
+	void Release();
+
+	// Writes the next frameCount mono frames into 'out'. Returns false once the note's died away
+	// (anything past that point is silence)
+	bool Render(float* out, unsigned frameCount);
+
+private:
+	enum class Stage : uint8_t
+	{
+		Attack,
+		Decay,
+		Release,
+		Done
+	};
+
+	void RenderOscillator(float* out, unsigned frameCount);
+	void ApplyEnvelope(float* out, unsigned frameCount);
+	void StartRelease();
+
+	Waveform waveform;
+	float frequency;
+	unsigned sampleRate;
+	float pulseWidth;
+
+	// Where we are in the cycle, 0 to 1, and how far it moves per frame
+	float phase;
+	float phaseStep;
+	// The triangle table for this frequency
+	const float* table;
+
+	Stage stage;
+	float level;
+	// Attack: how much the level goes up per frame, and how many frames of it are left
+	float attackStep;
+	unsigned attackFrames;
+	// Decay and release: how much of the distance left to go is still there after each frame
+	float decayCoefficient;
+	float releaseCoefficient;
+	float sustain;
+	// Frames until the note lets go by itself, 0 if it's waiting for Release()
+	unsigned holdFrames;
+};
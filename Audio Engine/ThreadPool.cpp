@@ -0,0 +1,75 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned count) : threadCount(count), busyCount(0), stopping(false)
+{
+	if (threadCount == 0)
+	{
+		unsigned cores = std::thread::hardware_concurrency();
+		threadCount = cores > 1 ? cores - 1 : 1;
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	jobReady.notify_all();
+
+	// Workers finish whatever's still queued before they go, so no future is left hanging
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::Enqueue(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(std::move(job));
+
+		if (workers.empty())
+		{
+			for (unsigned i = 0; i < threadCount; i++)
+			{
+				workers.emplace_back(&ThreadPool::WorkerMain, this);
+			}
+		}
+	}
+	jobReady.notify_one();
+}
+
+void ThreadPool::WaitIdle()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	idle.wait(lock, [this] { return jobs.empty() && busyCount == 0; });
+}
+
+void ThreadPool::WorkerMain()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		jobReady.wait(lock, [this] { return stopping || !jobs.empty(); });
+		if (jobs.empty())
+		{
+			return;
+		}
+
+		std::function<void()> job = std::move(jobs.front());
+		jobs.pop_front();
+		busyCount++;
+
+		lock.unlock();
+		job();
+		lock.lock();
+
+		busyCount--;
+		if (jobs.empty() && busyCount == 0)
+		{
+			idle.notify_all();
+		}
+	}
+}
@@ -0,0 +1,56 @@
+// ThreadPool.h
+// A handful of worker threads that take jobs off a shared queue. Anything slow that the game
+// shouldn't have to wait for (loading sounds, mostly) goes through here.
+// Never submit from the audio thread: submitting allocates and takes a lock.
+
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+	// 0 threads means one per core, leaving one for the game
+	ThreadPool(unsigned threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Queues a job and returns a future for whatever it returns. The threads start on the first submit
+	template <typename Function>
+	auto Submit(Function&& function) -> std::future<decltype(function())>
+	{
+		typedef decltype(function()) Result;
+		// std::function has to be copyable and packaged_task isn't, hence the shared_ptr
+		std::shared_ptr<std::packaged_task<Result()>> task = std::make_shared<std::packaged_task<Result()>>(std::forward<Function>(function));
+		std::future<Result> result = task->get_future();
+		Enqueue([task] { (*task)(); });
+		return result;
+	}
+
+	// Blocks until the queue is empty and every job has finished
+	void WaitIdle();
+
+	unsigned GetThreadCount() const { return threadCount; }
+
+private:
+	void Enqueue(std::function<void()> job);
+	void WorkerMain();
+
+	unsigned threadCount;
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable jobReady;
+	std::condition_variable idle;
+	std::deque<std::function<void()>> jobs;
+	unsigned busyCount;
+	bool stopping;
+};
@@ -0,0 +1,208 @@
+// TimingWheel.h
+// Holds things that are due at a particular frame until that frame comes round, for the audio thread.
+// Everything's allocated up front, so scheduling and firing never allocate, and both are O(1).
+//
+// It's a hierarchical timing wheel: four rings of 256 slots. The first ring has a slot per frame for the
+// next 256 frames, the second a slot per 256 frames for the next 65536, and so on up to 2^32 frames (a good
+// day at 48kHz), with anything further out than that parked on its own list. An item goes in the ring that
+// matches how far off it is. Every time the clock passes into a new slot of an outer ring, that slot's items
+// get moved in towards the first ring, until they land in the slot for their exact frame.
+// Items due at the same frame come out in the order they went in.
+
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+template <typename T>
+class TimingWheel
+{
+public:
+	TimingWheel(unsigned capacity) : nodes(capacity), freeList(capacity > 0 ? 0 : kEnd), count(0), now(0)
+	{
+		for (unsigned i = 0; i < capacity; i++)
+		{
+			nodes[i].next = i + 1 < capacity ? i + 1 : kEnd;
+		}
+	}
+
+	TimingWheel(const TimingWheel&) = delete;
+	TimingWheel& operator=(const TimingWheel&) = delete;
+
+	// Queues an item for 'time'. Anything that's already late is due at the current frame.
+	// Returns false if every node's in use
+	bool Schedule(uint64_t time, const T& item)
+	{
+		if (freeList == kEnd)
+		{
+			return false;
+		}
+		unsigned index = freeList;
+		freeList = nodes[index].next;
+		nodes[index].time = time < now ? now : time;
+		nodes[index].item = item;
+		Insert(index);
+		count++;
+		return true;
+	}
+
+	// Hands everything due at the next frame (GetTime()) to 'fire', in the order it was scheduled, and moves
+	// the clock on a frame. Has to be called for every frame in turn while anything's waiting
+	template <typename Function>
+	void Advance(Function&& fire)
+	{
+		if (count == 0)
+		{
+			// Nothing waiting, so nothing to bring in either
+			now++;
+			return;
+		}
+
+		// Taken off the wheel and the clock moved on before anything fires, so whatever it does can schedule
+		// more straight away (anything for this frame or earlier comes out next frame)
+		List& slot = slots[GetSlot(now, 0)];
+		unsigned index = slot.head;
+		slot = List();
+		now++;
+
+		// Crossing into a new slot on an outer ring brings its items in a ring, outermost first. Done as soon
+		// as the clock gets there, so they're in before anything new can be scheduled for the same frames
+		// (which keeps the same frame's items in the order they were scheduled)
+		if ((now & kSlotMask) == 0)
+		{
+			if ((now & 0xFFFFFFFFull) == 0)
+			{
+				Cascade(far);
+			}
+			for (unsigned level = kLevels - 1; level > 0; level--)
+			{
+				if ((now & ((1ull << (kSlotBits * level)) - 1)) == 0)
+				{
+					Cascade(slots[level * kSlots + GetSlot(now, level)]);
+				}
+			}
+		}
+
+		while (index != kEnd)
+		{
+			unsigned next = nodes[index].next;
+			count--;
+			T item = nodes[index].item;
+			nodes[index].next = freeList;
+			freeList = index;
+			fire(item);
+			index = next;
+		}
+	}
+
+	// Jumps the clock straight to 'time', for when nothing's waiting (so there's no need to go frame by frame)
+	void SetTime(uint64_t time)
+	{
+		if (count == 0)
+		{
+			now = time;
+		}
+	}
+
+	// Takes everything out, due or not, handing each to 'drop'
+	template <typename Function>
+	void Clear(Function&& drop)
+	{
+		for (List& slot : slots)
+		{
+			DrainList(slot, drop);
+		}
+		DrainList(far, drop);
+		count = 0;
+	}
+
+	bool IsEmpty() const { return count == 0; }
+	unsigned GetCount() const { return count; }
+	// The next frame Advance() is expecting
+	uint64_t GetTime() const { return now; }
+
+private:
+	static const unsigned kLevels = 4;
+	static const unsigned kSlotBits = 8;
+	static const unsigned kSlots = 1u << kSlotBits;
+	static const uint64_t kSlotMask = kSlots - 1;
+	static const unsigned kEnd = 0xFFFFFFFF;
+
+	struct Node
+	{
+		T item;
+		uint64_t time;
+		unsigned next;
+	};
+
+	struct List
+	{
+		unsigned head = kEnd;
+		unsigned tail = kEnd;
+	};
+
+	static unsigned GetSlot(uint64_t time, unsigned level)
+	{
+		return (unsigned)((time >> (kSlotBits * level)) & kSlotMask);
+	}
+
+	// The innermost ring where the item's time and now agree on everything above that ring's slots
+	void Insert(unsigned index)
+	{
+		uint64_t time = nodes[index].time;
+		List* list = &far;
+		for (unsigned level = 0; level < kLevels; level++)
+		{
+			if ((time >> (kSlotBits * (level + 1))) == (now >> (kSlotBits * (level + 1))))
+			{
+				list = &slots[level * kSlots + GetSlot(time, level)];
+				break;
+			}
+		}
+
+		nodes[index].next = kEnd;
+		if (list->tail == kEnd)
+		{
+			list->head = index;
+		}
+		else
+		{
+			nodes[list->tail].next = index;
+		}
+		list->tail = index;
+	}
+
+	void Cascade(List& list)
+	{
+		unsigned index = list.head;
+		list = List();
+		while (index != kEnd)
+		{
+			unsigned next = nodes[index].next;
+			Insert(index);
+			index = next;
+		}
+	}
+
+	template <typename Function>
+	void DrainList(List& list, Function& drop)
+	{
+		unsigned index = list.head;
+		list = List();
+		while (index != kEnd)
+		{
+			unsigned next = nodes[index].next;
+			drop(nodes[index].item);
+			nodes[index].next = freeList;
+			freeList = index;
+			index = next;
+		}
+	}
+
+	std::vector<Node> nodes;
+	List slots[kLevels * kSlots];
+	// Further off than the outermost ring goes
+	List far;
+	unsigned freeList;
+	unsigned count;
+	uint64_t now;
+};
@@ -0,0 +1,217 @@
+#include "VoicePool.h"
+
+VoicePool::VoicePool(unsigned capacity) :
+	freeCount(capacity),
+	activeCount(0),
+	handleCount(capacity * 4),
+	handleCursor(0),
+	nextStartOrder(0),
+	steals(0),
+	rejects(0)
+{
+	voices.resize(capacity);
+	freeList.resize(capacity);
+	active.resize(capacity);
+
+	// Hand out low indices first, it doesn't matter but it's easier to debug
+	for (unsigned i = 0; i < capacity; i++)
+	{
+		voices[i].active = false;
+		voices[i].voiceCount = nullptr;
+		freeList[i] = capacity - 1 - i;
+	}
+
+	// Four slots per voice keeps the table mostly empty, so claiming one almost always works first time
+	handles.reset(new HandleSlot[handleCount]);
+	for (unsigned i = 0; i < handleCount; i++)
+	{
+		handles[i].state.store(1 << 1, std::memory_order_relaxed);
+		handles[i].voice = kNoVoice;
+	}
+
+	for (unsigned group = 0; group < kMaxGroups; group++)
+	{
+		groupLimits[group] = 0;
+		groupCounts[group] = 0;
+	}
+}
+
+VoiceHandle VoicePool::ReserveHandle()
+{
+	// Try each slot at most once, starting wherever the last claim left off
+	VoiceHandle handle;
+	for (uint32_t attempt = 0; attempt < handleCount; attempt++)
+	{
+		uint32_t index = handleCursor.fetch_add(1, std::memory_order_relaxed) % handleCount;
+		uint32_t state = handles[index].state.load(std::memory_order_relaxed);
+		if ((state & 1) == 0 && handles[index].state.compare_exchange_strong(state, state | 1, std::memory_order_acquire))
+		{
+			handle.index = index;
+			handle.generation = state >> 1;
+			return handle;
+		}
+	}
+	return handle;
+}
+
+void VoicePool::CancelHandle(VoiceHandle handle)
+{
+	// Only ever called for handles that never got a voice, so there's nothing to unbind,
+	// just move the generation on. If it's already moved on this does nothing
+	if (handle.index < handleCount)
+	{
+		uint32_t claimed = (handle.generation << 1) | 1;
+		handles[handle.index].state.compare_exchange_strong(claimed, (handle.generation + 1) << 1, std::memory_order_release);
+	}
+}
+
+bool VoicePool::IsHandleCurrent(VoiceHandle handle) const
+{
+	return handle.index < handleCount && handles[handle.index].state.load(std::memory_order_acquire) == ((handle.generation << 1) | 1);
+}
+
+Voice* VoicePool::GetVoice(VoiceHandle handle)
+{
+	if (!IsHandleCurrent(handle) || handles[handle.index].voice == kNoVoice)
+	{
+		return nullptr;
+	}
+	return &voices[handles[handle.index].voice];
+}
+
+void VoicePool::FreeHandle(uint32_t slot)
+{
+	// Moving the generation on is what makes every copy of the old handle go stale
+	uint32_t generation = handles[slot].state.load(std::memory_order_relaxed) >> 1;
+	handles[slot].voice = kNoVoice;
+	handles[slot].state.store((generation + 1) << 1, std::memory_order_release);
+}
+
+Voice* VoicePool::Allocate(int priority, unsigned group, VoiceHandle& handle)
+{
+	if (!handle.IsValid())
+	{
+		handle = ReserveHandle();
+		if (!handle.IsValid())
+		{
+			rejects++;
+			return nullptr;
+		}
+	}
+	else if (!IsHandleCurrent(handle) || handles[handle.index].voice != kNoVoice)
+	{
+		// Stopped before it got going (or it's already playing)
+		return nullptr;
+	}
+
+	if (group >= kMaxGroups)
+	{
+		group = kMaxGroups - 1;
+	}
+
+	// If the group is full, the new sound has to replace something in its own group
+	if (groupLimits[group] != 0 && groupCounts[group] >= groupLimits[group])
+	{
+		Voice* victim = FindVictim(priority, (int)group);
+		if (!victim)
+		{
+			rejects++;
+			CancelHandle(handle);
+			return nullptr;
+		}
+		Release(victim);
+		steals++;
+	}
+	// Otherwise, if the whole pool is full, anything is fair game
+	else if (freeCount == 0)
+	{
+		Voice* victim = FindVictim(priority, -1);
+		if (!victim)
+		{
+			rejects++;
+			CancelHandle(handle);
+			return nullptr;
+		}
+		Release(victim);
+		steals++;
+	}
+
+	unsigned index = freeList[--freeCount];
+	Voice* voice = &voices[index];
+	voice->priority = priority;
+	voice->group = group;
+	voice->startOrder = nextStartOrder++;
+	voice->activeSlot = activeCount;
+	voice->handleSlot = handle.index;
+	voice->active = true;
+	handles[handle.index].voice = index;
+	active[activeCount++] = index;
+	groupCounts[group]++;
+	return voice;
+}
+
+void VoicePool::Release(Voice* voice)
+{
+	if (!voice->active)
+	{
+		return;
+	}
+
+	// Swap the last active voice into this one's slot so the active list stays packed
+	unsigned slot = voice->activeSlot;
+	unsigned last = active[--activeCount];
+	active[slot] = last;
+	voices[last].activeSlot = slot;
+
+	groupCounts[voice->group]--;
+	FreeHandle(voice->handleSlot);
+	if (voice->voiceCount)
+	{
+		// Release, so everything this voice read of its sample happens before anyone sees it's stopped
+		voice->voiceCount->fetch_sub(1, std::memory_order_release);
+		voice->voiceCount = nullptr;
+	}
+	voice->active = false;
+	freeList[freeCount++] = (unsigned)(voice - voices.data());
+}
+
+void VoicePool::ReleaseAll()
+{
+	while (activeCount > 0)
+	{
+		Release(GetActive(activeCount - 1));
+	}
+}
+
+void VoicePool::SetGroupLimit(unsigned group, unsigned limit)
+{
+	if (group < kMaxGroups)
+	{
+		groupLimits[group] = limit;
+	}
+}
+
+Voice* VoicePool::FindVictim(int priority, int group)
+{
+	Voice* victim = nullptr;
+	for (unsigned i = 0; i < activeCount; i++)
+	{
+		Voice* voice = GetActive(i);
+		if (group >= 0 && voice->group != (unsigned)group)
+		{
+			continue;
+		}
+		// Never steal from something more important than the new sound
+		if (voice->priority > priority)
+		{
+			continue;
+		}
+		// Lowest priority loses, and the oldest loses a tie
+		if (!victim || voice->priority < victim->priority ||
+			(voice->priority == victim->priority && voice->startOrder < victim->startOrder))
+		{
+			victim = voice;
+		}
+	}
+	return victim;
+}
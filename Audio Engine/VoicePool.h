@@ -0,0 +1,179 @@
+// VoicePool.h
+// A fixed number of voices, all allocated up front. A voice is one playing instance of a sample,
+// so the same sample can be going in lots of voices at once (ten footsteps, one set of footstep data).
+// When we run out, or a group hits its limit, the least important voice gets stolen:
+// lowest priority first, and the oldest one if there's a tie.
+
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "Sample.h"
+#include "Synth.h"
+
+// Names one particular play of a sound, so it can be stopped or changed later.
+// Voices get reused, so a handle also carries the generation of its slot: once the sound it was for
+// finishes (or gets stolen) the slot moves on a generation and the old handle quietly stops working.
+// Checking one is an array index and a compare.
+struct VoiceHandle
+{
+	static const uint32_t kInvalidIndex = 0xFFFFFFFF;
+
+	uint32_t index = kInvalidIndex;
+	uint32_t generation = 0;
+
+	bool IsValid() const { return index != kInvalidIndex; }
+};
+
+// Everything you can say about a voice when you start it
+class EffectChain;
+
+struct VoiceParams
+{
+	// Linear gain, 1 = as recorded
+	float gain = 1.0f;
+	// Playback speed multiplier, 1 = as recorded
+	float pitch = 1.0f;
+	// -1 (left) to 1 (right)
+	float pan = 0.0f;
+	// Goes round the sample's loop points (see Sample::loopStart) until it's stopped
+	bool looping = false;
+	// Higher wins. A new sound can only steal a voice with the same or lower priority
+	int priority = 0;
+	// Which voice group this counts against (see VoicePool::SetGroupLimit)
+	unsigned group = 0;
+	// Which mixer bus it's summed into (0 is the main bus)
+	unsigned bus = 0;
+	// Start this many source frames in, rather than at the beginning
+	unsigned startFrame = 0;
+	// Ramp up from silence over this many output frames, so starting part way through doesn't click
+	unsigned fadeInFrames = 0;
+	// Effects to play it through, on top of whatever its bus has (see EffectChain.h)
+	EffectChain* effects = nullptr;
+	// An aux send: this much of the voice (linear, before its own effects) also goes into sendBus,
+	// on top of its own bus. For sharing one reverb between every voice that wants it. 0 = no send
+	float sendLevel = 0.0f;
+	unsigned sendBus = 0;
+};
+
+class StreamingSound;
+
+struct Voice
+{
+	// What's playing: a sample in memory, or a stream coming off disk (the other one is null).
+	// Both null means it's a synth note
+	const Sample* sample;
+	StreamingSound* stream;
+	SynthVoice synth;
+	// Streams can't look backwards, so they keep the last frame of the previous block to interpolate from
+	float history[2];
+	// Where we are in the sample, in source frames. Fractional so we can resample
+	double position;
+	// How far to move through the source per output frame
+	double step;
+	// Volume and pan as they were asked for, and the per-side gains they work out to
+	float gain;
+	float pan;
+	float gainLeft;
+	float gainRight;
+	// Fade-in multiplier on top of the gains, and how much it goes up per frame until it gets to 1
+	float fade;
+	float fadeStep;
+	bool looping;
+
+	int priority;
+	unsigned group;
+	unsigned bus;
+	// Its own effects, if it has any
+	EffectChain* effects;
+	// Its aux send (sendLevel 0 for none)
+	float sendLevel;
+	unsigned sendBus;
+	// The count of voices playing whatever this is playing, knocked down by one when it's released
+	std::atomic<unsigned>* voiceCount;
+	// When it started (counts up with every allocation), smaller means older
+	unsigned long long startOrder;
+
+	// Where this voice is in the pool's active list, so releasing it is O(1)
+	unsigned activeSlot;
+	// The handle slot that points at this voice
+	uint32_t handleSlot;
+	bool active;
+};
+
+// Everything here belongs to the audio thread, apart from the handle functions marked otherwise.
+class VoicePool
+{
+public:
+	static const unsigned kMaxGroups = 16;
+
+	VoicePool(unsigned capacity);
+
+	// Claims a handle before there's a voice to go with it, so a play can be handed its handle before the
+	// audio thread gets round to starting it. Allocate() takes the handle over.
+	// Returns an invalid handle if they've all been claimed. Safe from any thread, never blocks
+	VoiceHandle ReserveHandle();
+	// Gives up a reserved handle that never got a voice. Safe from any thread
+	void CancelHandle(VoiceHandle handle);
+	// True from ReserveHandle() until the voice it ends up with is released. Safe from any thread
+	bool IsHandleCurrent(VoiceHandle handle) const;
+	// The voice a handle is playing on, or null if it's finished (or hasn't started yet)
+	Voice* GetVoice(VoiceHandle handle);
+
+	// Hands out a voice for a new sound, stealing one if it has to, and binds it to 'handle'
+	// (reserving a fresh one if it isn't valid). Returns null if everything that could be stolen
+	// is more important than the new sound, or if 'handle' was cancelled in the meantime.
+	// Never allocates memory.
+	Voice* Allocate(int priority, unsigned group, VoiceHandle& handle);
+	void Release(Voice* voice);
+	void ReleaseAll();
+
+	// Caps how many voices a group can have at once (0 = no cap other than the pool size)
+	void SetGroupLimit(unsigned group, unsigned limit);
+
+	// Playing voices are kept packed together so mixing only ever walks the ones that are playing
+	unsigned GetActiveCount() const { return activeCount; }
+	Voice* GetActive(unsigned index) { return &voices[active[index]]; }
+
+	unsigned GetCapacity() const { return (unsigned)voices.size(); }
+	unsigned long long GetStealCount() const { return steals; }
+	unsigned long long GetRejectCount() const { return rejects; }
+
+private:
+	// Finds the best voice to steal, optionally only looking inside one group
+	Voice* FindVictim(int priority, int group);
+
+	std::vector<Voice> voices;
+
+	// Indices of free voices, used like a stack
+	std::vector<unsigned> freeList;
+	unsigned freeCount;
+
+	// Indices of playing voices, packed at the front
+	std::vector<unsigned> active;
+	unsigned activeCount;
+
+	unsigned groupLimits[kMaxGroups];
+	unsigned groupCounts[kMaxGroups];
+
+	// Handle slots. There are more of these than voices, so sounds waiting to start can hold one too.
+	// 'state' is the slot's generation shifted up one, with the bottom bit set while it's claimed,
+	// so claiming, checking and freeing are each a single atomic operation
+	struct HandleSlot
+	{
+		std::atomic<uint32_t> state;
+		// Index of the voice it's bound to, or kNoVoice. Audio thread only
+		uint32_t voice;
+	};
+	static const uint32_t kNoVoice = 0xFFFFFFFF;
+	std::unique_ptr<HandleSlot[]> handles;
+	uint32_t handleCount;
+	// Where to start looking for a free slot, moves on one every time
+	std::atomic<uint32_t> handleCursor;
+	void FreeHandle(uint32_t slot);
+
+	unsigned long long nextStartOrder;
+	unsigned long long steals;
+	unsigned long long rejects;
+};
@@ -0,0 +1,36 @@
+#include "WavFileBackend.h"
+#include "ConsoleColor.h"
+#include <iostream>
+
+WavFileBackend::WavFileBackend(const char* file, bool realTimePaced, unsigned bits) :
+	ThreadedBackend(realTimePaced),
+	filename(file),
+	bitsPerSample(bits)
+{
+}
+
+WavFileBackend::~WavFileBackend()
+{
+	// Stop here rather than in the base destructor, while Consume() still exists
+	Stop();
+}
+
+bool WavFileBackend::OnStart(unsigned sampleRate, unsigned channels)
+{
+	if (!writer.Open(filename.c_str(), channels, sampleRate, bitsPerSample))
+	{
+		return false;
+	}
+	std::cout << blue << "INFO: Rendering mix to " << filename << white << std::endl;
+	return true;
+}
+
+void WavFileBackend::OnStop()
+{
+	writer.Close();
+}
+
+void WavFileBackend::Consume(const float* frames, unsigned frameCount)
+{
+	writer.Write(frames, frameCount);
+}
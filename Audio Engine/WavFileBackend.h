@@ -0,0 +1,28 @@
+// WavFileBackend.h
+// Renders the mix straight into a .wav file. Unpaced it's an offline bounce, paced it records
+// whatever you play in real time (so you can listen back to what a headless run sounded like).
+
+#pragma once
+#include <string>
+#include "AudioBackend.h"
+#include "WaveFile.h"
+
+class WavFileBackend : public ThreadedBackend
+{
+public:
+	// bitsPerSample is 16 (PCM) or 32 (float)
+	WavFileBackend(const char* filename, bool realTimePaced = false, unsigned bitsPerSample = 16);
+	virtual ~WavFileBackend();
+
+	virtual const char* GetName() const override { return "WAV file"; }
+
+protected:
+	virtual bool OnStart(unsigned sampleRate, unsigned channels) override;
+	virtual void OnStop() override;
+	virtual void Consume(const float* frames, unsigned frameCount) override;
+
+private:
+	std::string filename;
+	unsigned bitsPerSample;
+	WaveWriter writer;
+};
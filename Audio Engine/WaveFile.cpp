@@ -0,0 +1,485 @@
+#include "WaveFile.h"
+#include "FileHelpers.h"
+#include "ConsoleColor.h"
+#include "MixKernels.h"
+#include "Hash.h"
+#include "Adpcm.h"
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <memory>
+
+// Format tags we care about (same values as WAVE_FORMAT_PCM, WAVE_FORMAT_IEEE_FLOAT, WAVE_FORMAT_IMA_ADPCM
+// and WAVE_FORMAT_EXTENSIBLE)
+static const uint16_t kWaveFormatPcm = 1;
+static const uint16_t kWaveFormatFloat = 3;
+static const uint16_t kWaveFormatImaAdpcm = 0x11;
+static const uint16_t kWaveFormatExtensible = 0xFFFE;
+
+// Every WAVE_FORMAT_EXTENSIBLE sub format GUID is the plain format tag followed by these 14 bytes
+static const unsigned char kSubFormatTail[14] = { 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 };
+
+static bool IsFourCC(const void* id, const char* expected)
+{
+	return memcmp(id, expected, 4) == 0;
+}
+
+// RIFF is little-endian whatever the machine is
+static uint16_t Read16(const unsigned char* bytes)
+{
+	return (uint16_t)(bytes[0] | (bytes[1] << 8));
+}
+
+static uint32_t Read32(const unsigned char* bytes)
+{
+	return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+unsigned WaveFormatInfo::GetFrameCount() const
+{
+	if (blockAlign == 0)
+	{
+		return 0;
+	}
+	if (encoding != WaveEncoding::ImaAdpcm)
+	{
+		return (unsigned)(dataSize / blockAlign);
+	}
+
+	// A short last block still starts with its header frame, then has however many 8-frame groups made it
+	const size_t headerBytes = (size_t)channels * 4;
+	const size_t rest = dataSize % blockAlign;
+	size_t frames = dataSize / blockAlign * framesPerBlock;
+	if (rest >= headerBytes)
+	{
+		frames += 1 + (rest - headerBytes) / headerBytes * 8;
+	}
+	// The last block gets padded out, and 'fact' says how much of it is real
+	if (factFrames != 0 && factFrames < frames)
+	{
+		frames = factFrames;
+	}
+	return (unsigned)frames;
+}
+
+static bool ParseFormatChunk(const unsigned char* fmt, uint32_t size, WaveFormatInfo& info)
+{
+	if (size < 16)
+	{
+		std::cout << red << "ERROR: fmt chunk is too short!" << white << std::endl;
+		return false;
+	}
+
+	uint16_t tag = Read16(fmt);
+	info.channels = Read16(fmt + 2);
+	info.sampleRate = Read32(fmt + 4);
+	info.blockAlign = Read16(fmt + 12);
+	info.bitsPerSample = Read16(fmt + 14);
+
+	// Extensible is one of the others underneath, with the real tag at the front of its sub format.
+	// The valid bits and speaker positions don't matter here: the unused low bits are zero and we only do mono/stereo
+	if (tag == kWaveFormatExtensible)
+	{
+		if (size < 40 || memcmp(fmt + 26, kSubFormatTail, sizeof(kSubFormatTail)) != 0)
+		{
+			std::cout << red << "ERROR: Unknown WAVE_FORMAT_EXTENSIBLE sub format!" << white << std::endl;
+			return false;
+		}
+		tag = Read16(fmt + 24);
+	}
+
+	// The mixer only does mono and stereo
+	if (info.channels < 1 || info.channels > 2 || info.sampleRate == 0)
+	{
+		std::cout << red << "ERROR: Only mono/stereo is supported!" << white << std::endl;
+		return false;
+	}
+
+	const unsigned bits = info.bitsPerSample;
+	switch (tag)
+	{
+	case kWaveFormatPcm:
+		info.encoding = WaveEncoding::Pcm;
+		if ((bits != 8 && bits != 16 && bits != 24 && bits != 32) || info.blockAlign != info.channels * bits / 8)
+		{
+			std::cout << red << "ERROR: Only 8/16/24/32-bit PCM is supported!" << white << std::endl;
+			return false;
+		}
+		return true;
+
+	case kWaveFormatFloat:
+		info.encoding = WaveEncoding::Float;
+		if (bits != 32 || info.blockAlign != info.channels * 4)
+		{
+			std::cout << red << "ERROR: Only 32-bit float is supported!" << white << std::endl;
+			return false;
+		}
+		return true;
+
+	case kWaveFormatImaAdpcm:
+	{
+		// Each block is a 4-byte header per channel (its first frame, and the step index), then the codes
+		info.encoding = WaveEncoding::ImaAdpcm;
+		const unsigned headerBytes = info.channels * 4;
+		const unsigned maxFrames = info.blockAlign > headerBytes ? (info.blockAlign - headerBytes) * 2 / info.channels + 1 : 0;
+		info.framesPerBlock = size >= 20 ? Read16(fmt + 18) : maxFrames;
+		if (bits != 4 || info.blockAlign % headerBytes != 0 || info.framesPerBlock == 0 || info.framesPerBlock > maxFrames)
+		{
+			std::cout << red << "ERROR: Only standard 4-bit IMA ADPCM is supported!" << white << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	default:
+		std::cout << red << "ERROR: Unsupported wave format " << tag << "!" << white << std::endl;
+		return false;
+	}
+}
+
+bool ParseWaveHeader(const void* fileBytes, size_t available, size_t fileSize, WaveFormatInfo& info)
+{
+	const unsigned char* file = (const unsigned char*)fileBytes;
+	available = std::min(available, fileSize);
+	info = WaveFormatInfo();
+	if (available < 12)
+	{
+		std::cout << red << "ERROR: Couldn't read wave file!" << white << std::endl;
+		return false;
+	}
+	if (!IsFourCC(file, "RIFF"))
+	{
+		std::cout << red << "ERROR: Chunk ID is not RIFF!" << white << std::endl;
+		return false;
+	}
+	if (!IsFourCC(file + 8, "WAVE"))
+	{
+		std::cout << red << "ERROR: File format is not WAVE!" << white << std::endl;
+		return false;
+	}
+
+	// Chunk by chunk until we've seen both 'fmt ' and 'data', whichever order they come in. The RIFF size
+	// isn't trusted any more than the data size is (see below), so it's the end of the file that stops it
+	bool haveFormat = false;
+	bool haveData = false;
+	size_t offset = 12;
+	while (!haveFormat || !haveData)
+	{
+		// offset never passes available (see the bottom of the loop), so this can't wrap round
+		if (available - offset < 8)
+		{
+			std::cout << red << (haveFormat ? "ERROR: Couldn't find data chunk header!" : "ERROR: Couldn't find fmt chunk!") << white << std::endl;
+			return false;
+		}
+
+		const unsigned char* chunk = file + offset;
+		const uint32_t size = Read32(chunk + 4);
+		const size_t body = offset + 8;
+		if (IsFourCC(chunk, "fmt "))
+		{
+			if (size > available - body)
+			{
+				std::cout << red << "ERROR: Couldn't read fmt chunk!" << white << std::endl;
+				return false;
+			}
+			if (!ParseFormatChunk(chunk + 8, size, info))
+			{
+				return false;
+			}
+			haveFormat = true;
+		}
+		else if (IsFourCC(chunk, "fact") && size >= 4 && available - body >= 4)
+		{
+			info.factFrames = Read32(chunk + 8);
+		}
+		else if (IsFourCC(chunk, "data"))
+		{
+			// Files written by the old CreateWavFile (there are plenty still lying around in Sounds folders) claim a slightly
+			// bigger data chunk than they have, and ones still being written can say anything, so trust the size of the file
+			info.dataOffset = body;
+			info.dataSize = std::min((size_t)size, fileSize - body);
+			haveData = true;
+		}
+		// Anything else (LIST, cue, smpl, JUNK...) doesn't change how it sounds.
+		// Chunks are padded out to an even number of bytes. Worked out in 64 bits since size_t is only 32 on Win32
+		// and a junk size would wrap round; a chunk that runs off the end leaves nothing after it to look at
+		const uint64_t next = (uint64_t)body + size + (size & 1);
+		offset = next > available ? available : (size_t)next;
+	}
+	return true;
+}
+
+void ConvertPcmToFloat(const unsigned char* pcm, const WaveFormatInfo& format, float* out, size_t sampleCount)
+{
+	const MixKernels& kernels = GetMixKernels();
+	if (format.encoding == WaveEncoding::Float)
+	{
+		memcpy(out, pcm, sampleCount * sizeof(float));
+		return;
+	}
+
+	// 8-bit wav is unsigned, everything bigger is signed
+	switch (format.bitsPerSample)
+	{
+	case 8:
+		kernels.uint8ToFloat(out, pcm, sampleCount);
+		break;
+	case 16:
+		kernels.int16ToFloat(out, (const int16_t*)pcm, sampleCount);
+		break;
+	case 24:
+		kernels.int24ToFloat(out, pcm, sampleCount);
+		break;
+	default:
+		kernels.int32ToFloat(out, pcm, sampleCount);
+		break;
+	}
+}
+
+// Microsoft's IMA ADPCM: every block starts each channel afresh from a header frame, then the codes come in
+// groups of 8 frames, 4 bytes per channel in turn, low half of each byte first
+static void DecodeWaveAdpcm(const unsigned char* blocks, const WaveFormatInfo& format, float* out, unsigned frameCount)
+{
+	const unsigned channels = format.channels;
+	unsigned frame = 0;
+	for (size_t block = 0; frame < frameCount; block++)
+	{
+		const unsigned char* data = blocks + block * format.blockAlign;
+		const unsigned frames = std::min(format.framesPerBlock, frameCount - frame);
+		float* blockOut = out + (size_t)frame * channels;
+		for (unsigned channel = 0; channel < channels; channel++)
+		{
+			const unsigned char* header = data + channel * 4;
+			int predictor = (int16_t)Read16(header);
+			int index = std::min<int>(header[2], kAdpcmStepCount - 1);
+			blockOut[channel] = predictor * (1.0f / 32768.0f);
+			for (unsigned k = 1; k < frames; k++)
+			{
+				const unsigned code = k - 1;
+				const unsigned char* group = data + (size_t)channels * 4 * (1 + code / 8) + channel * 4;
+				const unsigned nibble = (group[(code % 8) / 2] >> ((code & 1) * 4)) & 15;
+				blockOut[(size_t)k * channels + channel] = DecodeAdpcmCode(predictor, index, nibble) * (1.0f / 32768.0f);
+			}
+		}
+		frame += frames;
+	}
+}
+
+bool LoadWaveFile(const char* filename, Sample& sample, const WaveLoadOptions& options)
+{
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+	if (!file->Open(filename))
+	{
+		return false;
+	}
+
+	WaveFormatInfo info;
+	if (!ParseWaveHeader(file->GetData(), file->GetSize(), file->GetSize(), info))
+	{
+		return false;
+	}
+
+	unsigned bytesPerSample = info.bitsPerSample / 8;
+	const unsigned char* waveData = file->GetData() + info.dataOffset;
+
+	sample.channels = info.channels;
+	sample.sampleRate = info.sampleRate;
+	sample.frameCount = info.GetFrameCount();
+	size_t sampleCount = (size_t)sample.frameCount * sample.channels;
+
+	bool convertRate = options.targetSampleRate != 0 && options.targetSampleRate != info.sampleRate;
+	bool zeroCopy = options.zeroCopy && info.encoding == WaveEncoding::Pcm && bytesPerSample == 2 && !convertRate && !options.compress;
+
+	// The hash starts from everything that decides what the frames come out as, so only
+	// loads that end up with the same frames end up with the same hash
+	uint64_t seed = HashName(options.compress ? "adpcm" : (zeroCopy ? "int16" : "float"));
+	seed = (seed ^ info.channels) * kFnvPrime;
+	seed = (seed ^ info.sampleRate) * kFnvPrime;
+	seed = (seed ^ (unsigned)info.encoding) * kFnvPrime;
+	seed = (seed ^ info.bitsPerSample) * kFnvPrime;
+	seed = (seed ^ (convertRate ? options.targetSampleRate : 0)) * kFnvPrime;
+	seed = (seed ^ (convertRate ? (unsigned)options.conversionQuality : 0)) * kFnvPrime;
+	ContentHasher hasher(seed);
+	const size_t dataBytes = info.encoding == WaveEncoding::ImaAdpcm ? info.dataSize : sampleCount * bytesPerSample;
+	sample.contentHash = 0;
+
+	if (zeroCopy)
+	{
+		// 16-bit data can be mixed as it is, so just point at it. Chunks always start on an even byte,
+		// which keeps the samples 2-byte aligned in the (page aligned) mapping
+		sample.format = SampleFormat::Int16;
+		sample.frames = waveData;
+		sample.storage.clear();
+		sample.mapping = file;
+
+		file->Advise(MappedFile::AccessHint::Sequential);
+		if (options.prefetch)
+		{
+			file->Prefetch(info.dataOffset, dataBytes);
+		}
+		if (options.hashContent)
+		{
+			hasher.Add(waveData, dataBytes);
+			sample.contentHash = hasher.Get();
+		}
+		return true;
+	}
+
+	// Otherwise convert to float, reading straight out of the mapping. A piece at a time when it's being hashed
+	// too, so each piece is hashed and converted while it's still in the cache
+	file->Advise(MappedFile::AccessHint::Sequential);
+	sample.format = SampleFormat::Float32;
+	sample.mapping.reset();
+	sample.storage.resize(sampleCount);
+	if (info.encoding == WaveEncoding::ImaAdpcm)
+	{
+		// A quarter the size of 16-bit, so it's hashed in one go
+		if (options.hashContent)
+		{
+			hasher.Add(waveData, dataBytes);
+		}
+		DecodeWaveAdpcm(waveData, info, sample.storage.data(), sample.frameCount);
+	}
+	else
+	{
+		const size_t kPieceSamples = 16384;
+		for (size_t first = 0; first < sampleCount; first += kPieceSamples)
+		{
+			size_t count = std::min(kPieceSamples, sampleCount - first);
+			const unsigned char* piece = waveData + first * bytesPerSample;
+			if (options.hashContent)
+			{
+				hasher.Add(piece, count * bytesPerSample);
+			}
+			ConvertPcmToFloat(piece, info, sample.storage.data() + first, count);
+		}
+	}
+	sample.frames = sample.storage.data();
+	if (options.hashContent)
+	{
+		sample.contentHash = hasher.Get();
+	}
+
+	// The mapping goes away with 'file' here, we have our own copy now
+	if (convertRate && !ConvertSampleRate(sample, options.targetSampleRate, options.conversionQuality))
+	{
+		return false;
+	}
+	sample.fileSampleRate = convertRate ? info.sampleRate : 0;
+	return !options.compress || CompressSample(sample);
+}
+
+void FillWaveHeader(WaveHeaderType& header, unsigned channels, unsigned sampleRate, unsigned bitsPerSample, uint32_t dataSize)
+{
+	memcpy(header.chunkId, "RIFF", 4);
+	header.chunkSize = dataSize + sizeof(WaveHeaderType) - 8;
+	memcpy(header.format, "WAVE", 4);
+	memcpy(header.subChunkId, "fmt ", 4);
+	header.subChunkSize = 16;
+	header.audioFormat = (bitsPerSample == 32) ? kWaveFormatFloat : kWaveFormatPcm;
+	header.numChannels = (uint16_t)channels;
+	header.sampleRate = sampleRate;
+	header.blockAlign = (uint16_t)(channels * bitsPerSample / 8);
+	header.bytesPerSecond = sampleRate * header.blockAlign;
+	header.bitsPerSample = (uint16_t)bitsPerSample;
+	memcpy(header.dataChunkId, "data", 4);
+	header.dataSize = dataSize;
+}
+
+WaveWriter::WaveWriter() : filePtr(nullptr), channels(0), bitsPerSample(0), framesWritten(0), scratch(nullptr), scratchSize(0)
+{
+}
+
+WaveWriter::~WaveWriter()
+{
+	Close();
+	delete[] scratch;
+}
+
+bool WaveWriter::Open(const char* filename, unsigned channelCount, unsigned sampleRate, unsigned bits)
+{
+	Close();
+
+	if (bits != 16 && bits != 32)
+	{
+		std::cout << red << "ERROR: WaveWriter only writes 16-bit PCM or 32-bit float!" << white << std::endl;
+		return false;
+	}
+
+	filePtr = openFile(filename, "wb");
+	if (!filePtr)
+	{
+		std::cout << red << "ERROR: Couldn't open " << filename << " for writing!" << white << std::endl;
+		return false;
+	}
+
+	channels = channelCount;
+	bitsPerSample = bits;
+	framesWritten = 0;
+
+	// Write a header with the sizes left at zero, Close() fills them in
+	WaveHeaderType header;
+	FillWaveHeader(header, channels, sampleRate, bits, 0);
+	header.chunkSize = 0;
+	return fwrite(&header, sizeof(header), 1, filePtr) == 1;
+}
+
+bool WaveWriter::Write(const float* frames, unsigned frameCount)
+{
+	if (!filePtr)
+	{
+		return false;
+	}
+
+	size_t sampleCount = (size_t)frameCount * channels;
+	size_t bytes = sampleCount * (bitsPerSample / 8);
+
+	if (bitsPerSample == 32)
+	{
+		// Already in the right format
+		if (fwrite(frames, 1, bytes, filePtr) != bytes)
+		{
+			return false;
+		}
+	}
+	else
+	{
+		if (bytes > scratchSize)
+		{
+			delete[] scratch;
+			scratch = new unsigned char[bytes];
+			scratchSize = bytes;
+		}
+
+		// Clip and convert to 16-bit
+		GetMixKernels().floatToInt16((int16_t*)scratch, frames, sampleCount);
+
+		if (fwrite(scratch, 1, bytes, filePtr) != bytes)
+		{
+			return false;
+		}
+	}
+
+	framesWritten += frameCount;
+	return true;
+}
+
+void WaveWriter::Close()
+{
+	if (!filePtr)
+	{
+		return;
+	}
+
+	// Patch up the RIFF chunk size and the data chunk size now we know how much we wrote
+	uint32_t dataSize = (uint32_t)(framesWritten * channels * (bitsPerSample / 8));
+	uint32_t chunkSize = dataSize + sizeof(WaveHeaderType) - 8;
+
+	fseek(filePtr, 4, SEEK_SET);
+	fwrite(&chunkSize, sizeof(chunkSize), 1, filePtr);
+	fseek(filePtr, sizeof(WaveHeaderType) - 4, SEEK_SET);
+	fwrite(&dataSize, sizeof(dataSize), 1, filePtr);
+
+	fclose(filePtr);
+	filePtr = nullptr;
+}
@@ -0,0 +1,132 @@
+// WaveFile.h
+// Portable .wav reading and writing for the software mixer.
+// Reading turns a file into a Sample (float frames), writing goes the other way and is what the
+// render-to-WAV backend uses to capture the mix.
+//
+// Reading walks the file's RIFF chunks rather than expecting a fixed header, so whatever else an editor has
+// put in there (LIST, fact, cue, smpl, JUNK...) gets stepped over. It takes 8, 16, 24 and 32-bit PCM, 32-bit
+// float and IMA ADPCM, plain or as WAVE_FORMAT_EXTENSIBLE, and they all come out as the same float frames.
+
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include "Sample.h"
+#include "Resampler.h"
+
+// The canonical 44-byte header we write: RIFF chunk, then a 16-byte 'fmt ' chunk, then the 'data' chunk header.
+// Fixed-width types so it's still 44 bytes on platforms where long is 8 bytes.
+struct WaveHeaderType
+{
+	char		chunkId[4];
+	uint32_t	chunkSize;
+	char		format[4];
+	char		subChunkId[4];
+	uint32_t	subChunkSize;
+	uint16_t	audioFormat;
+	uint16_t	numChannels;
+	uint32_t	sampleRate;
+	uint32_t	bytesPerSecond;
+	uint16_t	blockAlign;
+	uint16_t	bitsPerSample;
+	char		dataChunkId[4];
+	uint32_t	dataSize;
+};
+
+enum class WaveEncoding
+{
+	// Integer PCM: unsigned 8-bit, or signed 16, 24 or 32-bit
+	Pcm,
+	// 32-bit IEEE float
+	Float,
+	// Microsoft's IMA ADPCM blocks (not the same layout as a compressed Sample, see Adpcm.h)
+	ImaAdpcm
+};
+
+// What a .wav's chunks say about the audio in it
+struct WaveFormatInfo
+{
+	WaveEncoding encoding = WaveEncoding::Pcm;
+	unsigned channels = 0;
+	unsigned sampleRate = 0;
+	// As stored: 4 for ADPCM, and a 24-bit sample in a 32-bit container counts as 32
+	unsigned bitsPerSample = 0;
+	// Bytes per frame, or per block for ADPCM
+	unsigned blockAlign = 0;
+	// ADPCM only: how many frames each block holds
+	unsigned framesPerBlock = 0;
+	// How many frames the 'fact' chunk says there are, 0 if there wasn't one
+	unsigned factFrames = 0;
+	// Where the audio starts in the file, and how many bytes of it there really are
+	size_t dataOffset = 0;
+	size_t dataSize = 0;
+
+	unsigned GetBlockAlign() const { return blockAlign; }
+	unsigned GetFrameCount() const;
+};
+
+// How much of the start of a file ParseWaveHeader() gets to see when only the start's been read (streaming).
+// Anything with more than this in front of its audio is mostly metadata and had better be loaded instead
+static const size_t kWaveHeaderSearchBytes = 64 * 1024;
+
+// Walks the chunks at the start of a .wav (the first 'available' bytes of it) until it has both the format
+// and where the audio is, checks it's something we can play, and fills in 'info'. fileSize is used to catch
+// data chunks that claim more than there is. Returns false (and says why) if not.
+bool ParseWaveHeader(const void* fileBytes, size_t available, size_t fileSize, WaveFormatInfo& info);
+
+// Fills in a header for 16-bit PCM or 32-bit float with dataSize bytes of audio after it
+void FillWaveHeader(WaveHeaderType& header, unsigned channels, unsigned sampleRate, unsigned bitsPerSample, uint32_t dataSize);
+
+// Turns PCM or float samples (anything but ADPCM) into float in [-1, 1), in one pass through the SIMD kernels
+void ConvertPcmToFloat(const unsigned char* pcm, const WaveFormatInfo& format, float* out, size_t sampleCount);
+
+struct WaveLoadOptions
+{
+	// Play 16-bit PCM straight out of the memory-mapped file instead of converting it to float (anything else always is).
+	// Costs nothing at load time, pages come in from disk the first time they're played
+	bool zeroCopy = true;
+	// Ask the OS to start reading the audio in now, in the background, rather than on first play
+	bool prefetch = false;
+	// Resample to this rate as it loads, if it isn't there already, so the mixer can play it straight through
+	// at normal pitch instead of resampling it every time (0 leaves it as it is). A sample that needs converting
+	// ends up as float even with zeroCopy on
+	unsigned targetSampleRate = 0;
+	ResampleQuality conversionQuality = ResampleQuality::Best;
+	// Hash the audio as it loads (Sample::contentHash), so sounds with the same audio under different names can
+	// share one copy. It's done as the data goes past, but a zero-copy load then reads the whole file in up front
+	bool hashContent = true;
+	// Keep it in memory as 4-bit IMA ADPCM (see Adpcm.h), a seventh the size of float, decoded as it plays.
+	// Slightly lossy, so best for the big banks of effects and ambience rather than anything exposed and pure.
+	// Turns zeroCopy off, and happens after any rate conversion
+	bool compress = false;
+};
+
+// Loads a .wav file into a Sample. The file is memory-mapped rather than read, so the data is either
+// used in place (zero copy) or converted to float in one pass with no temporary buffer.
+// Returns false (and says why) on failure.
+bool LoadWaveFile(const char* filename, Sample& sample, const WaveLoadOptions& options = WaveLoadOptions());
+
+// Writes float frames out as a .wav, either 16-bit PCM or 32-bit float.
+// The sizes in the header get patched up when the file is closed, so you can stream as much as you like into it.
+class WaveWriter
+{
+public:
+	WaveWriter();
+	~WaveWriter();
+
+	bool Open(const char* filename, unsigned channels, unsigned sampleRate, unsigned bitsPerSample = 16);
+	bool Write(const float* frames, unsigned frameCount);
+	void Close();
+
+	bool IsOpen() const { return filePtr != nullptr; }
+	uint64_t GetFramesWritten() const { return framesWritten; }
+
+private:
+	FILE* filePtr;
+	unsigned channels;
+	unsigned bitsPerSample;
+	uint64_t framesWritten;
+
+	// Scratch space for converting a block before it goes to disk, so we do one fwrite per block
+	unsigned char* scratch;
+	size_t scratchSize;
+};